@@ -27,6 +27,7 @@
 
 */
 
+#include <algorithm>
 #include <functional>
 #include <memory>
 
@@ -95,6 +96,62 @@ unsigned long EventEmitter::getEventCount() {
     return _event_count;
 }
 
+unsigned long EventEmitter::remaining(unsigned long now) const {
+    unsigned long out { Idle };
+
+    if (_pending) {
+        const auto elapsed = now - _pending_timestamp;
+        out = (elapsed < _delay) ? (_delay - elapsed) : 0;
+    }
+
+    if (_ready) {
+        const auto elapsed = now - _event_start;
+        out = std::min(out, (elapsed <= _repeat) ? (_repeat - elapsed + 1) : 0);
+    }
+
+    return out;
+}
+
+types::Event EventEmitter::_change(unsigned long timestamp) {
+    auto event = types::EventNone;
+
+    _value = !_value;
+
+    if (_is_switch) {
+        event = isPressed()
+            ? types::EventPressed
+            : types::EventReleased;
+    } else {
+        if (_value == _default_value) {
+            _event_length = timestamp - _event_start;
+            _ready = true;
+        } else {
+            event = types::EventPressed;
+            _event_start = timestamp;
+            _event_length = 0;
+            if (_reset_count) {
+                _event_count = 1;
+                _reset_count = false;
+            } else {
+                ++_event_count;
+            }
+            _ready = false;
+        }
+    }
+
+    return event;
+}
+
+types::Event EventEmitter::_release(unsigned long timestamp) {
+    if (_ready && (timestamp - _event_start > _repeat)) {
+        _ready = false;
+        _reset_count = true;
+        return types::EventReleased;
+    }
+
+    return types::EventNone;
+}
+
 // TODO: current implementation allows pin == nullptr
 
 types::Event EventEmitter::loop() {
@@ -113,37 +170,13 @@ types::Event EventEmitter::loop() {
 
         value = _pin->digitalRead() == (HIGH);
         if (value != _value) {
-
-            _value = !_value;
-
-            if (_is_switch) {
-                event = isPressed()
-                    ? types::EventPressed
-                    : types::EventReleased;
-            } else {
-                if (_value == _default_value) {
-                    _event_length = millis() - _event_start;
-                    _ready = true;
-                } else {
-                    event = types::EventPressed;
-                    _event_start = millis();
-                    _event_length = 0;
-                    if (_reset_count) {
-                        _event_count = 1;
-                        _reset_count = false;
-                    } else {
-                        ++_event_count;
-                    }
-                    _ready = false;
-                }
-            }
+            event = _change(millis());
         }
     }
 
-    if (_ready && (millis() - _event_start > _repeat)) {
-        _ready = false;
-        _reset_count = true;
-        event = types::EventReleased;
+    const auto released = _release(millis());
+    if (released != types::EventNone) {
+        event = released;
     }
 
     if (_callback && (event != types::EventNone)) {
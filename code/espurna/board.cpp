@@ -117,6 +117,9 @@ const char* getEspurnaModules() {
 #if HOMEASSISTANT_SUPPORT
     "HOMEASSISTANT "
 #endif
+#if HTTP_CLIENT_SUPPORT
+    "HTTP_CLIENT "
+#endif
 #if I2C_SUPPORT
     "I2C "
 #endif
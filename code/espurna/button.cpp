@@ -23,6 +23,8 @@ Copyright (C) 2019-2021 by Maxim Prokhorov <prokhorov dot max at outlook dot com
 
 #include "mcp23s08_pin.h"
 
+#include "libs/EdgeRing.h"
+
 #include <bitset>
 #include <memory>
 #include <vector>
@@ -41,6 +43,7 @@ alignas(4) static constexpr char Provider[] PROGMEM = "btnProv";
 alignas(4) static constexpr char Mode[] PROGMEM = "btnMode";
 alignas(4) static constexpr char DefaultValue[] PROGMEM = "btnDefVal";
 alignas(4) static constexpr char PinMode[] PROGMEM = "btnPinMode";
+alignas(4) static constexpr char Interrupt[] PROGMEM = "btnIntr";
 
 alignas(4) static constexpr char Release[] PROGMEM = "btnRlse";
 alignas(4) static constexpr char Press[] PROGMEM = "btnPress";
@@ -517,6 +520,10 @@ constexpr bool mqttRetain() {
     return (1 == BUTTON_MQTT_RETAIN);
 }
 
+constexpr bool interrupt() {
+    return (1 == BUTTON_INTERRUPT);
+}
+
 constexpr bool mqttRetain(size_t index) {
     return (
         (index == 0) ? (1 == BUTTON1_MQTT_RETAIN) :
@@ -609,6 +616,10 @@ debounce_event::types::PinMode pinMode(size_t index) {
     return getSetting({keys::PinMode, index}, build::pinMode(index));
 }
 
+bool interrupt(size_t index) {
+    return getSetting({keys::Interrupt, index}, build::interrupt());
+}
+
 ButtonAction release(size_t index) {
     return getSetting({keys::Release, index}, build::release(index));
 }
@@ -695,6 +706,7 @@ ID_VALUE(provider, settings::provider)
 ID_VALUE(mode, settings::mode)
 ID_VALUE(defaultValue, settings::defaultValue)
 ID_VALUE(pinMode, settings::pinMode)
+ID_VALUE(interrupt, settings::interrupt)
 ID_VALUE(release, settings::release)
 ID_VALUE(press, settings::press)
 ID_VALUE(click, settings::click)
@@ -729,6 +741,7 @@ static constexpr espurna::settings::query::IndexedSetting IndexedSettings[] PROG
     {keys::Mode, internal::mode},
     {keys::DefaultValue, internal::defaultValue},
     {keys::PinMode, internal::pinMode},
+    {keys::Interrupt, internal::interrupt},
     {keys::Release, internal::release},
     {keys::Press, internal::press},
     {keys::Click, internal::click},
@@ -797,6 +810,19 @@ constexpr ButtonEvent _buttonMapReleased(uint8_t count, unsigned long length, un
     );
 }
 
+ButtonEvent _buttonMapEvent(debounce_event::types::Event event, uint8_t count, unsigned long length, const ButtonEventDelays& delays) {
+    switch (event) {
+    case debounce_event::types::EventPressed:
+        return ButtonEvent::Pressed;
+    case debounce_event::types::EventReleased:
+        return _buttonMapReleased(count, length, delays.lngclick, delays.lnglngclick);
+    case debounce_event::types::EventNone:
+        break;
+    }
+
+    return ButtonEvent::None;
+}
+
 debounce_event::types::Config _buttonRuntimeConfig(size_t index) {
     return {
         espurna::button::settings::mode(index),
@@ -833,22 +859,40 @@ Button::Button(BasePinPtr&& pin, const debounce_event::types::Config& config, Bu
     event_delays(std::move(delays_))
 {}
 
+// Interrupt handler only records the time and the pin value after the change. Edges are decoded in the loop,
+// so the click timing no longer depends on how often the loop runs. Loop is woken up right away, and
+// then only when the debounce or the repeat delay expires.
+// Timestamp is stored without the lowest bit, which is used for the pin value instead
+
+struct ButtonEdges {
+    explicit ButtonEdges(unsigned char pin) :
+        pin(pin)
+    {}
+
+    ~ButtonEdges() {
+        ::detachInterrupt(pin);
+    }
+
+    void IRAM_ATTR push() {
+        const uint32_t value = (HIGH == digitalRead(pin)) ? 1 : 0;
+        ring.push((static_cast<uint32_t>(millis()) & ~1ul) | value);
+    }
+
+    espurna::edge::Ring<BUTTON_EDGE_RING_SIZE> ring;
+    unsigned char pin;
+    uint32_t overflows { 0 };
+};
+
+Button::Button(Button&&) noexcept = default;
+Button::~Button() = default;
+
 ButtonEvent Button::loop() {
     if (event_emitter) {
-        switch (event_emitter->loop()) {
-        case debounce_event::types::EventPressed:
-            return ButtonEvent::Pressed;
-        case debounce_event::types::EventReleased: {
-            return _buttonMapReleased(
-                event_emitter->getEventCount(),
-                event_emitter->getEventLength(),
-                event_delays.lngclick,
-                event_delays.lnglngclick
-            );
-        }
-        case debounce_event::types::EventNone:
-            break;
-        }
+        return _buttonMapEvent(
+            event_emitter->loop(),
+            event_emitter->getEventCount(),
+            event_emitter->getEventLength(),
+            event_delays);
     }
 
     return ButtonEvent::None;
@@ -1137,9 +1181,87 @@ void _buttonConfigure() {
 
 } // namespace
 
+#if BUTTON_PROVIDER_GPIO_SUPPORT
+
+namespace {
+
+void IRAM_ATTR _buttonEdgeInterrupt(void* arg) {
+    reinterpret_cast<ButtonEdges*>(arg)->push();
+    espurnaLoopWake();
+}
+
+// GPIO16 is not able to generate interrupts
+bool _buttonSetupEdges(Button& button, size_t index) {
+    if (!espurna::button::settings::interrupt(index)) {
+        return false;
+    }
+
+    if (GpioType::Hardware != espurna::button::settings::pinType(index)) {
+        return false;
+    }
+
+    const auto pin = button.event_emitter->pin()->pin();
+    if (pin >= 16) {
+        return false;
+    }
+
+    button.edges = std::make_unique<ButtonEdges>(pin);
+    ::attachInterruptArg(pin, _buttonEdgeInterrupt, button.edges.get(), CHANGE);
+
+    // current pin value, in case it is already different from the default one
+    button.edges->push();
+
+    return true;
+}
+
+void _buttonEdgesLoop(size_t id, Button& button) {
+    auto& emitter = *button.event_emitter;
+
+    auto callback = [&](debounce_event::types::Event event, uint8_t count, unsigned long length) {
+        const auto mapped = _buttonMapEvent(event, count, length, button.event_delays);
+        if (mapped != ButtonEvent::None) {
+            buttonEvent(id, mapped);
+        }
+    };
+
+    auto& edges = *button.edges;
+    edges.ring.drain([&](uint32_t edge) {
+        emitter.edge(edge & ~1ul, (edge & 1) != 0, callback);
+    });
+
+    const auto now = millis();
+    emitter.update(now, callback);
+
+    const auto remaining = emitter.remaining(now);
+    if (remaining != debounce_event::EventEmitter::Idle) {
+        espurnaLoopDeadline(espurna::duration::Milliseconds(remaining));
+    }
+
+#if DEBUG_SUPPORT
+    const auto overflows = edges.ring.overflows();
+    if (overflows != edges.overflows) {
+        DEBUG_MSG_P(PSTR("[BUTTON] Button #%u lost %u edge(s)\n"),
+            id, overflows - edges.overflows);
+        edges.overflows = overflows;
+    }
+#endif
+}
+
+} // namespace
+
+#endif
+
 void buttonLoop() {
     for (size_t id = 0; id < espurna::button::internal::buttons.size(); ++id) {
-        auto event = espurna::button::internal::buttons[id].loop();
+        auto& button = espurna::button::internal::buttons[id];
+#if BUTTON_PROVIDER_GPIO_SUPPORT
+        if (button.edges) {
+            _buttonEdgesLoop(id, button);
+            continue;
+        }
+#endif
+
+        auto event = button.loop();
         if (event != ButtonEvent::None) {
             buttonEvent(id, event);
         }
@@ -1366,6 +1488,11 @@ bool _buttonSetupProvider(size_t index, ButtonProvider provider) {
             _buttonRuntimeConfig(index),
             _buttonActions(index),
             _buttonDelays(index));
+#if BUTTON_PROVIDER_GPIO_SUPPORT
+        if (ButtonProvider::Gpio == provider) {
+            _buttonSetupEdges(espurna::button::internal::buttons.back(), index);
+        }
+#endif
         result = true;
 #endif
         break;
@@ -1430,10 +1557,13 @@ void buttonSetup() {
         size_t id { 0 };
         for (const auto& button : espurna::button::internal::buttons) {
             ctx.output.printf_P(
-                PSTR("button%u {%s}\n"), id++,
+                PSTR("button%u {%s}%s\n"), id++,
                 button.event_emitter
                     ? (button.event_emitter->pin()->description().c_str())
-                    : PSTR("Virtual"));
+                    : PSTR("Virtual"),
+                button.edges
+                    ? PSTR(" (interrupt)")
+                    : PSTR(""));
         }
     });
 #endif
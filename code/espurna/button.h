@@ -81,15 +81,22 @@ struct ButtonEventDelays {
 
 using ButtonEventEmitterPtr = std::unique_ptr<debounce_event::EventEmitter>;
 
+struct ButtonEdges;
+using ButtonEdgesPtr = std::unique_ptr<ButtonEdges>;
+
 struct Button {
     Button(ButtonActions&& actions, ButtonEventDelays&& delays);
     Button(BasePinPtr&& pin, const debounce_event::types::Config& config,
         ButtonActions&& actions, ButtonEventDelays&& delays);
 
+    Button(Button&&) noexcept;
+    ~Button();
+
     bool state();
     ButtonEvent loop();
 
     ButtonEventEmitterPtr event_emitter;
+    ButtonEdgesPtr edges;
 
     ButtonActions actions;
     ButtonEventDelays event_delays;
@@ -122,6 +122,11 @@
 #define THINGSPEAK_SUPPORT          0               // Thingspeak in ASYNC mode requires ASYNC_TCP_SSL_ENABLED
 #endif
 
+#if INFLUXDB_SUPPORT || (THINGSPEAK_SUPPORT && THINGSPEAK_USE_ASYNC)
+#undef HTTP_CLIENT_SUPPORT
+#define HTTP_CLIENT_SUPPORT         1               // Both use the shared async HTTP client
+#endif
+
 #if WEB_SUPPORT && WEB_SSL_ENABLED && (!ASYNC_TCP_SSL_ENABLED)
 #warning "WEB_SUPPORT with SSL requires a globally defined ASYNC_TCP_SSL_ENABLED=1"
 #undef WEB_SSL_ENABLED
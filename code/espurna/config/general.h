@@ -32,6 +32,21 @@
                                                 // - https://github.com/esp8266/Arduino/issues/5825
 #endif
 
+#ifndef LOOP_PROFILER_SUPPORT
+#define LOOP_PROFILER_SUPPORT   1               // Measure execution time of every loop callback. Only active after 'LOOP.PROFILE start',
+                                                // otherwise costs a single flag check per loop
+#endif
+
+#ifndef LOOP_PROFILER_BUDGET
+#define LOOP_PROFILER_BUDGET    10000           // Default time (in microseconds) a single callback is allowed to take
+                                                // Callbacks that take more than that are counted as overruns
+#endif
+
+#ifndef TIMER_LATENESS_TOLERANCE
+#define TIMER_LATENESS_TOLERANCE 50             // Time (in milliseconds) a software timer callback is allowed to be late
+                                                // Callbacks that run later than that are counted as overruns ('TIMERS' command)
+#endif
+
 //------------------------------------------------------------------------------
 // HEARTBEAT
 //------------------------------------------------------------------------------
@@ -57,6 +72,17 @@
 #define DEBUG_LOG_MODE                  DebugLogMode::Enabled
 #endif
 
+#ifndef DEBUG_LOG_RING_SIZE
+#define DEBUG_LOG_RING_SIZE             2048    // Log messages are stored here until every output sends them
+                                                // (rounded down to the power of two, oldest messages are dropped when full)
+#endif
+
+#ifndef DEBUG_LOG_DEFERRED
+#define DEBUG_LOG_DEFERRED              0       // Store format string address and raw arguments instead of the text
+                                                // Serial output then needs to be decoded with scripts/log_decoder.py
+                                                // (text is still available via telnet, web and syslog)
+#endif
+
 // Serial debug log
 
 #ifndef DEBUG_SERIAL_SUPPORT
@@ -176,6 +202,15 @@
                                                 // Helps to avoid lost data with lwip2 TCP_MSS=536 option
 #endif
 
+#ifndef TELNET_BUFFER_CHUNK_SIZE
+#define TELNET_BUFFER_CHUNK_SIZE    256         // Buffered output is stored in chunks of this size, shared between all clients
+#endif
+
+#ifndef TELNET_CLIENT_BUFFER_MAX
+#define TELNET_CLIENT_BUFFER_MAX    1024        // Output that was not acknowledged yet by the client, newer data is dropped when
+                                                // this is reached and until at least half of it is acknowledged
+#endif
+
 // Enable this flag to add support for reverse telnet (+800 bytes)
 // This is useful to telnet to a device behind a NAT or firewall
 // To use this feature, start a listen server on a publicly reachable host with e.g. "ncat -vlp <port>" and use the MQTT reverse telnet command to connect
@@ -259,6 +294,13 @@
 #define GARLAND_LEDS                60          // Number of LEDs
 #endif
 
+#ifndef GARLAND_PROVIDER
+#define GARLAND_PROVIDER            GARLAND_PROVIDER_NEOPIXEL
+                                                // GARLAND_PROVIDER_NEOPIXEL - bit-banged output through GARLAND_DATA_PIN
+                                                // GARLAND_PROVIDER_I2S - I2S DMA output, always through GPIO3 (RX)
+                                                // can be changed at runtime with `garlandProvider` setting
+#endif
+
 //------------------------------------------------------------------------------
 // THERMOSTAT
 //------------------------------------------------------------------------------
@@ -504,6 +546,18 @@
 #define BUTTON_PROVIDER_GPIO_SUPPORT                1
 #endif
 
+// Record pin changes in the GPIO interrupt handler, instead of polling the pin in the loop
+// Only used with the hardware GPIO pins, MCP23S08 and analog buttons are always polled
+// Can also be changed for every button with the `btnIntr#` setting
+
+#ifndef BUTTON_INTERRUPT
+#define BUTTON_INTERRUPT                            0
+#endif
+
+#ifndef BUTTON_EDGE_RING_SIZE
+#define BUTTON_EDGE_RING_SIZE                       16      // Number of pin changes queued for each button. Must be a power of two
+#endif
+
 // Resistor ladder support. Poll analog pin and return digital LOW when analog reading is in a certain range
 // ref. https://github.com/bxparks/AceButton/tree/develop/docs/resistor_ladder
 // Uses BUTTON#_ANALOG_LEVEL for the individual button level configuration
@@ -614,6 +668,16 @@
 #define WIFI_SCAN_RSSI_CHECK_INTERVAL   60000              // Time (ms) between RSSI checks
 #endif
 
+#ifndef WIFI_FAST_RECONNECT
+#define WIFI_FAST_RECONNECT             1                  // Try the BSSID and channel of the last connection first, scan only when that fails
+                                                           // Stored in RTC memory, so only available after a soft reset or a deep sleep
+#endif
+
+#ifndef WIFI_FAST_RECONNECT_LEASE
+#define WIFI_FAST_RECONNECT_LEASE       0                  // Also re-use the last DHCP lease as a static address, skipping the DHCP exchange
+                                                           // Only safe when DHCP server reserves this address for the device
+#endif
+
 // ref: https://docs.espressif.com/projects/esp-idf/en/latest/api-reference/kconfig.html#config-lwip-esp-gratuitous-arp
 // ref: https://github.com/xoseperez/espurna/pull/1877#issuecomment-525612546
 //
@@ -1054,6 +1118,12 @@
 #define MQTT_QUEUE_MAX_SIZE         20              // Size of the MQTT queue when MQTT_USE_JSON is enabled
 #endif
 
+#ifndef MQTT_HEARTBEAT_BUFFER_SIZE
+#define MQTT_HEARTBEAT_BUFFER_SIZE  1536            // Heartbeat values and the resulting JSON payload (when MQTT_USE_JSON is enabled)
+                                                    // are composed in a single buffer of this size. Values that do not fit are not sent.
+                                                    // When JSON payload does not fit, values are sent using individual topics instead
+#endif
+
 #ifndef MQTT_BUFFER_MAX_SIZE
 #define MQTT_BUFFER_MAX_SIZE        1024            // Size of the MQTT payload buffer for MQTT_MESSAGE_EVENT. Large messages will only be available via MQTT_MESSAGE_RAW_EVENT.
                                                     // Note: When using MQTT_LIBRARY_PUBSUBCLIENT, MQTT_MAX_PACKET_SIZE should not be more than this value.
@@ -1191,6 +1261,11 @@
 #define LIGHT_USE_GAMMA         0           // Use gamma correction for color channels
 #endif
 
+#ifndef LIGHT_GAMMA_EXPONENT
+#define LIGHT_GAMMA_EXPONENT    2.2         // Gamma correction curve, output = input ^ exponent
+                                            // Lookup table is generated at build time, based on this value
+#endif
+
 #ifndef LIGHT_USE_RGB
 #define LIGHT_USE_RGB           0           // Use RGB color selector (1=> RGB, 0=> HSV)
 #endif
@@ -1213,6 +1288,11 @@
 #define LIGHT_TRANSITION_TIME   500         // Time in millis from color to color
 #endif
 
+#ifndef LIGHT_TRANSITION_EASING
+#define LIGHT_TRANSITION_EASING 0           // Transition curve between the values
+                                            // 0 => linear, 1 => ease in & out, 2 => linear in CIE L* (perceived lightness)
+#endif
+
 #ifndef LIGHT_RELAY_ENABLED
 #define LIGHT_RELAY_ENABLED     1           // Add a virtual switch that controls the global light state. Depends on RELAY_SUPPORT
 #endif
@@ -1257,6 +1337,45 @@
 #define HOMEASSISTANT_RETAIN    MQTT_RETAIN     // Make broker retain the messages
 #endif
 
+#ifndef HOMEASSISTANT_DISCOVERY_WINDOW
+#define HOMEASSISTANT_DISCOVERY_WINDOW  4       // Number of discovery messages waiting for the broker ACK at the same time
+#endif
+
+#ifndef HOMEASSISTANT_DISCOVERY_CACHE
+#define HOMEASSISTANT_DISCOVERY_CACHE   1       // Keep discovery messages between reconnects, until the configuration changes
+                                                // When disabled, messages are serialized again on every reconnect
+#endif
+
+// -----------------------------------------------------------------------------
+// HTTP CLIENT
+// -----------------------------------------------------------------------------
+
+#ifndef HTTP_CLIENT_SUPPORT
+#define HTTP_CLIENT_SUPPORT         0               // Shared async HTTP client, enabled automatically by the modules using it
+#endif
+
+#ifndef HTTP_CLIENT_CONNECTIONS
+#define HTTP_CLIENT_CONNECTIONS     2               // Maximum number of connections, one per host:port
+#endif
+
+#ifndef HTTP_CLIENT_PIPELINE
+#define HTTP_CLIENT_PIPELINE        1               // Number of requests sent before receiving the response
+                                                    // Only used after the server confirms that connection is persistent,
+                                                    // and only for the idempotent requests (POST is never pipelined)
+#endif
+
+#ifndef HTTP_CLIENT_QUEUE
+#define HTTP_CLIENT_QUEUE           8               // Number of requests waiting for each connection
+#endif
+
+#ifndef HTTP_CLIENT_TIMEOUT
+#define HTTP_CLIENT_TIMEOUT         5000            // Time to wait for the connection or the response (ms)
+#endif
+
+#ifndef HTTP_CLIENT_KEEPALIVE
+#define HTTP_CLIENT_KEEPALIVE       30000           // Idle connection is closed after this time (ms)
+#endif
+
 // -----------------------------------------------------------------------------
 // INFLUXDB
 // -----------------------------------------------------------------------------
@@ -1551,6 +1670,11 @@
 #define IR_RX_RAW_MQTT              0               // (boolean) Report RAW payload for everything received (even unknown protocols)
 #endif
 
+#ifndef IR_RX_RAW_MQTT_PACKED
+#define IR_RX_RAW_MQTT_PACKED       1               // (boolean) Report RAW payload as the packed timings, '@' followed by base64 data
+                                                    // (when disabled, timings are reported as the comma-separated list of μs)
+#endif
+
 #ifndef IR_RX_STATE_MQTT
 #define IR_RX_STATE_MQTT            0               // (boolean) Report state payload for supported protocols
 #endif
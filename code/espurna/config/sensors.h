@@ -57,6 +57,13 @@
                                                             // Warning: this might wear out flash fast!
 #endif
 
+#ifndef SENSOR_ENERGY_JOURNAL_SECTORS
+#define SENSOR_ENERGY_JOURNAL_SECTORS       4               // Instead of settings, save energy totals into a journal using N last sectors
+                                                            // of the filesystem area. Only used when SPIFFS support is disabled and
+                                                            // the filesystem area is big enough, otherwise settings are used instead
+                                                            // A 0 means journal is disabled
+#endif
+
 #define SENSOR_PUBLISH_ADDRESSES            0               // Publish sensor addresses
 #define SENSOR_ADDRESS_TOPIC                "address"       // Topic to publish sensor addresses
 
@@ -273,7 +280,6 @@
 #define CSE7766_PIN_INVERSE             0       // Signal is inverted
 #endif
 
-#define CSE7766_SYNC_INTERVAL           300     // Safe time between transmissions (ms)
 #define CSE7766_BAUDRATE                4800    // UART baudrate
 
 #define CSE7766_V1R                     1.0     // 1mR current resistor
@@ -431,6 +437,10 @@
 #define EMON_FILTER_SPEED               512         // Mobile average filter speed
 #endif
 
+#ifndef EMON_SLICE_TIME
+#define EMON_SLICE_TIME                 1000        // Max time in us to sample on every loop, 0 to only sample when reading
+#endif
+
 #ifndef EMON_REFERENCE_VOLTAGE
 #define EMON_REFERENCE_VOLTAGE          3.3         // Reference voltage of the ADC
 #endif
@@ -650,6 +660,11 @@
 #define EVENTS8_DEBOUNCE                 50      // Do not register events within less than 50 millis
 #endif
 
+#ifndef EVENTS_EDGE_RING_SIZE
+#define EVENTS_EDGE_RING_SIZE            16      // Queue edge timestamps in the ISR and debounce in the loop
+                                                 // Must be a power of two. Set to 0 to only count in the ISR
+#endif
+
 //------------------------------------------------------------------------------
 // Geiger sensor
 // Enable support by passing GEIGER_SUPPORT=1 build flag
@@ -766,6 +781,11 @@
                                                 // Use FALLING for BL0937 / HJL0
 #endif
 
+#ifndef HLW8012_EDGE_RING_SIZE
+#define HLW8012_EDGE_RING_SIZE          0       // Also queue CF pulse timestamps, for the instantaneous pulse rate
+                                                // Must be a power of two. Set to 0 to disable
+#endif
+
 //------------------------------------------------------------------------------
 // LDR sensor
 // Enable support by passing LDR_SUPPORT=1 build flag
@@ -981,6 +1001,11 @@
 #define PULSEMETER_DEBOUNCE             50         // Do not register pulses within less than 50 millis
 #endif
 
+#ifndef PULSEMETER_EDGE_RING_SIZE
+#define PULSEMETER_EDGE_RING_SIZE       16         // Queue pulse timestamps in the ISR and debounce in the loop
+                                                   // Must be a power of two. Set to 0 to only count in the ISR
+#endif
+
 //------------------------------------------------------------------------------
 // PZEM004T based power monitor
 // Enable support by passing PZEM004T_SUPPORT=1 build flag
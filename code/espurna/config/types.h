@@ -219,6 +219,13 @@
 #define LIGHT_PROVIDER_DIMMER       2
 #define LIGHT_PROVIDER_CUSTOM       3
 
+// -----------------------------------------------------------------------------
+// GARLAND
+// -----------------------------------------------------------------------------
+
+#define GARLAND_PROVIDER_NEOPIXEL   GarlandProvider::NeoPixel
+#define GARLAND_PROVIDER_I2S        GarlandProvider::I2s
+
 // -----------------------------------------------------------------------------
 // SCHEDULER
 // -----------------------------------------------------------------------------
@@ -17,7 +17,9 @@ Copyright (C) 2016-2019 by Xose Pérez <xose dot perez at gmail dot com>
 #include "utils.h"
 #include "ws.h"
 
-#include <limits>
+#include "libs/DeferredFormat.h"
+#include "libs/LogRing.h"
+
 #include <type_traits>
 #include <vector>
 
@@ -127,6 +129,16 @@ constexpr DebugLogMode mode() {
     return DEBUG_LOG_MODE;
 }
 
+constexpr size_t ringSize() {
+    return DEBUG_LOG_RING_SIZE;
+}
+
+constexpr bool deferred() {
+    return 1 == DEBUG_LOG_DEFERRED;
+}
+
+constexpr size_t SmallStringBufferSize { 128 };
+
 constexpr bool buffer() {
     return 1 == DEBUG_LOG_BUFFER_ENABLED;
 }
@@ -200,9 +212,10 @@ void send(const char* message, size_t len) {
     send(message, len, build::AddTimestamp);
 }
 
+void sendDeferred(const uint8_t* data, size_t len, bool line);
+
 void formatAndSend(const char* format, va_list args) {
-    constexpr size_t SmallStringBufferSize { 128 };
-    char temp[SmallStringBufferSize];
+    char temp[build::SmallStringBufferSize];
 
     int len = vsnprintf_P(temp, sizeof(temp), format, args);
     if (len <= 0) {
@@ -227,11 +240,151 @@ void formatAndSend(const char* format, va_list args) {
     delete[] buffer;
 }
 
+// Only the format strings from flash are guaranteed to stay the same and could be found in the .elf
+bool persistent(const char* format) {
+    static constexpr uintptr_t FlashMapped { 0x40200000 };
+    return reinterpret_cast<uintptr_t>(format) >= FlashMapped;
+}
+
+// Message is not formatted here, only the format pointer and the arguments are stored.
+// Falls back to the usual formatting when the message can't be deferred
+void deferAndSend(const char* format, va_list args) {
+    if (persistent(format)) {
+        uint8_t temp[build::SmallStringBufferSize];
+
+        va_list copy;
+        va_copy(copy, args);
+        const auto result = deferred::encode(temp, sizeof(temp), format, copy);
+        va_end(copy);
+
+        if (result) {
+            sendDeferred(temp, result.size, result.line);
+            return;
+        }
+    }
+
+    formatAndSend(format, args);
+}
+
+// Every message is stored in the ring first, each output then sends it at its own pace.
+// Nothing is formatted here, timestamp prefix is added by the output when the message is sent
+
+namespace ring {
+
+constexpr uint8_t FlagTimestamp { 1 };
+constexpr uint8_t FlagDeferred { 1 << 1 };
+
+namespace internal {
+
+LogRing ring;
+bool draining { false };
+uint32_t dropped { 0 };
+
+} // namespace internal
+
+LogRing& get() {
+    if (!internal::ring) {
+        internal::ring.reset(build::ringSize());
+    }
+
+    return internal::ring;
+}
+
+// Output might log something while the message is being sent. Storing it could overwrite
+// the record that is currently in use, so it is dropped instead
+bool append(uint32_t timestamp, uint8_t flags, const char* message, size_t len) {
+    if (internal::draining) {
+        ++internal::dropped;
+        return false;
+    }
+
+    return get().append(timestamp, flags, message, len);
+}
+
+struct Prefix {
+    explicit Prefix(const LogRing::Record& record) {
+        if (record.flags & FlagTimestamp) {
+            const auto len = snprintf_P(_buffer, sizeof(_buffer), PSTR("[%06lu] "),
+                static_cast<unsigned long>(record.timestamp % 1000000));
+            _length = (len > 0) ? std::min(static_cast<size_t>(len), sizeof(_buffer) - 1) : 0;
+        }
+    }
+
+    const char* c_str() const {
+        return _buffer;
+    }
+
+    size_t length() const {
+        return _length;
+    }
+
+private:
+    char _buffer[10] {};
+    size_t _length { 0 };
+};
+
+// Deferred records are formatted here, only for the outputs that need the text
+template <typename T>
+bool text(const LogRing::Record& record, T&& callback) {
+    if (!(record.flags & FlagDeferred)) {
+        return callback(record.data, record.length);
+    }
+
+    const auto* data = reinterpret_cast<const uint8_t*>(record.data);
+
+    char temp[build::SmallStringBufferSize];
+    const int len = deferred::render(temp, sizeof(temp), data, record.length);
+    if (len < 0) {
+        return true;
+    }
+
+    if (static_cast<size_t>(len) < sizeof(temp)) {
+        return callback(temp, len);
+    }
+
+    const size_t BufferSize { static_cast<size_t>(len) + 1 };
+    std::unique_ptr<char[]> buffer(new (std::nothrow) char[BufferSize]);
+    if (!buffer) {
+        return true;
+    }
+
+    deferred::render(buffer.get(), BufferSize, data, record.length);
+    return callback(buffer.get(), len);
+}
+
+struct Sink {
+    LogRing::Cursor cursor {};
+};
+
+template <typename T>
+size_t drain(Sink& sink, T&& callback) {
+    if (internal::draining || !internal::ring) {
+        return 0;
+    }
+
+    internal::draining = true;
+    const auto out = internal::ring.read(sink.cursor, callback);
+    internal::draining = false;
+
+    return out;
+}
+
+// Nothing to send to, not counted as dropped
+void skip(Sink& sink) {
+    internal::ring.skip(sink.cursor);
+}
+
+uint32_t dropped(const Sink& sink) {
+    return sink.cursor.dropped;
+}
+
+} // namespace ring
+
 namespace buffer {
 namespace internal {
 
 bool enabled { false };
-std::vector<char> storage;
+LogRing storage;
 
 } // namespace internal
 
@@ -243,8 +396,12 @@ size_t capacity() {
     return internal::storage.capacity();
 }
 
+uint32_t dropped() {
+    return internal::storage.evicted();
+}
+
 void reserve(size_t size) {
-    internal::storage.reserve(size);
+    internal::storage.reset(size);
 }
 
 bool enabled() {
@@ -366,7 +523,6 @@ void sendBytes(const uint8_t* bytes, size_t size) {
         reinterpret_cast<const char*>(bytes) + size);
 
     if (internal::line.end() != std::find(internal::line.begin(), internal::line.end(), '\n')) {
-        // TODO: ws and telnet still assume this is a c-string and will try to strlen this pointer
         auto len = internal::line.size();
         internal::line.push_back('\0');
 
@@ -377,66 +533,99 @@ void sendBytes(const uint8_t* bytes, size_t size) {
     }
 }
 
-// Longer recording of all log data. Stops when storage is filled, requires manual flushing.
+// Longer recording of all log data, requires manual flushing. When storage is filled, oldest messages are dropped.
 
-void add(const char (&prefix)[10], const char* data, size_t len) {
-    if (len > std::numeric_limits<uint16_t>::max()) {
-        return;
-    }
+void add(uint32_t timestamp, uint8_t flags, const char* message, size_t len) {
+    internal::storage.append(timestamp, flags, message, len);
+}
 
-    size_t total { len };
-    bool withPrefix { prefix[0] != '\0' };
-    if (withPrefix) {
-        total += sizeof(prefix) - 1;
-    }
+void dump(Print& out) {
+    auto cursor = internal::storage.begin();
+    internal::storage.read(cursor, [&](const LogRing::Record& record) {
+        const ring::Prefix prefix(record);
+        return ring::text(record, [&](const char* data, size_t length) {
+            if (prefix.length()) {
+                out.write(prefix.c_str(), prefix.length());
+            }
+            out.write(data, length);
+            return true;
+        });
+    });
 
-    if ((internal::storage.capacity() - internal::storage.size()) <= (total + 3)) {
-        internal::enabled = false;
-        return;
-    }
+    internal::storage.reset(0);
+}
+
+} // namespace buffer
 
-    internal::storage.push_back(total >> 8);
-    internal::storage.push_back(total & 0xff);
+#if DEBUG_SERIAL_SUPPORT
+namespace serial {
+namespace internal {
 
-    if (withPrefix) {
-        internal::storage.insert(internal::storage.end(), prefix, prefix + sizeof(prefix));
-    }
-    internal::storage.insert(internal::storage.end(), data, data + len);
-}
+ring::Sink sink;
 
-void dump(Print& out) {
-    size_t index = 0;
-    do {
-        if (index >= internal::storage.size()) {
-            break;
-        }
+} // namespace internal
 
-        size_t len = internal::storage[index] << 8;
-        len = len | internal::storage[index + 1];
-        index += 2;
+// Deferred records are sent as-is and are expected to be decoded on the host.
+// Every one is a separate line, starting with the marker and followed by base64 of
+// the header (timestamp, record flags and a padding byte) and the payload (see scripts/log_decoder.py)
+constexpr char DeferredMarker { '\x1e' };
+constexpr size_t DeferredHeaderSize { 6 };
 
-        auto value = internal::storage[index + len];
-        internal::storage[index + len] = '\0';
-        out.print(internal::storage.data() + index);
-        internal::storage[index + len] = value;
+// header is encoded separately from the payload, so there should be no base64 padding
+static_assert((DeferredHeaderSize % 3) == 0, "");
 
-        index += len;
-    } while (true);
+size_t length(const LogRing::Record& record, const ring::Prefix& prefix) {
+    if (record.flags & ring::FlagDeferred) {
+        return 2 + deferred::base64Length(DeferredHeaderSize)
+            + deferred::base64Length(record.length);
+    }
 
-    internal::storage.clear();
-    internal::storage.shrink_to_fit();
+    return prefix.length() + record.length;
 }
 
-} // namespace buffer
+void write(const LogRing::Record& record, const ring::Prefix& prefix) {
+    if (record.flags & ring::FlagDeferred) {
+        uint8_t header[DeferredHeaderSize] {};
+        std::memcpy(&header[0], &record.timestamp, sizeof(record.timestamp));
+        header[sizeof(record.timestamp)] = record.flags;
 
-#if DEBUG_SERIAL_SUPPORT
-namespace serial {
+        const auto output = [](const char* chunk, size_t length) {
+            DEBUG_PORT.write(chunk, length);
+        };
+
+        DEBUG_PORT.write(DeferredMarker);
+        deferred::base64(header, sizeof(header), output);
+        deferred::base64(reinterpret_cast<const uint8_t*>(record.data), record.length, output);
+        DEBUG_PORT.write('\n');
+        return;
+    }
 
-void output(Print& out, const char (&prefix)[10], const char* message, size_t len) {
-    if (prefix[0] != '\0') {
-        out.write(&prefix[0], sizeof(prefix) - 1);
+    if (prefix.length()) {
+        DEBUG_PORT.write(prefix.c_str(), prefix.length());
     }
-    out.write(message, len);
+    DEBUG_PORT.write(record.data, record.length);
+}
+
+// Only CONT is allowed to wait until everything is written out,
+// SYS sends as much as the port is able to accept and leaves the rest for the loop
+void drain() {
+    const bool blocking = can_yield();
+    ring::drain(internal::sink, [&](const LogRing::Record& record) {
+        const ring::Prefix prefix(record);
+        if (!blocking) {
+            const auto available = DEBUG_PORT.availableForWrite();
+            if ((available <= 0) || (static_cast<size_t>(available) < length(record, prefix))) {
+                return false;
+            }
+        }
+
+        write(record, prefix);
+        return true;
+    });
+}
+
+uint32_t dropped() {
+    return ring::dropped(internal::sink);
 }
 
 } // namespace serial
@@ -466,6 +655,8 @@ size_t len { 0 };
 char header[128] = {0};
 WiFiUDP udp;
 
+ring::Sink sink;
+
 } // namespace
 
 // We use the syslog header as defined in RFC5424 (The Syslog Protocol), ref:
@@ -473,69 +664,192 @@ WiFiUDP udp;
 // - https://github.com/xoseperez/espurna/issues/2312/
 
 void configure() {
-    snprintf_P(
+    const auto len = snprintf_P(
         internal::header, sizeof(internal::header),
         PSTR("<%u>1 - %.31s ESPurna - - - "), DEBUG_UDP_FAC_PRI,
         getHostname().c_str());
+    internal::len = (len > 0)
+        ? std::min(static_cast<size_t>(len), sizeof(internal::header) - 1)
+        : 0;
 }
 
 bool output(const char* message, size_t len) {
-    if (build::enabled() && wifiConnected()) {
-        internal::udp.beginPacket(build::ip(), build::port());
-        internal::udp.write(internal::header, internal::len);
-        internal::udp.write(message, len);
+    if (!internal::udp.beginPacket(build::ip(), build::port())) {
+        return false;
+    }
+
+    internal::udp.write(internal::header, internal::len);
+    internal::udp.write(message, len);
+
+    return internal::udp.endPacket() > 0;
+}
 
-        return internal::udp.endPacket() > 0;
+void drain() {
+    if (!wifiConnected()) {
+        ring::skip(internal::sink);
+        return;
     }
 
-    return false;
+    ring::drain(internal::sink, [](const LogRing::Record& record) {
+        return ring::text(record, output);
+    });
+}
+
+uint32_t dropped() {
+    return ring::dropped(internal::sink);
 }
 
 } // namespace syslog
 #endif
 
-void send(const char* message, size_t len, Timestamp timestamp) {
-    if (!message || !len) {
+#if DEBUG_TELNET_SUPPORT
+namespace telnet {
+namespace internal {
+
+ring::Sink sink;
+
+} // namespace internal
+
+void drain() {
+    if (!telnetDebugConnected()) {
+        ring::skip(internal::sink);
+        return;
+    }
+
+    ring::drain(internal::sink, [](const LogRing::Record& record) {
+        const ring::Prefix prefix(record);
+        return ring::text(record, [&](const char* data, size_t) {
+            return telnetDebugSend(prefix.c_str(), data);
+        });
+    });
+}
+
+uint32_t dropped() {
+    return ring::dropped(internal::sink);
+}
+
+} // namespace telnet
+#endif
+
+#if DEBUG_WEB_SUPPORT
+namespace web {
+namespace internal {
+
+ring::Sink sink;
+
+} // namespace internal
+
+void drain() {
+    if (!wsConnected()) {
+        ring::skip(internal::sink);
         return;
     }
 
-    char prefix[10] = {0};
+    ring::drain(internal::sink, [](const LogRing::Record& record) {
+        const ring::Prefix prefix(record);
+        return ring::text(record, [&](const char* data, size_t) {
+            return wsDebugSend(prefix.c_str(), data);
+        });
+    });
+}
+
+uint32_t dropped() {
+    return ring::dropped(internal::sink);
+}
+
+} // namespace web
+#endif
+
+// Message is only copied into the ring, every network output is sent from the loop.
+// Serial is drained right away, so the log is not delayed when loop is not running (yet)
+void store(uint8_t flags, const char* data, size_t len, Timestamp timestamp, bool line) {
     static bool continue_timestamp = true;
     if (timestamp && continue_timestamp) {
-        snprintf(prefix, sizeof(prefix), "[%06lu] ", millis() % 1000000);
+        flags |= ring::FlagTimestamp;
+    }
+
+    continue_timestamp = static_cast<bool>(timestamp) || line;
+
+    const auto now = millis();
+
+#if DEBUG_LOG_BUFFER_SUPPORT
+    if (buffer::enabled()) {
+        buffer::add(now, flags, data, len);
+    }
+#endif
+
+    if (!ring::append(now, flags, data, len)) {
+        return;
+    }
+
+#if DEBUG_SERIAL_SUPPORT
+    serial::drain();
+#endif
+
+    espurnaLoopWake();
+}
+
+void send(const char* message, size_t len, Timestamp timestamp) {
+    if (!message || !len) {
+        return;
     }
 
-    continue_timestamp = static_cast<bool>(timestamp)
-        || (message[len - 1] == '\r')
-        || (message[len - 1] == '\n');
+    store(0, message, len, timestamp,
+        (message[len - 1] == '\r') || (message[len - 1] == '\n'));
+}
 
-    bool pause { false };
+void sendDeferred(const uint8_t* data, size_t len, bool line) {
+    store(ring::FlagDeferred, reinterpret_cast<const char*>(data), len,
+        build::AddTimestamp, line);
+}
 
+void loop() {
 #if DEBUG_SERIAL_SUPPORT
-    serial::output(DEBUG_PORT, prefix, message, len);
+    serial::drain();
 #endif
 
 #if DEBUG_UDP_SUPPORT
-    pause = syslog::output(message, len);
+    if (syslog::build::enabled()) {
+        syslog::drain();
+    }
 #endif
 
 #if DEBUG_TELNET_SUPPORT
-    pause = telnetDebugSend(prefix, message) || pause;
+    telnet::drain();
 #endif
 
 #if DEBUG_WEB_SUPPORT
-    pause = wsDebugSend(prefix, message) || pause;
+    web::drain();
 #endif
+}
 
-#if DEBUG_LOG_BUFFER_SUPPORT
-    buffer::add(prefix, message, len);
+#if TERMINAL_SUPPORT
+namespace terminal {
+
+void sinks(::terminal::CommandContext&& ctx) {
+    const auto& storage = ring::get();
+    ctx.output.printf_P(PSTR("ring: %u / %u bytes, dropped %u (busy)\n"),
+        storage.size(), storage.capacity(), ring::internal::dropped);
+
+#if DEBUG_SERIAL_SUPPORT
+    ctx.output.printf_P(PSTR("serial: dropped %u\n"), serial::dropped());
+#endif
+#if DEBUG_UDP_SUPPORT
+    ctx.output.printf_P(PSTR("syslog: dropped %u\n"), syslog::dropped());
+#endif
+#if DEBUG_TELNET_SUPPORT
+    ctx.output.printf_P(PSTR("telnet: dropped %u\n"), telnet::dropped());
+#endif
+#if DEBUG_WEB_SUPPORT
+    ctx.output.printf_P(PSTR("web: dropped %u\n"), web::dropped());
 #endif
 
-    if (pause) {
-        optimistic_yield(1000);
-    }
+    terminalOK(ctx);
 }
 
+} // namespace terminal
+#endif
+
 // -----------------------------------------------------------------------------
 
 #if DEBUG_WEB_SUPPORT
@@ -647,7 +961,11 @@ void debugSend(const char* format, ...) {
     if (espurna::debug::enabled()) {
         va_list args;
         va_start(args, format);
-        espurna::debug::formatAndSend(format, args);
+        if (espurna::debug::build::deferred()) {
+            espurna::debug::deferAndSend(format, args);
+        } else {
+            espurna::debug::formatAndSend(format, args);
+        }
         va_end(args);
     }
 }
@@ -684,13 +1002,20 @@ void debugSetup() {
             return;
         }
 
-        ctx.output.printf_P(PSTR("buffer size: %u / %u bytes\n"),
-            espurna::debug::buffer::size(), espurna::debug::buffer::capacity());
+        ctx.output.printf_P(PSTR("buffer size: %u / %u bytes, dropped %u\n"),
+            espurna::debug::buffer::size(), espurna::debug::buffer::capacity(),
+            espurna::debug::buffer::dropped());
         espurna::debug::buffer::dump(ctx.output);
         terminalOK(ctx);
     });
 #endif
 #endif
+
+#if TERMINAL_SUPPORT
+    terminalRegisterCommand(F("DEBUG.SINKS"), espurna::debug::terminal::sinks);
+#endif
+
+    espurnaRegisterLoop(espurna::debug::loop);
 }
 
 #endif // DEBUG_SUPPORT
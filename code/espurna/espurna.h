@@ -63,4 +63,36 @@ void espurnaRegisterLoop(LoopCallback);
 espurna::duration::Milliseconds espurnaLoopDelay();
 void espurnaLoopDelay(espurna::duration::Milliseconds);
 
+// Loop sleeps for at most espurnaLoopDelay() after running every callback.
+// Callbacks may ask for the next loop to happen sooner, sleep then lasts only until the earliest deadline.
+void espurnaLoopDeadline(espurna::duration::Milliseconds);
+
+template <typename Rep, typename Period>
+void espurnaLoopDeadline(std::chrono::duration<Rep, Period> value) {
+    espurnaLoopDeadline(std::chrono::ceil<espurna::duration::Milliseconds>(value));
+}
+
+// Interrupt the current sleep or skip the next one. Safe to call from ISR and SYS contexts
+void espurnaLoopWake();
+
+#if LOOP_PROFILER_SUPPORT
+#include "loop_profiler.h"
+
+namespace espurna {
+namespace loop {
+namespace profiler {
+
+bool enabled();
+
+using ReportCallback = std::function<void(LoopCallback, const Report&)>;
+void foreach(ReportCallback);
+
+// Time spent in all of the callbacks
+Report total();
+
+} // namespace profiler
+} // namespace loop
+} // namespace espurna
+#endif
+
 void extraSetup();
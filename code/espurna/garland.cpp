@@ -48,6 +48,7 @@ Infinite commands can be interrupted by immediate command or by reset command.
 #if GARLAND_SUPPORT
 
 #include <Adafruit_NeoPixel.h>
+#include <i2s.h>
 
 #include <array>
 #include <list>
@@ -68,6 +69,7 @@ namespace {
 alignas(4) static constexpr char NAME_GARLAND_ENABLED[] = "garlandEnabled";
 alignas(4) static constexpr char NAME_GARLAND_BRIGHTNESS[] = "garlandBrightness";
 alignas(4) static constexpr char NAME_GARLAND_SPEED[] = "garlandSpeed";
+alignas(4) static constexpr char NAME_GARLAND_PROVIDER[] = "garlandProvider";
 
 alignas(4) static constexpr char NAME_GARLAND_SWITCH[] = "garland_switch";
 alignas(4) static constexpr char NAME_GARLAND_SET_BRIGHTNESS[] = "garland_set_brightness";
@@ -89,6 +91,8 @@ alignas(4) static constexpr char MQTT_COMMAND_RESET[] = "reset"; // reset queue
 alignas(4) static constexpr char MQTT_COMMAND_QUEUE[] = "queue"; // enqueue command payload
 alignas(4) static constexpr char MQTT_COMMAND_SEQUENCE[] = "sequence"; // place command to sequence
 
+constexpr GarlandProvider GarlandProviderDefault { GARLAND_PROVIDER };
+
 #define EFFECT_UPDATE_INTERVAL_MIN      7000  // 5 sec
 #define EFFECT_UPDATE_INTERVAL_MAX      12000 // 10 sec
 
@@ -146,7 +150,10 @@ constexpr unsigned char GarlandPin { GARLAND_DATA_PIN };
 constexpr neoPixelType GarlandPixelType { NEO_GRB + NEO_KHZ800 };
 
 Adafruit_NeoPixel pixels(GarlandLeds, GarlandPin, GarlandPixelType);
-Scene<GarlandLeds> scene(&pixels);
+std::unique_ptr<Output> output;
+
+static_assert(pixelRgb(GarlandPixelType), "Only 3-byte pixels are supported");
+Scene<GarlandLeds> scene(GarlandPixelType);
 
 std::array<Anim*, 15> anims {
     new AnimGlow(),
@@ -222,7 +229,8 @@ void _garlandWebSocketOnConnected(JsonObject& root) {
 bool _garlandWebSocketOnKeyCheck(espurna::StringView key, const JsonVariant&) {
     return espurna::settings::query::samePrefix(key, NAME_GARLAND_ENABLED)
         || espurna::settings::query::samePrefix(key, NAME_GARLAND_BRIGHTNESS)
-        || espurna::settings::query::samePrefix(key, NAME_GARLAND_SPEED);
+        || espurna::settings::query::samePrefix(key, NAME_GARLAND_SPEED)
+        || espurna::settings::query::samePrefix(key, NAME_GARLAND_PROVIDER);
 }
 
 //------------------------------------------------------------------------------
@@ -367,6 +375,8 @@ bool executeCommand(const String& command) {
 // Loop
 //------------------------------------------------------------------------------
 void garlandLoop(void) {
+    output->run();
+
     if (!_immediate_command.isEmpty()) {
         executeCommand(_immediate_command);
         _immediate_command.clear();
@@ -516,29 +526,18 @@ void Scene<Leds>::run() {
     }
 
     if (state == Transition && cyclesRemain < 3) {
-        // transition coef, if within 0..1 - transition is active
-        // changes from 1 to 0 during transition, so we interpolate from current
-        // color to previous
-        float transc = (float)((long)transms - (long)millis()) / GARLAND_SCENE_TRANSITION_MS;
+        // transition weight of the previous colors, changes from max to 0 during transition
+        const long remaining = (long)transms - (long)millis();
+        const uint16_t weight = (remaining > 0)
+            ? (uint16_t)((remaining * BlendWeightMax) / GARLAND_SCENE_TRANSITION_MS)
+            : 0;
         Color* leds_prev = (_leds == &_leds1[0]) ? &_leds2[0] : &_leds1[0];
 
-        if (transc > 0) {
-            for (int i = 0; i < Leds; i++) {
-                // transition is in progress
-                Color c = _leds[i].interpolate(leds_prev[i], transc);
-                byte r = (int)(bri_lvl[c.r]) * brightness / 256;
-                byte g = (int)(bri_lvl[c.g]) * brightness / 256;
-                byte b = (int)(bri_lvl[c.b]) * brightness / 256;
-                _pixels->setPixelColor(i, _pixels->Color(r, g, b));
-            }
-        } else {
-            for (int i = 0; i < Leds; i++) {
-                // regular operation
-                byte r = (int)(bri_lvl[_leds[i].r]) * brightness / 256;
-                byte g = (int)(bri_lvl[_leds[i].g]) * brightness / 256;
-                byte b = (int)(bri_lvl[_leds[i].b]) * brightness / 256;
-                _pixels->setPixelColor(i, _pixels->Color(r, g, b));
-            }
+        // render straight into the strip buffer, it will be sent as-is on the next show()
+        _lut.update(bri_lvl, brightness);
+        auto* out = _output ? _output->getPixels() : nullptr;
+        if (out) {
+            render(out, _leds, leds_prev, Leds, weight, _lut, _order);
         }
 
         sum_pixl_time += (micros() - iteration_start_time);
@@ -554,11 +553,17 @@ void Scene<Leds>::run() {
         will lead to reseting the transmition operation. From other hand, long operation can cause
         Soft WDT reset. To avoid wdt reset we need to switch soft wdt off for long strips.
         It is not best practice, but assuming that it is only garland, it can be acceptable.
-        Tested up to 300 leds. */
+        Tested up to 300 leds.
+        Strip still needs some time to latch the previous frame, instead of waiting for it inside
+        of the show() call, come back on the next loop and spend this time on something else */
+        if (!_output || !_output->canShow()) {
+            return;
+        }
+
         if (Leds > NUMLEDS_CAN_CAUSE_WDT_RESET) {
             ESP.wdtDisable();
         }
-        _pixels->show();
+        _output->show();
         if (Leds > NUMLEDS_CAN_CAUSE_WDT_RESET) {
             ESP.wdtEnable(5000);
         }
@@ -673,13 +678,45 @@ byte Anim::rngb() {
 
 //------------------------------------------------------------------------------
 
+namespace espurna {
+namespace settings {
+namespace internal {
+namespace {
+
+alignas(4) static constexpr char GarlandProviderNeoPixel[] PROGMEM = "neopixel";
+alignas(4) static constexpr char GarlandProviderI2s[] PROGMEM = "i2s";
+
+static constexpr std::array<options::Enumeration<GarlandProvider>, 2> GarlandProviderOptions PROGMEM {
+    {{GarlandProvider::NeoPixel, GarlandProviderNeoPixel},
+     {GarlandProvider::I2s, GarlandProviderI2s}}
+};
+
+} // namespace
+
+template <>
+GarlandProvider convert(const String& value) {
+    return convert(GarlandProviderOptions, value, GarlandProviderDefault);
+}
+
+String serialize(GarlandProvider value) {
+    return serialize(GarlandProviderOptions, value);
+}
+
+} // namespace internal
+} // namespace settings
+} // namespace espurna
+
+//------------------------------------------------------------------------------
+
 void garlandEnabled(bool enabled) {
     _garland_enabled = enabled;
     setSetting(NAME_GARLAND_ENABLED, _garland_enabled);
     if (!_garland_enabled) {
         schedule_function([]() {
-            pixels.clear();
-            pixels.show();
+            if (output) {
+                output->clear();
+                output->show();
+            }
         });
     }
 
@@ -695,7 +732,9 @@ bool garlandEnabled() {
 }
 
 void garlandDisable() {
-    pixels.clear();
+    if (output) {
+        output->clear();
+    }
 }
 
 void garlandSetup() {
@@ -714,7 +753,17 @@ void garlandSetup() {
     espurnaRegisterLoop(garlandLoop);
     espurnaRegisterReload(_garlandReload);
 
-    pixels.begin();
+    switch (getSetting(NAME_GARLAND_PROVIDER, GarlandProviderDefault)) {
+    case GarlandProvider::I2s:
+        output = std::make_unique<I2sOutput>(pixels);
+        break;
+    case GarlandProvider::NeoPixel:
+        output = std::make_unique<NeoPixelOutput>(pixels);
+        break;
+    }
+
+    output->begin();
+    scene.setOutput(output.get());
     scene.setAnim(_currentAnim);
     scene.setPalette(_currentPalette);
     scene.setup();
@@ -0,0 +1,131 @@
+/*
+Part of the GARLAND MODULE
+
+Strip output, either bit-banged by the Adafruit_NeoPixel or sent through the I2S DMA
+*/
+
+#pragma once
+
+#include "ws2812.h"
+
+enum class GarlandProvider {
+    NeoPixel,
+    I2s
+};
+
+class Output {
+public:
+    explicit Output(Adafruit_NeoPixel& pixels) : _pixels(pixels) {}
+    virtual ~Output() = default;
+
+    // Frame is always rendered into the NeoPixel buffer, regardless of the output method
+    byte* getPixels() { return _pixels.getPixels(); }
+    void clear() { _pixels.clear(); }
+
+    virtual void begin() = 0;
+    virtual void run() {}
+    virtual bool canShow() = 0;
+    virtual void show() = 0;
+
+protected:
+    Adafruit_NeoPixel& _pixels;
+};
+
+// Interrupts are disabled while the frame is sent, ~30us per LED
+class NeoPixelOutput : public Output {
+public:
+    using Output::Output;
+
+    void begin() override { _pixels.begin(); }
+    bool canShow() override { return _pixels.canShow(); }
+    void show() override { _pixels.show(); }
+};
+
+// Frame is encoded into the separate buffer (4 bytes per every byte of pixel data), which is
+// then fed into the I2S DMA from the loop. Data is always sent through the GPIO3 (RX) pin.
+// DMA buffers of the Core fit ~170 LEDs, longer strips depend on the loop being called
+// at least every ~5ms. Otherwise, strip would latch a partial frame (until the next one).
+// While the frame is in flight, loop does not sleep longer than the minimal deadline and
+// is also woken up by the DMA interrupt every time one of the buffers is free again
+class I2sOutput : public Output {
+public:
+    using Output::Output;
+
+    ~I2sOutput() override {
+        if (_started) {
+            i2s_end();
+        }
+    }
+
+    void begin() override {
+        _samples.resize(ws2812::samples(bytes()));
+        i2s_begin();
+        i2s_set_rate(ws2812::SampleRate);
+        _started = true;
+    }
+
+    void run() override {
+        feed();
+    }
+
+    bool canShow() override {
+        feed();
+        return !busy();
+    }
+
+    // Buffer can't be replaced while it is still being sent, retry after it is done
+    void show() override {
+        if (busy()) {
+            _pending = true;
+            return;
+        }
+
+        start();
+    }
+
+private:
+    // Only 3-byte pixels are supported
+    size_t bytes() const {
+        return _pixels.numPixels() * 3;
+    }
+
+    bool busy() const {
+        return _position < _size;
+    }
+
+    static void IRAM_ATTR wake() {
+        espurnaLoopWake();
+    }
+
+    void start() {
+        _size = ws2812::encode(_samples.data(), _pixels.getPixels(), bytes());
+        _position = 0;
+        _pending = false;
+        i2s_set_callback(wake);
+        feed();
+    }
+
+    void feed() {
+        while (busy() && i2s_write_sample_nb(_samples[_position])) {
+            ++_position;
+        }
+
+        if (busy()) {
+            espurnaLoopDeadline(espurna::duration::Milliseconds(1));
+            return;
+        }
+
+        // DMA interrupt keeps happening after the frame is sent, don't wake up the loop needlessly
+        i2s_set_callback(nullptr);
+
+        if (_pending) {
+            start();
+        }
+    }
+
+    std::vector<uint32_t> _samples;
+    size_t _position = 0;
+    size_t _size = 0;
+    bool _pending = false;
+    bool _started = false;
+};
@@ -0,0 +1,82 @@
+/*
+Part of the GARLAND MODULE
+
+Frame rendering, from the animation colors to the strip byte buffer
+*/
+
+#pragma once
+
+#include "color.h"
+
+// Position of each color inside of the 3-byte pixel, as described by the NeoPixel type flags
+// (same as the Adafruit_NeoPixel would use internally, see NEO_RGB, NEO_GRB, etc.)
+struct PixelOrder {
+    uint8_t r;
+    uint8_t g;
+    uint8_t b;
+};
+
+constexpr PixelOrder pixelOrder(uint16_t type) {
+    return PixelOrder{
+        static_cast<uint8_t>((type >> 4) & 0b11),
+        static_cast<uint8_t>((type >> 2) & 0b11),
+        static_cast<uint8_t>(type & 0b11)};
+}
+
+// There's no separate white channel in the types we support, so white offset is the same as red
+constexpr bool pixelRgb(uint16_t type) {
+    return ((type >> 6) & 0b11) == ((type >> 4) & 0b11);
+}
+
+// Brightness and gamma correction folded into a single table, so every channel
+// of every pixel costs exactly one lookup. Only rebuilt when brightness changes
+class BrightnessLut {
+public:
+    using Gamma = std::array<byte, 256>;
+
+    void update(const Gamma& gamma, byte brightness) {
+        if (_valid && (brightness == _brightness)) {
+            return;
+        }
+
+        for (size_t index = 0; index < _values.size(); ++index) {
+            _values[index] = static_cast<int>(gamma[index]) * brightness / 256;
+        }
+
+        _brightness = brightness;
+        _valid = true;
+    }
+
+    byte operator[](byte value) const {
+        return _values[value];
+    }
+
+private:
+    std::array<byte, 256> _values{};
+    byte _brightness = 0;
+    bool _valid = false;
+};
+
+// Transition weight of the previous frame, [0:256]. 0 means only the current frame is visible
+constexpr uint16_t BlendWeightMax { 256 };
+
+inline byte blend(byte current, byte previous, uint16_t weight) {
+    return current + ((static_cast<int>(previous - current) * weight) >> 8);
+}
+
+// Every pixel takes the same path regardless of the transition state,
+// with weight of 0 blend() simply returns the current color
+inline void render(byte* out, const Color* leds, const Color* prev, size_t size,
+        uint16_t weight, const BrightnessLut& lut, PixelOrder order)
+{
+    for (size_t index = 0; index < size; ++index) {
+        const Color& current = leds[index];
+        const Color& previous = prev[index];
+
+        out[order.r] = lut[blend(current.r, previous.r, weight)];
+        out[order.g] = lut[blend(current.g, previous.g, weight)];
+        out[order.b] = lut[blend(current.b, previous.b, weight)];
+
+        out += 3;
+    }
+}
@@ -8,6 +8,8 @@ Inspired by https://github.com/Vasil-Pahomov/ArWs2812 (currently https://github.
 #pragma once
 
 #include "anim.h"
+#include "output.h"
+#include "render.h"
 #include "animations/anim_assemble.h"
 #include "animations/anim_comets.h"
 #include "animations/anim_dolphins.h"
@@ -27,9 +29,10 @@ Inspired by https://github.com/Vasil-Pahomov/ArWs2812 (currently https://github.
 template <uint16_t Leds>
 class Scene {
 public:
-    Scene(Adafruit_NeoPixel* pixels) : _pixels(pixels) {}
+    Scene(uint16_t type) : _order(pixelOrder(type)) {}
     constexpr uint16_t getLeds() const { return Leds; }
 
+    void setOutput(Output* output) { _output = output; }
     void setAnim(Anim* anim) { _anim = anim; }
     bool finishedAnimCycle() { return _anim ? _anim->finishedycle() : true; }
     unsigned long getAvgCalcTime() { return sum_calc_time / calc_num; }
@@ -47,7 +50,9 @@ public:
     void setup();
 
 private:
-    Adafruit_NeoPixel* _pixels = nullptr;
+    Output*            _output = nullptr;
+    PixelOrder         _order;
+    BrightnessLut      _lut;
     //Color arrays - two for making transition
     std::array<Color, Leds> _leds1;
     std::array<Color, Leds> _leds2;
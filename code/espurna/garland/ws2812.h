@@ -0,0 +1,62 @@
+/*
+Part of the GARLAND MODULE
+
+WS2812 waveform encoded as a stream of 32bit I2S samples
+
+Every data bit is sent as 4 I2S bits at 3.2MHz (312.5ns each), high part first
+- 0 => 1000 (312ns high, 938ns low)
+- 1 => 1110 (938ns high, 312ns low)
+So, a single byte of pixel data is exactly one 32bit sample (or, one 16bit stereo frame)
+Samples are transmitted MSB first, line stays low when there is nothing to send
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace ws2812 {
+
+constexpr uint32_t BitRate { 800000 };
+constexpr uint32_t BitsPerDataBit { 4 };
+constexpr uint32_t BitClock { BitRate * BitsPerDataBit };
+
+constexpr uint32_t SampleBits { 32 };
+constexpr uint32_t SampleRate { BitClock / SampleBits };
+
+constexpr uint32_t Zero { 0b1000 };
+constexpr uint32_t One { 0b1110 };
+
+// Original WS2812 only needs 50us, newer WS2812B revisions need at least 280us
+constexpr uint32_t ResetTime { 300 };
+constexpr size_t ResetSamples {
+    (((ResetTime * BitClock) / 1000000) + SampleBits - 1) / SampleBits };
+
+constexpr uint32_t encode(uint8_t value) {
+    uint32_t out { 0 };
+    for (int bit = 7; bit >= 0; --bit) {
+        out = (out << BitsPerDataBit) | (((value >> bit) & 1) ? One : Zero);
+    }
+
+    return out;
+}
+
+// Number of samples required to send the specified number of bytes, including the reset time
+constexpr size_t samples(size_t bytes) {
+    return bytes + ResetSamples;
+}
+
+// Output is expected to have enough space for samples(size)
+inline size_t encode(uint32_t* out, const uint8_t* data, size_t size) {
+    for (size_t index = 0; index < size; ++index) {
+        out[index] = encode(data[index]);
+    }
+
+    for (size_t index = size; index < samples(size); ++index) {
+        out[index] = 0;
+    }
+
+    return samples(size);
+}
+
+} // namespace ws2812
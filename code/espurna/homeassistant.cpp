@@ -25,6 +25,7 @@ Copyright (C) 2019-2021 by Maxim Prokhorov <prokhorov dot max at outlook dot com
 
 #include <forward_list>
 #include <memory>
+#include <vector>
 
 namespace homeassistant {
 namespace {
@@ -42,6 +43,14 @@ constexpr bool retain() {
     return 1 == HOMEASSISTANT_RETAIN;
 }
 
+constexpr size_t window() {
+    return HOMEASSISTANT_DISCOVERY_WINDOW;
+}
+
+constexpr bool cache() {
+    return 1 == HOMEASSISTANT_DISCOVERY_CACHE;
+}
+
 } // namespace build
 
 namespace settings {
@@ -716,218 +725,283 @@ private:
 
 #endif
 
-// Reworked discovery class. Try to send and wait for MQTT QoS 1 publish ACK to continue.
-// Topic and message are generated on demand and most of JSON payload is cached for re-use to save RAM.
+// Every discovery message is serialized once and kept until the configuration changes (or, until all of
+// them are sent, when the cache is disabled). Up to build::window() messages are published at the same time
+// and each one waits for its own QoS 1 publish ACK. When something fails, only that specific message is retried.
 
-class DiscoveryTask {
-public:
-    using Entity = std::unique_ptr<Discovery>;
-    using Entities = std::forward_list<Entity>;
-
-    static constexpr espurna::duration::Milliseconds WaitShort { 100 };
-    static constexpr espurna::duration::Milliseconds WaitLong { 1000 };
-    static constexpr int Retries { 5 };
+struct Message {
+    enum class Status {
+        Pending,
+        Sent,
+        Done,
+        Failed
+    };
 
-    DiscoveryTask(bool enabled) :
-        _enabled(enabled)
-    {}
+    String topic;
+    String payload;
 
-    void add(Entity&& entity) {
-        _entities.push_front(std::move(entity));
-    }
+    Status status;
+    uint16_t pid;
+    int retries;
+    espurna::time::CoreClock::time_point sent;
+};
 
-    template <typename T>
-    void add() {
-        _entities.push_front(std::make_unique<T>(_ctx));
-    }
+using Messages = std::vector<Message>;
 
-    bool retry() {
-        if (_retry < 0) {
-            return false;
-        }
+namespace internal {
 
-        return (--_retry > 0);
-    }
+static constexpr espurna::duration::Milliseconds WaitShort { 100 };
+static constexpr espurna::duration::Milliseconds WaitLong { 1000 };
+static constexpr espurna::duration::Milliseconds Timeout { 5000 };
+static constexpr int Retries { 5 };
 
-    Context& context() {
-        return _ctx;
-    }
+bool retain { false };
+bool enabled { false };
 
-    bool done() const {
-        return _entities.empty();
-    }
+enum class State {
+    Initial,
+    Pending,
+    Sent
+};
 
-    bool ok() const {
-        if ((_retry > 0) && !_entities.empty()) {
-            auto& entity = _entities.front();
-            return entity->ok();
+State state { State::Initial };
+espurna::timer::SystemTimer timer { "ha" };
+
+Messages messages;
+size_t in_flight { 0 };
+bool active { false };
+bool scheduled { false };
+
+// PUBACK callbacks from the previous attempt are ignored
+uint32_t generation { 0 };
+
+template <typename T>
+void serialize(Messages& out, Context& ctx) {
+    T entity(ctx);
+    while (entity.ok()) {
+        out.push_back(Message{
+            .topic = entity.topic(),
+            .payload = enabled ? entity.message() : String(),
+            .status = Message::Status::Pending,
+            .pid = 0,
+            .retries = 0,
+            .sent = {}});
+
+        if (!entity.next()) {
+            break;
         }
-
-        return false;
     }
 
-    template <typename T>
-    bool send(T&& action) {
-        while (!_entities.empty()) {
-            auto& entity = _entities.front();
-            if (!entity->ok()) {
-                _entities.pop_front();
-                _ctx.reset();
-                continue;
-            }
+    ctx.reset();
+}
 
-            const auto* topic = entity->topic().c_str();
-            const auto* msg = _enabled
-                ? entity->message().c_str()
-                : "";
+Messages serialize() {
+    Messages out;
+    auto ctx = makeContext();
 
-            if (action(topic, msg)) {
-                if (!entity->next()) {
-                    _retry = Retries;
-                    _entities.pop_front();
-                    _ctx.reset();
-                }
-                return true;
-            }
+#if LIGHT_PROVIDER != LIGHT_PROVIDER_NONE
+    serialize<LightDiscovery>(out, ctx);
+#endif
+#if RELAY_SUPPORT
+    serialize<RelayDiscovery>(out, ctx);
+#endif
+#if SENSOR_SUPPORT
+    serialize<SensorDiscovery>(out, ctx);
+#endif
 
-            return false;
-        }
+    return out;
+}
 
-        return false;
+void send();
+
+// PUBACK is received in the network context, actual publishing is done later
+void wake() {
+    if (!scheduled) {
+        scheduled = true;
+        ::schedule_function([]() {
+            scheduled = false;
+            send();
+        });
     }
+}
 
-private:
-    bool _enabled { false };
+void ack(uint32_t ack_generation, size_t index, uint16_t pid) {
+    if ((ack_generation != generation) || (index >= messages.size())) {
+        return;
+    }
 
-    int _retry { Retries };
-    Context _ctx { makeContext() };
-    Entities _entities;
-};
+    auto& message = messages[index];
+    if ((message.status == Message::Status::Sent) && (message.pid == pid)) {
+        message.status = Message::Status::Done;
+        --in_flight;
+        wake();
+    }
+}
 
-constexpr espurna::duration::Milliseconds DiscoveryTask::WaitShort;
-constexpr espurna::duration::Milliseconds DiscoveryTask::WaitLong;
+void retry(Message& message) {
+    if (++message.retries < Retries) {
+        message.status = Message::Status::Pending;
+        return;
+    }
 
-namespace internal {
+    DEBUG_MSG_P(PSTR("[HA] Could not send %s\n"), message.topic.c_str());
+    message.status = Message::Status::Failed;
+}
 
-using TaskPtr = std::shared_ptr<DiscoveryTask>;
-using FlagPtr = std::shared_ptr<bool>;
+// - async fails when disconneted and when it's buffers are filled, which should be resolved after $LATENCY
+// and the time it takes for the lwip to process it. future versions use queue, but could still fail when low on RAM
+// - lwmqtt will fail when disconnected (already checked above) and *will* disconnect in case publish fails.
+// ::publish() will wait for the puback, so we don't have to do it ourselves. not tested.
+// - pubsub will fail when it can't buffer the payload *or* the underlying WiFiClient calls fail. also not tested.
+bool publish(size_t index, espurna::time::CoreClock::time_point now) {
+    auto& message = messages[index];
+
+    const auto pid = ::mqttSendRaw(
+        message.topic.c_str(), message.payload.c_str(), retain, 1);
+    if (!pid) {
+        return false;
+    }
 
-bool retain { false };
-bool enabled { false };
+#if MQTT_LIBRARY == MQTT_LIBRARY_ASYNCMQTTCLIENT
+    message.status = Message::Status::Sent;
+    message.pid = pid;
+    message.sent = now;
+    ++in_flight;
+
+    const auto current = generation;
+    mqttOnPublish(pid, [current, index, pid]() {
+        ack(current, index, pid);
+    });
+#else
+    message.status = Message::Status::Done;
+#endif
 
-enum class State {
-    Initial,
-    Pending,
-    Sent
-};
+    return true;
+}
 
-State state { State::Initial };
-Ticker timer;
+void stop() {
+    timer.stop();
+    active = false;
+    in_flight = 0;
+    ++generation;
+}
 
-void send(TaskPtr ptr, FlagPtr flag_ptr);
+void finish(size_t failed) {
+    stop();
 
-void stop(bool done) {
-    timer.detach();
-    if (done) {
-        DEBUG_MSG_P(PSTR("[HA] Stopping discovery\n"));
-        state = State::Sent;
-    } else {
+    if (failed) {
         DEBUG_MSG_P(PSTR("[HA] Discovery error\n"));
         state = State::Pending;
+    } else {
+        DEBUG_MSG_P(PSTR("[HA] Stopping discovery\n"));
+        state = State::Sent;
     }
-}
-
-void schedule(espurna::duration::Milliseconds wait, TaskPtr ptr, FlagPtr flag_ptr) {
-    internal::timer.once_ms_scheduled(
-        wait.count(),
-        [ptr, flag_ptr]() {
-            send(ptr, flag_ptr);
-        });
-}
 
-void schedule(TaskPtr ptr, FlagPtr flag_ptr) {
-    schedule(DiscoveryTask::WaitShort, ptr, flag_ptr);
+    if (!build::cache()) {
+        Messages().swap(messages);
+    }
 }
 
-void schedule(TaskPtr ptr) {
-    schedule(DiscoveryTask::WaitShort, ptr, std::make_shared<bool>(true));
-}
+// Fill the window with pending messages. Without the PUBACK, only the timer resumes sending.
+void send() {
+    timer.stop();
+    if (!active) {
+        return;
+    }
 
-void send(TaskPtr ptr, FlagPtr flag_ptr) {
-    auto& task = *ptr;
-    if (!mqttConnected() || task.done()) {
-        stop(true);
+    if (!mqttConnected()) {
+        finish(messages.size());
         return;
     }
 
-    auto& flag = *flag_ptr;
-    if (!flag) {
-        if (task.retry()) {
-            schedule(ptr, flag_ptr);
-        } else {
-            stop(false);
+    const auto now = espurna::time::CoreClock::now();
+
+    auto wait = Timeout;
+    size_t published { 0 };
+    size_t failed { 0 };
+    bool busy { false };
+
+    for (size_t index = 0; index < messages.size(); ++index) {
+        auto& message = messages[index];
+        if ((message.status == Message::Status::Sent) && (now - message.sent > Timeout)) {
+            --in_flight;
+            retry(message);
+        }
+
+        if ((message.status == Message::Status::Pending)
+            && (wait != WaitLong)
+            && (in_flight < build::window())
+            && (published < build::window()))
+        {
+            if (publish(index, now)) {
+                ++published;
+            } else {
+                retry(message);
+                wait = WaitLong;
+            }
+        }
+
+        switch (message.status) {
+        case Message::Status::Pending:
+        case Message::Status::Sent:
+            busy = true;
+            break;
+        case Message::Status::Failed:
+            ++failed;
+            break;
+        case Message::Status::Done:
+            break;
         }
-        return;
     }
 
-    uint16_t pid { 0u };
-    auto res = task.send([&](const char* topic, const char* message) {
-        pid = ::mqttSendRaw(topic, message, internal::retain, 1);
-        return pid > 0;
-    });
+    if (!busy) {
+        finish(failed);
+        return;
+    }
 
-#if MQTT_LIBRARY == MQTT_LIBRARY_ASYNCMQTTCLIENT
-    // - async fails when disconneted and when it's buffers are filled, which should be resolved after $LATENCY
-    // and the time it takes for the lwip to process it. future versions use queue, but could still fail when low on RAM
-    // - lwmqtt will fail when disconnected (already checked above) and *will* disconnect in case publish fails.
-    // ::publish() will wait for the puback, so we don't have to do it ourselves. not tested.
-    // - pubsub will fail when it can't buffer the payload *or* the underlying WiFiClient calls fail. also not tested.
-
-    if (res) {
-        flag = false;
-        mqttOnPublish(pid, [flag_ptr]() {
-            (*flag_ptr) = true;
-        });
+    if (!in_flight && (wait != WaitLong)) {
+        wait = WaitShort;
     }
-#endif
 
-    auto wait = res
-        ? DiscoveryTask::WaitShort
-        : DiscoveryTask::WaitLong;
+    timer.once(wait, send);
+}
 
-    if (res || task.retry()) {
-        schedule(wait, ptr, flag_ptr);
-        return;
+void invalidate() {
+    if (active) {
+        stop();
+        state = State::Pending;
     }
 
-    stop(false);
+    Messages().swap(messages);
 }
 
 } // namespace internal
 
 void publishDiscovery() {
-    if (!mqttConnected() || internal::timer.active() || (internal::state != internal::State::Pending)) {
+    if (!mqttConnected() || internal::active || (internal::state != internal::State::Pending)) {
         return;
     }
 
-    auto task = std::make_shared<DiscoveryTask>(internal::enabled);
-
-#if LIGHT_PROVIDER != LIGHT_PROVIDER_NONE
-    task->add<LightDiscovery>();
-#endif
-#if RELAY_SUPPORT
-    task->add<RelayDiscovery>();
-#endif
-#if SENSOR_SUPPORT
-    task->add<SensorDiscovery>();
-#endif
+    if (internal::messages.empty()) {
+        internal::messages = internal::serialize();
+    }
 
-    // only happens when nothing is configured to do the add()
-    if (task->done()) {
+    // only happens when nothing is configured
+    if (internal::messages.empty()) {
         return;
     }
 
-    internal::schedule(task);
+    for (auto& message : internal::messages) {
+        message.status = Message::Status::Pending;
+        message.pid = 0;
+        message.retries = 0;
+    }
+
+    ++internal::generation;
+    internal::in_flight = 0;
+    internal::active = true;
+
+    internal::send();
 }
 
 void configure() {
@@ -935,6 +1009,8 @@ void configure() {
     internal::enabled = settings::enabled();
     internal::retain = settings::retain();
 
+    internal::invalidate();
+
     if (internal::enabled != current) {
         internal::state = internal::State::Pending;
     }
@@ -947,7 +1023,10 @@ void mqttCallback(unsigned int type, const char* topic, char* payload) {
         if (internal::state == internal::State::Sent) {
             internal::state = internal::State::Pending;
         }
-        internal::timer.detach();
+        if (internal::active) {
+            internal::stop();
+            internal::state = internal::State::Pending;
+        }
         return;
     }
 
@@ -1016,6 +1095,7 @@ void haSetup() {
 
 #if TERMINAL_SUPPORT
     terminalRegisterCommand(F("HA.SEND"), [](::terminal::CommandContext&& ctx) {
+        homeassistant::internal::invalidate();
         homeassistant::internal::state = homeassistant::internal::State::Pending;
         homeassistant::publishDiscovery();
         terminalOK(ctx);
@@ -0,0 +1,329 @@
+/*
+
+HTTP CLIENT MODULE
+
+*/
+
+#include "espurna.h"
+
+#if HTTP_CLIENT_SUPPORT
+
+#include "http_client.h"
+
+#include <ESPAsyncTCP.h>
+#include "libs/AsyncClientHelpers.h"
+
+#include <memory>
+#include <vector>
+
+namespace espurna {
+namespace http {
+namespace client {
+namespace {
+
+using TimeSource = espurna::time::CoreClock;
+
+namespace build {
+
+static constexpr size_t Connections { HTTP_CLIENT_CONNECTIONS };
+static constexpr size_t Pipeline { HTTP_CLIENT_PIPELINE };
+static constexpr size_t Queue { HTTP_CLIENT_QUEUE };
+
+static constexpr auto Timeout = espurna::duration::Milliseconds(HTTP_CLIENT_TIMEOUT);
+static constexpr auto KeepAlive = espurna::duration::Milliseconds(HTTP_CLIENT_KEEPALIVE);
+
+} // namespace build
+
+// Connection object is only removed from the main loop and only when it is already disconnected,
+// since AsyncClient destructor would call the disconnect callback otherwise
+class Connection {
+public:
+    Connection(String host, uint16_t port, bool secure) :
+        _host(std::move(host)),
+        _port(port),
+        _secure(secure),
+        _pipeline(build::Pipeline)
+    {
+        _client.onConnect(_onConnect, this);
+        _client.onDisconnect(_onDisconnect, this);
+        _client.onTimeout(_onTimeout, this);
+        _client.onAck(_onAck, this);
+        _client.onData(_onData, this);
+    }
+
+    Connection(const Connection&) = delete;
+    Connection& operator=(const Connection&) = delete;
+
+    bool matches(const String& host, uint16_t port, bool secure) const {
+        return (_port == port) && (_secure == secure) && _host.equals(host);
+    }
+
+    bool idle() const {
+        return _pipeline.idle();
+    }
+
+    bool removable() const {
+        return (_state == AsyncClientState::Disconnected) && _pipeline.idle();
+    }
+
+    bool push(Request&& request) {
+        if (_pipeline.size() >= build::Queue) {
+            return false;
+        }
+
+        _pipeline.push(std::move(request));
+        if (_state == AsyncClientState::Connected) {
+            send();
+        }
+
+        return true;
+    }
+
+    void close() {
+        if (_state == AsyncClientState::Connected) {
+            _state = AsyncClientState::Disconnecting;
+            _client.close();
+        }
+    }
+
+    void loop(TimeSource::time_point now) {
+        switch (_state) {
+        case AsyncClientState::Disconnected:
+            if (!_pipeline.idle()) {
+                connect(now);
+            }
+            break;
+
+        case AsyncClientState::Connecting:
+            if (now - _last > build::Timeout) {
+                abort(Error::Timeout);
+            }
+            break;
+
+        case AsyncClientState::Connected:
+            if (_pipeline.in_flight() && (now - _last > build::Timeout)) {
+                abort(Error::Timeout);
+            } else if (_pipeline.closing() && !_pipeline.in_flight()) {
+                close();
+            } else if (_pipeline.idle() && (now - _last > build::KeepAlive)) {
+                DEBUG_MSG_P(PSTR("[HTTP] Closing idle connection to %s:%hu\n"),
+                    _host.c_str(), _port);
+                close();
+            } else {
+                send();
+            }
+            break;
+
+        case AsyncClientState::Disconnecting:
+            break;
+        }
+    }
+
+private:
+    void connect(TimeSource::time_point now) {
+        _last = now;
+        _error = Error::Closed;
+        _state = AsyncClientState::Connecting;
+
+#if ASYNC_TCP_SSL_ENABLED
+        const bool result = _client.connect(_host.c_str(), _port, _secure);
+#else
+        const bool result = !_secure && _client.connect(_host.c_str(), _port);
+#endif
+
+        if (!result) {
+            DEBUG_MSG_P(PSTR("[HTTP] Connection to %s:%hu failed\n"),
+                _host.c_str(), _port);
+            _state = AsyncClientState::Disconnected;
+            _pipeline.abort(Error::Connection);
+        }
+    }
+
+    void abort(Error error) {
+        _error = error;
+        _client.close(true);
+    }
+
+    void send() {
+        _pipeline.send(_client);
+        if (_pipeline.broken()) {
+            abort(Error::Body);
+        }
+    }
+
+    void onConnect() {
+        DEBUG_MSG_P(PSTR("[HTTP] Connected to %s:%hu\n"),
+            _host.c_str(), _port);
+
+        _last = TimeSource::now();
+        _state = AsyncClientState::Connected;
+        send();
+    }
+
+    // Anything sent but not answered is repeated through the next connection, unless it was already retried
+    void onDisconnect() {
+        const auto state = _state;
+        _state = AsyncClientState::Disconnected;
+
+        if (state == AsyncClientState::Connecting) {
+            DEBUG_MSG_P(PSTR("[HTTP] Could not connect to %s:%hu\n"),
+                _host.c_str(), _port);
+            _pipeline.abort(Error::Connection);
+            return;
+        }
+
+        DEBUG_MSG_P(PSTR("[HTTP] Disconnected from %s:%hu\n"),
+            _host.c_str(), _port);
+        _pipeline.closed(_error);
+        _error = Error::Closed;
+    }
+
+    void onTimeout(uint32_t time) {
+        DEBUG_MSG_P(PSTR("[HTTP] Network timeout after %ums\n"), time);
+        abort(Error::Timeout);
+    }
+
+    void onAck() {
+        _last = TimeSource::now();
+        if (_state == AsyncClientState::Connected) {
+            send();
+        }
+    }
+
+    void onData(const uint8_t* data, size_t size) {
+        _last = TimeSource::now();
+
+        _pipeline.receive(data, size);
+        if (_pipeline.broken()) {
+            abort(Error::Response);
+            return;
+        }
+
+        if (_pipeline.closing()) {
+            if (!_pipeline.in_flight()) {
+                close();
+            }
+            return;
+        }
+
+        send();
+    }
+
+    static void _onConnect(void* ptr, AsyncClient*) {
+        reinterpret_cast<Connection*>(ptr)->onConnect();
+    }
+
+    static void _onDisconnect(void* ptr, AsyncClient*) {
+        reinterpret_cast<Connection*>(ptr)->onDisconnect();
+    }
+
+    static void _onTimeout(void* ptr, AsyncClient*, uint32_t time) {
+        reinterpret_cast<Connection*>(ptr)->onTimeout(time);
+    }
+
+    static void _onAck(void* ptr, AsyncClient*, size_t, uint32_t) {
+        reinterpret_cast<Connection*>(ptr)->onAck();
+    }
+
+    static void _onData(void* ptr, AsyncClient*, void* data, size_t size) {
+        reinterpret_cast<Connection*>(ptr)->onData(reinterpret_cast<const uint8_t*>(data), size);
+    }
+
+    String _host;
+    uint16_t _port;
+    bool _secure;
+
+    AsyncClient _client;
+    AsyncClientState _state { AsyncClientState::Disconnected };
+
+    Pipeline _pipeline;
+    Error _error { Error::Closed };
+    TimeSource::time_point _last;
+};
+
+using ConnectionPtr = std::unique_ptr<Connection>;
+
+namespace internal {
+
+std::vector<ConnectionPtr> connections;
+
+} // namespace internal
+
+// When there are no free slots, idle connection is closed and the slot is available
+// after it is removed from the loop
+Connection* connection(const String& host, uint16_t port, bool secure) {
+    for (auto& connection : internal::connections) {
+        if (connection->matches(host, port, secure)) {
+            return connection.get();
+        }
+    }
+
+    if (internal::connections.size() >= build::Connections) {
+        for (auto& connection : internal::connections) {
+            if (connection->idle()) {
+                connection->close();
+                break;
+            }
+        }
+
+        return nullptr;
+    }
+
+    internal::connections.push_back(
+        std::make_unique<Connection>(host, port, secure));
+    return internal::connections.back().get();
+}
+
+bool send(const String& host, uint16_t port, bool secure, Request&& request) {
+    auto* ptr = connection(host, port, secure);
+    if (!ptr) {
+        return false;
+    }
+
+    return ptr->push(std::move(request));
+}
+
+void loop() {
+    if (internal::connections.empty()) {
+        return;
+    }
+
+    const auto now = TimeSource::now();
+    for (auto& connection : internal::connections) {
+        connection->loop(now);
+    }
+
+    internal::connections.erase(
+        std::remove_if(
+            internal::connections.begin(),
+            internal::connections.end(),
+            [](const ConnectionPtr& connection) {
+                return connection->removable();
+            }),
+        internal::connections.end());
+}
+
+void setup() {
+    internal::connections.reserve(build::Connections);
+    espurnaRegisterLoop(loop);
+}
+
+} // namespace
+} // namespace client
+} // namespace http
+} // namespace espurna
+
+bool httpClientSend(const String& host, uint16_t port, espurna::http::Request&& request) {
+    return espurna::http::client::send(host, port, false, std::move(request));
+}
+
+bool httpClientSend(const URL& url, espurna::http::Request&& request) {
+    return espurna::http::client::send(url.host, url.port,
+        url.protocol.equals(F("https")), std::move(request));
+}
+
+void httpClientSetup() {
+    espurna::http::client::setup();
+}
+
+#endif // HTTP_CLIENT_SUPPORT
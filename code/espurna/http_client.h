@@ -0,0 +1,19 @@
+/*
+
+HTTP CLIENT MODULE
+
+*/
+
+#pragma once
+
+#include <Arduino.h>
+
+#include "libs/HttpClient.h"
+#include "libs/URL.h"
+
+// Request is queued in the connection to the host:port, which is kept open and re-used by the following requests.
+// Returns false when request could not be queued right now (too many connections or requests), caller should retry later
+bool httpClientSend(const String& host, uint16_t port, espurna::http::Request&&);
+bool httpClientSend(const URL&, espurna::http::Request&&);
+
+void httpClientSetup();
@@ -127,9 +127,9 @@ void report(FanSpeed speed [[gnu::unused]]) {
 }
 
 void save(FanSpeed speed) {
-    static Ticker ticker;
+    static espurna::timer::SystemTimer timer { "ifan" };
     config.speed = speed;
-    ticker.once_ms(config.save, []() {
+    timer.once(espurna::duration::Milliseconds(config.save), []() {
         auto value = speedToPayload(config.speed);
         setSetting("fanSpeed", value);
         DEBUG_MSG_P(PSTR("[IFAN] Saved speed setting \"%s\"\n"), value.c_str());
@@ -21,114 +21,26 @@ Copyright (C) 2017-2019 by Xose Pérez <xose dot perez at gmail dot com>
 #include "terminal.h"
 #include "ws.h"
 
-#include <ESPAsyncTCP.h>
-#include "libs/AsyncClientHelpers.h"
+#include "http_client.h"
 
-const char InfluxDb_http_success[] = "HTTP/1.1 204";
-const char InfluxDb_http_template[] PROGMEM = "POST /write?db=%s&u=%s&p=%s HTTP/1.1\r\nHost: %s:%u\r\nContent-Length: %d\r\n\r\n";
+constexpr int InfluxDb_http_success { 204 };
+constexpr size_t InfluxDbBufferSize { 256 };
 
-class AsyncInfluxDB : public AsyncClient {
-    public:
-
-    constexpr static const unsigned long ClientTimeout = 5000;
-    constexpr static const size_t DataBufferSize = 256;
-
-    AsyncClientState state = AsyncClientState::Disconnected;
-    String host;
-    uint16_t port = 0;
+// Connection is shared with other modules, requests are pipelined when server allows it
+constexpr size_t InfluxDbPendingMax { HTTP_CLIENT_PIPELINE };
+constexpr unsigned long InfluxDbRetryInterval { 1000 };
 
+// Values are only kept until the next flush, request body is built from them
+struct InfluxDbClient {
     std::map<String, String> values;
-    String payload;
 
     bool flush = false;
+    size_t pending = 0;
     uint32_t timestamp = 0;
 };
 
 bool _idb_enabled = false;
-std::unique_ptr<AsyncInfluxDB> _idb_client = nullptr;
-
-// -----------------------------------------------------------------------------
-
-void _idbInitClient() {
-
-    _idb_client = std::make_unique<AsyncInfluxDB>();
-
-    _idb_client->payload.reserve(AsyncInfluxDB::DataBufferSize);
-
-    _idb_client->onDisconnect([](void * s, AsyncClient * ptr) {
-        auto *client = reinterpret_cast<AsyncInfluxDB*>(ptr);
-        DEBUG_MSG_P(PSTR("[INFLUXDB] Disconnected\n"));
-        client->flush = false;
-        client->payload = "";
-        client->timestamp = 0;
-        client->state = AsyncClientState::Disconnected;
-    }, nullptr);
-
-    _idb_client->onTimeout([](void * s, AsyncClient * client, uint32_t time) {
-        DEBUG_MSG_P(PSTR("[INFLUXDB] Network timeout after %ums\n"), time);
-        client->close(true);
-    }, nullptr);
-
-    _idb_client->onData([](void * arg, AsyncClient * ptr, void * response, size_t len) {
-        // ref: https://docs.influxdata.com/influxdb/v1.7/tools/api/#summary-table-1
-        auto *client = reinterpret_cast<AsyncInfluxDB*>(ptr);
-        if (client->state == AsyncClientState::Connected) {
-            client->state = AsyncClientState::Disconnecting;
-
-            const bool result = (len > sizeof(InfluxDb_http_success) && (0 == strncmp((char*) response, InfluxDb_http_success, strlen(InfluxDb_http_success))));
-            DEBUG_MSG_P(PSTR("[INFLUXDB] %s response after %ums\n"), result ? "Success" : "Failure", millis() - client->timestamp);
-
-            client->timestamp = millis();
-            client->close();
-        }
-    }, nullptr);
-
-    _idb_client->onPoll([](void * arg, AsyncClient * ptr) {
-        auto *client = reinterpret_cast<AsyncInfluxDB*>(ptr);
-        unsigned long ts = millis() - client->timestamp;
-        if (ts > AsyncInfluxDB::ClientTimeout) {
-            DEBUG_MSG_P(PSTR("[INFLUXDB] No response after %ums\n"), ts);
-            client->close(true);
-            return;
-        }
-
-        if (client->payload.length()) {
-            client->write(client->payload.c_str(), client->payload.length());
-            client->payload = "";
-        }
-    });
-
-    _idb_client->onConnect([](void * arg, AsyncClient * ptr) {
-
-        auto *client = reinterpret_cast<AsyncInfluxDB*>(ptr);
-
-        client->timestamp = millis();
-        client->state = AsyncClientState::Connected;
-
-        DEBUG_MSG_P(PSTR("[INFLUXDB] Connected to %s:%u\n"),
-            IPAddress(client->getRemoteAddress()).toString().c_str(),
-            client->getRemotePort()
-        );
-
-        constexpr const int BUFFER_SIZE = 256;
-        char headers[BUFFER_SIZE];
-        int len = snprintf_P(headers, sizeof(headers), InfluxDb_http_template,
-            getSetting("idbDatabase", INFLUXDB_DATABASE).c_str(),
-            getSetting("idbUsername", INFLUXDB_USERNAME).c_str(),
-            getSetting("idbPassword", INFLUXDB_PASSWORD).c_str(),
-            client->host.c_str(), client->port, client->payload.length()
-        );
-        if ((len < 0) || (len > BUFFER_SIZE - 1)) {
-            client->close(true);
-            return;
-        }
-
-        client->write(headers, len);
-
-    });
-
-}
-
+std::unique_ptr<InfluxDbClient> _idb_client = nullptr;
 
 // -----------------------------------------------------------------------------
 
@@ -155,7 +67,7 @@ void _idbConfigure() {
         _idb_enabled = false;
         setSetting("idbEnabled", 0);
     }
-    if (_idb_enabled && !_idb_client) _idbInitClient();
+    if (_idb_enabled && !_idb_client) _idb_client = std::make_unique<InfluxDbClient>();
 }
 
 void _idbSendSensor(const espurna::sensor::Value& value) {
@@ -170,7 +82,6 @@ void _idbSendStatus(size_t id, bool status) {
 
 bool idbSend(const char * topic, const char * payload) {
     if (!_idb_enabled) return false;
-    if (_idb_client->state != AsyncClientState::Disconnected) return false;
 
     _idb_client->values[topic] = payload;
     _idb_client->flush = true;
@@ -178,35 +89,49 @@ bool idbSend(const char * topic, const char * payload) {
     return true;
 }
 
-void _idbSend(const String& host, const uint16_t port) {
-    if (_idb_client->state != AsyncClientState::Disconnected) return;
-
+bool _idbSend(const String& host, const uint16_t port, String&& payload) {
     DEBUG_MSG_P(PSTR("[INFLUXDB] Sending to %s:%u\n"), host.c_str(), port);
 
-    // TODO: cache `Host: <host>:<port>` header instead of storing things separately?
-    _idb_client->host = host;
-    _idb_client->port = port;
-    _idb_client->timestamp = millis();
-    _idb_client->state = _idb_client->connect(host.c_str(), port)
-        ? AsyncClientState::Connecting
-        : AsyncClientState::Disconnected;
-
-    if (_idb_client->state == AsyncClientState::Disconnected) {
-        DEBUG_MSG_P(PSTR("[INFLUXDB] Connection to %s:%u failed\n"), host.c_str(), port);
-        _idb_client->close(true);
-    }
+    String path;
+    path.reserve(64);
+    path += F("/write?db=");
+    path += getSetting("idbDatabase", INFLUXDB_DATABASE);
+    path += F("&u=");
+    path += getSetting("idbUsername", INFLUXDB_USERNAME);
+    path += F("&p=");
+    path += getSetting("idbPassword", INFLUXDB_PASSWORD);
+
+    espurna::http::Request request;
+    request.head = espurna::http::Head("POST", host, port, path)
+        .finish(payload.length());
+    request.body_size = payload.length();
+    request.body = espurna::http::body(std::move(payload));
+
+    // ref: https://docs.influxdata.com/influxdb/v1.7/tools/api/#summary-table-1
+    const auto timestamp = millis();
+    request.on_complete = [timestamp](int status, espurna::http::Error) {
+        DEBUG_MSG_P(PSTR("[INFLUXDB] %s response after %ums (%d)\n"),
+            (status == InfluxDb_http_success) ? "Success" : "Failure",
+            millis() - timestamp, status);
+        if (_idb_client && _idb_client->pending) {
+            --_idb_client->pending;
+        }
+    };
+
+    return httpClientSend(host, port, std::move(request));
 }
 
 void _idbFlush() {
     // Clean-up client object when not in use
-    if (_idb_client && !_idb_enabled && (_idb_client->state == AsyncClientState::Disconnected)) {
+    if (_idb_client && !_idb_enabled && !_idb_client->pending) {
         _idb_client = nullptr;
     }
 
-    // Wait until current connection is finished
+    // Wait until some of the requests are finished
     if (!_idb_client) return;
     if (!_idb_client->flush) return;
-    if (_idb_client->state != AsyncClientState::Disconnected) return;
+    if (_idb_client->pending >= InfluxDbPendingMax) return;
+    if (_idb_client->timestamp && (millis() - _idb_client->timestamp < InfluxDbRetryInterval)) return;
 
     // Wait until connected
     if (!wifiConnected()) return;
@@ -218,27 +143,32 @@ void _idbFlush() {
     //       note that we also send heartbeat data, persistent values should be flagged
     const String device = getHostname();
 
-    _idb_client->payload = "";
-    for (auto& pair : _idb_client->values) {
-        if (!isNumber(pair.second)) {
-            String quoted;
-            quoted.reserve(pair.second.length() + 2);
-            quoted += '"';
-            quoted += pair.second;
-            quoted += '"';
-            pair.second = quoted;
-        }
+    String payload;
+    payload.reserve(InfluxDbBufferSize);
+
+    for (const auto& pair : _idb_client->values) {
+        const char* quote = isNumber(pair.second) ? "" : "\"";
 
         char buffer[128] = {0};
         snprintf_P(buffer, sizeof(buffer),
-            PSTR("%s,device=%s value=%s\n"),
-            pair.first.c_str(), device.c_str(), pair.second.c_str()
+            PSTR("%s,device=%s value=%s%s%s\n"),
+            pair.first.c_str(), device.c_str(),
+            quote, pair.second.c_str(), quote
         );
-        _idb_client->payload += buffer;
+        payload += buffer;
     }
-    _idb_client->values.clear();
 
-    _idbSend(host, port);
+    // Values are kept when the request could not be queued, try again a bit later
+    if (!_idbSend(host, port, std::move(payload))) {
+        DEBUG_MSG_P(PSTR("[INFLUXDB] Connection to %s:%u is busy\n"), host.c_str(), port);
+        _idb_client->timestamp = millis();
+        return;
+    }
+
+    ++_idb_client->pending;
+    _idb_client->timestamp = 0;
+    _idb_client->values.clear();
+    _idb_client->flush = false;
 }
 
 bool idbSend(const char * topic, unsigned char id, const char * payload) {
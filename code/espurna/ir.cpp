@@ -29,6 +29,8 @@ $ pio run -e ... \
 #include "relay.h"
 #include "terminal.h"
 
+#include "libs/IrCodes.h"
+
 #include <IRremoteESP8266.h>
 #include <IRrecv.h>
 #include <IRsend.h>
@@ -36,6 +38,7 @@ $ pio run -e ... \
 
 #include <cstdint>
 #include <cstring>
+#include <limits>
 #include <queue>
 #include <vector>
 
@@ -746,6 +749,103 @@ Payload prepare(StringView frequency, StringView series, StringView delay, declt
 
 #include "ir_parse_raw.re.ipp"
 
+// Compact alternative to the list of timings, see libs/IrCodes.h for the format
+//
+// Transmitting:
+//   Payload: <frequency>:<series>:<delay>:@<packed>
+//
+// Receiving:
+//   Payload: @<packed>
+//
+// Packed timings are in ticks (2μs), the same values that are stored in the receiver buffer
+
+namespace packed {
+
+constexpr char Marker { '@' };
+constexpr size_t Limit { 1024 };
+
+template <typename T>
+String encode(T& result) {
+    auto raw = result.raw();
+
+    std::vector<uint8_t> data;
+    codes::packed::encode(raw.begin(), raw.end(),
+        [&](uint8_t byte) {
+            data.push_back(byte);
+        });
+
+    String out;
+    out.reserve(1 + (((data.size() + 2) / 3) * 4));
+    out += Marker;
+
+    codes::packed::base64(data.data(), data.size(),
+        [&](const char* chunk, size_t length) {
+            for (size_t index = 0; index < length; ++index) {
+                out += chunk[index];
+            }
+        });
+
+    return out;
+}
+
+ParseResult<Payload> parse(StringView view) {
+    ParseResult<Payload> out;
+
+    const char* options[4] { view.begin() };
+    for (size_t index = 1; index < std::size(options); ++index) {
+        const char* sep = std::find(options[index - 1], view.end(), ':');
+        if ((sep == options[index - 1]) || (sep == view.end())) {
+            return out;
+        }
+
+        options[index] = sep + 1;
+    }
+
+    const char* ptr = options[3];
+    if ((ptr == view.end()) || (*ptr != Marker)) {
+        return out;
+    }
+
+    std::vector<uint8_t> data;
+    if (!codes::packed::unbase64(ptr + 1, view.end(), data)) {
+        return out;
+    }
+
+    decltype(Payload::time) time;
+    if (!codes::packed::decode(data.data(), data.size(), Limit, time) || time.empty()) {
+        return out;
+    }
+
+    static_assert((kRawTick == 2), "");
+    for (auto& value : time) {
+        if (value > (std::numeric_limits<uint16_t>::max() / kRawTick)) {
+            return out;
+        }
+
+        value *= kRawTick;
+    }
+
+    out = prepare(
+        StringView{options[0], options[1] - 1},
+        StringView{options[1], options[2] - 1},
+        StringView{options[2], options[3] - 1},
+        std::move(time));
+
+    return out;
+}
+
+} // namespace packed
+
+// Generated parser only handles the list of timings
+ParseResult<Payload> parse_any(StringView view) {
+    auto out = packed::parse(view);
+    if (out) {
+        return out;
+    }
+
+    return parse(view);
+}
+
 } // namespace raw
 
 // TODO: current solution works directly with the internal 'u8 state[]', both for receiving and sending
@@ -1206,6 +1306,11 @@ constexpr bool rxRaw() {
     return IR_RX_RAW_MQTT == 1;
 }
 
+// (optional) RAW rx output as the packed timings, instead of the comma-separated list
+constexpr bool rxRawPacked() {
+    return IR_RX_RAW_MQTT_PACKED == 1;
+}
+
 // (optional) enables MQTT state rx output (commonly, HVAC remotes, or anything that has payload larger than 64bit)
 // (*may need* increased timeout setting for the receiver, so it could buffer very large messages consistently and not lose some of the parts)
 // (*requires* increase buffer size. but, depends on the protocol, so adjust accordingly)
@@ -1251,6 +1356,10 @@ bool rxRaw() {
     return getSetting("irRxMqttRaw", build::rxRaw());
 }
 
+bool rxRawPacked() {
+    return getSetting("irRxMqttRawPack", build::rxRawPacked());
+}
+
 bool rxState() {
     return getSetting("irRxMqttState", build::rxState());
 }
@@ -1260,6 +1369,7 @@ bool rxState() {
 namespace internal {
 
 bool publish_raw { build::rxRaw() };
+bool publish_raw_packed { build::rxRawPacked() };
 bool publish_simple { build::rxSimple() };
 bool publish_state { build::rxState() };
 
@@ -1281,7 +1391,7 @@ void callback(unsigned int type, const char* topic, char* payload) {
         } else if (t.equals(build::topicTxState())) {
             ir::tx::enqueue(ir::state::parse(view));
         } else if (t.equals(build::topicTxRaw())) {
-            ir::tx::enqueue(ir::raw::parse(view));
+            ir::tx::enqueue(ir::raw::parse_any(view));
         }
 
         break;
@@ -1300,12 +1410,16 @@ void process(rx::DecodeResult& result) {
     }
 
     if (internal::publish_raw) {
-        ::mqttSend(build::topicRxRaw(), espurna::ir::raw::payload::encode(result).c_str());
+        const auto payload = internal::publish_raw_packed
+            ? espurna::ir::raw::packed::encode(result)
+            : espurna::ir::raw::payload::encode(result);
+        ::mqttSend(build::topicRxRaw(), payload.c_str());
     }
 }
 
 void configure() {
     internal::publish_raw = settings::rxRaw();
+    internal::publish_raw_packed = settings::rxRawPacked();
     internal::publish_simple = settings::rxSimple();
     internal::publish_state = settings::rxState();
 }
@@ -1531,6 +1645,14 @@ Preset preset() {
 
 namespace internal {
 
+alignas(4) static constexpr char Command[] PROGMEM = "irCmd";
+
+// Preset entries are indexed by their position in the preset array.
+// Every settings command shares a single index, the key is then read using the received value
+static constexpr uint16_t Setting { codes::Dictionary::None - 1 };
+
+codes::Dictionary dictionary;
+
 void inject(String command) {
     terminalInject(command.c_str(), command.length());
     if (!command.endsWith("\r\n") && !command.endsWith("\n")) {
@@ -1540,25 +1662,54 @@ void inject(String command) {
 
 } // namespace internal
 
-void process(rx::DecodeResult& result) {
-    auto value = ir::simple::value::encode(result.value());
+// Every known value is indexed when the module is (re)configured, so the received value
+// is looked up directly instead of being compared with every preset and settings key.
+void configure() {
+    std::vector<std::pair<uint64_t, uint16_t>> values;
 
 #if IR_RX_PRESET != 0
     auto preset = build::preset();
-    if (preset.begin && preset.end && (preset.begin != preset.end)) {
-        for (auto* it = preset.begin; it != preset.end; ++it) {
-            String other((*it).value);
-            if (other == value) {
-                internal::inject((*it).command);
-                return;
+    for (auto* it = preset.begin; it != preset.end; ++it) {
+        const String value((*it).value);
+        values.emplace_back(
+            ir::simple::value::decode(StringView{value}),
+            static_cast<uint16_t>(it - preset.begin));
+    }
+#endif
+
+    // key is expected to be exactly the same as the encoded value
+    espurna::settings::foreach_prefix(
+        [&](StringView prefix, String key, const espurna::settings::kvs_type::ReadResult&) {
+            const auto value = ir::simple::value::decode(
+                StringView{key.c_str() + prefix.length(), key.c_str() + key.length()});
+            if (ir::simple::value::encode(value).equals(key.c_str() + prefix.length())) {
+                values.emplace_back(value, internal::Setting);
             }
-        }
+        },
+        {internal::Command});
+
+    internal::dictionary.reset(values.size());
+    for (const auto& value : values) {
+        internal::dictionary.insert(value.first, value.second);
+    }
+}
+
+void process(rx::DecodeResult& result) {
+    const auto index = internal::dictionary.find(result.value());
+    if (index == codes::Dictionary::None) {
+        return;
+    }
+
+#if IR_RX_PRESET != 0
+    if (index != internal::Setting) {
+        internal::inject(build::preset().begin[index].command);
+        return;
     }
 #endif
 
     String key;
-    key += F("irCmd");
-    key += value;
+    key += FPSTR(internal::Command);
+    key += ir::simple::value::encode(result.value());
 
     const auto cmd = espurna::settings::get(key);
     if (cmd) {
@@ -1583,7 +1734,7 @@ void setup() {
                 return;
             }
 
-            auto raw = ir::raw::parse(view);
+            auto raw = ir::raw::parse_any(view);
             if (ir::tx::enqueue(std::move(raw))) {
                 terminalOK(ctx);
                 return;
@@ -1708,6 +1859,9 @@ void configure() {
 #if MQTT_SUPPORT
     mqtt::configure();
 #endif
+#if TERMINAL_SUPPORT
+    terminal::configure();
+#endif
 }
 
 void setup() {
@@ -2101,6 +2255,23 @@ void setup() {
         IR_TEST_RUNNER() {
             const uint16_t raw[] {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16};
             IR_TEST(raw::time::encode(std::begin(raw), std::end(raw)) == F("2,4,6,8,10,12,14,16,18,20,22,24,26,28,30,32"));
+        },
+        IR_TEST_RUNNER() {
+            IR_TEST(!raw::packed::parse("38:1:500:100,200,150,250"));
+            IR_TEST(!raw::packed::parse("38:1:500:@BDLIAUv6"));
+        },
+        IR_TEST_RUNNER() {
+            auto result = raw::parse_any("38:1:500:@BDLIAUv6AQ==");
+            IR_TEST(result.has_value());
+
+            auto& payload = result.value();
+            IR_TEST(payload.frequency == 38);
+            IR_TEST(payload.series == 1);
+            IR_TEST(payload.delay == 500);
+
+            decltype(raw::Payload::time) expected_time {
+                100, 200, 150, 250};
+            IR_TEST(expected_time == payload.time);
         }
     }
     IR_TEST_SETUP_END();
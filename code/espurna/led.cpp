@@ -139,6 +139,11 @@ struct Pattern {
         return _delays;
     }
 
+    // Time until the next toggle, only valid when the pattern is started
+    Delay::Duration remaining() const {
+        return _cycle.remaining();
+    }
+
     template <typename Status, typename Last>
     void run(Status&& status, Last&& last) {
         if (!_sequence) {
@@ -267,6 +272,13 @@ private:
             return (Delay::Source::now() - _last > _delay);
         }
 
+        Delay::Duration remaining() const {
+            const auto elapsed = Delay::Source::now() - _last;
+            return (elapsed > _delay)
+                ? Delay::Duration::min()
+                : (_delay - elapsed);
+        }
+
     private:
         Delay::TimePoint _last;
         Delay::Duration _delay;
@@ -337,6 +349,10 @@ struct Led {
             [&]() {
                 status(false);
             });
+
+        if (_pattern.started()) {
+            espurnaLoopDeadline(_pattern.remaining());
+        }
     }
 
 private:
@@ -805,9 +821,13 @@ void run(Led& led, const Delay& delay) {
     static auto delay_for = delay.on();
 
     const auto clock_current = TimeSource::now();
-    if (clock_current - clock_last >= delay_for) {
+    const auto elapsed = clock_current - clock_last;
+    if (elapsed >= delay_for) {
         delay_for = led.toggle() ? delay.on() : delay.off();
         clock_last = clock_current;
+        espurnaLoopDeadline(delay_for);
+    } else {
+        espurnaLoopDeadline(delay_for - elapsed);
     }
 }
 
@@ -88,6 +88,34 @@ class EventEmitter {
         types::Event loop();
         bool isPressed();
 
+        // Edge-driven alternative to the loop(), where pin is never read directly.
+        // Edges are expected to be recorded elsewhere (e.g. by the GPIO interrupt handler) as the
+        // millis() timestamp and the pin value right after the change. Every resulting event is
+        // passed to the callback as (event, count, length), since there could be more than one
+        template <typename T>
+        void edge(unsigned long timestamp, bool value, T&& callback) {
+            update(timestamp, callback);
+            _pending = (value != _value);
+            _pending_timestamp = timestamp;
+        }
+
+        // Edge is only accepted when the pin value did not change again during the debounce delay.
+        // Pushbutton release is only reported after the repeat delay, same as with the loop()
+        template <typename T>
+        void update(unsigned long now, T&& callback) {
+            if (_pending && ((now - _pending_timestamp) >= _delay)) {
+                _pending = false;
+                _emit(_release(_pending_timestamp), callback);
+                _emit(_change(_pending_timestamp), callback);
+            }
+
+            _emit(_release(_pending ? _pending_timestamp : now), callback);
+        }
+
+        // Time until update() has something to do, or `Idle` when there is nothing pending
+        static constexpr unsigned long Idle { static_cast<unsigned long>(-1) };
+        unsigned long remaining(unsigned long now) const;
+
         const BasePinPtr& pin() const;
         const types::Config& config() const;
 
@@ -95,6 +123,16 @@ class EventEmitter {
         unsigned long getEventCount();
 
     private:
+        types::Event _change(unsigned long timestamp);
+        types::Event _release(unsigned long timestamp);
+
+        template <typename T>
+        void _emit(types::Event event, T& callback) {
+            if (event != types::EventNone) {
+                callback(event, _event_count, _event_length);
+            }
+        }
+
         BasePinPtr _pin;
         types::EventHandler _callback;
 
@@ -115,6 +153,9 @@ class EventEmitter {
         unsigned long _event_length { 0ul };
         unsigned char _event_count { 0ul };
 
+        bool _pending { false };
+        unsigned long _pending_timestamp { 0ul };
+
 };
 
 
@@ -0,0 +1,515 @@
+/*
+
+Deferred printf-like formatting
+
+Instead of formatting the message right away, store the format string address and the raw
+values of every argument. Text is only produced by the `render()`, when it's actually needed,
+or by the host tools that are able to read the format string from the firmware .elf
+
+Payload is the format pointer, followed by the arguments in the order of their appearance
+- '*' width and precision, integers, pointers and doubles are copied as-is
+- strings are copied up to and including the '\0'
+
+Format strings are expected to be in flash and are always read via pgm_read_byte
+
+*/
+
+#pragma once
+
+#include <cstdarg>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+namespace espurna {
+namespace debug {
+namespace deferred {
+
+enum class Argument : uint8_t {
+    None,
+    Int,
+    Long,
+    LongLong,
+    Size,
+    Pointer,
+    Double,
+    String,
+    Invalid,
+};
+
+struct Spec {
+    static constexpr size_t MaxLength { 16 };
+    static constexpr size_t MaxStars { 2 };
+
+    size_t length;
+    size_t stars;
+    Argument argument;
+};
+
+struct Result {
+    explicit operator bool() const {
+        return size > 0;
+    }
+
+    size_t size;
+    bool line;
+};
+
+namespace internal {
+
+inline char read(const char* ptr) {
+    return static_cast<char>(pgm_read_byte(ptr));
+}
+
+inline bool digit(char c) {
+    return (c >= '0') && (c <= '9');
+}
+
+class Writer {
+public:
+    Writer(uint8_t* data, size_t size) :
+        _data(data),
+        _size(size)
+    {}
+
+    explicit operator bool() const {
+        return _ok;
+    }
+
+    size_t size() const {
+        return _position;
+    }
+
+    template <typename T>
+    void write(const T& value) {
+        if (_ok && ((_size - _position) >= sizeof(value))) {
+            std::memcpy(_data + _position, &value, sizeof(value));
+            _position += sizeof(value);
+            return;
+        }
+
+        _ok = false;
+    }
+
+    // Returns the last character of the string, string itself might also be in flash
+    char string(const char* value) {
+        if (!value) {
+            value = "(null)";
+        }
+
+        char last { '\0' };
+        for (;;) {
+            if (!_ok || (_position == _size)) {
+                _ok = false;
+                break;
+            }
+
+            const char c = read(value++);
+            _data[_position++] = static_cast<uint8_t>(c);
+            if (c == '\0') {
+                break;
+            }
+
+            last = c;
+        }
+
+        return last;
+    }
+
+private:
+    uint8_t* _data;
+    size_t _size;
+    size_t _position { 0 };
+    bool _ok { true };
+};
+
+class Reader {
+public:
+    Reader(const uint8_t* data, size_t size) :
+        _data(data),
+        _size(size)
+    {}
+
+    template <typename T>
+    bool read(T& value) {
+        if ((_size - _position) < sizeof(value)) {
+            return false;
+        }
+
+        std::memcpy(&value, _data + _position, sizeof(value));
+        _position += sizeof(value);
+
+        return true;
+    }
+
+    const char* string() {
+        const auto* begin = _data + _position;
+        const auto* end = static_cast<const uint8_t*>(
+            std::memchr(begin, '\0', _size - _position));
+        if (!end) {
+            return nullptr;
+        }
+
+        _position += (end - begin) + 1;
+        return reinterpret_cast<const char*>(begin);
+    }
+
+private:
+    const uint8_t* _data;
+    size_t _size;
+    size_t _position { 0 };
+};
+
+template <typename T>
+int print(char* out, size_t size, const char* spec, const int (&stars)[Spec::MaxStars], size_t count, T value) {
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat-nonliteral"
+    switch (count) {
+    case 0:
+        return std::snprintf(out, size, spec, value);
+    case 1:
+        return std::snprintf(out, size, spec, stars[0], value);
+    case 2:
+        return std::snprintf(out, size, spec, stars[0], stars[1], value);
+    }
+#pragma GCC diagnostic pop
+
+    return -1;
+}
+
+template <typename T>
+int print(Reader& reader, char* out, size_t size, const char* spec, const int (&stars)[Spec::MaxStars], size_t count) {
+    T value;
+    if (!reader.read(value)) {
+        return -1;
+    }
+
+    return print(out, size, spec, stars, count, value);
+}
+
+} // namespace internal
+
+// Format specification starting at the '%'. Length modifiers only matter
+// for the size of the argument, everything else is left up to the printf
+inline Spec parse(const char* format) {
+    using internal::digit;
+    using internal::read;
+
+    Spec out{0, 0, Argument::Invalid};
+
+    const char* ptr = format + 1;
+    for (;;) {
+        const char c = read(ptr);
+        if ((c == '-') || (c == '+') || (c == ' ') || (c == '#') || (c == '0')) {
+            ++ptr;
+            continue;
+        }
+
+        break;
+    }
+
+    if (read(ptr) == '*') {
+        ++out.stars;
+        ++ptr;
+    } else {
+        while (digit(read(ptr))) {
+            ++ptr;
+        }
+    }
+
+    if (read(ptr) == '.') {
+        ++ptr;
+        if (read(ptr) == '*') {
+            ++out.stars;
+            ++ptr;
+        } else {
+            while (digit(read(ptr))) {
+                ++ptr;
+            }
+        }
+    }
+
+    int longs { 0 };
+    bool size { false };
+
+    switch (read(ptr)) {
+    case 'h':
+        ++ptr;
+        if (read(ptr) == 'h') {
+            ++ptr;
+        }
+        break;
+    case 'l':
+        ++ptr;
+        ++longs;
+        if (read(ptr) == 'l') {
+            ++ptr;
+            ++longs;
+        }
+        break;
+    case 'j':
+        ++ptr;
+        longs = 2;
+        break;
+    case 'z':
+    case 't':
+        ++ptr;
+        size = true;
+        break;
+    }
+
+    const char conversion = read(ptr);
+    switch (conversion) {
+    case 'd':
+    case 'i':
+    case 'u':
+    case 'x':
+    case 'X':
+    case 'o':
+    case 'c':
+        out.argument = (longs == 2) ? Argument::LongLong
+            : (longs == 1) ? Argument::Long
+            : size ? Argument::Size
+            : Argument::Int;
+        break;
+    case 'f':
+    case 'F':
+    case 'e':
+    case 'E':
+    case 'g':
+    case 'G':
+    case 'a':
+    case 'A':
+        out.argument = Argument::Double;
+        break;
+    case 's':
+        out.argument = longs ? Argument::Invalid : Argument::String;
+        break;
+    case 'p':
+        out.argument = Argument::Pointer;
+        break;
+    case '%':
+        out.argument = Argument::None;
+        break;
+    }
+
+    if (conversion != '\0') {
+        ++ptr;
+    }
+
+    out.length = ptr - format;
+    if (out.length > Spec::MaxLength) {
+        out.argument = Argument::Invalid;
+    }
+
+    return out;
+}
+
+// Empty result when the format is not supported or the payload does not fit, message should be formatted as usual then.
+// Arguments are consumed, caller is expected to va_copy() them beforehand when they are used again
+inline Result encode(uint8_t* out, size_t size, const char* format, va_list args) {
+    internal::Writer writer(out, size);
+    writer.write(format);
+
+    char last { '\0' };
+
+    const char* ptr = format;
+    for (;;) {
+        const char c = internal::read(ptr);
+        if (c == '\0') {
+            break;
+        }
+
+        if (c != '%') {
+            last = c;
+            ++ptr;
+            continue;
+        }
+
+        const auto spec = parse(ptr);
+        for (size_t star = 0; star < spec.stars; ++star) {
+            writer.write(va_arg(args, int));
+        }
+
+        switch (spec.argument) {
+        case Argument::None:
+            break;
+        case Argument::Int:
+            writer.write(va_arg(args, int));
+            break;
+        case Argument::Long:
+            writer.write(va_arg(args, long));
+            break;
+        case Argument::LongLong:
+            writer.write(va_arg(args, long long));
+            break;
+        case Argument::Size:
+            writer.write(va_arg(args, size_t));
+            break;
+        case Argument::Pointer:
+            writer.write(va_arg(args, void*));
+            break;
+        case Argument::Double:
+            writer.write(va_arg(args, double));
+            break;
+        case Argument::String:
+            last = writer.string(va_arg(args, const char*));
+            break;
+        case Argument::Invalid:
+            return Result{0, false};
+        }
+
+        if (!writer) {
+            return Result{0, false};
+        }
+
+        if (spec.argument != Argument::String) {
+            last = internal::read(ptr + spec.length - 1);
+        }
+
+        ptr += spec.length;
+    }
+
+    if (!writer) {
+        return Result{0, false};
+    }
+
+    return Result{writer.size(), (last == '\r') || (last == '\n')};
+}
+
+// Same as vsnprintf, using the format and the arguments from the encoded payload.
+// Returns the number of characters that would've been written, or -1 when payload is malformed
+inline int render(char* out, size_t size, const uint8_t* data, size_t length) {
+    internal::Reader reader(data, length);
+
+    const char* format;
+    if (!reader.read(format)) {
+        return -1;
+    }
+
+    size_t total { 0 };
+    const char* ptr = format;
+    for (;;) {
+        const char c = internal::read(ptr);
+        if (c == '\0') {
+            break;
+        }
+
+        if (c != '%') {
+            if ((total + 1) < size) {
+                out[total] = c;
+            }
+
+            ++total;
+            ++ptr;
+            continue;
+        }
+
+        const auto spec = parse(ptr);
+        if (spec.argument == Argument::Invalid) {
+            return -1;
+        }
+
+        char buffer[Spec::MaxLength + 1];
+        for (size_t index = 0; index < spec.length; ++index) {
+            buffer[index] = internal::read(ptr + index);
+        }
+        buffer[spec.length] = '\0';
+        ptr += spec.length;
+
+        int stars[Spec::MaxStars] {};
+        for (size_t star = 0; star < spec.stars; ++star) {
+            if (!reader.read(stars[star])) {
+                return -1;
+            }
+        }
+
+        char* current = (total < size) ? (out + total) : nullptr;
+        const size_t available = (total < size) ? (size - total) : 0;
+
+        int result { -1 };
+
+        switch (spec.argument) {
+        case Argument::None:
+            result = internal::print(current, available, "%c", stars, 0, '%');
+            break;
+        case Argument::Int:
+            result = internal::print<int>(reader, current, available, buffer, stars, spec.stars);
+            break;
+        case Argument::Long:
+            result = internal::print<long>(reader, current, available, buffer, stars, spec.stars);
+            break;
+        case Argument::LongLong:
+            result = internal::print<long long>(reader, current, available, buffer, stars, spec.stars);
+            break;
+        case Argument::Size:
+            result = internal::print<size_t>(reader, current, available, buffer, stars, spec.stars);
+            break;
+        case Argument::Pointer:
+            result = internal::print<void*>(reader, current, available, buffer, stars, spec.stars);
+            break;
+        case Argument::Double:
+            result = internal::print<double>(reader, current, available, buffer, stars, spec.stars);
+            break;
+        case Argument::String:
+        {
+            const char* value = reader.string();
+            if (value) {
+                result = internal::print(current, available, buffer, stars, spec.stars, value);
+            }
+            break;
+        }
+        case Argument::Invalid:
+            break;
+        }
+
+        if (result < 0) {
+            return -1;
+        }
+
+        total += static_cast<size_t>(result);
+    }
+
+    if (size) {
+        out[(total < size) ? total : (size - 1)] = '\0';
+    }
+
+    return static_cast<int>(total);
+}
+
+// Binary payload as the printable text, output receives every 4 characters
+template <typename T>
+void base64(const uint8_t* data, size_t length, T&& output) {
+    static constexpr char Alphabet[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+    for (size_t index = 0; index < length; index += 3) {
+        const size_t remaining = length - index;
+
+        uint32_t value = static_cast<uint32_t>(data[index]) << 16;
+        if (remaining > 1) {
+            value |= static_cast<uint32_t>(data[index + 1]) << 8;
+        }
+        if (remaining > 2) {
+            value |= static_cast<uint32_t>(data[index + 2]);
+        }
+
+        const char chunk[4] {
+            Alphabet[(value >> 18) & 0x3f],
+            Alphabet[(value >> 12) & 0x3f],
+            (remaining > 1) ? Alphabet[(value >> 6) & 0x3f] : '=',
+            (remaining > 2) ? Alphabet[value & 0x3f] : '=',
+        };
+
+        output(chunk, sizeof(chunk));
+    }
+}
+
+constexpr size_t base64Length(size_t length) {
+    return ((length + 2) / 3) * 4;
+}
+
+} // namespace deferred
+} // namespace debug
+} // namespace espurna
@@ -0,0 +1,155 @@
+/*
+
+Single-producer, single-consumer ring of edge timestamps
+
+Producer is the GPIO interrupt handler, which only ever writes the head
+index and the overflow counter. Consumer is the loop, which only ever writes
+the tail index. Indexes are free-running and are only masked when accessing
+the buffer, so the ring can use all of its slots and there's no need for locks.
+
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace espurna {
+namespace edge {
+
+template <size_t Size>
+class Ring {
+public:
+    static_assert((Size > 0) && ((Size & (Size - 1)) == 0), "Size must be a power of two");
+
+    // Producer side, must only be called from the ISR. Forced inline to avoid
+    // calling into the flash from the IRAM function
+    __attribute__((always_inline)) bool push(uint32_t timestamp) {
+        const auto head = _head.load(std::memory_order_relaxed);
+        if ((head - _tail.load(std::memory_order_acquire)) >= Size) {
+            _overflows.store(_overflows.load(std::memory_order_relaxed) + 1,
+                std::memory_order_relaxed);
+            return false;
+        }
+
+        _buffer[head & (Size - 1)] = timestamp;
+        _head.store(head + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    // Consumer side, only called from the loop
+    bool pop(uint32_t& out) {
+        const auto tail = _tail.load(std::memory_order_relaxed);
+        if (tail == _head.load(std::memory_order_acquire)) {
+            return false;
+        }
+
+        out = _buffer[tail & (Size - 1)];
+        _tail.store(tail + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    template <typename Callback>
+    size_t drain(Callback&& callback) {
+        size_t out { 0 };
+
+        uint32_t timestamp;
+        while (pop(timestamp)) {
+            callback(timestamp);
+            ++out;
+        }
+
+        return out;
+    }
+
+    void clear() {
+        _tail.store(_head.load(std::memory_order_acquire), std::memory_order_release);
+    }
+
+    size_t size() const {
+        return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire);
+    }
+
+    static constexpr size_t capacity() {
+        return Size;
+    }
+
+    // Number of edges that did not fit. Only updated by the producer
+    uint32_t overflows() const {
+        return _overflows.load(std::memory_order_relaxed);
+    }
+
+private:
+    uint32_t _buffer[Size];
+
+    std::atomic<uint32_t> _head { 0 };
+    std::atomic<uint32_t> _tail { 0 };
+    std::atomic<uint32_t> _overflows { 0 };
+};
+
+// Loop-side debounce, applied to the edges after they were taken out of the ring.
+// Timestamps are CPU cycles, so their difference alone is only valid when edges are
+// no more than ~26s (160MHz) or ~53s (80MHz) apart. Longer intervals need the caller
+// to also provide the time between edges measured by a clock that does not wrap as fast
+class Debounce {
+public:
+    static constexpr uint64_t Period { static_cast<uint64_t>(1) << 32 };
+
+    Debounce() = default;
+
+    explicit Debounce(uint32_t cycles) :
+        _cycles(cycles)
+    {}
+
+    uint32_t cycles() const {
+        return _cycles;
+    }
+
+    // Returns true when the edge should be accepted. Interval between the previously
+    // accepted edge and this one is available as `interval()`, when there was one
+    bool accept(uint32_t timestamp) {
+        return accept(timestamp, 0);
+    }
+
+    // `elapsed` is the time since the previously accepted edge in cycles, e.g. converted from
+    // the loop-side millis(). It is only used to restore the number of counter wraps, so it
+    // is allowed to be off by the loop latency (as long as it is less than a half of the period)
+    bool accept(uint32_t timestamp, uint64_t elapsed) {
+        const uint32_t cycles = timestamp - _last;
+        const uint64_t wraps = (elapsed + (Period / 2) > cycles)
+            ? ((elapsed + (Period / 2) - cycles) / Period)
+            : 0;
+
+        const uint64_t interval = (wraps * Period) + cycles;
+        if (_started && (interval <= _cycles)) {
+            return false;
+        }
+
+        _interval = _started ? interval : 0;
+        _last = timestamp;
+        _started = true;
+
+        return true;
+    }
+
+    uint64_t interval() const {
+        return _interval;
+    }
+
+    void reset() {
+        _started = false;
+        _interval = 0;
+    }
+
+private:
+    uint32_t _cycles { 0 };
+    uint32_t _last { 0 };
+    uint64_t _interval { 0 };
+    bool _started { false };
+};
+
+} // namespace edge
+} // namespace espurna
@@ -0,0 +1,310 @@
+/*
+
+Framed serial protocol parser
+
+Bytes are read from the stream in bulk into a ring buffer, which is then
+searched for the frames described by the `Spec`. When header does not match
+or frame check fails, only the first byte is dropped and the search continues
+from the next one, so the parser resyncs on its own after any kind of corruption.
+
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace espurna {
+namespace frame {
+
+// When mask is set, only the masked bits of the header bytes are compared
+// (which also allows to skip the byte completely with the 0x00 mask)
+struct Header {
+    const uint8_t* bytes;
+    const uint8_t* mask;
+    size_t size;
+};
+
+// Receives at least `Spec::length` bytes of the frame, returns the full frame length
+using LengthFunc = size_t(*)(const uint8_t* frame);
+
+// Receives the full frame, returns whether it is valid
+using CheckFunc = bool(*)(const uint8_t* frame, size_t length);
+
+struct Spec {
+    Header header;
+    size_t length; // fixed frame length, or the minimal one when `frame_length` is set
+    LengthFunc frame_length;
+    CheckFunc check;
+};
+
+namespace checksum {
+
+// Sum of the [Begin, End) bytes is stored right after them
+template <size_t Begin, size_t End>
+bool sum8(const uint8_t* frame, size_t length) {
+    static_assert(Begin < End, "");
+    if (length <= End) {
+        return false;
+    }
+
+    uint8_t sum { 0 };
+    for (size_t index = Begin; index < End; ++index) {
+        sum += frame[index];
+    }
+
+    return sum == frame[End];
+}
+
+// Sum of every frame byte, including the checksum itself, is zero
+inline bool sum8_zero(const uint8_t* frame, size_t length) {
+    uint8_t sum { 0 };
+    for (size_t index = 0; index < length; ++index) {
+        sum += frame[index];
+    }
+
+    return sum == 0;
+}
+
+// Sum of every frame byte is stored as the last two bytes (big-endian)
+inline bool sum16_be(const uint8_t* frame, size_t length) {
+    if (length < 2) {
+        return false;
+    }
+
+    uint16_t sum { 0 };
+    for (size_t index = 0; index < length - 2; ++index) {
+        sum += frame[index];
+    }
+
+    return sum == ((frame[length - 2] << 8) | frame[length - 1]);
+}
+
+} // namespace checksum
+
+// Capacity must be a power of two, so the position is always calculated with a mask
+template <size_t Capacity>
+class Ring {
+public:
+    static_assert((Capacity > 0) && ((Capacity & (Capacity - 1)) == 0), "Capacity must be a power of two");
+
+    size_t size() const {
+        return _tail - _head;
+    }
+
+    size_t available() const {
+        return Capacity - size();
+    }
+
+    uint8_t peek(size_t offset) const {
+        return _buffer[(_head + offset) & (Capacity - 1)];
+    }
+
+    void copy(uint8_t* out, size_t size) const {
+        for (size_t index = 0; index < size; ++index) {
+            out[index] = peek(index);
+        }
+    }
+
+    void drop(size_t size) {
+        _head += size;
+    }
+
+    void clear() {
+        _head = _tail;
+    }
+
+    // Contiguous free space, starting at the tail.
+    // Can be used to read directly into the buffer, followed up by the `commit()`
+    uint8_t* tail() {
+        return &_buffer[_tail & (Capacity - 1)];
+    }
+
+    size_t contiguous() const {
+        const auto tail = _tail & (Capacity - 1);
+        const auto end = Capacity - tail;
+        const auto free = available();
+        return (free < end) ? free : end;
+    }
+
+    void commit(size_t size) {
+        _tail += size;
+    }
+
+    size_t push(const uint8_t* data, size_t size) {
+        size_t out { 0 };
+        while ((out < size) && available()) {
+            const auto chunk = std::min(contiguous(), size - out);
+            std::memcpy(tail(), data + out, chunk);
+            commit(chunk);
+            out += chunk;
+        }
+
+        return out;
+    }
+
+private:
+    uint8_t _buffer[Capacity];
+    size_t _head { 0 };
+    size_t _tail { 0 };
+};
+
+struct Stats {
+    uint32_t frames { 0 };  // valid frames
+    uint32_t errors { 0 };  // frames that failed length or data check
+    uint32_t dropped { 0 }; // bytes skipped while searching for the header
+};
+
+template <size_t Capacity, size_t MaxLength>
+class Parser {
+public:
+    static_assert(MaxLength <= Capacity, "Ring buffer must be able to hold the whole frame");
+
+    explicit Parser(const Spec& spec) :
+        _spec(spec)
+    {}
+
+    const Stats& stats() const {
+        return _stats;
+    }
+
+    const uint8_t* data() const {
+        return _frame;
+    }
+
+    size_t length() const {
+        return _length;
+    }
+
+    size_t buffered() const {
+        return _ring.size();
+    }
+
+    void reset() {
+        _ring.clear();
+        _length = 0;
+    }
+
+    size_t push(const uint8_t* data, size_t size) {
+        return _ring.push(data, size);
+    }
+
+    // Stream is expected to provide `int available()` and `size_t readBytes(uint8_t*, size_t)`
+    template <typename T>
+    size_t fill(T& stream) {
+        size_t out { 0 };
+
+        while (_ring.available()) {
+            const auto available = stream.available();
+            if (available <= 0) {
+                break;
+            }
+
+            const auto size = std::min(
+                static_cast<size_t>(available), _ring.contiguous());
+            const auto result = stream.readBytes(_ring.tail(), size);
+            if (!result) {
+                break;
+            }
+
+            _ring.commit(result);
+            out += result;
+        }
+
+        return out;
+    }
+
+    // Returns true when a valid frame was found, which is then available through `data()` and `length()`
+    bool next() {
+        _length = 0;
+
+        while (_ring.size() >= _spec.header.size) {
+            if (!_header()) {
+                _ring.drop(1);
+                ++_stats.dropped;
+                continue;
+            }
+
+            if (_ring.size() < _spec.length) {
+                break;
+            }
+
+            size_t length { _spec.length };
+            if (_spec.frame_length) {
+                _ring.copy(_frame, _spec.length);
+                length = _spec.frame_length(_frame);
+                if ((length < _spec.length) || (length > MaxLength)) {
+                    _ring.drop(1);
+                    ++_stats.errors;
+                    continue;
+                }
+            }
+
+            if (_ring.size() < length) {
+                break;
+            }
+
+            _ring.copy(_frame, length);
+            if (_spec.check && !_spec.check(_frame, length)) {
+                _ring.drop(1);
+                ++_stats.errors;
+                continue;
+            }
+
+            _ring.drop(length);
+            _length = length;
+            ++_stats.frames;
+
+            return true;
+        }
+
+        return false;
+    }
+
+    // Drain the stream and handle every frame. Since the ring buffer can be smaller than the
+    // amount of available data, alternate between reading and parsing until nothing is left
+    template <typename T, typename Callback>
+    size_t read(T& stream, Callback&& callback) {
+        size_t out { 0 };
+
+        for (;;) {
+            const auto result = fill(stream);
+            while (next()) {
+                callback(_frame, _length);
+                ++out;
+            }
+
+            if (!result) {
+                break;
+            }
+        }
+
+        return out;
+    }
+
+private:
+    bool _header() const {
+        const auto& header = _spec.header;
+        for (size_t index = 0; index < header.size; ++index) {
+            const uint8_t mask = header.mask ? header.mask[index] : 0xff;
+            if ((_ring.peek(index) & mask) != (header.bytes[index] & mask)) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    const Spec& _spec;
+    Stats _stats;
+
+    Ring<Capacity> _ring;
+
+    uint8_t _frame[MaxLength];
+    size_t _length { 0 };
+};
+
+} // namespace frame
+} // namespace espurna
@@ -0,0 +1,268 @@
+/*
+
+Part of the SYSTEM MODULE
+
+Heartbeat payload composition. Every value is formatted into the same fixed buffer as a NUL-terminated string,
+which could then be sent through the individual topics as-is, or serialized as a single JSON object
+using the remaining buffer space.
+
+*/
+
+#pragma once
+
+#include <Arduino.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace espurna {
+namespace heartbeat {
+
+template <size_t Size, size_t Fields>
+class Builder {
+public:
+    static_assert(Size > 2, "");
+    static_assert(Fields > 0, "");
+
+    struct Field {
+        const char* topic;
+        const char* value;
+        bool number;
+    };
+
+    void clear() {
+        _size = 0;
+        _count = 0;
+        _temporaries = 0;
+        _dropped = 0;
+    }
+
+    bool add(const char* topic, const char* value, size_t length) {
+        return push(topic, value, length, false);
+    }
+
+    // Value is already a valid JSON literal, e.g. a number
+    bool add(const char* topic, const char* value, size_t length, bool number) {
+        return push(topic, value, length, number);
+    }
+
+    // Topic is also copied into the buffer, when it is not guaranteed to outlive the builder
+    bool add(const String& topic, const String& value, bool number) {
+        const size_t length = topic.length() + 1;
+        if ((_count >= Fields) || (length > Size - _size)) {
+            ++_dropped;
+            return false;
+        }
+
+        const size_t size = _size;
+        char* out = &_buffer[size];
+        std::memcpy(out, topic.c_str(), length);
+        _size += length;
+
+        if (!push(out, value.c_str(), value.length(), number)) {
+            _size = size;
+            return false;
+        }
+
+        return true;
+    }
+
+    bool add(const char* topic, const char* value) {
+        return add(topic, value, std::strlen(value));
+    }
+
+    bool add(const char* topic, const String& value) {
+        return add(topic, value.c_str(), value.length());
+    }
+
+    // Value was created only to be copied here
+    bool add(const char* topic, String&& value) {
+        ++_temporaries;
+        return add(topic, value.c_str(), value.length());
+    }
+
+    bool add(const char* topic, uint32_t value) {
+        char buffer[16];
+        const size_t length = format(buffer, value);
+        return push(topic, buffer, length, true);
+    }
+
+    bool add(const char* topic, int32_t value) {
+        char buffer[16];
+
+        size_t length { 0 };
+        if (value < 0) {
+            buffer[0] = '-';
+            length = 1 + format(&buffer[1], static_cast<uint32_t>(0) - static_cast<uint32_t>(value));
+        } else {
+            length = format(buffer, static_cast<uint32_t>(value));
+        }
+
+        return push(topic, buffer, length, true);
+    }
+
+    size_t size() const {
+        return _count;
+    }
+
+    bool contains(const char* topic) const {
+        for (size_t index = 0; index < _count; ++index) {
+            if (std::strcmp(_fields[index].topic, topic) == 0) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    size_t bytes() const {
+        return _size;
+    }
+
+    // Number of values that had to be created as temporary Strings
+    size_t temporaries() const {
+        return _temporaries;
+    }
+
+    // Number of values that did not fit into the buffer
+    size_t dropped() const {
+        return _dropped;
+    }
+
+    template <typename T>
+    void foreach(T&& callback) const {
+        for (size_t index = 0; index < _count; ++index) {
+            callback(_fields[index]);
+        }
+    }
+
+    // Object is placed right after the values and is only valid until the next add() or clear().
+    // Strings are escaped, numbers are written as-is. Returns nullptr when the object does not fit
+    const char* json() {
+        Writer writer(&_buffer[_size], Size - _size);
+
+        writer.put('{');
+        for (size_t index = 0; index < _count; ++index) {
+            const auto& field = _fields[index];
+            if (index) {
+                writer.put(',');
+            }
+
+            writer.string(field.topic);
+            writer.put(':');
+            if (field.number) {
+                writer.raw(field.value);
+            } else {
+                writer.string(field.value);
+            }
+        }
+        writer.put('}');
+
+        return writer.finish();
+    }
+
+private:
+    struct Writer {
+        Writer(char* begin, size_t size) :
+            _begin(begin),
+            _it(begin),
+            _end(begin + size)
+        {}
+
+        void put(char c) {
+            if (_it != _end) {
+                *_it = c;
+                ++_it;
+            } else {
+                _overflow = true;
+            }
+        }
+
+        void raw(const char* value) {
+            for (; *value; ++value) {
+                put(*value);
+            }
+        }
+
+        void string(const char* value) {
+            static constexpr char Hex[] = "0123456789abcdef";
+
+            put('"');
+            for (; *value; ++value) {
+                const auto c = static_cast<unsigned char>(*value);
+                if ((c == '"') || (c == '\\')) {
+                    put('\\');
+                    put(c);
+                } else if (c < 0x20) {
+                    raw("\\u00");
+                    put(Hex[(c >> 4) & 0xf]);
+                    put(Hex[c & 0xf]);
+                } else {
+                    put(c);
+                }
+            }
+            put('"');
+        }
+
+        const char* finish() {
+            put('\0');
+            return _overflow ? nullptr : _begin;
+        }
+
+    private:
+        char* _begin;
+        char* _it;
+        char* _end;
+        bool _overflow { false };
+    };
+
+    static size_t format(char* out, uint32_t value) {
+        char tmp[10];
+
+        size_t length { 0 };
+        do {
+            tmp[length++] = '0' + (value % 10);
+            value /= 10;
+        } while (value);
+
+        for (size_t index = 0; index < length; ++index) {
+            out[index] = tmp[length - index - 1];
+        }
+        out[length] = '\0';
+
+        return length;
+    }
+
+    bool push(const char* topic, const char* value, size_t length, bool number) {
+        if ((_count >= Fields) || (length + 1 > Size - _size)) {
+            ++_dropped;
+            return false;
+        }
+
+        char* out = &_buffer[_size];
+        std::memcpy(out, value, length);
+        out[length] = '\0';
+
+        _fields[_count] = Field{
+            .topic = topic,
+            .value = out,
+            .number = number};
+
+        _size += length + 1;
+        ++_count;
+
+        return true;
+    }
+
+    char _buffer[Size];
+    Field _fields[Fields];
+
+    size_t _size { 0 };
+    size_t _count { 0 };
+    size_t _temporaries { 0 };
+    size_t _dropped { 0 };
+};
+
+} // namespace heartbeat
+} // namespace espurna
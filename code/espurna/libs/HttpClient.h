@@ -0,0 +1,632 @@
+/*
+
+Part of the HTTP CLIENT MODULE
+
+HTTP/1.1 request serialization, incremental response parser and the request pipeline
+of a single persistent connection. Transport is provided by the caller
+
+*/
+
+#pragma once
+
+#include <Arduino.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <utility>
+
+namespace espurna {
+namespace http {
+
+enum class Error {
+    None,
+    Connection,
+    Timeout,
+    Closed,
+    Response,
+    Body,
+};
+
+// Request line, `Host` and `Content-Length` headers are always present. Everything else is appended by the caller
+class Head {
+public:
+    static constexpr size_t Reserve { 128 };
+
+    Head(const char* method, const String& host, uint16_t port, const String& path) {
+        _head.reserve(Reserve);
+
+        _head += method;
+        _head += ' ';
+        _head += path.length() ? path.c_str() : "/";
+        _head += " HTTP/1.1";
+
+        header("Host", host.c_str());
+        if (port != 80) {
+            _head += ':';
+            _head += number(port).data;
+        }
+    }
+
+    Head& header(const char* name, const char* value) {
+        _head += "\r\n";
+        _head += name;
+        _head += ": ";
+        _head += value;
+
+        return *this;
+    }
+
+    // Connection is expected to be persistent, no need to send `Connection: keep-alive` with HTTP/1.1
+    String finish(size_t length) {
+        header("Content-Length", number(length).data);
+        _head += "\r\n\r\n";
+
+        return std::move(_head);
+    }
+
+private:
+    struct Number {
+        char data[12];
+    };
+
+    static Number number(size_t value) {
+        Number out;
+        snprintf(out.data, sizeof(out.data), "%zu", value);
+        return out;
+    }
+
+    String _head;
+};
+
+// Body is not copied into the request, it is requested in parts when the transport has space for it.
+// Size must be known beforehand, producer must return exactly the requested amount of bytes
+using BodyProducer = std::function<size_t(uint8_t* out, size_t size, size_t offset)>;
+
+// Response body is not stored anywhere, it is passed to the callback as it arrives
+using BodyCallback = std::function<void(const uint8_t* data, size_t size)>;
+
+// Either status code from the response, or error and status 0
+using CompletionCallback = std::function<void(int status, Error error)>;
+
+struct Request {
+    String head;
+
+    size_t body_size { 0 };
+    BodyProducer body;
+
+    BodyCallback on_body;
+    CompletionCallback on_complete;
+
+    // Request can be safely repeated, ref. RFC 7230 §6.3.1 (e.g. GET or PUT, but not POST).
+    // Only idempotent requests are pipelined and retried automatically
+    bool idempotent { false };
+
+    // When connection closes before any response data arrives, idempotent request is sent once again
+    size_t retries { 1 };
+};
+
+// Body is stored in the producer, which is useful for small payloads that are already built
+inline BodyProducer body(String&& payload) {
+    return [payload = std::move(payload)](uint8_t* out, size_t size, size_t offset) -> size_t {
+        if (offset >= payload.length()) {
+            return 0;
+        }
+
+        size = std::min(size, payload.length() - offset);
+        std::memcpy(out, payload.c_str() + offset, size);
+
+        return size;
+    };
+}
+
+// Incremental response parser. Data may arrive in any number of parts, only the current line is kept
+// in a fixed size buffer. Lines that do not fit are truncated and header lines are ignored, since only the
+// length, encoding and connection headers are important here. Bytes after the response are not consumed
+class Parser {
+public:
+    static constexpr size_t LineSize { 64 };
+
+    enum class State {
+        Status,
+        Headers,
+        Body,
+        ChunkSize,
+        ChunkData,
+        ChunkEnd,
+        Trailer,
+        Close,
+        Done,
+        Error,
+    };
+
+    State state() const {
+        return _state;
+    }
+
+    bool done() const {
+        return _state == State::Done;
+    }
+
+    bool error() const {
+        return _state == State::Error;
+    }
+
+    // Anything received after the status line
+    bool started() const {
+        return _started;
+    }
+
+    int status() const {
+        return _status;
+    }
+
+    bool keep_alive() const {
+        return _keep_alive;
+    }
+
+    void reset() {
+        *this = Parser();
+    }
+
+    // Body without length ends when the connection is closed
+    void finish() {
+        if (_state == State::Close) {
+            _state = State::Done;
+        } else if (_state != State::Done) {
+            _state = State::Error;
+        }
+    }
+
+    template <typename T>
+    size_t parse(const uint8_t* data, size_t size, T&& on_body) {
+        const uint8_t* ptr = data;
+        const uint8_t* end = data + size;
+
+        if (size) {
+            _started = true;
+        }
+
+        while ((ptr != end) && (_state != State::Done) && (_state != State::Error)) {
+            switch (_state) {
+            case State::Body:
+            case State::ChunkData:
+            case State::Close:
+            {
+                size_t length = end - ptr;
+                if (_state != State::Close) {
+                    length = std::min(length, _remaining);
+                    _remaining -= length;
+                }
+
+                on_body(ptr, length);
+                ptr += length;
+
+                if (!_remaining) {
+                    if (_state == State::Body) {
+                        _state = State::Done;
+                    } else if (_state == State::ChunkData) {
+                        _state = State::ChunkEnd;
+                    }
+                }
+                break;
+            }
+
+            default:
+                if (line(*ptr++)) {
+                    process();
+                    _line_size = 0;
+                    _overflow = false;
+                }
+                break;
+            }
+        }
+
+        return ptr - data;
+    }
+
+private:
+    bool line(uint8_t byte) {
+        if (byte == '\n') {
+            if (_line_size && (_line[_line_size - 1] == '\r')) {
+                --_line_size;
+            }
+            _line[_line_size] = '\0';
+            return true;
+        }
+
+        if (_line_size < (LineSize - 1)) {
+            _line[_line_size++] = static_cast<char>(byte);
+        } else {
+            _overflow = true;
+        }
+
+        return false;
+    }
+
+    static bool same(const char* lhs, const char* rhs) {
+        return 0 == strcasecmp(lhs, rhs);
+    }
+
+    static bool contains(const char* value, const char* token) {
+        const size_t length = strlen(token);
+        for (const char* ptr = value; *ptr; ++ptr) {
+            if (0 == strncasecmp(ptr, token, length)) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    void process() {
+        switch (_state) {
+        case State::Status:
+            status_line();
+            break;
+        case State::Headers:
+            header_line();
+            break;
+        case State::ChunkSize:
+            chunk_size();
+            break;
+        case State::ChunkEnd:
+            _state = (_line_size || _overflow)
+                ? State::Error
+                : State::ChunkSize;
+            break;
+        case State::Trailer:
+            if (!_line_size && !_overflow) {
+                _state = State::Done;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    // > HTTP/1.1 <code> <reason>
+    void status_line() {
+        int minor { 0 };
+        int status { 0 };
+        if ((2 != sscanf(_line, "HTTP/1.%d %3d", &minor, &status)) || (status < 100)) {
+            _state = State::Error;
+            return;
+        }
+
+        _status = status;
+        _keep_alive = (minor >= 1);
+        _state = State::Headers;
+    }
+
+    void header_line() {
+        if (!_line_size && !_overflow) {
+            headers_end();
+            return;
+        }
+
+        if (_overflow) {
+            return;
+        }
+
+        char* value = strchr(_line, ':');
+        if (!value) {
+            _state = State::Error;
+            return;
+        }
+
+        *value++ = '\0';
+        while (*value == ' ') {
+            ++value;
+        }
+
+        if (same(_line, "Content-Length")) {
+            char* endptr { nullptr };
+            _length = strtoul(value, &endptr, 10);
+            _has_length = (endptr != value);
+        } else if (same(_line, "Transfer-Encoding")) {
+            _chunked = contains(value, "chunked");
+        } else if (same(_line, "Connection")) {
+            if (contains(value, "close")) {
+                _keep_alive = false;
+            } else if (contains(value, "keep-alive")) {
+                _keep_alive = true;
+            }
+        }
+    }
+
+    void headers_end() {
+        // Interim response, the real one follows
+        if ((_status >= 100) && (_status < 200)) {
+            const bool started = _started;
+            reset();
+            _started = started;
+            return;
+        }
+
+        if ((_status == 204) || (_status == 304)) {
+            _state = State::Done;
+        } else if (_chunked) {
+            _state = State::ChunkSize;
+        } else if (_has_length) {
+            _remaining = _length;
+            _state = _remaining ? State::Body : State::Done;
+        } else {
+            _keep_alive = false;
+            _state = State::Close;
+        }
+    }
+
+    // > <hex size>[;extensions]
+    void chunk_size() {
+        char* endptr { nullptr };
+        _remaining = strtoul(_line, &endptr, 16);
+        if (_overflow || (endptr == _line)) {
+            _state = State::Error;
+            return;
+        }
+
+        _state = _remaining ? State::ChunkData : State::Trailer;
+    }
+
+    State _state { State::Status };
+
+    char _line[LineSize];
+    size_t _line_size { 0 };
+    bool _overflow { false };
+
+    bool _started { false };
+    int _status { 0 };
+    bool _keep_alive { false };
+
+    bool _chunked { false };
+    bool _has_length { false };
+    size_t _length { 0 };
+    size_t _remaining { 0 };
+};
+
+// Requests of a single connection. Until the first response confirms that connection is persistent,
+// only one request is sent. After that, up to `depth` requests are sent without waiting for responses.
+// Body is copied into the transport through a fixed size buffer. Transport must implement
+// > size_t space();
+// > size_t write(const char*, size_t);
+class Pipeline {
+public:
+    static constexpr size_t BufferSize { 256 };
+
+    explicit Pipeline(size_t depth) :
+        _depth(std::max(depth, static_cast<size_t>(1)))
+    {}
+
+    void push(Request&& request) {
+        _requests.push_back(std::move(request));
+    }
+
+    // Nothing is waiting to be sent or for the response
+    bool idle() const {
+        return _requests.empty();
+    }
+
+    size_t size() const {
+        return _requests.size();
+    }
+
+    // Requests that were at least partially sent
+    size_t in_flight() const {
+        return _sent + (_offset ? 1 : 0);
+    }
+
+    // Connection can't be used anymore and must be closed
+    bool broken() const {
+        return _broken;
+    }
+
+    // Server does not expect any more requests
+    bool closing() const {
+        return _closing;
+    }
+
+    bool confirmed() const {
+        return _confirmed;
+    }
+
+    template <typename T>
+    size_t send(T& transport) {
+        size_t out { 0 };
+
+        while (!_broken && !_closing && (_sent < _requests.size()) && (_sent < limit())) {
+            auto& request = _requests[_sent];
+
+            // Nothing is pipelined with a non-idempotent request, ref. RFC 7230 §6.3.2
+            if (_sent && (!request.idempotent || !_requests[_sent - 1].idempotent)) {
+                break;
+            }
+
+            const size_t head = request.head.length();
+            const size_t total = head + request.body_size;
+
+            while (_offset < total) {
+                const size_t space = transport.space();
+                if (!space) {
+                    return out;
+                }
+
+                size_t wrote { 0 };
+                if (_offset < head) {
+                    wrote = transport.write(
+                        request.head.c_str() + _offset,
+                        std::min(space, head - _offset));
+                } else {
+                    const size_t offset = _offset - head;
+                    const size_t size = std::min({space, BufferSize, request.body_size - offset});
+
+                    const size_t produced = request.body
+                        ? request.body(_buffer, size, offset)
+                        : 0;
+                    if (produced != size) {
+                        _broken = true;
+                        return out;
+                    }
+
+                    wrote = transport.write(reinterpret_cast<const char*>(_buffer), size);
+                    if (wrote != size) {
+                        _broken = true;
+                        return out;
+                    }
+                }
+
+                if (!wrote) {
+                    return out;
+                }
+
+                _offset += wrote;
+                out += wrote;
+            }
+
+            ++_sent;
+            _offset = 0;
+        }
+
+        return out;
+    }
+
+    // Responses always arrive in the same order as the requests
+    void receive(const uint8_t* data, size_t size) {
+        while (size && !_broken) {
+            if (!in_flight()) {
+                _broken = true;
+                break;
+            }
+
+            auto& request = _requests.front();
+            const size_t parsed = _parser.parse(data, size,
+                [&](const uint8_t* body, size_t length) {
+                    if (request.on_body) {
+                        request.on_body(body, length);
+                    }
+                });
+
+            data += parsed;
+            size -= parsed;
+
+            if (_parser.error()) {
+                _broken = true;
+                complete(0, Error::Response);
+                break;
+            }
+
+            if (_parser.done()) {
+                const bool keep_alive = _parser.keep_alive();
+                const int status = _parser.status();
+
+                // Response may arrive before the request is fully written
+                if (!_sent) {
+                    _broken = true;
+                }
+
+                complete(status, Error::None);
+
+                if (!keep_alive) {
+                    _closing = true;
+                    break;
+                }
+
+                _confirmed = true;
+            }
+        }
+    }
+
+    // Once the connection is closed, only the idempotent requests that were sent but did not receive anything are repeated
+    void closed(Error error) {
+        if (in_flight()) {
+            _parser.finish();
+            if (_parser.done()) {
+                complete(_parser.status(), Error::None);
+            } else if (_parser.started()) {
+                complete(0, error);
+            }
+        }
+
+        size_t index { 0 };
+        size_t pending = in_flight();
+        while (pending--) {
+            auto& request = _requests[index];
+            if (request.idempotent && request.retries) {
+                --request.retries;
+                ++index;
+                continue;
+            }
+
+            auto failed = std::move(request);
+            _requests.erase(_requests.begin() + index);
+            notify(failed, 0, error);
+        }
+
+        restart();
+    }
+
+    // Every request fails, e.g. when connection could not be established
+    void abort(Error error) {
+        auto requests = std::move(_requests);
+        _requests.clear();
+        restart();
+
+        for (auto& request : requests) {
+            notify(request, 0, error);
+        }
+    }
+
+private:
+    size_t limit() const {
+        return _confirmed ? _depth : 1;
+    }
+
+    void restart() {
+        _parser.reset();
+        _sent = 0;
+        _offset = 0;
+        _confirmed = false;
+        _closing = false;
+        _broken = false;
+    }
+
+    static void notify(Request& request, int status, Error error) {
+        if (request.on_complete) {
+            request.on_complete(status, error);
+        }
+    }
+
+    // Callback is allowed to push more requests
+    void complete(int status, Error error) {
+        auto request = std::move(_requests.front());
+        _requests.pop_front();
+        if (_sent) {
+            --_sent;
+        } else {
+            _offset = 0;
+        }
+
+        _parser.reset();
+        notify(request, status, error);
+    }
+
+    size_t _depth;
+
+    std::deque<Request> _requests;
+    size_t _sent { 0 };
+    size_t _offset { 0 };
+
+    Parser _parser;
+    bool _confirmed { false };
+    bool _closing { false };
+    bool _broken { false };
+
+    uint8_t _buffer[BufferSize];
+};
+
+} // namespace http
+} // namespace espurna
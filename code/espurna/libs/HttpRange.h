@@ -0,0 +1,129 @@
+/*
+
+Part of the WEBSERVER MODULE
+
+HTTP Range request header parser (RFC 7233)
+
+Only a single byte range is supported. Multiple ranges and anything that could not be
+parsed are ignored, which the RFC allows, and the full content should be sent instead
+
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace espurna {
+namespace web {
+namespace range {
+
+struct Range {
+    enum class Type {
+        Full,
+        Partial,
+        Unsatisfiable,
+    };
+
+    Type type;
+    size_t start;
+    size_t end;
+
+    size_t length() const {
+        return (type == Type::Partial) ? (end - start + 1) : 0;
+    }
+};
+
+namespace internal {
+
+// Returns pointer to the first character that is not a digit, or nullptr when there are no digits.
+// Values that do not fit are saturated, since they are clamped to the content length anyway
+inline const char* number(const char* ptr, const char* end, size_t& out) {
+    static constexpr size_t Max = static_cast<size_t>(-1);
+    const char* begin = ptr;
+
+    out = 0;
+    while ((ptr != end) && (*ptr >= '0') && (*ptr <= '9')) {
+        const size_t digit = static_cast<size_t>(*ptr - '0');
+        out = (out > ((Max - digit) / 10)) ? Max : ((out * 10) + digit);
+        ++ptr;
+    }
+
+    return (ptr != begin) ? ptr : nullptr;
+}
+
+} // namespace internal
+
+inline Range parse(const char* value, size_t length, size_t total) {
+    static constexpr char Prefix[] = "bytes=";
+    static constexpr size_t PrefixLength = sizeof(Prefix) - 1;
+
+    const Range Full{Range::Type::Full, 0, 0};
+    const Range Unsatisfiable{Range::Type::Unsatisfiable, 0, 0};
+
+    if ((length <= PrefixLength) || (std::strncmp(value, Prefix, PrefixLength) != 0)) {
+        return Full;
+    }
+
+    const char* ptr = value + PrefixLength;
+    const char* end = value + length;
+
+    if (std::memchr(ptr, ',', end - ptr)) {
+        return Full;
+    }
+
+    // bytes=-<suffix length>
+    if (*ptr == '-') {
+        size_t suffix;
+        ptr = internal::number(ptr + 1, end, suffix);
+        if (!ptr || (ptr != end)) {
+            return Full;
+        }
+
+        if (!suffix || !total) {
+            return Unsatisfiable;
+        }
+
+        if (suffix > total) {
+            suffix = total;
+        }
+
+        return Range{Range::Type::Partial, total - suffix, total - 1};
+    }
+
+    // bytes=<first>-[<last>]
+    size_t first;
+    ptr = internal::number(ptr, end, first);
+    if (!ptr || (ptr == end) || (*ptr != '-')) {
+        return Full;
+    }
+
+    size_t last { total ? (total - 1) : 0 };
+    ++ptr;
+
+    if (ptr != end) {
+        ptr = internal::number(ptr, end, last);
+        if (!ptr || (ptr != end) || (last < first)) {
+            return Full;
+        }
+    }
+
+    if (first >= total) {
+        return Unsatisfiable;
+    }
+
+    if (last >= total) {
+        last = total - 1;
+    }
+
+    return Range{Range::Type::Partial, first, last};
+}
+
+inline Range parse(const char* value, size_t total) {
+    return parse(value, std::strlen(value), total);
+}
+
+} // namespace range
+} // namespace web
+} // namespace espurna
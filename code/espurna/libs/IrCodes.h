@@ -0,0 +1,322 @@
+/*
+
+Part of the IR MODULE
+
+Received code -> command lookup, and compact representation of the raw timings
+
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace espurna {
+namespace ir {
+namespace codes {
+
+// Decoded value -> command index. Entries are only added when commands are (re)loaded,
+// so there's no removal and the table is simply rebuilt instead.
+// Table is kept at least half-empty, so probing always ends at the unused slot
+class Dictionary {
+public:
+    static constexpr uint16_t None { 0xffff };
+
+    void reset(size_t entries) {
+        size_t size { 4 };
+        while (size < (entries * 2)) {
+            size *= 2;
+        }
+
+        _entries.clear();
+        _entries.resize(size, Entry{0, None});
+        _size = 0;
+    }
+
+    size_t size() const {
+        return _size;
+    }
+
+    // Existing value is never replaced, the first added index always wins
+    bool insert(uint64_t value, uint16_t index) {
+        if (_entries.empty() || (index == None) || ((_size + 1) * 2 > _entries.size())) {
+            return false;
+        }
+
+        const size_t mask = _entries.size() - 1;
+        for (size_t slot = hash(value) & mask; ; slot = (slot + 1) & mask) {
+            auto& entry = _entries[slot];
+            if (entry.index == None) {
+                entry = Entry{value, index};
+                ++_size;
+                return true;
+            }
+
+            if (entry.value == value) {
+                return false;
+            }
+        }
+    }
+
+    uint16_t find(uint64_t value) const {
+        if (_entries.empty()) {
+            return None;
+        }
+
+        const size_t mask = _entries.size() - 1;
+        for (size_t slot = hash(value) & mask; ; slot = (slot + 1) & mask) {
+            const auto& entry = _entries[slot];
+            if ((entry.index == None) || (entry.value == value)) {
+                return entry.index;
+            }
+        }
+    }
+
+private:
+    struct Entry {
+        uint64_t value;
+        uint16_t index;
+    };
+
+    // Protocols tend to have a fixed prefix (e.g. address), so both halves are mixed
+    static uint32_t hash(uint64_t value) {
+        uint32_t out = static_cast<uint32_t>(value) ^ static_cast<uint32_t>(value >> 32);
+        out ^= out >> 16;
+        out *= 0x7feb352dul;
+        out ^= out >> 15;
+
+        return out;
+    }
+
+    std::vector<Entry> _entries;
+    size_t _size { 0 };
+};
+
+// Raw timings (in receiver ticks), packed as LEB128 varints and then base64-encoded for the text payload.
+// Timings are always alternating ON and OFF, so encoding works with (ON, OFF) pairs.
+// Pair that is repeated multiple times in a row is only encoded once, with the repeat count
+//
+// > varint(count)
+// > { varint(on), varint(off << 1 | repeated), [ varint(times - 2) ] }...
+// > [ varint(on) ] when count is odd
+namespace packed {
+
+namespace internal {
+
+template <typename T>
+void varint(T&& output, uint32_t value) {
+    while (value >= 0x80) {
+        output(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+
+    output(static_cast<uint8_t>(value));
+}
+
+class Reader {
+public:
+    Reader(const uint8_t* data, size_t size) :
+        _ptr(data),
+        _end(data + size)
+    {}
+
+    bool done() const {
+        return _ptr == _end;
+    }
+
+    bool varint(uint32_t& out) {
+        out = 0;
+        for (int shift = 0; shift < 32; shift += 7) {
+            if (_ptr == _end) {
+                return false;
+            }
+
+            const uint8_t byte = *(_ptr++);
+            out |= static_cast<uint32_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+private:
+    const uint8_t* _ptr;
+    const uint8_t* _end;
+};
+
+constexpr char Alphabet[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+inline int base64(char c) {
+    if ((c >= 'A') && (c <= 'Z')) {
+        return c - 'A';
+    } else if ((c >= 'a') && (c <= 'z')) {
+        return c - 'a' + 26;
+    } else if ((c >= '0') && (c <= '9')) {
+        return c - '0' + 52;
+    } else if (c == '+') {
+        return 62;
+    } else if (c == '/') {
+        return 63;
+    }
+
+    return -1;
+}
+
+} // namespace internal
+
+// Output receives every byte of the packed data
+template <typename T, typename Output>
+void encode(const T* begin, const T* end, Output&& output) {
+    internal::varint(output, end - begin);
+
+    const T* it = begin;
+    while ((end - it) >= 2) {
+        const uint32_t on = it[0];
+        const uint32_t off = it[1];
+
+        size_t times { 1 };
+        while (((end - it) >= static_cast<ptrdiff_t>((times + 1) * 2))
+            && (it[times * 2] == on)
+            && (it[(times * 2) + 1] == off))
+        {
+            ++times;
+        }
+
+        internal::varint(output, on);
+        internal::varint(output, (off << 1) | ((times > 1) ? 1 : 0));
+        if (times > 1) {
+            internal::varint(output, times - 2);
+        }
+
+        it += times * 2;
+    }
+
+    if (it != end) {
+        internal::varint(output, *it);
+    }
+}
+
+// Timings are appended to the output, unless there are more than `limit` of them or data is malformed
+template <typename T>
+bool decode(const uint8_t* data, size_t size, size_t limit, std::vector<T>& out) {
+    internal::Reader reader(data, size);
+
+    uint32_t count;
+    if (!reader.varint(count) || (count > limit)) {
+        return false;
+    }
+
+    const size_t start = out.size();
+    out.reserve(start + count);
+
+    auto value = [](uint32_t input, T& output) {
+        output = static_cast<T>(input);
+        return static_cast<uint32_t>(output) == input;
+    };
+
+    while ((out.size() - start) < count) {
+        uint32_t on;
+        T on_value;
+        if (!reader.varint(on) || !value(on, on_value)) {
+            return false;
+        }
+
+        if ((count - (out.size() - start)) == 1) {
+            out.push_back(on_value);
+            break;
+        }
+
+        uint32_t off;
+        T off_value;
+        if (!reader.varint(off) || !value(off >> 1, off_value)) {
+            return false;
+        }
+
+        uint32_t times { 1 };
+        if (off & 1) {
+            if (!reader.varint(times) || (times > (limit / 2))) {
+                return false;
+            }
+
+            times += 2;
+        }
+
+        if (((out.size() - start) + (times * 2)) > count) {
+            return false;
+        }
+
+        for (uint32_t index = 0; index < times; ++index) {
+            out.push_back(on_value);
+            out.push_back(off_value);
+        }
+    }
+
+    return reader.done();
+}
+
+// Output receives every 4 characters. No line breaks, and the last chunk is padded with '='
+template <typename T>
+void base64(const uint8_t* data, size_t size, T&& output) {
+    for (size_t index = 0; index < size; index += 3) {
+        const size_t remaining = size - index;
+
+        uint32_t value = static_cast<uint32_t>(data[index]) << 16;
+        if (remaining > 1) {
+            value |= static_cast<uint32_t>(data[index + 1]) << 8;
+        }
+        if (remaining > 2) {
+            value |= static_cast<uint32_t>(data[index + 2]);
+        }
+
+        const char chunk[4] {
+            internal::Alphabet[(value >> 18) & 0x3f],
+            internal::Alphabet[(value >> 12) & 0x3f],
+            (remaining > 1) ? internal::Alphabet[(value >> 6) & 0x3f] : '=',
+            (remaining > 2) ? internal::Alphabet[value & 0x3f] : '=',
+        };
+
+        output(chunk, sizeof(chunk));
+    }
+}
+
+// Padding is optional. Any other character that is not in the alphabet is an error
+inline bool unbase64(const char* begin, const char* end, std::vector<uint8_t>& out) {
+    while ((begin != end) && (*(end - 1) == '=')) {
+        --end;
+    }
+
+    if (((end - begin) % 4) == 1) {
+        return false;
+    }
+
+    out.reserve(out.size() + (((end - begin) * 3) / 4));
+
+    uint32_t value { 0 };
+    int bits { 0 };
+
+    for (const char* it = begin; it != end; ++it) {
+        const int decoded = internal::base64(*it);
+        if (decoded < 0) {
+            return false;
+        }
+
+        value = (value << 6) | static_cast<uint32_t>(decoded);
+        bits += 6;
+
+        if (bits >= 8) {
+            bits -= 8;
+            out.push_back(static_cast<uint8_t>(value >> bits));
+        }
+    }
+
+    return true;
+}
+
+} // namespace packed
+} // namespace codes
+} // namespace ir
+} // namespace espurna
@@ -0,0 +1,328 @@
+/*
+
+Append-only journal for monotonic counters
+
+Every update is stored as a fixed-size binary record, appended to the current sector.
+When sector is full, the next one in the ring is erased and every known counter is
+carried forward to its beginning. This way, only the head sector (and the one before it,
+in case carry forward was interrupted) needs to be scanned on boot, and every sector
+is erased once per `records per sector - counters` updates instead of on every update.
+
+Storage is expected to behave like a NOR flash:
+- erased sector is filled with 0xff
+- record can only be written once after the sector is erased
+
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace espurna {
+namespace journal {
+
+struct Value {
+    uint32_t data[2];
+    uint32_t timestamp;
+};
+
+inline bool operator==(const Value& lhs, const Value& rhs) {
+    return (lhs.data[0] == rhs.data[0])
+        && (lhs.data[1] == rhs.data[1]);
+}
+
+inline bool operator!=(const Value& lhs, const Value& rhs) {
+    return !(lhs == rhs);
+}
+
+struct Record {
+    static constexpr uint32_t Empty { 0xffffffff };
+
+    uint32_t sequence;
+    uint16_t id;
+    uint16_t checksum;
+    Value value;
+};
+
+static_assert(sizeof(Record) == 20, "");
+static_assert((sizeof(Record) % 4) == 0, "Flash writes are expected to be 4-byte aligned");
+
+// FNV-1a, folded into 16 bits. Avoid depending on the crc implementation from the Core
+inline uint16_t checksum(const Record& record) {
+    uint32_t out { 2166136261ul };
+
+    auto update = [&](uint32_t value) {
+        for (size_t byte = 0; byte < sizeof(value); ++byte) {
+            out ^= (value >> (byte * 8)) & 0xff;
+            out *= 16777619ul;
+        }
+    };
+
+    update(record.sequence);
+    update(record.id);
+    update(record.value.data[0]);
+    update(record.value.data[1]);
+    update(record.value.timestamp);
+
+    return static_cast<uint16_t>((out >> 16) ^ (out & 0xffff));
+}
+
+inline bool empty(const Record& record) {
+    const auto* ptr = reinterpret_cast<const uint8_t*>(&record);
+    for (size_t index = 0; index < sizeof(Record); ++index) {
+        if (ptr[index] != 0xff) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+inline bool valid(const Record& record) {
+    return (record.sequence != Record::Empty)
+        && (record.checksum == checksum(record));
+}
+
+// Storage must implement:
+// - size_t sectors() const
+// - size_t sector_size() const
+// - bool erase(size_t sector)
+// - bool read(size_t sector, size_t offset, Record&)
+// - bool write(size_t sector, size_t offset, const Record&)
+template <typename Storage>
+class Journal {
+public:
+    struct Entry {
+        uint16_t id;
+        uint32_t sequence;
+        Value value;
+    };
+
+    using Entries = std::vector<Entry>;
+
+    explicit Journal(Storage storage) :
+        _storage(std::move(storage))
+    {}
+
+    Storage& storage() {
+        return _storage;
+    }
+
+    size_t records() const {
+        return _storage.sector_size() / sizeof(Record);
+    }
+
+    size_t head() const {
+        return _head;
+    }
+
+    size_t offset() const {
+        return _offset;
+    }
+
+    uint32_t sequence() const {
+        return _sequence;
+    }
+
+    const Entries& entries() const {
+        return _entries;
+    }
+
+    // Find the most recent sector and load the latest value of every counter
+    void begin() {
+        _entries.clear();
+        _sequence = 0;
+        _head = 0;
+        _offset = records();
+
+        const auto sectors = _storage.sectors();
+        if (!sectors) {
+            return;
+        }
+
+        bool found { false };
+        uint32_t latest { 0 };
+
+        Record record;
+        for (size_t sector = 0; sector < sectors; ++sector) {
+            if (!_storage.read(sector, 0, record) || !valid(record)) {
+                continue;
+            }
+
+            if (!found || (record.sequence > latest)) {
+                found = true;
+                latest = record.sequence;
+                _head = sector;
+            }
+        }
+
+        // Nothing was ever written, next append() would erase the first sector
+        if (!found) {
+            _head = sectors - 1;
+            return;
+        }
+
+        // Carry forward might've been interrupted, so also check out the previous sector
+        // (which would only happen when there are at least two of them)
+        if (sectors > 1) {
+            const auto previous = (_head + sectors - 1) % sectors;
+            if (_storage.read(previous, 0, record) && valid(record) && (record.sequence < latest)) {
+                _scan(previous);
+            }
+        }
+
+        _offset = _scan(_head);
+    }
+
+    bool get(uint16_t id, Value& out) const {
+        const auto* entry = _find(id);
+        if (entry) {
+            out = entry->value;
+            return true;
+        }
+
+        return false;
+    }
+
+    // Store the latest value, skipping the write when nothing changed
+    bool append(uint16_t id, Value value) {
+        auto* entry = _find(id);
+        if (entry && (entry->value == value)) {
+            return true;
+        }
+
+        if (_offset >= records()) {
+            if (!_rotate()) {
+                return false;
+            }
+        }
+
+        if (!_write(id, value)) {
+            return false;
+        }
+
+        return true;
+    }
+
+private:
+    const Entry* _find(uint16_t id) const {
+        for (const auto& entry : _entries) {
+            if (entry.id == id) {
+                return &entry;
+            }
+        }
+
+        return nullptr;
+    }
+
+    Entry* _find(uint16_t id) {
+        for (auto& entry : _entries) {
+            if (entry.id == id) {
+                return &entry;
+            }
+        }
+
+        return nullptr;
+    }
+
+    void _update(uint16_t id, uint32_t sequence, Value value) {
+        auto* entry = _find(id);
+        if (!entry) {
+            _entries.push_back(Entry{
+                .id = id,
+                .sequence = sequence,
+                .value = value,
+            });
+            return;
+        }
+
+        if (entry->sequence < sequence) {
+            entry->sequence = sequence;
+            entry->value = value;
+        }
+    }
+
+    // Returns the offset of the first empty record. Broken records still take up space
+    size_t _scan(size_t sector) {
+        size_t out { 0 };
+
+        Record record;
+        for (size_t offset = 0; offset < records(); ++offset) {
+            if (!_storage.read(sector, offset, record)) {
+                break;
+            }
+
+            if (empty(record)) {
+                break;
+            }
+
+            out = offset + 1;
+            if (!valid(record)) {
+                continue;
+            }
+
+            _update(record.id, record.sequence, record.value);
+            if (record.sequence >= _sequence) {
+                _sequence = record.sequence + 1;
+            }
+        }
+
+        return out;
+    }
+
+    bool _write(uint16_t id, Value value) {
+        Record record;
+        record.sequence = _sequence;
+        record.id = id;
+        record.value = value;
+        record.checksum = checksum(record);
+
+        const auto offset = _offset++;
+        if (!_storage.write(_head, offset, record)) {
+            return false;
+        }
+
+        ++_sequence;
+        _update(id, record.sequence, value);
+
+        return true;
+    }
+
+    bool _rotate() {
+        if (_entries.size() >= records()) {
+            return false;
+        }
+
+        _head = (_head + 1) % _storage.sectors();
+        _offset = 0;
+
+        if (!_storage.erase(_head)) {
+            _offset = records();
+            return false;
+        }
+
+        // Sector is always started with the current state, which
+        // also marks it as the most recent one for begin()
+        for (const auto& entry : _entries) {
+            if (!_write(entry.id, entry.value)) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    Storage _storage;
+
+    Entries _entries;
+    uint32_t _sequence { 0 };
+
+    size_t _head { 0 };
+    size_t _offset { 0 };
+};
+
+} // namespace journal
+} // namespace espurna
@@ -0,0 +1,258 @@
+/*
+
+Ring of variable-length log records, shared between multiple readers
+
+Producer appends records and never waits for anyone. When there's no space left, the oldest
+records are evicted. Every reader has its own cursor and can drain the ring at its own pace,
+records that were evicted before the reader got to them are added to its own drop counter.
+
+Every record is stored contiguously, as the header followed by the data and a trailing '\0'.
+When the record does not fit at the end of the storage, the remaining space is skipped and the
+record is stored at the start instead. So, readers are able to use the data as-is.
+
+Positions are free-running and are only masked when accessing the storage. Nothing is locked,
+on ESP8266 both CONT and SYS contexts are cooperative and never preempt each other. Appending
+from an ISR is not supported, and readers are not expected to yield while handling the record.
+
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+namespace espurna {
+namespace debug {
+
+class LogRing {
+public:
+    // Lower bits are free to use by the producer, higher ones are reserved
+    static constexpr uint8_t FlagSkip { 1 << 7 };
+
+    struct Record {
+        uint32_t timestamp;
+        uint8_t flags;
+        const char* data;
+        size_t length;
+    };
+
+    struct Cursor {
+        uint32_t position;
+        uint32_t sequence;
+        uint32_t dropped;
+    };
+
+    static constexpr size_t Alignment { 4 };
+    static constexpr size_t HeaderSize { 8 };
+
+    LogRing() = default;
+
+    explicit LogRing(size_t capacity) {
+        reset(capacity);
+    }
+
+    // Capacity is always a power of two, so positions are able to wrap around
+    void reset(size_t capacity) {
+        size_t size { 0 };
+        if (capacity >= (HeaderSize * 4)) {
+            size = 1;
+            while ((size * 2) <= capacity) {
+                size *= 2;
+            }
+        }
+
+        _storage.reset(size ? new (std::nothrow) uint8_t[size] : nullptr);
+        _capacity = _storage ? size : 0;
+
+        _head = 0;
+        _tail = 0;
+        _head_sequence = 0;
+        _tail_sequence = 0;
+    }
+
+    explicit operator bool() const {
+        return _capacity > 0;
+    }
+
+    size_t capacity() const {
+        return _capacity;
+    }
+
+    size_t size() const {
+        return _head - _tail;
+    }
+
+    // Longer records are truncated, so every record is at most a half of the storage
+    size_t maxLength() const {
+        return (_capacity / 2) - HeaderSize - Alignment;
+    }
+
+    // Total number of records that were ever evicted, regardless of the readers
+    uint32_t evicted() const {
+        return _tail_sequence;
+    }
+
+    bool append(uint32_t timestamp, uint8_t flags, const char* data, size_t length) {
+        if (!_capacity) {
+            return false;
+        }
+
+        length = (length > maxLength()) ? maxLength() : length;
+
+        const size_t size = align(HeaderSize + length + 1);
+        const size_t remaining = _capacity - offset(_head);
+        const size_t skip = (remaining < size) ? remaining : 0;
+
+        while ((_head + skip + size - _tail) > _capacity) {
+            bool skipped;
+            _tail += next(_tail, skipped);
+            if (!skipped) {
+                ++_tail_sequence;
+            }
+        }
+
+        if (skip) {
+            if (skip >= HeaderSize) {
+                writeHeader(_head, 0, FlagSkip, 0);
+            }
+            _head += skip;
+        }
+
+        writeHeader(_head, length, flags & ~FlagSkip, timestamp);
+
+        auto* ptr = &_storage[offset(_head) + HeaderSize];
+        std::memcpy(ptr, data, length);
+        ptr[length] = '\0';
+
+        _head += size;
+        ++_head_sequence;
+
+        return true;
+    }
+
+    // New readers either start from the oldest record, or only see the ones appended after them
+    Cursor begin() const {
+        return Cursor{_tail, _tail_sequence, 0};
+    }
+
+    Cursor end() const {
+        return Cursor{_head, _head_sequence, 0};
+    }
+
+    // Move the cursor to the end, without counting anything as dropped
+    void skip(Cursor& cursor) const {
+        cursor.position = _head;
+        cursor.sequence = _head_sequence;
+    }
+
+    // Callback receives every Record after the cursor and returns `false` when it is unable to handle it.
+    // Reading stops at the specified position, any record appended after that is not visited
+    template <typename T>
+    size_t read(Cursor& cursor, uint32_t until, T&& callback) const {
+        size_t out { 0 };
+
+        for (;;) {
+            if (static_cast<int32_t>(_tail - cursor.position) > 0) {
+                cursor.dropped += _tail_sequence - cursor.sequence;
+                cursor.position = _tail;
+                cursor.sequence = _tail_sequence;
+            }
+
+            if ((cursor.position == _head) || (static_cast<int32_t>(until - cursor.position) <= 0)) {
+                break;
+            }
+
+            bool skipped;
+            const auto size = next(cursor.position, skipped);
+            if (skipped) {
+                cursor.position += size;
+                continue;
+            }
+
+            if (!callback(record(cursor.position))) {
+                break;
+            }
+
+            cursor.position += size;
+            ++cursor.sequence;
+            ++out;
+        }
+
+        return out;
+    }
+
+    template <typename T>
+    size_t read(Cursor& cursor, T&& callback) const {
+        return read(cursor, _head, callback);
+    }
+
+private:
+    static constexpr size_t align(size_t size) {
+        return (size + Alignment - 1) & ~(Alignment - 1);
+    }
+
+    size_t offset(uint32_t position) const {
+        return position & (_capacity - 1);
+    }
+
+    void writeHeader(uint32_t position, size_t length, uint8_t flags, uint32_t timestamp) {
+        auto* ptr = &_storage[offset(position)];
+
+        const uint16_t len = length;
+        std::memcpy(ptr, &len, sizeof(len));
+        ptr[2] = flags;
+        ptr[3] = 0;
+        std::memcpy(ptr + 4, &timestamp, sizeof(timestamp));
+    }
+
+    // Size of the record at the position. End of the storage is implicitly skipped when the header does not fit
+    size_t next(uint32_t position, bool& skipped) const {
+        const size_t remaining = _capacity - offset(position);
+        if (remaining < HeaderSize) {
+            skipped = true;
+            return remaining;
+        }
+
+        const auto* ptr = &_storage[offset(position)];
+        skipped = (ptr[2] & FlagSkip) != 0;
+        if (skipped) {
+            return remaining;
+        }
+
+        uint16_t length;
+        std::memcpy(&length, ptr, sizeof(length));
+
+        return align(HeaderSize + length + 1);
+    }
+
+    Record record(uint32_t position) const {
+        const auto* ptr = &_storage[offset(position)];
+
+        uint16_t length;
+        std::memcpy(&length, ptr, sizeof(length));
+
+        uint32_t timestamp;
+        std::memcpy(&timestamp, ptr + 4, sizeof(timestamp));
+
+        return Record{
+            .timestamp = timestamp,
+            .flags = ptr[2],
+            .data = reinterpret_cast<const char*>(ptr + HeaderSize),
+            .length = length,
+        };
+    }
+
+    std::unique_ptr<uint8_t[]> _storage;
+    size_t _capacity { 0 };
+
+    uint32_t _head { 0 };
+    uint32_t _tail { 0 };
+
+    uint32_t _head_sequence { 0 };
+    uint32_t _tail_sequence { 0 };
+};
+
+} // namespace debug
+} // namespace espurna
@@ -0,0 +1,185 @@
+/*
+
+Part of the SCHEDULER MODULE
+
+Next event time calculation and the event queue ordered by it
+
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <vector>
+
+namespace espurna {
+namespace scheduler {
+namespace events {
+
+// Time of the day, matching any of the weekdays
+// Weekdays mask uses TimeLib order, Monday as bit 0 and Sunday as bit 6
+struct Time {
+    int weekdays;
+    int hour;
+    int minute;
+    int second;
+    bool utc;
+};
+
+static constexpr time_t Never { -1 };
+
+namespace internal {
+
+static constexpr time_t SecondsPerDay { 60 * 60 * 24 };
+static constexpr int DaysPerWeek { 7 };
+
+inline bool weekday(int weekdays, int wday) {
+    return weekdays & (1 << ((wday + 6) % DaysPerWeek));
+}
+
+inline int seconds(int hour, int minute, int second) {
+    return (hour * 60 * 60) + (minute * 60) + second;
+}
+
+inline int seconds(const Time& time) {
+    return seconds(time.hour, time.minute, time.second);
+}
+
+inline int seconds(const tm& time) {
+    return seconds(time.tm_hour, time.tm_min, time.tm_sec);
+}
+
+// No timegm in newlib, but UTC days are always the same length
+inline time_t nextUtc(const Time& time, time_t after) {
+    const time_t midnight = after - (after % SecondsPerDay);
+    const int offset = (after % SecondsPerDay) < seconds(time) ? 0 : 1;
+
+    for (int day = offset; day <= DaysPerWeek; ++day) {
+        const time_t start = midnight + (day * SecondsPerDay);
+
+        // 1970-01-01 is Thursday
+        const int wday = static_cast<int>(((start / SecondsPerDay) + 4) % DaysPerWeek);
+        if (weekday(time.weekdays, wday)) {
+            return start + seconds(time);
+        }
+    }
+
+    return Never;
+}
+
+// Local date is shifted by N days and mktime() figures out the actual timestamp, using the DST rules
+// of that specific day. When the wall clock time does not exist (i.e. DST gap), result is shifted forward.
+// When it happens twice (i.e. DST overlap), only one of them is used. Comparing wall clock instead of the
+// timestamp makes sure the same day is never used twice
+inline time_t nextLocal(const Time& time, time_t after) {
+    tm today;
+    localtime_r(&after, &today);
+
+    const int offset = seconds(today) < seconds(time) ? 0 : 1;
+
+    for (int day = offset; day <= DaysPerWeek; ++day) {
+        tm next{};
+        next.tm_year = today.tm_year;
+        next.tm_mon = today.tm_mon;
+        next.tm_mday = today.tm_mday + day;
+        next.tm_hour = time.hour;
+        next.tm_min = time.minute;
+        next.tm_sec = time.second;
+        next.tm_isdst = -1;
+
+        const time_t out = mktime(&next);
+        if (out == static_cast<time_t>(-1)) {
+            break;
+        }
+
+        // tm_wday is updated by mktime() and could belong to the next day when shifted by DST
+        const int wday = (today.tm_wday + day) % DaysPerWeek;
+        if (weekday(time.weekdays, wday) && (out > after)) {
+            return out;
+        }
+    }
+
+    return Never;
+}
+
+} // namespace internal
+
+// Earliest timestamp after the specified one, or `Never` when no weekdays are set
+inline time_t next(const Time& time, time_t after) {
+    if (!(time.weekdays & 0x7f)) {
+        return Never;
+    }
+
+    return time.utc
+        ? internal::nextUtc(time, after)
+        : internal::nextLocal(time, after);
+}
+
+// Min-heap of pending events, only the earliest one needs to be checked
+class Queue {
+public:
+    struct Event {
+        time_t timestamp;
+        size_t id;
+    };
+
+    void clear() {
+        _events.clear();
+    }
+
+    void reserve(size_t size) {
+        _events.reserve(size);
+    }
+
+    bool empty() const {
+        return _events.empty();
+    }
+
+    size_t size() const {
+        return _events.size();
+    }
+
+    void push(time_t timestamp, size_t id) {
+        _events.push_back(Event{timestamp, id});
+        std::push_heap(_events.begin(), _events.end(), compare);
+    }
+
+    const Event& top() const {
+        return _events.front();
+    }
+
+    Event pop() {
+        std::pop_heap(_events.begin(), _events.end(), compare);
+        const auto out = _events.back();
+        _events.pop_back();
+
+        return out;
+    }
+
+    // Callback receives every event that is due at the specified time, in order
+    template <typename T>
+    size_t expire(time_t now, T&& callback) {
+        size_t out { 0 };
+        while (!_events.empty() && (top().timestamp <= now)) {
+            callback(pop());
+            ++out;
+        }
+
+        return out;
+    }
+
+private:
+    // Same timestamp is ordered by id, so events always happen in the settings order
+    static bool compare(const Event& lhs, const Event& rhs) {
+        return (lhs.timestamp > rhs.timestamp)
+            || ((lhs.timestamp == rhs.timestamp) && (lhs.id > rhs.id));
+    }
+
+    std::vector<Event> _events;
+};
+
+} // namespace events
+} // namespace scheduler
+} // namespace espurna
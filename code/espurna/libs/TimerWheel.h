@@ -0,0 +1,429 @@
+/*
+
+Part of the SYSTEM MODULE
+
+Hashed timer wheel. Timers are intrusive nodes placed into the slot of their expiry tick,
+only the slots between the previous and the current time are visited when time advances.
+Callbacks run in the caller context, in the expiry order.
+
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <utility>
+
+namespace espurna {
+namespace timer {
+
+struct Stats {
+    uint32_t runs { 0 };
+
+    // Callback ran later than the expected tolerance, or the periodic timer missed its period
+    uint32_t overruns { 0 };
+
+    // Time between expiry and the callback (ms)
+    uint32_t late_max { 0 };
+
+    // Time spent in the callback (us)
+    uint32_t runtime_max { 0 };
+    uint64_t runtime_total { 0 };
+};
+
+class Wheel;
+
+class Timer {
+public:
+    using Callback = std::function<void()>;
+
+    Timer() = default;
+
+    explicit Timer(const char* name) :
+        _name(name)
+    {}
+
+    Timer(const Timer&) = delete;
+    Timer& operator=(const Timer&) = delete;
+
+    ~Timer();
+
+    bool armed() const {
+        return _list != nullptr;
+    }
+
+    const char* name() const {
+        return _name;
+    }
+
+    uint32_t expiry() const {
+        return _expiry;
+    }
+
+    uint32_t period() const {
+        return _period;
+    }
+
+    const Stats& stats() const {
+        return _stats;
+    }
+
+private:
+    friend class Wheel;
+
+    struct List {
+        Timer* head { nullptr };
+    };
+
+    Timer* _prev { nullptr };
+    Timer* _next { nullptr };
+    List* _list { nullptr };
+
+    // Every timer that was ever armed is also known to the wheel, so its stats could be reported
+    Timer* _known_prev { nullptr };
+    Timer* _known_next { nullptr };
+    Wheel* _wheel { nullptr };
+
+    Callback _callback;
+    uint32_t _expiry { 0 };
+    uint32_t _period { 0 };
+    uint32_t _generation { 0 };
+
+    const char* _name { nullptr };
+    Stats _stats;
+};
+
+class Wheel {
+public:
+    static constexpr size_t Slots { 64 };
+    static constexpr uint32_t Resolution { 16 };
+
+    static constexpr uint32_t Never { UINT32_MAX };
+
+    // Source of microseconds for the callback runtime, optional
+    using Runtime = uint32_t(*)();
+
+    Wheel() = default;
+
+    Wheel(uint32_t tolerance, Runtime runtime) :
+        _tolerance(tolerance),
+        _runtime(runtime)
+    {}
+
+    Wheel(const Wheel&) = delete;
+    Wheel& operator=(const Wheel&) = delete;
+
+    ~Wheel() {
+        while (_known) {
+            forget(*_known);
+        }
+    }
+
+    void tolerance(uint32_t value) {
+        _tolerance = value;
+    }
+
+    void once(Timer& timer, uint32_t now, uint32_t delay, Timer::Callback callback) {
+        arm(timer, now, now + delay, 0, std::move(callback));
+    }
+
+    void repeat(Timer& timer, uint32_t now, uint32_t period, Timer::Callback callback) {
+        arm(timer, now, now + period, period ? period : 1, std::move(callback));
+    }
+
+    // Absolute time, expiry in the past runs the callback on the next advance
+    void at(Timer& timer, uint32_t now, uint32_t expiry, Timer::Callback callback) {
+        arm(timer, now, expiry, 0, std::move(callback));
+    }
+
+    void cancel(Timer& timer) {
+        if (timer._list) {
+            unlink(timer);
+            --_armed;
+        }
+        ++timer._generation;
+    }
+
+    size_t armed() const {
+        return _armed;
+    }
+
+    // Stats of every timer that finished running
+    const Stats& total() const {
+        return _total;
+    }
+
+    // Time until the next expiry, zero when something is already expired or `Never` when nothing is armed
+    uint32_t next(uint32_t now) const {
+        uint32_t out { Never };
+
+        for (const auto& slot : _slots) {
+            for (auto* timer = slot.head; timer; timer = timer->_next) {
+                const auto remaining = static_cast<int32_t>(timer->_expiry - now);
+                if (remaining <= 0) {
+                    return 0;
+                }
+
+                if (static_cast<uint32_t>(remaining) < out) {
+                    out = remaining;
+                }
+            }
+        }
+
+        return out;
+    }
+
+    // Runs every expired callback. Slots are only visited once, even when more than a full turn has passed.
+    // Callbacks are allowed to arm or cancel any timer, including themselves and the ones that are about to run
+    size_t advance(uint32_t now) {
+        const uint32_t current = now / Resolution;
+
+        size_t ticks = current - _tick;
+        if (ticks >= Slots) {
+            ticks = Slots - 1;
+        }
+
+        for (uint32_t tick = current - ticks; tick != current + 1; ++tick) {
+            auto& slot = _slots[tick % Slots];
+
+            Timer* timer = slot.head;
+            while (timer) {
+                Timer* next = timer->_next;
+                if (static_cast<int32_t>(now - timer->_expiry) >= 0) {
+                    unlink(*timer);
+                    expire(*timer);
+                }
+                timer = next;
+            }
+        }
+
+        _tick = current;
+        _now = now;
+
+        size_t out { 0 };
+        while (_expired.head) {
+            run(*_expired.head, now);
+            ++out;
+        }
+
+        return out;
+    }
+
+    template <typename T>
+    void foreach(T&& callback) const {
+        for (const Timer* timer = _known; timer; timer = timer->_known_next) {
+            callback(*timer);
+        }
+    }
+
+private:
+    friend class Timer;
+
+    static uint32_t diff(uint32_t lhs, uint32_t rhs) {
+        return static_cast<int32_t>(lhs - rhs) > 0 ? lhs - rhs : 0;
+    }
+
+    static void link(Timer::List& list, Timer& timer) {
+        timer._list = &list;
+        timer._prev = nullptr;
+        timer._next = list.head;
+        if (list.head) {
+            list.head->_prev = &timer;
+        }
+        list.head = &timer;
+    }
+
+    static void unlink(Timer& timer) {
+        if (timer._prev) {
+            timer._prev->_next = timer._next;
+        } else {
+            timer._list->head = timer._next;
+        }
+
+        if (timer._next) {
+            timer._next->_prev = timer._prev;
+        }
+
+        timer._prev = nullptr;
+        timer._next = nullptr;
+        timer._list = nullptr;
+    }
+
+    void remember(Timer& timer) {
+        if (timer._wheel == this) {
+            return;
+        }
+
+        if (timer._wheel) {
+            timer._wheel->forget(timer);
+        }
+
+        timer._wheel = this;
+        timer._known_prev = nullptr;
+        timer._known_next = _known;
+        if (_known) {
+            _known->_known_prev = &timer;
+        }
+        _known = &timer;
+    }
+
+    void forget(Timer& timer) {
+        if (timer._list) {
+            unlink(timer);
+            --_armed;
+        }
+
+        if (timer._known_prev) {
+            timer._known_prev->_known_next = timer._known_next;
+        } else {
+            _known = timer._known_next;
+        }
+
+        if (timer._known_next) {
+            timer._known_next->_known_prev = timer._known_prev;
+        }
+
+        if (_running == &timer) {
+            _running = nullptr;
+        }
+
+        timer._known_prev = nullptr;
+        timer._known_next = nullptr;
+        timer._wheel = nullptr;
+    }
+
+    // Expiry tick can't be earlier than the one already visited
+    void schedule(Timer& timer, uint32_t expiry) {
+        if (static_cast<int32_t>(expiry - _now) < 0) {
+            expiry = _now;
+        }
+
+        timer._expiry = expiry;
+        link(_slots[(expiry / Resolution) % Slots], timer);
+        ++_armed;
+    }
+
+    void arm(Timer& timer, uint32_t now, uint32_t expiry, uint32_t period, Timer::Callback callback) {
+        remember(timer);
+        cancel(timer);
+
+        if (static_cast<int32_t>(now - _now) > 0) {
+            advance_time(now);
+        }
+
+        timer._callback = std::move(callback);
+        timer._period = period;
+        schedule(timer, expiry);
+    }
+
+    // Nothing was armed yet, time can move forward without visiting the slots
+    void advance_time(uint32_t now) {
+        if (!_armed) {
+            _tick = now / Resolution;
+            _now = now;
+        }
+    }
+
+    // Expired list is kept in the expiry order. Timer is still considered armed until it runs
+    void expire(Timer& timer) {
+        Timer* prev { nullptr };
+        for (Timer* it = _expired.head; it; it = it->_next) {
+            if (static_cast<int32_t>(it->_expiry - timer._expiry) > 0) {
+                break;
+            }
+            prev = it;
+        }
+
+        if (!prev) {
+            link(_expired, timer);
+            return;
+        }
+
+        timer._list = &_expired;
+        timer._prev = prev;
+        timer._next = prev->_next;
+        if (prev->_next) {
+            prev->_next->_prev = &timer;
+        }
+        prev->_next = &timer;
+    }
+
+    void run(Timer& timer, uint32_t now) {
+        unlink(timer);
+        --_armed;
+
+        const uint32_t late = diff(now, timer._expiry);
+        bool overrun = late > _tolerance;
+
+        // Periodic timer is re-armed before the callback, which then is allowed to cancel it
+        if (timer._period) {
+            uint32_t next = timer._expiry + timer._period;
+            if (static_cast<int32_t>(now - next) >= 0) {
+                next = now + timer._period;
+                overrun = true;
+            }
+            schedule(timer, next);
+        }
+
+        // Callback could replace itself by re-arming the timer
+        const auto generation = timer._generation;
+        auto callback = std::move(timer._callback);
+
+        _running = &timer;
+        const uint32_t start = _runtime ? _runtime() : 0;
+        if (callback) {
+            callback();
+        }
+        const uint32_t runtime = _runtime ? (_runtime() - start) : 0;
+
+        update(_total, late, runtime, overrun);
+
+        // Timer object might have been destroyed by the callback
+        if (_running == &timer) {
+            _running = nullptr;
+            update(timer._stats, late, runtime, overrun);
+            if (timer._generation == generation) {
+                timer._callback = std::move(callback);
+            }
+        }
+    }
+
+    static void update(Stats& stats, uint32_t late, uint32_t runtime, bool overrun) {
+        ++stats.runs;
+        if (overrun) {
+            ++stats.overruns;
+        }
+        if (late > stats.late_max) {
+            stats.late_max = late;
+        }
+        if (runtime > stats.runtime_max) {
+            stats.runtime_max = runtime;
+        }
+        stats.runtime_total += runtime;
+    }
+
+    Timer::List _slots[Slots];
+    Timer::List _expired;
+
+    Timer* _known { nullptr };
+    Timer* _running { nullptr };
+
+    uint32_t _tick { 0 };
+    uint32_t _now { 0 };
+    size_t _armed { 0 };
+
+    uint32_t _tolerance { UINT32_MAX };
+    Runtime _runtime { nullptr };
+
+    Stats _total;
+};
+
+inline Timer::~Timer() {
+    if (_wheel) {
+        _wheel->forget(*this);
+    }
+}
+
+} // namespace timer
+} // namespace espurna
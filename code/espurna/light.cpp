@@ -12,13 +12,13 @@ Copyright (C) 2019-2021 by Maxim Prokhorov <prokhorov dot max at outlook dot com
 #if LIGHT_PROVIDER != LIGHT_PROVIDER_NONE
 
 #include "api.h"
+#include "light_transition.h"
 #include "mqtt.h"
 #include "relay.h"
 #include "rpc.h"
 #include "rtcmem.h"
 #include "ws.h"
 
-#include <Ticker.h>
 #include <Schedule.h>
 #include <ArduinoJson.h>
 
@@ -94,6 +94,10 @@ constexpr bool gamma() {
     return 1 == LIGHT_USE_GAMMA;
 }
 
+constexpr double gammaExponent() {
+    return LIGHT_GAMMA_EXPONENT;
+}
+
 constexpr bool transition() {
     return 1 == LIGHT_USE_TRANSITIONS;
 }
@@ -106,6 +110,12 @@ constexpr espurna::duration::Milliseconds transitionStep() {
     return espurna::duration::Milliseconds(LIGHT_TRANSITION_STEP);
 }
 
+constexpr espurna::light::transition::Easing transitionEasing() {
+    return (LIGHT_TRANSITION_EASING == 2) ? espurna::light::transition::Easing::Perceptual :
+        (LIGHT_TRANSITION_EASING == 1) ? espurna::light::transition::Easing::InOut :
+        espurna::light::transition::Easing::Linear;
+}
+
 constexpr bool save() {
     return 1 == LIGHT_SAVE_ENABLED;
 }
@@ -348,6 +358,10 @@ void transitionStep(espurna::duration::Milliseconds value) {
     setSetting("ltStep", value.count());
 }
 
+espurna::light::transition::Easing transitionEasing() {
+    return getSetting("ltEasing", build::transitionEasing());
+}
+
 bool save() {
     return getSetting("ltSave", build::save());
 }
@@ -585,6 +599,34 @@ private:
 } // namespace
 } // namespace light
 
+namespace settings {
+namespace internal {
+namespace {
+
+alignas(4) static constexpr char EasingLinear[] PROGMEM = "linear";
+alignas(4) static constexpr char EasingInOut[] PROGMEM = "inout";
+alignas(4) static constexpr char EasingPerceptual[] PROGMEM = "cie";
+
+static constexpr std::array<espurna::settings::options::Enumeration<light::transition::Easing>, 3> EasingOptions PROGMEM {
+    {{light::transition::Easing::Linear, EasingLinear},
+     {light::transition::Easing::InOut, EasingInOut},
+     {light::transition::Easing::Perceptual, EasingPerceptual}}
+};
+
+} // namespace
+
+template <>
+light::transition::Easing convert(const String& value) {
+    return convert(EasingOptions, value, light::build::transitionEasing());
+}
+
+String serialize(light::transition::Easing value) {
+    return serialize(EasingOptions, value);
+}
+
+} // namespace internal
+} // namespace settings
+
 #if LIGHT_PROVIDER == LIGHT_PROVIDER_MY92XX
 namespace settings {
 namespace internal {
@@ -638,10 +680,10 @@ void _lightUpdateMapping(T& channels) {
 
 auto _light_save_delay = espurna::light::build::saveDelay();
 bool _light_save { espurna::light::build::save() };
-Ticker _light_save_ticker;
+espurna::timer::SystemTimer _light_save_timer { "light save" };
 
 auto _light_report_delay = espurna::light::build::reportDelay();
-Ticker _light_report_ticker;
+espurna::timer::SystemTimer _light_report_timer { "light report" };
 std::forward_list<LightReportListener> _light_report;
 
 bool _light_has_controls = false;
@@ -749,23 +791,26 @@ void _lightValuesWithBrightnessExceptWhite(LightChannels& channels, long brightn
 // (TODO: notice that this also means HSV mode will hardly agree with our changes and will try to bounce
 // the brigthness all over the place. at least for now, only `useRGB` mode works correctly)
 
-// Map from normal 153...500 to 0...347, so we get a value 0...1
-double _lightMiredFactor() {
+// Map from normal 153...500 to 0...347, so we get a Q16.16 value 0...1
+espurna::light::transition::Fixed _lightMiredFactor() {
     if (_light_cold_mireds < _light_warm_mireds) {
-        const auto Cold = static_cast<double>(_light_cold_mireds);
-        const auto Warm = static_cast<double>(_light_warm_mireds);
-        const auto Mireds = static_cast<double>(_light_mireds);
-        return (Mireds - Cold) / (Warm - Cold);
+        const auto Mireds = std::clamp(_light_mireds, _light_cold_mireds, _light_warm_mireds);
+        return static_cast<espurna::light::transition::Fixed>(
+            ((Mireds - _light_cold_mireds) * espurna::light::transition::One)
+                / (_light_warm_mireds - _light_cold_mireds));
     }
 
-    return 0.0;
+    return 0;
 }
 
+// Both parts always add up to the original value
 espurna::light::MiredsRange _lightCctRange(long value) {
-    const double Factor { _lightMiredFactor() };
-    return {
-        std::lround(Factor * value),
-        std::lround((1.0 - Factor) * value)};
+    using espurna::light::transition::fixed;
+    using espurna::light::transition::integral;
+    using espurna::light::transition::multiply;
+
+    const auto Cold = integral(multiply(fixed(value), _lightMiredFactor()));
+    return {Cold, value - Cold};
 }
 
 // To handle both 4 and 5 channels, allow to 'adjust' internal factor calculation after construction
@@ -1398,65 +1443,36 @@ void _lightAdjustMireds(const char* payload) {
 
 namespace {
 
-// Gamma Correction lookup table (8 bit, ~2.2)
+// Output resolution of the provider, e.g. 1023 for the 10bit PWM
+// Gamma corrected value is rounded to the nearest output step instead of an 8bit value
 // TODO: input value modifier, instead of a transition-only thing?
-// TODO: calculate on the fly instead of limiting this to an 8bit value?
-
-constexpr long LightGammaMin { 0 };
-constexpr long LightGammaMax { 255 };
-
-long _lightGammaMap(size_t index) {
-    const static std::array<uint8_t, 256> Gamma PROGMEM {
-        0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
-        1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   2,   2,   2,   2,   2,   2,
-        3,   3,   3,   3,   3,   3,   4,   4,   4,   4,   5,   5,   5,   5,   6,   6,
-        6,   7,   7,   7,   7,   8,   8,   8,   9,   9,   9,   10,  10,  11,  11,  11,
-        12,  12,  13,  13,  14,  14,  14,  15,  15,  16,  16,  17,  17,  18,  18,  19,
-        19,  20,  20,  21,  22,  22,  23,  23,  24,  25,  25,  26,  26,  27,  28,  28,
-        29,  30,  30,  31,  32,  33,  33,  34,  35,  35,  36,  37,  38,  39,  39,  40,
-        41,  42,  43,  43,  44,  45,  46,  47,  48,  49,  50,  50,  51,  52,  53,  54,
-        55,  56,  57,  58,  59,  60,  61,  62,  63,  64,  65,  66,  67,  68,  69,  71,
-        72,  73,  74,  75,  76,  77,  78,  80,  81,  82,  83,  84,  86,  87,  88,  89,
-        91,  92,  93,  94,  96,  97,  98,  100, 101, 102, 104, 105, 106, 108, 109, 110,
-        112, 113, 115, 116, 118, 119, 121, 122, 123, 125, 126, 128, 130, 131, 133, 134,
-        136, 137, 139, 140, 142, 144, 145, 147, 149, 150, 152, 154, 155, 157, 159, 160,
-        162, 164, 166, 167, 169, 171, 173, 175, 176, 178, 180, 182, 184, 186, 187, 189,
-        191, 193, 195, 197, 199, 201, 203, 205, 207, 209, 211, 213, 215, 217, 219, 221,
-        223, 225, 227, 229, 231, 233, 235, 238, 240, 242, 244, 246, 248, 251, 253, 255
-    };
+uint32_t _lightProviderResolution();
 
-    if (index < Gamma.size()) {
-        return pgm_read_byte(&Gamma[index]);
-    }
+// Gamma correction lookup table (16 bit, interpolated between the entries)
+alignas(4) static constexpr espurna::light::transition::table::Values LightGammaTable PROGMEM =
+    espurna::light::transition::table::gamma(espurna::light::build::gammaExponent());
 
-    return 0;
-}
-
-long _lightGammaMap(long value) {
-    static_assert(espurna::light::ValueMin >= 0, "");
-    static_assert(espurna::light::ValueMax >= 0, "");
+static_assert(LightGammaTable.front() == 0, "");
+static_assert(LightGammaTable.back() == espurna::light::transition::table::OutputMax, "");
 
-    constexpr auto Divisor = (espurna::light::ValueMax - espurna::light::ValueMin);
-    if (Divisor != 0l) {
-        const long Scaled {
-            (value - espurna::light::ValueMin) * (LightGammaMax - LightGammaMin) / Divisor + LightGammaMin };
-        return _lightGammaMap(static_cast<size_t>(Scaled));
-    }
-
-    return espurna::light::ValueMin;
+uint16_t _lightGammaTable(size_t index) {
+    return pgm_read_word(&LightGammaTable[index]);
 }
 
 class LightTransitionHandler {
 public:
-    // internal calculations are done in floats, so hard-limit target & step time to a certain value
-    // that can be representend precisely when casting milliseconds times back and forth
+    // transition is split into (time / step) steps, hard-limit target & step time to a
+    // certain value so the number of steps always fits into the Q16.16 progress value
     static constexpr espurna::duration::Milliseconds TimeMin { 10 };
     static constexpr espurna::duration::Milliseconds TimeMax { 1ul << 24ul };
 
+    using Curve = espurna::light::transition::Curve;
+    using Easing = espurna::light::transition::Easing;
+    using Fixed = espurna::light::transition::Fixed;
+
     struct Transition {
         float& value;
-        long target;
-        float step;
+        Curve curve;
         size_t count;
     };
 
@@ -1464,11 +1480,12 @@ public:
 
     LightTransitionHandler() = delete;
 
-    LightTransitionHandler(LightChannels& channels, LightTransition transition, bool state) :
+    LightTransitionHandler(LightChannels& channels, LightTransition transition, Easing easing, bool state) :
         _transition(clamp(transition)),
+        _easing(easing),
         _state(state)
     {
-        prepare(channels, transition, state);
+        prepare(channels, _transition, state);
     }
 
     template <typename StateFunc, typename ValueFunc, typename UpdateFunc>
@@ -1480,6 +1497,9 @@ public:
             state(_state);
         }
 
+        // every channel shares the same progress value, curves are only different in the shape
+        const auto progress = espurna::light::transition::progress(++_step, _steps);
+
         for (size_t index = 0; index < _prepared.size(); ++index) {
             auto& transition = _prepared[index];
             if (!transition.count) {
@@ -1487,10 +1507,12 @@ public:
             }
 
             if (--transition.count) {
-                transition.value += transition.step;
+                transition.value = espurna::light::transition::toFloat(
+                    transition.curve.at(progress));
                 next = true;
             } else {
-                transition.value = transition.target;
+                transition.value = espurna::light::transition::toFloat(
+                    transition.curve.end());
             }
 
             value(index, transition.value);
@@ -1522,13 +1544,21 @@ public:
         return _transition.step;
     }
 
+    size_t steps() const {
+        return _steps;
+    }
+
 private:
     void minimalTime() {
         _transition.time = TimeMin;
         _transition.step = TimeMin;
     }
 
-    void prepare(LightChannels& channels, LightTransition transition, bool state) {
+    void prepare(LightChannels& channels, const LightTransition& transition, bool state) {
+        _steps = isImmediate(transition)
+            ? 1
+            : std::max<size_t>(1, transition.time.count() / transition.step.count());
+
         // generate a single transitions list for all the channels that had changed
         // after that, provider loop will run() the list and assign intermediate target value(s)
         bool delayed { false };
@@ -1545,64 +1575,50 @@ private:
     }
 
     bool prepare(LightChannel& channel, const LightTransition& transition, bool state) {
+        using espurna::light::transition::fixed;
+        using espurna::light::transition::One;
+
         long target = (state && channel.state)
             ? channel.value
             : espurna::light::ValueMin;
 
         channel.target = target;
+
+        // fractional part is kept, gamma corrected value is only rounded to the provider step
+        auto value = fixed(target);
         if (channel.gamma) {
-            target = _lightGammaMap(target);
+            value = espurna::light::transition::gamma(
+                _lightGammaTable, value, espurna::light::ValueMax, _lightProviderResolution());
         }
 
         if (channel.inverse) {
-            target = espurna::light::ValueMax - target;
+            value = fixed(espurna::light::ValueMax) - value;
         }
 
-        const float Diff { static_cast<float>(target) - channel.current };
-        if (!isImmediate(transition, Diff)) {
-            pushGradual(transition, channel.current, target, Diff);
+        const auto current = static_cast<Fixed>(
+            channel.current * static_cast<float>(One));
+
+        if (!isImmediate(transition) && (current != value)) {
+            push(channel.current, Curve(_easing, current, value, espurna::light::ValueMax), _steps);
             return true;
         }
 
-        pushImmediate(channel.current, target, Diff);
+        push(channel.current, Curve(Easing::Linear, value, value, espurna::light::ValueMax), 1);
         return false;
     }
 
-    void push(float& current, long target, float diff, size_t count) {
+    void push(float& current, Curve curve, size_t count) {
         _prepared.push_back(
             Transition{
                 .value = current,
-                .target = target,
-                .step = diff,
+                .curve = curve,
                 .count = count,
             });
     }
 
-    void pushImmediate(float& current, long target, float diff) {
-        push(current, target, diff, 1);
-    }
-
-    void pushGradual(const LightTransition& transition, float& current, long target, float diff) {
-        const auto TotalTime = static_cast<float>(transition.time.count());
-        const auto StepTime = static_cast<float>(transition.step.count());
-
-        constexpr float BaseStep { 1.0f };
-        const float Diff { std::abs(diff) };
-        const float Every { TotalTime / Diff };
-
-        float step { (diff > 0.0f) ? BaseStep : -BaseStep };
-        if (Every < StepTime) {
-            step *= (StepTime / Every);
-        }
-
-        const float Count { std::floor(Diff / std::abs(step)) };
-        push(current, target, step, static_cast<size_t>(Count));
-    }
-
-    static bool isImmediate(const LightTransition& transition, float diff) {
+    static bool isImmediate(const LightTransition& transition) {
         return !transition.time.count()
-            || (transition.step >= transition.time)
-            || (std::abs(diff) <= std::numeric_limits<float>::epsilon());
+            || (transition.step >= transition.time);
     }
 
     static LightTransition clamp(LightTransition value) {
@@ -1616,7 +1632,11 @@ private:
     bool _state_notified { false };
 
     LightTransition _transition;
+    Easing _easing;
     bool _state;
+
+    size_t _steps { 1 };
+    size_t _step { 0 };
 };
 
 constexpr espurna::duration::Milliseconds LightTransitionHandler::TimeMin;
@@ -1701,20 +1721,23 @@ bool _light_provider_update = false;
 
 LightSequenceHandler _light_sequence;
 
-Ticker _light_transition_ticker;
+espurna::timer::SystemTimer _light_transition_timer { "light step" };
 std::unique_ptr<LightTransitionHandler> _light_transition;
 
 auto _light_transition_time = espurna::light::build::transitionTime();
 auto _light_transition_step = espurna::light::build::transitionStep();
+auto _light_transition_easing = espurna::light::build::transitionEasing();
 bool _light_use_transitions = false;
 
 void _lightProviderSchedule(espurna::duration::Milliseconds);
 
 static_assert((espurna::light::ValueMax - espurna::light::ValueMin) != 0, "");
 
+// Transition values have a fractional part, which should not be truncated before scaling
 template <typename T>
-constexpr T _lightValueMap(long value, T min, T max) {
-    return (value - espurna::light::ValueMin) * (max - min) / (espurna::light::ValueMax - espurna::light::ValueMin) + min;
+constexpr T _lightValueMap(float value, T min, T max) {
+    return static_cast<T>((value - espurna::light::ValueMin) * static_cast<float>(max - min)
+        / static_cast<float>(espurna::light::ValueMax - espurna::light::ValueMin)) + min;
 }
 
 #if LIGHT_PROVIDER == LIGHT_PROVIDER_DIMMER
@@ -1737,6 +1760,10 @@ void _lightProviderHandleValue(size_t channel, float value) {
     pwmDuty(channel, _lightValueMap(value, _light_pwm_min, _light_pwm_max));
 }
 
+uint32_t _lightProviderResolution() {
+    return _light_pwm_max - _light_pwm_min;
+}
+
 void _lightProviderHandleUpdate() {
     pwmUpdate();
 }
@@ -1770,6 +1797,10 @@ void _lightProviderHandleValue(size_t channel, float value) {
         _lightValueMap(value, _my92xx_value_min, _my92xx_value_max));
 }
 
+uint32_t _lightProviderResolution() {
+    return _my92xx_value_max - _my92xx_value_min;
+}
+
 void _lightProviderHandleUpdate() {
     _my92xx->update();
 }
@@ -1788,6 +1819,11 @@ void _lightProviderHandleValue(size_t channel, float value) {
     _light_provider->channel(channel, value);
 }
 
+// value is passed as-is, keep the same precision as our own [ValueMin:ValueMax]
+uint32_t _lightProviderResolution() {
+    return espurna::light::ValueMax - espurna::light::ValueMin;
+}
+
 void _lightProviderHandleUpdate() {
     _light_provider->update();
 }
@@ -1819,7 +1855,7 @@ void _lightProviderUpdate() {
 }
 
 void _lightProviderSchedule(espurna::duration::Milliseconds next) {
-    _light_transition_ticker.once_ms(next.count(), []() {
+    _light_transition_timer.once(next, []() {
         _light_provider_update = true;
     });
 }
@@ -2402,6 +2438,7 @@ void _lightWebSocketOnConnected(JsonObject& root) {
     root["ltSaveDelay"] = _light_save_delay.count();
     root["ltTime"] = _light_transition_time.count();
     root["ltStep"] = _light_transition_step.count();
+    root["ltEasing"] = espurna::settings::internal::serialize(_light_transition_easing);
 #if RELAY_SUPPORT
     root["ltRelay"] = espurna::light::settings::relay();
 #endif
@@ -2805,9 +2842,10 @@ void _lightUpdateDebug(const LightTransitionHandler& handler) {
 
     for (auto& transition : handler.prepared()) {
         if (transition.count > 1) {
-            DEBUG_MSG_P(PSTR("[LIGHT] Transition from %s to %ld (step %s, %u times)\n"),
-                    String(transition.value, 2).c_str(), transition.target,
-                    String(transition.step, 2).c_str(), transition.count);
+            DEBUG_MSG_P(PSTR("[LIGHT] Transition from %s to %s (%u steps)\n"),
+                    String(transition.value, 2).c_str(),
+                    String(espurna::light::transition::toFloat(transition.curve.end()), 2).c_str(),
+                    transition.count);
         }
     }
 }
@@ -2867,14 +2905,15 @@ void _lightUpdate() {
     _light_update.run([](LightTransition transition, int report, bool save) {
         // Channel output values will be set by the handler class and the specified provider
         // We either set the values immediately or schedule an ongoing transition
-        _light_transition = std::make_unique<LightTransitionHandler>(_light_channels, transition, _light_state);
+        _light_transition = std::make_unique<LightTransitionHandler>(
+            _light_channels, transition, _light_transition_easing, _light_state);
         _lightProviderSchedule(_light_transition->step());
         _lightUpdateDebug(*_light_transition);
 
         // Send current state to all available 'report' targets
         // (make sure to delay the report, in case lightUpdate is called repeatedly)
-        _light_report_ticker.once_ms(
-            _light_report_delay.count(),
+        _light_report_timer.once(
+            _light_report_delay,
             [report]() {
                 _lightReport(report);
             });
@@ -2882,8 +2921,8 @@ void _lightUpdate() {
         // Always save to RTCMEM, optionally preserve the state in the settings storage
         _lightSaveRtcmem();
         if (save) {
-            _light_save_ticker.once_ms(
-                _light_save_delay.count(),
+            _light_save_timer.once(
+                _light_save_delay,
                 _lightSaveSettings);
         }
     });
@@ -3206,6 +3245,7 @@ void _lightConfigure() {
     _light_use_transitions = espurna::light::settings::transition();
     _light_transition_time = espurna::light::settings::transitionTime();
     _light_transition_step = espurna::light::settings::transitionStep();
+    _light_transition_easing = espurna::light::settings::transitionEasing();
 
     _light_save = espurna::light::settings::save();
     _light_save_delay = espurna::light::settings::saveDelay();
@@ -0,0 +1,278 @@
+/*
+
+Part of the LIGHT MODULE
+
+Fixed-point transition curves and gamma correction
+
+*/
+
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+namespace espurna {
+namespace light {
+namespace transition {
+
+// Q16.16, integer part is the channel value [ValueMin:ValueMax], fractional part
+// allows to represent values in-between them. This makes it possible to have smooth
+// transitions at low brightness, when provider has more than 8 bits of resolution
+using Fixed = int32_t;
+
+constexpr int FractionBits { 16 };
+constexpr Fixed One { 1 << FractionBits };
+
+constexpr Fixed fixed(long value) {
+    return static_cast<Fixed>(value * One);
+}
+
+constexpr long integral(Fixed value) {
+    return (value + (One / 2)) / One;
+}
+
+inline float toFloat(Fixed value) {
+    return static_cast<float>(value) / static_cast<float>(One);
+}
+
+constexpr Fixed multiply(Fixed lhs, Fixed rhs) {
+    return static_cast<Fixed>((static_cast<int64_t>(lhs) * static_cast<int64_t>(rhs)) >> FractionBits);
+}
+
+constexpr Fixed lerp(Fixed from, Fixed to, Fixed progress) {
+    return from + static_cast<Fixed>(
+        (static_cast<int64_t>(to - from) * static_cast<int64_t>(progress)) >> FractionBits);
+}
+
+// [0:One] progress of the step out of total number of steps
+constexpr Fixed progress(size_t step, size_t steps) {
+    return (step >= steps)
+        ? One
+        : static_cast<Fixed>((static_cast<uint64_t>(step) << FractionBits) / steps);
+}
+
+enum class Easing {
+    Linear,
+    InOut,       // smoothstep, slow start and slow end
+    Perceptual,  // linear in CIE L* (perceived lightness) instead of the output value
+};
+
+namespace cie {
+
+// CIE 1976 lightness L* and relative luminance Y, both normalized to [0:One]
+// L* = 116 * Y^(1/3) - 16 when Y > (6/29)^3, otherwise L* = 903.3 * Y
+constexpr Fixed Offset { 10486 };       // 0.16
+constexpr Fixed Scale { 76022 };        // 1.16
+constexpr Fixed Knee { 5243 };          // 0.08 lightness, (6/29)^3 luminance
+
+constexpr Fixed luminance(Fixed lightness) {
+    if (lightness <= Knee) {
+        return static_cast<Fixed>((static_cast<int64_t>(lightness) * 10000) / 90330);
+    }
+
+    const auto cube = static_cast<Fixed>(
+        (static_cast<int64_t>(lightness + Offset) << FractionBits) / Scale);
+    return multiply(multiply(cube, cube), cube);
+}
+
+// Only used once per transition, when preparing the channel
+inline Fixed lightness(Fixed luminance) {
+    const auto y = toFloat(luminance);
+    const auto out = (y <= 0.008856f)
+        ? (y * 9.033f)
+        : ((1.16f * std::cbrt(y)) - 0.16f);
+
+    return static_cast<Fixed>(std::lround(out * static_cast<float>(One)));
+}
+
+} // namespace cie
+
+constexpr Fixed ease(Easing easing, Fixed progress) {
+    return (easing == Easing::InOut)
+        ? multiply(multiply(progress, progress), (3 * One) - (2 * progress))
+        : progress;
+}
+
+// Single channel transition between two Q16.16 values in [0:max] range. Curve is
+// evaluated using integer operations only, per-step cost is a handful of multiplications
+class Curve {
+public:
+    Curve() = default;
+
+    Curve(Easing easing, Fixed from, Fixed to, long max) :
+        _easing(easing),
+        _from(from),
+        _to(to),
+        _end(to),
+        _max(max)
+    {
+        if (perceptual()) {
+            _from = cie::lightness(from / _max);
+            _to = cie::lightness(to / _max);
+        }
+    }
+
+    Fixed at(Fixed progress) const {
+        if (progress >= One) {
+            return _end;
+        }
+
+        if (perceptual()) {
+            return cie::luminance(lerp(_from, _to, progress)) * _max;
+        }
+
+        return lerp(_from, _to, ease(_easing, progress));
+    }
+
+    Fixed end() const {
+        return _end;
+    }
+
+private:
+    bool perceptual() const {
+        return (_easing == Easing::Perceptual) && (_max > 0);
+    }
+
+    Easing _easing { Easing::Linear };
+    Fixed _from { 0 };
+    Fixed _to { 0 };
+    Fixed _end { 0 };
+    long _max { 0 };
+};
+
+namespace table {
+namespace internal {
+
+// Generic math functions are not constexpr, these are only ever evaluated by the compiler
+constexpr double Ln2 { 0.69314718055994530942 };
+
+constexpr double ln(double value) {
+    // value = mantissa * 2^exponent, mantissa is in [0.5:1)
+    int exponent { 0 };
+    while (value < 0.5) {
+        value *= 2.0;
+        --exponent;
+    }
+
+    while (value >= 1.0) {
+        value /= 2.0;
+        ++exponent;
+    }
+
+    // ln(mantissa) = 2 * atanh(z), |z| <= 1/3
+    const double z { (value - 1.0) / (value + 1.0) };
+    const double z2 { z * z };
+
+    double term { z };
+    double out { 0.0 };
+    for (int n = 1; n < 40; n += 2) {
+        out += term / n;
+        term *= z2;
+    }
+
+    return (2.0 * out) + (exponent * Ln2);
+}
+
+constexpr double exp(double value) {
+    // e^value = 2^exponent * e^rest, |rest| < ln(2)
+    int exponent { static_cast<int>(value / Ln2) };
+    const double rest { value - (exponent * Ln2) };
+
+    double term { 1.0 };
+    double out { 1.0 };
+    for (int n = 1; n < 24; ++n) {
+        term *= rest / n;
+        out += term;
+    }
+
+    for (; exponent > 0; --exponent) {
+        out *= 2.0;
+    }
+
+    for (; exponent < 0; ++exponent) {
+        out /= 2.0;
+    }
+
+    return out;
+}
+
+} // namespace internal
+
+constexpr double power(double base, double exponent) {
+    return (base <= 0.0) ? 0.0
+        : (base >= 1.0) ? 1.0
+        : internal::exp(exponent * internal::ln(base));
+}
+
+// 16bit output values for the evenly spaced inputs in [0:1] range, 2^Bits segments
+constexpr size_t Bits { 8 };
+constexpr size_t Size { (1 << Bits) + 1 };
+constexpr uint32_t OutputMax { 0xffff };
+
+using Values = std::array<uint16_t, Size>;
+
+// Gamma curve is the same for every provider, only the final rounding step depends on the output resolution
+constexpr Values gamma(double exponent) {
+    Values out{};
+    for (size_t index = 0; index < Size; ++index) {
+        const double input { static_cast<double>(index) / static_cast<double>(Size - 1) };
+        out[index] = static_cast<uint16_t>((power(input, exponent) * OutputMax) + 0.5);
+    }
+
+    return out;
+}
+
+// Table is expected to be placed in flash, reader function is responsible for the aligned access
+using Read = uint16_t (*)(size_t index);
+
+// Q16.16 input in [0:max] range, result is in [0:OutputMax] range and is linearly interpolated
+// between the two nearest table entries
+inline uint32_t lookup(Read read, Fixed value, long max) {
+    if (value <= 0) {
+        return read(0);
+    }
+
+    if (value >= fixed(max)) {
+        return read(Size - 1);
+    }
+
+    // Q.16 position in the table, integer part is the index and fractional part is the weight of the next entry
+    const auto position = static_cast<uint64_t>(
+        (static_cast<uint64_t>(value) << (Bits + FractionBits)) / static_cast<uint64_t>(fixed(max)));
+
+    const auto index = static_cast<size_t>(position >> FractionBits);
+    const auto weight = static_cast<int64_t>(position & (One - 1));
+
+    const auto lhs = static_cast<int64_t>(read(index));
+    const auto rhs = static_cast<int64_t>(read(index + 1));
+
+    return static_cast<uint32_t>(lhs + (((rhs - lhs) * weight) >> FractionBits));
+}
+
+} // namespace table
+
+// Gamma correction of the channel value. Result is rounded to the nearest output step
+// of the provider with the specified resolution (e.g. 1023 for 10bit PWM), instead of
+// being limited to 8 bits. Input and output are Q16.16 in [0:max] range
+inline Fixed gamma(table::Read read, Fixed value, long max, uint32_t resolution) {
+    if ((value <= 0) || (max <= 0) || !resolution) {
+        return 0;
+    }
+
+    if (value >= fixed(max)) {
+        return fixed(max);
+    }
+
+    const auto corrected = table::lookup(read, value, max);
+    const auto steps = ((static_cast<uint64_t>(corrected) * resolution) + (table::OutputMax / 2))
+        / table::OutputMax;
+
+    return static_cast<Fixed>(
+        ((static_cast<int64_t>(steps) * static_cast<int64_t>(fixed(max))) + (resolution / 2)) / resolution);
+}
+
+} // namespace transition
+} // namespace light
+} // namespace espurna
@@ -0,0 +1,145 @@
+/*
+
+Part of the MAIN MODULE
+
+Execution time statistics of the loop callbacks
+
+*/
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+namespace espurna {
+namespace loop {
+namespace profiler {
+
+// Cycle counts are grouped by their log2, so every bucket is twice as wide as the previous one.
+// First bucket also includes everything below 2^(Shift + 1), last one everything above 2^(Shift + Buckets - 1)
+// (at 80MHz, this is <6.4us ... >1.67s, and half of that at 160MHz)
+class Histogram {
+public:
+    static constexpr size_t Buckets { 20 };
+    static constexpr uint32_t Shift { 8 };
+
+    static size_t bucket(uint32_t cycles) {
+        if (!cycles) {
+            return 0;
+        }
+
+        const uint32_t log2 = 31 - __builtin_clz(cycles);
+        if (log2 <= Shift) {
+            return 0;
+        }
+
+        const size_t out = log2 - Shift;
+        return (out < Buckets) ? out : (Buckets - 1);
+    }
+
+    static constexpr uint32_t lower(size_t bucket) {
+        return bucket ? (uint32_t(1) << (bucket + Shift)) : 0;
+    }
+
+    static constexpr uint32_t upper(size_t bucket) {
+        return (bucket + 1 < Buckets)
+            ? (uint32_t(1) << (bucket + Shift + 1))
+            : std::numeric_limits<uint32_t>::max();
+    }
+
+    void add(uint32_t cycles) {
+        ++_counts[bucket(cycles)];
+    }
+
+    uint32_t count(size_t bucket) const {
+        return _counts[bucket];
+    }
+
+    // Interpolated value at the specified rank, with the assumption that values are evenly spread inside of the bucket
+    uint32_t value(uint32_t rank) const {
+        uint32_t before { 0 };
+        for (size_t bucket = 0; bucket < Buckets; ++bucket) {
+            const auto count = _counts[bucket];
+            if (rank < before + count) {
+                const uint64_t width = upper(bucket) - lower(bucket);
+                const uint64_t position = (2 * (rank - before)) + 1;
+                return lower(bucket) + static_cast<uint32_t>((width * position) / (2 * count));
+            }
+
+            before += count;
+        }
+
+        return 0;
+    }
+
+private:
+    std::array<uint32_t, Buckets> _counts{};
+};
+
+struct Stats {
+    void add(uint32_t cycles, uint32_t budget) {
+        histogram.add(cycles);
+        min = (cycles < min) ? cycles : min;
+        max = (cycles > max) ? cycles : max;
+        sum += cycles;
+        ++count;
+
+        if (budget && (cycles > budget)) {
+            ++overruns;
+        }
+    }
+
+    uint32_t average() const {
+        return count ? static_cast<uint32_t>(sum / count) : 0;
+    }
+
+    // Histogram only provides an estimate, which is then limited by the real values
+    uint32_t percentile(uint32_t percent) const {
+        if (!count) {
+            return 0;
+        }
+
+        const auto rank = static_cast<uint32_t>(
+            ((static_cast<uint64_t>(count) * percent) + 99) / 100) - 1;
+        const auto out = histogram.value(rank);
+
+        return (out < min) ? min
+            : (out > max) ? max
+            : out;
+    }
+
+    Histogram histogram;
+    uint32_t min { std::numeric_limits<uint32_t>::max() };
+    uint32_t max { 0 };
+    uint64_t sum { 0 };
+    uint32_t count { 0 };
+    uint32_t overruns { 0 };
+};
+
+// Stats converted into something human-readable, all times are in microseconds
+struct Report {
+    uint32_t count;
+    uint32_t min;
+    uint32_t average;
+    uint32_t p99;
+    uint32_t max;
+    uint32_t overruns;
+};
+
+template <typename T>
+Report report(const Stats& stats, T&& convert) {
+    return Report{
+        .count = stats.count,
+        .min = stats.count ? convert(stats.min) : 0,
+        .average = convert(stats.average()),
+        .p99 = convert(stats.percentile(99)),
+        .max = convert(stats.max),
+        .overruns = stats.overruns,
+    };
+}
+
+} // namespace profiler
+} // namespace loop
+} // namespace espurna
@@ -23,6 +23,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "espurna.h"
 #include "main.h"
 
+#include <coredecls.h>
+
 // -----------------------------------------------------------------------------
 // GENERAL CALLBACKS
 // -----------------------------------------------------------------------------
@@ -44,6 +46,10 @@ constexpr espurna::duration::Milliseconds loopDelay() {
     return espurna::duration::Milliseconds { LOOP_DELAY_TIME };
 }
 
+// When loop callbacks have something to do sooner than the loop delay,
+// still give the SYS tasks at least some time to run
+constexpr espurna::duration::Milliseconds DeadlineMin { 1 };
+
 } // namespace build
 
 namespace settings {
@@ -64,6 +70,315 @@ bool reload_flag { false };
 
 } // namespace internal
 
+// Loop always sleeps for the configured delay, unless callbacks have something to do sooner than that.
+// Sleep can also be cut short by the wake() called from the ISR or SYS contexts (network, Ticker, etc.)
+namespace idle {
+
+using TimeSource = espurna::time::CoreClock;
+
+namespace internal {
+
+// Deadlines are stored relative to the start of the current loop, so they can be compared with each other
+TimeSource::time_point start;
+TimeSource::duration deadline { TimeSource::duration::max() };
+
+volatile bool wake { false };
+volatile bool sleeping { false };
+
+} // namespace internal
+
+void begin() {
+    internal::start = TimeSource::now();
+    internal::deadline = TimeSource::duration::max();
+}
+
+void deadline(espurna::duration::Milliseconds value) {
+    const auto elapsed = TimeSource::now() - internal::start;
+    if ((internal::deadline > elapsed) && (value < internal::deadline - elapsed)) {
+        internal::deadline = elapsed + value;
+    }
+}
+
+// Either the current sleep is interrupted by the scheduled CONT task,
+// or the next one will never happen since `wake` is checked right before it
+void IRAM_ATTR wake() {
+    internal::wake = true;
+    if (internal::sleeping) {
+        esp_schedule();
+    }
+}
+
+void sleep(espurna::duration::Milliseconds delay) {
+    if (internal::deadline != TimeSource::duration::max()) {
+        const auto elapsed = TimeSource::now() - internal::start;
+        const auto remaining = (internal::deadline > elapsed)
+            ? (internal::deadline - elapsed)
+            : TimeSource::duration::zero();
+        delay = std::min(delay, std::max(remaining, build::DeadlineMin));
+    }
+
+    internal::sleeping = true;
+    if (internal::wake) {
+        yield();
+    } else {
+        espurna::time::delay(delay);
+    }
+
+    internal::sleeping = false;
+    internal::wake = false;
+}
+
+} // namespace idle
+
+#if LOOP_PROFILER_SUPPORT
+namespace profiler {
+namespace build {
+
+constexpr espurna::duration::Microseconds budget() {
+    return espurna::duration::Microseconds { LOOP_PROFILER_BUDGET };
+}
+
+constexpr espurna::duration::Seconds WebInterval { 5 };
+
+} // namespace build
+
+using TimeSource = espurna::time::CpuClock;
+using espurna::loop::profiler::Report;
+using espurna::loop::profiler::Stats;
+
+namespace internal {
+
+bool enabled { false };
+TimeSource::duration budget { 0 };
+
+Stats loop;
+std::vector<Stats> callbacks;
+
+} // namespace internal
+
+bool enabled() {
+    return internal::enabled;
+}
+
+uint32_t microseconds(uint32_t cycles) {
+    return std::chrono::duration_cast<espurna::duration::Microseconds>(
+        TimeSource::duration(cycles)).count();
+}
+
+Report report(const Stats& stats) {
+    return espurna::loop::profiler::report(stats, microseconds);
+}
+
+espurna::duration::Microseconds budget() {
+    return std::chrono::duration_cast<espurna::duration::Microseconds>(internal::budget);
+}
+
+// Stats are resized lazily, only when callbacks are actually running
+void reset() {
+    internal::loop = Stats{};
+    internal::callbacks.clear();
+    internal::callbacks.shrink_to_fit();
+}
+
+void start(espurna::duration::Microseconds budget) {
+    reset();
+    internal::budget = std::chrono::duration_cast<TimeSource::duration>(budget);
+    internal::enabled = true;
+}
+
+// Gathered stats are kept until the next start() or reset()
+void stop() {
+    internal::enabled = false;
+}
+
+template <typename T>
+void foreach(const std::vector<LoopCallback>& callbacks, T&& callback) {
+    const auto size = std::min(callbacks.size(), internal::callbacks.size());
+    for (size_t index = 0; index < size; ++index) {
+        callback(callbacks[index], report(internal::callbacks[index]));
+    }
+}
+
+// Callbacks are only known by their address, use `xtensa-lx106-elf-addr2line -fe firmware.elf <address>` to find out the name
+void address(char (&buffer)[16], LoopCallback callback) {
+    snprintf_P(buffer, sizeof(buffer), PSTR("%p"),
+        reinterpret_cast<void*>(callback));
+}
+
+// Every callback is measured separately. Overall time also includes the overhead of measuring it
+void run(const std::vector<LoopCallback>& callbacks) {
+    if (internal::callbacks.size() != callbacks.size()) {
+        internal::callbacks.resize(callbacks.size());
+    }
+
+    const auto budget = internal::budget.count();
+    const auto loop_start = TimeSource::now();
+
+    auto it = internal::callbacks.begin();
+    for (const auto& callback : callbacks) {
+        const auto start = TimeSource::now();
+        callback();
+        (*it).add((TimeSource::now() - start).count(), budget);
+        ++it;
+    }
+
+    internal::loop.add((TimeSource::now() - loop_start).count(), 0);
+}
+
+#if WEB_SUPPORT
+namespace web {
+
+void fill(JsonArray& out, const Report& report) {
+    out.add(report.count);
+    out.add(report.min);
+    out.add(report.average);
+    out.add(report.p99);
+    out.add(report.max);
+    out.add(report.overruns);
+}
+
+void onVisible(JsonObject& root) {
+    wsPayloadModule(root, PSTR("loop"));
+}
+
+void onData(JsonObject& root) {
+    JsonObject& profile = root.createNestedObject(F("loopProfile"));
+    profile[F("enabled")] = enabled();
+    profile[F("budget")] = static_cast<uint32_t>(budget().count());
+
+    JsonArray& loop = profile.createNestedArray(F("loop"));
+    fill(loop, report(internal::loop));
+
+    JsonArray& callbacks = profile.createNestedArray(F("callbacks"));
+    foreach(espurna::main::internal::loop_callbacks,
+        [&](LoopCallback callback, const Report& report) {
+            char buffer[16];
+            address(buffer, callback);
+
+            JsonArray& entry = callbacks.createNestedArray();
+            entry.add(buffer);
+            fill(entry, report);
+        });
+}
+
+void onAction(uint32_t client_id, const char* action, JsonObject&) {
+    if (STRING_VIEW("loopProfileStart") == action) {
+        start(build::budget());
+    } else if (STRING_VIEW("loopProfileStop") == action) {
+        stop();
+    } else if (STRING_VIEW("loopProfileReset") == action) {
+        reset();
+    } else {
+        return;
+    }
+
+    wsPost(client_id, onData);
+}
+
+void loop() {
+    static auto last = espurna::time::CoreClock::now();
+
+    const auto now = espurna::time::CoreClock::now();
+    if (now - last < build::WebInterval) {
+        return;
+    }
+
+    last = now;
+    if (wsConnected()) {
+        wsPost(onData);
+    }
+}
+
+void setup() {
+    wsRegister()
+        .onVisible(onVisible)
+        .onData(onData)
+        .onAction(onAction);
+}
+
+} // namespace web
+#endif
+
+#if TERMINAL_SUPPORT
+namespace terminal {
+
+void print(Print& out, const char* name, const Report& report) {
+    out.printf_P(PSTR("%10s %8u %8u %8u %8u %8u %8u\n"),
+        name, report.count, report.min, report.average,
+        report.p99, report.max, report.overruns);
+}
+
+void dump(Print& out) {
+    out.printf_P(PSTR("%s, budget %u (us)\n"),
+        enabled() ? PSTR("running") : PSTR("stopped"),
+        static_cast<uint32_t>(budget().count()));
+    out.printf_P(PSTR("%10s %8s %8s %8s %8s %8s %8s\n"),
+        PSTR("callback"), PSTR("count"), PSTR("min"), PSTR("avg"),
+        PSTR("p99"), PSTR("max"), PSTR("overruns"));
+
+    foreach(espurna::main::internal::loop_callbacks,
+        [&](LoopCallback callback, const Report& report) {
+            char buffer[16];
+            address(buffer, callback);
+            print(out, buffer, report);
+        });
+
+    print(out, PSTR("loop"), report(internal::loop));
+}
+
+void command(::terminal::CommandContext&& ctx) {
+    if (ctx.argv.size() == 1) {
+        dump(ctx.output);
+        terminalOK(ctx);
+        return;
+    }
+
+    if (ctx.argv[1].equalsIgnoreCase(F("start"))) {
+        auto budget = build::budget();
+        if (ctx.argv.size() == 3) {
+            budget = espurna::duration::Microseconds(
+                espurna::settings::internal::convert<uint32_t>(ctx.argv[2]));
+        }
+
+        start(budget);
+        terminalOK(ctx);
+        return;
+    }
+
+    if (ctx.argv[1].equalsIgnoreCase(F("stop"))) {
+        stop();
+        terminalOK(ctx);
+        return;
+    }
+
+    if (ctx.argv[1].equalsIgnoreCase(F("reset"))) {
+        reset();
+        terminalOK(ctx);
+        return;
+    }
+
+    terminalError(ctx, F("LOOP.PROFILE [start [<budget>] | stop | reset]"));
+}
+
+void setup() {
+    terminalRegisterCommand(F("LOOP.PROFILE"), command);
+}
+
+} // namespace terminal
+#endif
+
+void setup() {
+#if WEB_SUPPORT
+    web::setup();
+#endif
+#if TERMINAL_SUPPORT
+    terminal::setup();
+#endif
+}
+
+} // namespace profiler
+#endif
+
 bool reload() {
     if (internal::reload_flag) {
         internal::reload_flag = false;
@@ -74,6 +389,8 @@ bool reload() {
 }
 
 void loop() {
+    idle::begin();
+
     // Reload config before running any callbacks
     if (reload()) {
         for (const auto& callback : internal::reload_callbacks) {
@@ -81,11 +398,24 @@ void loop() {
         }
     }
 
+#if LOOP_PROFILER_SUPPORT
+    if (profiler::enabled()) {
+        profiler::run(internal::loop_callbacks);
+#if WEB_SUPPORT
+        profiler::web::loop();
+#endif
+    } else {
+        for (const auto& callback : internal::loop_callbacks) {
+            callback();
+        }
+    }
+#else
     for (const auto& callback : internal::loop_callbacks) {
         callback();
     }
+#endif
 
-    espurna::time::delay(internal::loop_delay);
+    idle::sleep(internal::loop_delay);
 }
 
 void setup() {
@@ -246,6 +576,9 @@ void setup() {
     #if SENSOR_SUPPORT
         sensorSetup();
     #endif
+    #if HTTP_CLIENT_SUPPORT
+        httpClientSetup();
+    #endif
     #if INFLUXDB_SUPPORT
         idbSetup();
     #endif
@@ -296,6 +629,10 @@ void setup() {
         extraSetup();
     #endif
     
+    #if LOOP_PROFILER_SUPPORT
+        profiler::setup();
+    #endif
+
     // Update `cfg` version
     migrate();
 
@@ -308,6 +645,26 @@ void setup() {
 
 } // namespace
 
+#if LOOP_PROFILER_SUPPORT
+namespace loop {
+namespace profiler {
+
+bool enabled() {
+    return main::profiler::enabled();
+}
+
+void foreach(ReportCallback callback) {
+    main::profiler::foreach(main::internal::loop_callbacks, callback);
+}
+
+Report total() {
+    return main::profiler::report(main::profiler::internal::loop);
+}
+
+} // namespace profiler
+} // namespace loop
+#endif
+
 bool StringView::compare(StringView other) const {
     if (other._len == _len) {
         if (inFlash(_ptr)) {
@@ -344,6 +701,14 @@ void espurnaLoopDelay(espurna::duration::Milliseconds value) {
     espurna::main::internal::loop_delay = value;
 }
 
+void espurnaLoopDeadline(espurna::duration::Milliseconds value) {
+    espurna::main::idle::deadline(value);
+}
+
+void IRAM_ATTR espurnaLoopWake() {
+    espurna::main::idle::wake();
+}
+
 void setup() {
     espurna::main::setup();
 }
@@ -30,6 +30,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "encoder.h"
 #include "homeassistant.h"
 #include "garland.h"
+#include "http_client.h"
 #include "i2c.h"
 #include "influxdb.h"
 #include "fan.h"
@@ -13,7 +13,6 @@ Updated secure client support by Niek van der Maas < mail at niekvandermaas dot
 
 #include <forward_list>
 #include <utility>
-#include <Ticker.h>
 
 #include "system.h"
 #include "mdns.h"
@@ -24,6 +23,7 @@ Updated secure client support by Niek van der Maas < mail at niekvandermaas dot
 #include "ws.h"
 
 #include "libs/AsyncClientHelpers.h"
+#include "libs/HeartbeatBuilder.h"
 #include "libs/SecureClientHelpers.h"
 
 #if MQTT_LIBRARY == MQTT_LIBRARY_ASYNCMQTTCLIENT
@@ -89,6 +89,21 @@ std::forward_list<espurna::heartbeat::Callback> _mqtt_heartbeat_callbacks;
 espurna::heartbeat::Mode _mqtt_heartbeat_mode;
 espurna::duration::Seconds _mqtt_heartbeat_interval;
 
+// Buffer is allocated once, on the first heartbeat. Besides the heartbeat values themselves,
+// JSON payload also includes the enqueued fields and everything from the queue
+constexpr size_t MqttHeartbeatFields { 24 + MQTT_QUEUE_MAX_SIZE };
+using MqttHeartbeatBuilder = espurna::heartbeat::Builder<MQTT_HEARTBEAT_BUFFER_SIZE, MqttHeartbeatFields>;
+std::unique_ptr<MqttHeartbeatBuilder> _mqtt_heartbeat_builder;
+
+struct MqttHeartbeatStats {
+    size_t fields;
+    size_t bytes;
+    size_t dropped;
+    size_t allocations;
+};
+
+MqttHeartbeatStats _mqtt_heartbeat_stats{};
+
 String _mqtt_payload_online;
 String _mqtt_payload_offline;
 
@@ -537,7 +552,7 @@ private:
 
 size_t _mqtt_json_payload_count { 0ul };
 std::forward_list<MqttPayload> _mqtt_json_payload;
-Ticker _mqtt_json_payload_flush;
+espurna::timer::SystemTimer _mqtt_json_payload_flush { "mqtt json" };
 
 } // namespace
 
@@ -792,16 +807,16 @@ void _mqttConfigure() {
 
 #if MDNS_SERVER_SUPPORT
 
-constexpr unsigned long MqttMdnsDiscoveryInterval { 15000 };
-Ticker _mqtt_mdns_discovery;
+constexpr espurna::duration::Milliseconds MqttMdnsDiscoveryInterval { 15000 };
+espurna::timer::SystemTimer _mqtt_mdns_discovery { "mqtt mdns" };
 
 void _mqttMdnsStop() {
-    _mqtt_mdns_discovery.detach();
+    _mqtt_mdns_discovery.stop();
 }
 
 void _mqttMdnsDiscovery();
 void _mqttMdnsSchedule() {
-    _mqtt_mdns_discovery.once_ms_scheduled(MqttMdnsDiscoveryInterval, _mqttMdnsDiscovery);
+    _mqtt_mdns_discovery.once(MqttMdnsDiscoveryInterval, _mqttMdnsDiscovery);
 }
 
 void _mqttMdnsDiscovery() {
@@ -958,6 +973,11 @@ void _mqttInitCommands() {
     terminalRegisterCommand(F("MQTT"), [](::terminal::CommandContext&& ctx) {
         ctx.output.printf_P(PSTR("%s\n"), _mqttBuildInfo());
         ctx.output.printf_P(PSTR("client %s\n"), _mqttClientState().c_str());
+        ctx.output.printf_P(PSTR("heartbeat %u fields, %u bytes, %u dropped, %u allocations\n"),
+            static_cast<unsigned int>(_mqtt_heartbeat_stats.fields),
+            static_cast<unsigned int>(_mqtt_heartbeat_stats.bytes),
+            static_cast<unsigned int>(_mqtt_heartbeat_stats.dropped),
+            static_cast<unsigned int>(_mqtt_heartbeat_stats.allocations));
         settingsDump(ctx, mqtt::settings::query::Settings);
         terminalOK(ctx);
     });
@@ -1005,92 +1025,221 @@ void _mqttCallback(unsigned int type, const char* topic, char* payload) {
     }
 }
 
-bool _mqttHeartbeat(espurna::heartbeat::Mask mask) {
-    // No point retrying, since we will be re-scheduled on connection
-    if (!mqttConnected()) {
-        return true;
-    }
-
-#if NTP_SUPPORT
-    // Backported from the older utils implementation.
-    // Wait until the time is synced to avoid sending partial report *and*
-    // as a result, wait until the next interval to actually send the datetime string.
-    if ((mask & espurna::heartbeat::Report::Datetime) && !ntpSynced()) {
-        return false;
-    }
-#endif
-
-    // TODO: rework old HEARTBEAT_REPEAT_STATUS?
-    // for example: send full report once, send only the dynamic data after that
-    // (interval, hostname, description, ssid, bssid, ip, mac, rssi, uptime, datetime, heap, loadavg, vcc)
-    // otherwise, it is still possible by setting everything to 0 *but* the Report::Status bit
-    // TODO: per-module mask?
-    // TODO: simply send static data with onConnected, and the rest from here?
+// Every value is composed in the same buffer, only the values that are not available as
+// plain strings need a temporary String. Addresses are formatted the same way as the Core does.
+void _mqttHeartbeatIp(MqttHeartbeatBuilder& builder, const char* topic, IPAddress ip) {
+    char buffer[16];
+    snprintf_P(buffer, sizeof(buffer), PSTR("%u.%u.%u.%u"),
+        ip[0], ip[1], ip[2], ip[3]);
+    builder.add(topic, buffer);
+}
 
-    if (mask & espurna::heartbeat::Report::Status)
-        mqttSendStatus();
+void _mqttHeartbeatMac(MqttHeartbeatBuilder& builder, const char* topic, const uint8_t* mac) {
+    char buffer[18];
+    snprintf_P(buffer, sizeof(buffer), PSTR("%02X:%02X:%02X:%02X:%02X:%02X"),
+        mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+    builder.add(topic, buffer);
+}
 
+void _mqttHeartbeatValues(MqttHeartbeatBuilder& builder, espurna::heartbeat::Mask mask) {
     if (mask & espurna::heartbeat::Report::Interval)
-        mqttSend(MQTT_TOPIC_INTERVAL, String(_mqtt_heartbeat_interval.count()).c_str());
+        builder.add(MQTT_TOPIC_INTERVAL, static_cast<uint32_t>(_mqtt_heartbeat_interval.count()));
 
     if (mask & espurna::heartbeat::Report::App)
-        mqttSend(MQTT_TOPIC_APP, getAppName());
+        builder.add(MQTT_TOPIC_APP, getAppName());
 
     if (mask & espurna::heartbeat::Report::Version)
-        mqttSend(MQTT_TOPIC_VERSION, getVersion());
+        builder.add(MQTT_TOPIC_VERSION, getVersion());
 
     if (mask & espurna::heartbeat::Report::Board)
-        mqttSend(MQTT_TOPIC_BOARD, getBoardName().c_str());
+        builder.add(MQTT_TOPIC_BOARD, getBoardName());
 
     if (mask & espurna::heartbeat::Report::Hostname)
-        mqttSend(MQTT_TOPIC_HOSTNAME, getHostname().c_str());
+        builder.add(MQTT_TOPIC_HOSTNAME, getHostname());
 
     if (mask & espurna::heartbeat::Report::Description) {
         auto desc = getDescription();
         if (desc.length()) {
-            mqttSend(MQTT_TOPIC_DESCRIPTION, desc.c_str());
+            builder.add(MQTT_TOPIC_DESCRIPTION, std::move(desc));
         }
     }
 
-    if (mask & espurna::heartbeat::Report::Ssid)
-        mqttSend(MQTT_TOPIC_SSID, WiFi.SSID().c_str());
+    if (mask & espurna::heartbeat::Report::Ssid) {
+        station_config config{};
+        wifi_station_get_config(&config);
+
+        const auto* ssid = reinterpret_cast<const char*>(&config.ssid[0]);
+        builder.add(MQTT_TOPIC_SSID, ssid, strnlen(ssid, sizeof(config.ssid)));
+    }
 
     if (mask & espurna::heartbeat::Report::Bssid)
-        mqttSend(MQTT_TOPIC_BSSID, WiFi.BSSIDstr().c_str());
+        _mqttHeartbeatMac(builder, MQTT_TOPIC_BSSID, WiFi.BSSID());
 
     if (mask & espurna::heartbeat::Report::Ip)
-        mqttSend(MQTT_TOPIC_IP, wifiStaIp().toString().c_str());
+        _mqttHeartbeatIp(builder, MQTT_TOPIC_IP, wifiStaIp());
 
-    if (mask & espurna::heartbeat::Report::Mac)
-        mqttSend(MQTT_TOPIC_MAC, WiFi.macAddress().c_str());
+    if (mask & espurna::heartbeat::Report::Mac) {
+        uint8_t mac[6];
+        _mqttHeartbeatMac(builder, MQTT_TOPIC_MAC, WiFi.macAddress(mac));
+    }
 
     if (mask & espurna::heartbeat::Report::Rssi)
-        mqttSend(MQTT_TOPIC_RSSI, String(WiFi.RSSI()).c_str());
+        builder.add(MQTT_TOPIC_RSSI, static_cast<int32_t>(WiFi.RSSI()));
 
     if (mask & espurna::heartbeat::Report::Uptime)
-        mqttSend(MQTT_TOPIC_UPTIME, String(systemUptime().count()).c_str());
+        builder.add(MQTT_TOPIC_UPTIME, static_cast<uint32_t>(systemUptime().count()));
 
 #if NTP_SUPPORT
     if (mask & espurna::heartbeat::Report::Datetime)
-        mqttSend(MQTT_TOPIC_DATETIME, ntpDateTime().c_str());
+        builder.add(MQTT_TOPIC_DATETIME, ntpDateTime());
 #endif
 
     if (mask & espurna::heartbeat::Report::Freeheap) {
         auto stats = systemHeapStats();
-        mqttSend(MQTT_TOPIC_FREEHEAP, String(stats.available).c_str());
+        builder.add(MQTT_TOPIC_FREEHEAP, static_cast<uint32_t>(stats.available));
     }
 
     if (mask & espurna::heartbeat::Report::Loadavg)
-        mqttSend(MQTT_TOPIC_LOADAVG, String(systemLoadAverage()).c_str());
+        builder.add(MQTT_TOPIC_LOADAVG, static_cast<uint32_t>(systemLoadAverage()));
 
     if ((mask & espurna::heartbeat::Report::Vcc) && (ADC_MODE_VALUE == ADC_VCC))
-        mqttSend(MQTT_TOPIC_VCC, String(ESP.getVcc()).c_str());
+        builder.add(MQTT_TOPIC_VCC, static_cast<uint32_t>(ESP.getVcc()));
+}
+
+// Same fields as the ones mqttFlush() adds to the queued payload, unless heartbeat already has them.
+// Anything that is still queued (e.g. status and the module heartbeat values) is sent in the same message
+void _mqttHeartbeatEnqueued(MqttHeartbeatBuilder& builder) {
+#if NTP_SUPPORT && MQTT_ENQUEUE_DATETIME
+    if (ntpSynced() && !builder.contains(MQTT_TOPIC_DATETIME)) {
+        builder.add(MQTT_TOPIC_DATETIME, ntpDateTime());
+    }
+#endif
+#if MQTT_ENQUEUE_MAC
+    if (!builder.contains(MQTT_TOPIC_MAC)) {
+        uint8_t mac[6];
+        _mqttHeartbeatMac(builder, MQTT_TOPIC_MAC, WiFi.macAddress(mac));
+    }
+#endif
+#if MQTT_ENQUEUE_HOSTNAME
+    if (!builder.contains(MQTT_TOPIC_HOSTNAME)) {
+        builder.add(MQTT_TOPIC_HOSTNAME, getHostname());
+    }
+#endif
+#if MQTT_ENQUEUE_IP
+    if (!builder.contains(MQTT_TOPIC_IP)) {
+        _mqttHeartbeatIp(builder, MQTT_TOPIC_IP, wifiStaIp());
+    }
+#endif
+#if MQTT_ENQUEUE_MESSAGE_ID
+    builder.add(MQTT_TOPIC_MESSAGE_ID, static_cast<uint32_t>(Rtcmem->mqtt));
+#endif
+
+    // Queue is kept intact until the payload is sent, see mqttFlush() about the numbers.
+    // Both topic and message are copied, since the queue could change before the builder is used
+    for (auto& payload : _mqtt_json_payload) {
+        if (!builder.contains(payload.topic().c_str())) {
+            builder.add(payload.topic(), payload.message(), isNumber(payload.message()));
+        }
+    }
+}
 
+// Only the entries that made it into the heartbeat payload are removed,
+// everything else is left for the mqttFlush()
+void _mqttHeartbeatDequeue(const MqttHeartbeatBuilder& builder) {
+    _mqtt_json_payload.remove_if([&](const MqttPayload& payload) {
+        if (builder.contains(payload.topic().c_str())) {
+            --_mqtt_json_payload_count;
+            return true;
+        }
+
+        return false;
+    });
+}
+
+// With JSON enabled, heartbeat is a single message that also takes everything from the queue.
+// Otherwise (or when the JSON object does not fit), every heartbeat value is published as-is
+// using its own topic, and only the topic string is allocated
+void _mqttHeartbeatPublish(MqttHeartbeatBuilder& builder) {
+    const size_t values { builder.size() };
+    size_t allocations { builder.temporaries() };
+
+    const char* json { nullptr };
+    if (_mqtt_use_json) {
+        _mqttHeartbeatEnqueued(builder);
+        allocations = builder.temporaries();
+        json = builder.json();
+    }
+
+    if (json) {
+        mqttSendRaw(_mqtt_settings.topic_json.c_str(), json, false);
+#if MQTT_ENQUEUE_MESSAGE_ID
+        ++(Rtcmem->mqtt);
+#endif
+        _mqttHeartbeatDequeue(builder);
+    } else {
+        size_t index { 0 };
+        builder.foreach([&](const MqttHeartbeatBuilder::Field& field) {
+            if (index++ < values) {
+                mqttSendRaw(mqttTopic(field.topic, false).c_str(), field.value, _mqtt_settings.retain);
+                ++allocations;
+            }
+        });
+    }
+
+    _mqtt_heartbeat_stats = MqttHeartbeatStats{
+        .fields = builder.size(),
+        .bytes = builder.bytes(),
+        .dropped = builder.dropped(),
+        .allocations = allocations};
+
+    if (builder.dropped()) {
+        DEBUG_MSG_P(PSTR("[MQTT] Heartbeat buffer is full, %u value(s) were not sent\n"),
+            static_cast<unsigned int>(builder.dropped()));
+    }
+}
+
+bool _mqttHeartbeat(espurna::heartbeat::Mask mask) {
+    // No point retrying, since we will be re-scheduled on connection
+    if (!mqttConnected()) {
+        return true;
+    }
+
+#if NTP_SUPPORT
+    // Backported from the older utils implementation.
+    // Wait until the time is synced to avoid sending partial report *and*
+    // as a result, wait until the next interval to actually send the datetime string.
+    if ((mask & espurna::heartbeat::Report::Datetime) && !ntpSynced()) {
+        return false;
+    }
+#endif
+
+    // TODO: rework old HEARTBEAT_REPEAT_STATUS?
+    // for example: send full report once, send only the dynamic data after that
+    // (interval, hostname, description, ssid, bssid, ip, mac, rssi, uptime, datetime, heap, loadavg, vcc)
+    // otherwise, it is still possible by setting everything to 0 *but* the Report::Status bit
+    // TODO: per-module mask?
+    // TODO: simply send static data with onConnected, and the rest from here?
+
+    if (mask & espurna::heartbeat::Report::Status)
+        mqttSendStatus();
+
+    if (!_mqtt_heartbeat_builder) {
+        _mqtt_heartbeat_builder = std::make_unique<MqttHeartbeatBuilder>();
+    }
+
+    auto& builder = *_mqtt_heartbeat_builder;
+    builder.clear();
+
+    _mqttHeartbeatValues(builder, mask);
+
+    // Module values are queued when JSON is enabled, publish only after they are done
     auto status = mqttConnected();
     for (auto& cb : _mqtt_heartbeat_callbacks) {
         status = status && cb(mask);
     }
 
+    _mqttHeartbeatPublish(builder);
+
     return status;
 }
 
@@ -1353,7 +1502,7 @@ uint16_t mqttSendRaw(const char * topic, const char * message) {
 bool mqttSend(const char * topic, const char * message, bool force, bool retain) {
     if (!force && _mqtt_use_json) {
         mqttEnqueue(topic, message);
-        _mqtt_json_payload_flush.once_ms(MQTT_USE_JSON_DELAY, mqttFlush);
+        _mqtt_json_payload_flush.once(espurna::duration::Milliseconds(MQTT_USE_JSON_DELAY), mqttFlush);
         return true;
     }
 
@@ -17,7 +17,6 @@ Copyright (C) 2019 by Maxim Prokhorov <prokhorov dot max at outlook dot com>
 
 #include <Arduino.h>
 #include <coredecls.h>
-#include <Ticker.h>
 
 #include <ctime>
 #include <errno.h>
@@ -611,7 +610,7 @@ using Callbacks = std::forward_list<NtpTickCallback>;
 namespace internal {
 
 Callbacks callbacks;
-Ticker timer;
+espurna::timer::SystemTimer timer { "ntp tick" };
 
 } // namespace internal
 
@@ -656,19 +655,12 @@ void callback() {
     schedule(OffsetMax - espurna::duration::Seconds(local_tm.tm_sec));
 }
 
+// Never allow delays less than a second, or greater than a minute
 void schedule(espurna::duration::Seconds offset) {
-    static bool scheduled { false };
-
-    // Never allow delays less than a second, or greater than a minute
-    // (ref. Non-OS 3.1.1 os_timer_arm, actual minimal value is 5ms)
-    if (!scheduled) {
-        scheduled = true;
-        internal::timer.once_scheduled(
-            std::clamp(offset, OffsetMin, OffsetMax).count(),
-            []() {
-                scheduled = false;
-                callback();
-            });
+    if (!internal::timer) {
+        internal::timer.once(
+            std::clamp(offset, OffsetMin, OffsetMax),
+            callback);
     }
 }
 
@@ -682,9 +674,29 @@ void init() {
 
 } // namespace tick
 
+namespace synced {
+namespace internal {
+
+std::forward_list<NtpSyncedCallback> callbacks;
+
+} // namespace internal
+
+void add(NtpSyncedCallback callback) {
+    internal::callbacks.push_front(callback);
+}
+
+void notify() {
+    for (auto& callback : internal::callbacks) {
+        callback();
+    }
+}
+
+} // namespace synced
+
 void onSystemTimeSynced() {
     internal::status.update(::time(nullptr));
     tick::init();
+    synced::notify();
 
 #if WEB_SUPPORT
     wsPost(web::onData);
@@ -916,6 +928,10 @@ void ntpOnTick(NtpTickCallback callback) {
     ::espurna::ntp::tick::add(callback);
 }
 
+void ntpOnSynced(NtpSyncedCallback callback) {
+    ::espurna::ntp::synced::add(callback);
+}
+
 NtpInfo ntpInfo() {
     return ::espurna::ntp::makeInfo();
 }
@@ -18,6 +18,7 @@ enum class NtpTick {
 };
 
 using NtpTickCallback = void(*)(NtpTick);
+using NtpSyncedCallback = void(*)();
 
 struct NtpCalendarWeekday {
     int local_wday;
@@ -37,6 +38,9 @@ struct NtpInfo {
 };
 
 void ntpOnTick(NtpTickCallback);
+
+// Called every time the system time is (re)set, either by the NTP or manually
+void ntpOnSynced(NtpSyncedCallback);
 NtpInfo ntpInfo();
 
 String ntpDateTime(tm* timestruct);
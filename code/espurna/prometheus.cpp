@@ -39,6 +39,27 @@ static_assert(relaySupport() || sensorSupport(), "");
 
 namespace {
 
+#if LOOP_PROFILER_SUPPORT
+void loop_profile(AsyncResponseStream* response) {
+    const auto total = espurna::loop::profiler::total();
+    if (!total.count) {
+        return;
+    }
+
+    response->printf_P(PSTR("loop_time_avg_us %u\nloop_time_p99_us %u\nloop_time_max_us %u\n"),
+        total.average, total.p99, total.max);
+
+    espurna::loop::profiler::foreach(
+        [&](LoopCallback callback, const espurna::loop::profiler::Report& report) {
+            const auto* ptr = reinterpret_cast<void*>(callback);
+            response->printf_P(PSTR("loop_callback_time_avg_us{callback=\"%p\"} %u\n"), ptr, report.average);
+            response->printf_P(PSTR("loop_callback_time_p99_us{callback=\"%p\"} %u\n"), ptr, report.p99);
+            response->printf_P(PSTR("loop_callback_time_max_us{callback=\"%p\"} %u\n"), ptr, report.max);
+            response->printf_P(PSTR("loop_callback_overruns{callback=\"%p\"} %u\n"), ptr, report.overruns);
+        });
+}
+#endif
+
 void handler(AsyncWebServerRequest* request) {
 
     // TODO: Add more stuff?
@@ -64,6 +85,10 @@ void handler(AsyncWebServerRequest* request) {
         }
     }
 
+#if LOOP_PROFILER_SUPPORT
+    loop_profile(response);
+#endif
+
     response->write('\n');
 
     request->send(response);
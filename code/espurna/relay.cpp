@@ -1824,6 +1824,10 @@ static bool _relayStatus(size_t id, bool status, bool report, bool group_report)
         relaySync(id);
         changed = true;
 
+        // status can be changed from the SYS context (e.g. network callbacks),
+        // make sure it gets processed right away and not after the loop delay
+        espurnaLoopWake();
+
         if (relay.change_delay.count()) {
             DEBUG_MSG_P(PSTR("[RELAY] #%u scheduled %s in %u (ms)\n"),
                 id, status ? "ON" : "OFF", relay.change_delay.count());
@@ -2734,14 +2738,18 @@ void _relayProcess(bool mode) {
         // Only process the relays:
         // - target mode in the one requested by the arg
         // - target status is different from the current one
-        // - change delay has expired
+        // - change delay has expired (otherwise, ask the loop to wake up when it does)
         const bool target { _relays[id].target_status };
 
-        if ((target != _relays[id].current_status)
-            && (target == mode)
-            && ((!_relays[id].change_delay.count())
-                || (Relay::TimeSource::now() - _relays[id].change_start > _relays[id].change_delay)))
-        {
+        if ((target != _relays[id].current_status) && (target == mode)) {
+            if (_relays[id].change_delay.count()) {
+                const auto elapsed = Relay::TimeSource::now() - _relays[id].change_start;
+                if (elapsed <= _relays[id].change_delay) {
+                    espurnaLoopDeadline(_relays[id].change_delay - elapsed);
+                    continue;
+                }
+            }
+
             // delay will be reset back to the correct value via relayStatus
             _relays[id].change_delay = Relay::Delay::zero();
             _relays[id].current_status = target;
@@ -23,6 +23,7 @@ Copyright (C) 2016-2019 by Xose Pérez <xose dot perez at gmail dot com>
 #include <cstring>
 #include <list>
 #include <memory>
+#include <vector>
 
 // -----------------------------------------------------------------------------
 // GLOBALS TO THE MODULE
@@ -367,7 +368,16 @@ void on(size_t id, const String& value) {
 } // namespace settings
 } // namespace rfbridge
 
+namespace rfbridge {
+namespace match {
+
+void invalidate();
+
+} // namespace match
+} // namespace rfbridge
+
 void _rfbStore(size_t id, bool status, const String& code) {
+    rfbridge::match::invalidate();
     if (status) {
         rfbridge::settings::on(id, code);
     } else {
@@ -467,6 +477,20 @@ bool _rfbWebSocketOnKeyCheck(espurna::StringView key, const JsonVariant& value)
 // RELAY <-> CODE MATCHING
 // -----------------------------------------------------------------------------
 
+// FNV-1a, only the parts used by the comparison are hashed. Length is expected to match exactly
+uint32_t _rfbHashUpdate(uint32_t hash, const char* data, size_t length) {
+    for (size_t index = 0; index < length; ++index) {
+        hash = (hash ^ static_cast<uint8_t>(data[index])) * 16777619ul;
+    }
+
+    return hash;
+}
+
+uint32_t _rfbHashStart(size_t length) {
+    const uint8_t value = length;
+    return _rfbHashUpdate(2166136261ul, reinterpret_cast<const char*>(&value), 1);
+}
+
 #if RFB_PROVIDER == RFB_PROVIDER_EFM8BB1
 
 // we only care about last 6 chars (3 bytes in hex),
@@ -475,6 +499,15 @@ bool _rfbCompare(const char* lhs, const char* rhs, size_t length) {
     return (0 == std::memcmp((lhs + length - 6), (rhs + length - 6), 6));
 }
 
+bool _rfbHash(const char* code, size_t length, uint32_t& out) {
+    if (length < 6) {
+        return false;
+    }
+
+    out = _rfbHashUpdate(_rfbHashStart(length), code + length - 6, 6);
+    return true;
+}
+
 #elif RFB_PROVIDER == RFB_PROVIDER_RCSWITCH
 
 // protocol is [2:3), actual payload is [10:), as bit length may vary
@@ -484,11 +517,134 @@ bool _rfbCompare(const char* lhs, const char* rhs, size_t length) {
         && (0 == std::memcmp((lhs + 10), (rhs + 10), length - 10));
 }
 
+bool _rfbHash(const char* code, size_t length, uint32_t& out) {
+    if (length < 10) {
+        return false;
+    }
+
+    out = _rfbHashUpdate(_rfbHashStart(length), code + 2, 2);
+    out = _rfbHashUpdate(out, code + 10, length - 10);
+    return true;
+}
+
 #endif // RFB_PROVIDER == RFB_PROVIDER_EFM8BB1
 
 #if RELAY_SUPPORT
 
-// try to find the 'code' saves as either rfbON# or rfbOFF#
+namespace rfbridge {
+namespace match {
+
+// Received codes are looked up in RAM instead of scanning the settings storage every time.
+// Only the hashes of the stored codes are kept, any hit is then verified with the actual setting value.
+// Index is lazily rebuilt after the codes are changed or the settings are reloaded.
+// Most of the received codes are not ours, so a small bloom filter rejects them before probing the table
+class Index {
+public:
+    static constexpr size_t FilterBits { 256 };
+
+    struct Entry {
+        uint32_t hash;
+        uint8_t id;
+        bool status;
+        bool used;
+    };
+
+    bool valid() const {
+        return _valid;
+    }
+
+    void invalidate() {
+        _valid = false;
+    }
+
+    // Table is kept at least half-empty, so probing always ends at the unused slot
+    void reset(size_t entries) {
+        size_t size { 4 };
+        while (size < (entries * 2)) {
+            size *= 2;
+        }
+
+        _entries.clear();
+        _entries.resize(size, Entry{0, 0, false, false});
+        _filter.reset();
+        _valid = true;
+    }
+
+    void insert(uint32_t hash, size_t id, bool status) {
+        const size_t mask = _entries.size() - 1;
+        for (size_t slot = hash & mask; ; slot = (slot + 1) & mask) {
+            auto& entry = _entries[slot];
+            if (!entry.used) {
+                entry = Entry{hash, static_cast<uint8_t>(id), status, true};
+                break;
+            }
+        }
+
+        _filter.set(hash % FilterBits);
+        _filter.set((hash >> 16) % FilterBits);
+    }
+
+    bool maybe(uint32_t hash) const {
+        return _filter.test(hash % FilterBits)
+            && _filter.test((hash >> 16) % FilterBits);
+    }
+
+    // Callback receives (id, status) of every entry with the same hash
+    template <typename T>
+    void find(uint32_t hash, T&& callback) const {
+        const size_t mask = _entries.size() - 1;
+        for (size_t slot = hash & mask; ; slot = (slot + 1) & mask) {
+            const auto& entry = _entries[slot];
+            if (!entry.used) {
+                break;
+            }
+
+            if (entry.hash == hash) {
+                callback(entry.id, entry.status);
+            }
+        }
+    }
+
+private:
+    std::vector<Entry> _entries;
+    std::bitset<FilterBits> _filter;
+    bool _valid { false };
+};
+
+Index index;
+
+void invalidate() {
+    index.invalidate();
+}
+
+void build() {
+    const auto relays = relayCount();
+    index.reset(relays * 2);
+
+    for (size_t id = 0; id < relays; ++id) {
+        for (bool status : {false, true}) {
+            const auto code = _rfbRetrieve(id, status);
+
+            uint32_t hash;
+            if (_rfbHash(code.c_str(), code.length(), hash)) {
+                index.insert(hash, id, status);
+            }
+        }
+    }
+}
+
+const Index& get() {
+    if (!index.valid()) {
+        build();
+    }
+
+    return index;
+}
+
+} // namespace match
+} // namespace rfbridge
+
+// try to find the 'code' saved as either rfbON# or rfbOFF#
 //
 // **always** expect full length code as input to simplify comparison
 // previous implementation tried to help MQTT / API requests to match based on the saved code,
@@ -500,51 +656,36 @@ RfbRelayMatch _rfbMatch(const char* code) {
         return matched;
     }
 
-    const espurna::StringView codeView(code);
-
-    // we gather all available options, as the kv store might be defined in any order
-    // scan kvs only once, since we want both ON and OFF options and don't want to depend on the relayCount()
-    espurna::settings::foreach_prefix(
-        [codeView, &matched](espurna::StringView prefix, String key, const espurna::settings::kvs_type::ReadResult& value) {
-            if (codeView.length() != value.length()) {
-                return;
-            }
-
-            PayloadStatus status {
-                (prefix.c_str() == &rfbridge::settings::keys::On[0]) ? PayloadStatus::On :
-                (prefix.c_str() == &rfbridge::settings::keys::Off[0]) ? PayloadStatus::Off :
-                PayloadStatus::Unknown };
-
-            if (PayloadStatus::Unknown == status) {
-                return;
-            }
+    const size_t length = strlen(code);
 
-            if (!_rfbCompare(codeView.c_str(), value.read().c_str(), codeView.length())) {
-                return;
-            }
+    uint32_t hash;
+    if (!_rfbHash(code, length, hash)) {
+        return matched;
+    }
 
-            const char* id_ptr = key.c_str() + prefix.length();
-            if (*id_ptr == '\0') {
-                return;
-            }
+    const auto& index = rfbridge::match::get();
+    if (!index.maybe(hash)) {
+        return matched;
+    }
 
-            size_t id;
-            if (!tryParseId(id_ptr, relayCount, id)) {
-                return;
-            }
+    // both ON and OFF options are gathered, as the same code might be used for both
+    index.find(hash, [&](size_t id, bool status) {
+        const auto stored = _rfbRetrieve(id, status);
+        if ((stored.length() != length) || !_rfbCompare(code, stored.c_str(), length)) {
+            return;
+        }
 
-            // when we see the same id twice, we match the opposite statuses
-            if (matched && (id == matched.id())) {
-                matched.reset(matched.id(), PayloadStatus::Toggle);
-                return;
-            }
+        // when we see the same id twice, we match the opposite statuses
+        if (matched && (id == matched.id())) {
+            matched.reset(matched.id(), PayloadStatus::Toggle);
+            return;
+        }
 
-            matched.reset(matched ? std::min(id, matched.id()) : id, status);
-        },
-        {
-            rfbridge::settings::keys::On,
-            rfbridge::settings::keys::Off
-        });
+        const auto payload = status ? PayloadStatus::On : PayloadStatus::Off;
+        if (!matched || (id < matched.id())) {
+            matched.reset(id, payload);
+        }
+    });
 
     return matched;
 }
@@ -1264,6 +1405,7 @@ void rfbLearn(size_t id, bool status) {
 void rfbForget(size_t id, bool status) {
 
     delSetting({status ? F("rfbON") : F("rfbOFF"), id});
+    rfbridge::match::invalidate();
 
     // Websocket update needs to happen right here, since the only time
     // we send these in bulk is at the very start of the connection
@@ -1368,6 +1510,7 @@ void rfbSetup() {
 #if RELAY_SUPPORT
     relayOnStatusNotify(rfbStatus);
     relayOnStatusChange(rfbStatus);
+    espurnaRegisterReload(rfbridge::match::invalidate);
 #endif
 
 #if MQTT_SUPPORT
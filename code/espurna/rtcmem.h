@@ -25,7 +25,7 @@ Copyright (C) 2019 by Maxim Prokhorov <prokhorov dot max at outlook dot com>
 #define RTCMEM_BLOCKS 96u
 
 // Change this when modifying RtcmemData
-#define RTCMEM_MAGIC 0x46535076
+#define RTCMEM_MAGIC 0x46535077
 
 // XXX: All access must be 4-byte aligned and always at full length.
 //      Exactly like PROGMEM works. For example, using bitfields / inner structs / etc:
@@ -47,6 +47,18 @@ struct RtcmemEnergy {
     uint32_t ws;
 };
 
+// Last successful STA connection. Network is identified by the hash of its SSID and passphrase,
+// zero hash means there is nothing stored
+struct RtcmemWifi {
+    uint32_t hash;
+    uint32_t bssid[2];
+    uint32_t channel;
+    uint32_t ip;
+    uint32_t netmask;
+    uint32_t gateway;
+    uint32_t dns;
+};
+
 struct RtcmemData {
     uint32_t magic;
     uint32_t sys;
@@ -54,6 +66,7 @@ struct RtcmemData {
     uint32_t mqtt;
     uint64_t light;
     RtcmemEnergy energy[4];
+    RtcmemWifi wifi;
 };
 
 static_assert(sizeof(RtcmemData) <= (RTCMEM_BLOCKS * 4u), "RTCMEM struct is too big");
@@ -15,12 +15,13 @@ Adapted by Xose Pérez <xose dot perez at gmail dot com>
 #include "light.h"
 #include "mqtt.h"
 #include "ntp.h"
-#include "ntp_timelib.h"
 #include "curtain_kingart.h"
 #include "relay.h"
 #include "scheduler.h"
 #include "ws.h"
 
+#include "libs/SchedulerEvents.h"
+
 // -----------------------------------------------------------------------------
 
 namespace espurna {
@@ -101,6 +102,7 @@ struct Schedule {
     Weekdays weekdays;
     int hour;
     int minute;
+    int second;
 };
 
 using Schedules = std::vector<Schedule>;
@@ -175,6 +177,10 @@ constexpr int minute() {
     return 0;
 }
 
+constexpr int second() {
+    return 0;
+}
+
 constexpr int action() {
     return 0;
 }
@@ -247,9 +253,9 @@ void show(const Schedules& schedules) {
     size_t index { 0 };
     for (auto& schedule : schedules) {
         DEBUG_MSG_P(
-            PSTR("[SCH] #%d: %s #%d => %d at %02d:%02d (%s) on %s%s\n"),
+            PSTR("[SCH] #%d: %s #%d => %d at %02d:%02d:%02d (%s) on %s%s\n"),
             index++, scheduler::debug::type(schedule).c_str(), schedule.target,
-            schedule.action, schedule.hour, schedule.minute,
+            schedule.action, schedule.hour, schedule.minute, schedule.second,
             schedule.utc ? "UTC" : "local time",
             schedule.weekdays.toString().c_str(),
             schedule.enabled ? "" : " (disabled)");
@@ -271,6 +277,7 @@ alignas(4) static constexpr char UseUTC[] PROGMEM = "schUTC";
 alignas(4) static constexpr char Weekdays[] PROGMEM = "schWDs";
 alignas(4) static constexpr char Hour[] PROGMEM = "schHour";
 alignas(4) static constexpr char Minute[] PROGMEM = "schMinute";
+alignas(4) static constexpr char Second[] PROGMEM = "schSecond";
 
 } // namespace
 } // namespace keys
@@ -311,6 +318,10 @@ int minute(size_t index) {
     return getSetting({keys::Minute, index}, build::minute());
 }
 
+int second(size_t index) {
+    return getSetting({keys::Second, index}, build::second());
+}
+
 namespace internal {
 
 #define ID_VALUE(NAME, FUNC)\
@@ -331,6 +342,7 @@ String weekdays(size_t index) {
 
 ID_VALUE(hour, settings::hour)
 ID_VALUE(minute, settings::minute)
+ID_VALUE(second, settings::second)
 
 } // namespace internal
 
@@ -343,7 +355,8 @@ static constexpr espurna::settings::query::IndexedSetting IndexedSettings[] PROG
     {keys::UseUTC, internal::utc},
     {keys::Weekdays, internal::weekdays},
     {keys::Hour, internal::hour},
-    {keys::Minute, internal::minute}
+    {keys::Minute, internal::minute},
+    {keys::Second, internal::second}
 };
 
 Schedule schedule(size_t index, Type type) {
@@ -356,7 +369,8 @@ Schedule schedule(size_t index, Type type) {
         .utc = utc(index),
         .weekdays = weekdays(index),
         .hour = hour(index),
-        .minute = minute(index)
+        .minute = minute(index),
+        .second = second(index)
     };
 }
 
@@ -445,6 +459,7 @@ alignas(4) static constexpr char UseUTC[] PROGMEM = "utc";
 alignas(4) static constexpr char Weekdays[] PROGMEM = "weekdays";
 alignas(4) static constexpr char Hour[] PROGMEM = "hour";
 alignas(4) static constexpr char Minute[] PROGMEM = "minute";
+alignas(4) static constexpr char Second[] PROGMEM = "second";
 
 } // namespace keys
 
@@ -458,6 +473,7 @@ void print(JsonObject& root, const Schedule& schedule) {
     root[FPSTR(keys::Weekdays)] = schedule.weekdays.toString();
     root[FPSTR(keys::Hour)] = schedule.hour;
     root[FPSTR(keys::Minute)] = schedule.minute;
+    root[FPSTR(keys::Second)] = schedule.second;
 }
 
 template <typename T>
@@ -492,6 +508,7 @@ bool set(JsonObject& root, const size_t id) {
         setFromJsonIf<String>(root, settings::keys::Weekdays, id, keys::Weekdays);
         setFromJsonIf<int>(root, settings::keys::Hour, id, keys::Hour);
         setFromJsonIf<int>(root, settings::keys::Minute, id, keys::Minute);
+        setFromJsonIf<int>(root, settings::keys::Second, id, keys::Second);
         return true;
     }
 
@@ -649,12 +666,9 @@ tm localtimeDaysAgo(tm day, int days) {
     return day;
 }
 
-int minutesLeft(const Schedule& schedule, int hour, int minute) {
-    return (schedule.hour - hour) * 60 + schedule.minute - minute;
-}
-
-int minutesLeft(const Schedule& schedule, const tm& now) {
-    return minutesLeft(schedule, now.tm_hour, now.tm_min);
+int secondsLeft(const Schedule& schedule, const tm& now) {
+    return (((schedule.hour - now.tm_hour) * 60) + (schedule.minute - now.tm_min)) * 60
+        + (schedule.second - now.tm_sec);
 }
 
 // For 'restore'able schedules, do the most recent action, Normal check will take care of the current setting
@@ -692,7 +706,7 @@ void restore(time_t timestamp, const Schedules& schedules) {
                 // filter by the most recent ones of the same type (i.e. max hour and minute, but min daysAgo)
 
                 if (schedule.weekdays.match(offsetDay)) {
-                    if ((offset == 0) && (minutesLeft(schedule, offsetDay) >= 0)) {
+                    if ((offset == 0) && (secondsLeft(schedule, offsetDay) >= 0)) {
                         continue;
                     }
 
@@ -726,65 +740,119 @@ void restore(time_t timestamp, const Schedules& schedules) {
     }
 }
 
-void check(time_t timestamp, const Schedules& schedules) {
-    tm utc;
-    gmtime_r(&timestamp, &utc);
+// Schedules are only parsed when settings change. Every enabled schedule has exactly one pending event,
+// with the absolute time of the next action. Timer is armed for the earliest one, and the event is
+// re-queued with the next time right after the action happens
 
-    tm local;
-    localtime_r(&timestamp, &local);
+namespace internal {
 
-    for (auto& schedule : schedules) {
-        if (!schedule.enabled) {
-            continue;
-        }
+Schedules schedules;
+events::Queue queue;
+espurna::timer::SystemTimer timer { "scheduler" };
 
-        auto& today = schedule.utc
-            ? utc
-            : local;
+bool restored { false };
 
-        if (!schedule.weekdays.match(today)) {
-            continue;
-        }
+} // namespace internal
 
-        // 'Next scheduled' only happens at exactly the -15min
-        // e.g. at 0:00 updating the scheduler to trigger at 0:14 will not show the notification
+// Wall clock could be adjusted in the meantime, longer delays simply re-check the queue
+static constexpr espurna::duration::Milliseconds TimerMax { espurna::duration::Hours(1) };
 
-        auto left = minutesLeft(schedule, today);
-        if (left == 0) {
-          DEBUG_MSG_P(PSTR("[SCH] Action at %02d:%02d (%s #%u => %u)\n"),
-                      schedule.hour, schedule.minute,
-                      scheduler::debug::type(schedule).c_str(), schedule.target,
-                      schedule.action);
-          action(schedule);
-#if DEBUG_SUPPORT
-        } else if (left > 0) {
-            if ((left % 15 == 0) || (left < 15)) {
-                DEBUG_MSG_P(PSTR("[SCH] Next scheduled action at %02d:%02d\n"),
-                        schedule.hour, schedule.minute);
-            }
-#endif
-        }
+events::Time eventTime(const Schedule& schedule) {
+    return {
+        .weekdays = schedule.weekdays.mask(),
+        .hour = schedule.hour,
+        .minute = schedule.minute,
+        .second = schedule.second,
+        .utc = schedule.utc
+    };
+}
+
+void push(size_t id, time_t after) {
+    const auto& schedule = internal::schedules[id];
+    if (!schedule.enabled) {
+        return;
+    }
+
+    const auto next = events::next(eventTime(schedule), after);
+    if (next != events::Never) {
+        internal::queue.push(next, id);
     }
 }
 
-void ntp_tick(NtpTick tick) {
-    static bool initial { true };
-    if (tick != NtpTick::EveryMinute) {
+void expire();
+
+void arm() {
+    internal::timer.stop();
+    if (internal::queue.empty()) {
         return;
     }
 
-    auto timestamp = now();
-    auto schedules = settings::schedules();
-    if (initial) {
-        initial = false;
-        settings::gc(schedules.size());
+    const auto& event = internal::queue.top();
+
+    timeval tv;
+    gettimeofday(&tv, nullptr);
+
+    const int64_t left =
+        (static_cast<int64_t>(event.timestamp - tv.tv_sec) * 1000)
+        - (tv.tv_usec / 1000);
+
+    internal::timer.once(
+        espurna::duration::Milliseconds(
+            std::clamp<int64_t>(left, 1, TimerMax.count())),
+        expire);
+
 #if DEBUG_SUPPORT
-        debug::show(schedules);
+    const auto& schedule = internal::schedules[event.id];
+    DEBUG_MSG_P(PSTR("[SCH] Next action at %s (%s #%u => %d)\n"),
+        ntpDateTime(event.timestamp).c_str(),
+        scheduler::debug::type(schedule).c_str(), schedule.target,
+        schedule.action);
 #endif
-        restore(timestamp, schedules);
+}
+
+void expire() {
+    const auto now = ::time(nullptr);
+    internal::queue.expire(now,
+        [&](const events::Queue::Event& event) {
+            const auto& schedule = internal::schedules[event.id];
+            DEBUG_MSG_P(PSTR("[SCH] Action at %02d:%02d:%02d (%s #%u => %d)\n"),
+                schedule.hour, schedule.minute, schedule.second,
+                scheduler::debug::type(schedule).c_str(), schedule.target,
+                schedule.action);
+            action(schedule);
+            push(event.id, now);
+        });
+
+    arm();
+}
+
+// Events are never 'caught up' after the time changes, only the restore() handles the past ones
+void rebuild(time_t now) {
+    internal::queue.clear();
+    internal::queue.reserve(internal::schedules.size());
+
+    for (size_t id = 0; id < internal::schedules.size(); ++id) {
+        push(id, now);
+    }
+
+    arm();
+}
+
+void synced() {
+    const auto now = ::time(nullptr);
+    if (!internal::restored) {
+        internal::restored = true;
+        restore(now, internal::schedules);
     }
 
-    check(timestamp, schedules);
+    rebuild(now);
+}
+
+void reload() {
+    internal::schedules = settings::schedules();
+    if (ntpSynced()) {
+        rebuild(::time(nullptr));
+    }
 }
 
 void setup() {
@@ -799,7 +867,14 @@ void setup() {
     api::setup();
 #endif
 
-    ntpOnTick(ntp_tick);
+    internal::schedules = settings::schedules();
+    settings::gc(internal::schedules.size());
+#if DEBUG_SUPPORT
+    debug::show(internal::schedules);
+#endif
+
+    ntpOnSynced(synced);
+    espurnaRegisterReload(reload);
 }
 
 } // namespace
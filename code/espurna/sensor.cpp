@@ -28,11 +28,14 @@ Copyright (C) 2020-2022 by Maxim Prokhorov <prokhorov dot max at outlook dot com
 #include <cmath>
 #include <cstring>
 
+#include <array>
 #include <limits>
 #include <vector>
 
 //--------------------------------------------------------------------------------
 
+#include "libs/Journal.h"
+
 #include "sensors/BaseSensor.h"
 #include "sensors/BaseEmonSensor.h"
 #include "sensors/BaseAnalogEmonSensor.h"
@@ -462,8 +465,9 @@ public:
     Magnitude(Magnitude&& other) noexcept = default;
     Magnitude& operator=(Magnitude&&) noexcept = default;
 
-    Magnitude(BaseSensorPtr, unsigned char slot, unsigned char type);
+    Magnitude(unsigned char id, BaseSensorPtr, unsigned char slot, unsigned char type);
 
+    unsigned char id; // Position in the magnitudes list, also used to access the read & report state
     BaseSensorPtr sensor; // Sensor object, *cannot be empty*
     unsigned char slot; // Sensor slot # taken by the magnitude, used to access the measurement
     unsigned char type; // Type of measurement, returned by the BaseSensor::type(slot)
@@ -476,13 +480,15 @@ public:
     Filter filter_type { Filter::Median }; // Instead of using raw value, filter it through a filter object
     BaseFilterPtr filter; // *cannot be empty*
 
-    double last { Value::Unknown }; // Last raw value from sensor (unfiltered)
-    double reported { Value::Unknown }; // Last reported value
+    double correction { 0.0 }; // Value correction (applied when processing)
+};
 
+// Values that are checked on every read are not stored in the Magnitude itself,
+// but in separate arrays indexed by the `Magnitude::id` (see magnitude::internal)
+struct Thresholds {
+    double zero { Value::Unknown }; // Reset value to zero when below threshold (applied when reading)
     double min_delta { 0.0 }; // Minimum value change to report
     double max_delta { 0.0 }; // Maximum value change to report
-    double correction { 0.0 }; // Value correction (applied when processing)
-    double zero_threshold { Value::Unknown }; // Reset value to zero when below threshold (applied when reading)
 };
 
 static_assert(
@@ -495,7 +501,8 @@ static_assert(
     "std::vector<Magnitude> should only use move ctor"
 );
 
-Magnitude::Magnitude(BaseSensorPtr sensor, unsigned char slot, unsigned char type) :
+Magnitude::Magnitude(unsigned char id, BaseSensorPtr sensor, unsigned char slot, unsigned char type) :
+    id(id),
     sensor(std::move(sensor)),
     slot(slot),
     type(type),
@@ -1612,6 +1619,17 @@ namespace {
 
 std::vector<Magnitude> magnitudes;
 
+// Read & report loop state, kept as separate arrays so that the loop only touches what it needs
+// Every array is indexed by the `Magnitude::id`, and is resized together with the `magnitudes`
+std::vector<double> last; // Last raw value from sensor (unfiltered)
+std::vector<double> reported; // Last reported value
+std::vector<Thresholds> thresholds;
+
+// Magnitude ids grouped by type, `[offsets[type], offsets[type + 1])` is the range of the specific type
+// and `ids[offsets[type] + index_global]` is the id of the magnitude
+std::array<unsigned char, MAGNITUDE_MAX + 1> offsets{};
+std::vector<unsigned char> ids;
+
 using ReadHandlers = std::forward_list<MagnitudeReadHandler>;
 ReadHandlers read_handlers;
 ReadHandlers report_handlers;
@@ -1628,30 +1646,65 @@ size_t count() {
 }
 
 void add(BaseSensorPtr sensor, unsigned char slot, unsigned char type) {
-    internal::magnitudes.emplace_back(sensor, slot, type);
+    internal::magnitudes.emplace_back(internal::magnitudes.size(), sensor, slot, type);
+    internal::last.push_back(Value::Unknown);
+    internal::reported.push_back(Value::Unknown);
+    internal::thresholds.emplace_back();
 }
 
-const Magnitude* find(unsigned char type, unsigned char index) {
-    const Magnitude* out { nullptr };
+// Rebuild (type, index) -> id table. Since `index_global` is assigned in the order magnitudes
+// were added, every type range is also sorted by the index
+void index() {
+    auto& offsets = internal::offsets;
+    offsets.fill(0);
 
-    const auto result = std::find_if(
-        std::cbegin(internal::magnitudes),
-        std::cend(internal::magnitudes),
-        [&](const Magnitude& magnitude) {
-            return (magnitude.type == type) && (magnitude.index_global == index);
-        });
+    for (const auto& magnitude : internal::magnitudes) {
+        ++offsets[magnitude.type + 1];
+    }
 
-    if (result != internal::magnitudes.end()) {
-        out = std::addressof(*result);
+    for (size_t type = 1; type < offsets.size(); ++type) {
+        offsets[type] += offsets[type - 1];
     }
 
-    return out;
+    internal::ids.resize(internal::magnitudes.size());
+    for (const auto& magnitude : internal::magnitudes) {
+        internal::ids[offsets[magnitude.type] + magnitude.index_global] = magnitude.id;
+    }
+}
+
+// Returns `count()` when (type, index) pair does not exist
+size_t id(unsigned char type, unsigned char index) {
+    if ((type > MAGNITUDE_NONE) && (type < MAGNITUDE_MAX)) {
+        const auto offset = internal::offsets[type] + index;
+        if (offset < internal::offsets[type + 1]) {
+            return internal::ids[offset];
+        }
+    }
+
+    return count();
+}
+
+const Magnitude* find(unsigned char type, unsigned char index) {
+    const auto result = id(type, index);
+    if (result < count()) {
+        return &internal::magnitudes[result];
+    }
+
+    return nullptr;
 }
 
 Magnitude& get(size_t index) {
     return internal::magnitudes[index];
 }
 
+double last(const Magnitude& magnitude) {
+    return internal::last[magnitude.id];
+}
+
+double reported(const Magnitude& magnitude) {
+    return internal::reported[magnitude.id];
+}
+
 template <typename T>
 void forEachInstance(T&& callback) {
     for (auto& magnitude : internal::magnitudes) {
@@ -2191,7 +2244,7 @@ void load() {
         sensor->setPin(PULSEMETER_PIN);
         sensor->setInterruptMode(PULSEMETER_INTERRUPT_ON);
         sensor->setDebounceTime(
-            PulseMeterSensor::TimeSource::duration{PULSEMETER_DEBOUNCE});
+            espurna::duration::Milliseconds{PULSEMETER_DEBOUNCE});
         add(sensor);
     }
 #endif
@@ -2642,9 +2695,166 @@ sensor::Unit filter(const Magnitude& magnitude, Unit unit) {
 // Energy persistence
 // -----------------------------------------------------------------------------
 
+#if SENSOR_ENERGY_JOURNAL_SECTORS
+extern "C" uint32_t _FS_start;
+extern "C" uint32_t _FS_end;
+#endif
+
 namespace energy {
 namespace {
 
+#if SENSOR_ENERGY_JOURNAL_SECTORS
+// Journal takes N sectors of the filesystem area (which is otherwise unused) right below the EEPROM_Rotate sector pool
+// Notice that flash is accessed via physical address, not the one mapped in the memory
+struct JournalStorage {
+    static constexpr uint32_t FlashBase { 0x40200000 };
+
+    JournalStorage() = default;
+
+    JournalStorage(uint32_t sector, size_t sectors) :
+        _sector(sector),
+        _sectors(sectors)
+    {}
+
+    size_t sectors() const {
+        return _sectors;
+    }
+
+    size_t sector_size() const {
+        return SPI_FLASH_SEC_SIZE;
+    }
+
+    bool erase(size_t sector) {
+        return ESP.flashEraseSector(_sector + sector);
+    }
+
+    bool read(size_t sector, size_t offset, espurna::journal::Record& out) {
+        return ESP.flashRead(address(sector, offset),
+            reinterpret_cast<uint32_t*>(&out), sizeof(out));
+    }
+
+    bool write(size_t sector, size_t offset, const espurna::journal::Record& record) {
+        return ESP.flashWrite(address(sector, offset),
+            reinterpret_cast<const uint32_t*>(&record), sizeof(record));
+    }
+
+    // Settings pool counts back from the EEPROM sector and usually takes the end of the filesystem area.
+    // Anything below the filesystem area belongs to the sketch and OTA updates, so it is never used
+    static JournalStorage filesystem(size_t sectors) {
+        const uint32_t fs_start = sector(reinterpret_cast<uint32_t>(&_FS_start));
+        const uint32_t fs_end = sector(reinterpret_cast<uint32_t>(&_FS_end));
+
+        const uint32_t pool_size = EEPROMr.size();
+        const uint32_t pool_start = EEPROMr.base() + 1 - pool_size;
+
+        const uint32_t end = std::min(pool_start, fs_end);
+        if ((end <= fs_start) || ((end - fs_start) < sectors)) {
+            return JournalStorage();
+        }
+
+        const uint32_t start = end - sectors;
+        if (overlaps(start, sectors, pool_start, pool_size)) {
+            return JournalStorage();
+        }
+
+        return JournalStorage(start, sectors);
+    }
+
+private:
+    static uint32_t sector(uint32_t address) {
+        return (address - FlashBase) / SPI_FLASH_SEC_SIZE;
+    }
+
+    static bool overlaps(uint32_t lhs, uint32_t lhs_size, uint32_t rhs, uint32_t rhs_size) {
+        return (lhs < (rhs + rhs_size)) && (rhs < (lhs + lhs_size));
+    }
+
+    uint32_t address(size_t sector, size_t offset) const {
+        return ((_sector + sector) * SPI_FLASH_SEC_SIZE)
+            + (offset * sizeof(espurna::journal::Record));
+    }
+
+    uint32_t _sector { 0 };
+    size_t _sectors { 0 };
+};
+
+using Journal = espurna::journal::Journal<JournalStorage>;
+#endif
+
+namespace internal {
+
+#if SENSOR_ENERGY_JOURNAL_SECTORS
+Journal journal{JournalStorage()};
+#endif
+
+} // namespace internal
+
+#if SENSOR_ENERGY_JOURNAL_SECTORS
+bool journal_ready() {
+    return internal::journal.storage().sectors() > 0;
+}
+
+bool get_journal(unsigned char index, Energy& out) {
+    espurna::journal::Value value;
+    if (internal::journal.get(index, value)) {
+        out = Energy {
+            Energy::Pair {
+                .kwh = KilowattHours(value.data[0]),
+                .ws = WattSeconds(value.data[1]),
+            }};
+        return true;
+    }
+
+    return false;
+}
+
+// Also tracks when the value was saved, unless the time is not yet known
+bool set_journal(unsigned char index, const Energy& energy) {
+    const auto pair = energy.pair();
+
+    espurna::journal::Value value;
+    value.data[0] = pair.kwh.value;
+    value.data[1] = pair.ws.value;
+    value.timestamp = 0;
+#if NTP_SUPPORT
+    if (ntpSynced()) {
+        value.timestamp = static_cast<uint32_t>(time(nullptr));
+    }
+#endif
+
+    return internal::journal.append(index, value);
+}
+
+String time_journal(unsigned char index) {
+    String out;
+
+    espurna::journal::Value value;
+    if (internal::journal.get(index, value) && value.timestamp) {
+#if NTP_SUPPORT
+        out = ntpDateTime(static_cast<time_t>(value.timestamp));
+#endif
+    }
+
+    return out;
+}
+
+void setup_journal() {
+#if !SPIFFS_SUPPORT
+    internal::journal = Journal(
+        JournalStorage::filesystem(SENSOR_ENERGY_JOURNAL_SECTORS));
+    if (journal_ready()) {
+        internal::journal.begin();
+        DEBUG_MSG_P(PSTR("[ENERGY] Journal sector #%u offset %u, found %u value(s)\n"),
+            static_cast<uint32_t>(internal::journal.head()),
+            static_cast<uint32_t>(internal::journal.offset()),
+            static_cast<uint32_t>(internal::journal.entries().size()));
+    } else {
+        DEBUG_MSG_P(PSTR("[ENERGY] No space for the journal below the settings, using settings storage\n"));
+    }
+#endif
+}
+#endif
+
 struct Persist {
     Persist(size_t index, Energy energy) :
         _index(index),
@@ -2652,6 +2862,12 @@ struct Persist {
     {}
 
     void operator()() const {
+#if SENSOR_ENERGY_JOURNAL_SECTORS
+        if (journal_ready()) {
+            set_journal(_index, _energy);
+            return;
+        }
+#endif
         setSetting({F("eneTotal"), _index}, _energy.asString());
 #if NTP_SUPPORT
         if (ntpSynced()) {
@@ -2854,6 +3070,9 @@ Energy get(unsigned char index) {
 
     if (rtcmemStatus() && (index < (sizeof(Rtcmem->energy) / sizeof(*Rtcmem->energy)))) {
         result = get_rtcmem(index);
+#if SENSOR_ENERGY_JOURNAL_SECTORS
+    } else if (journal_ready() && get_journal(index, result)) {
+#endif
     } else {
         result = get_settings(index);
     }
@@ -2861,7 +3080,22 @@ Energy get(unsigned char index) {
     return result;
 }
 
+// Saved time is only available when NTP is synced
+String saved(unsigned char index) {
+#if SENSOR_ENERGY_JOURNAL_SECTORS
+    if (journal_ready()) {
+        return time_journal(index);
+    }
+#endif
+    return getSetting({F("eneTime"), index});
+}
+
 void reset(unsigned char index) {
+#if SENSOR_ENERGY_JOURNAL_SECTORS
+    if (journal_ready()) {
+        set_journal(index, Energy());
+    }
+#endif
     delSetting({F("eneTotal"), index});
     delSetting({F("eneTime"), index});
     if (index < (sizeof(Rtcmem->energy) / sizeof(*Rtcmem->energy))) {
@@ -3193,7 +3427,7 @@ void settings(JsonObject& root) {
             }
         }},
         {settings::suffix::ZeroThreshold, [](JsonArray& out, size_t index) {
-            const auto threshold = magnitude::get(index).zero_threshold;
+            const auto threshold = magnitude::internal::thresholds[index].zero;
             if (!std::isnan(threshold)) {
                 out.add(threshold);
             } else {
@@ -3201,10 +3435,10 @@ void settings(JsonObject& root) {
             }
         }},
         {settings::suffix::MinDelta, [](JsonArray& out, size_t index) {
-            out.add(magnitude::get(index).min_delta);
+            out.add(magnitude::internal::thresholds[index].min_delta);
         }},
         {settings::suffix::MaxDelta, [](JsonArray& out, size_t index) {
-            out.add(magnitude::get(index).max_delta);
+            out.add(magnitude::internal::thresholds[index].max_delta);
         }}
     });
 
@@ -3233,7 +3467,11 @@ void energy(JsonObject& root) {
         }},
         {STRING_VIEW("saved"), [](JsonArray& out, size_t index) {
             if (energy::internal::tracker) {
-                out.add(getSetting({F("eneTime"), magnitude::get(index).index_global}, F("(unknown)")));
+                auto saved = energy::saved(magnitude::get(index).index_global);
+                if (!saved.length()) {
+                    saved = F("(unknown)");
+                }
+                out.add(saved);
             } else {
                 out.add("");
             }
@@ -3248,7 +3486,7 @@ void magnitudes(JsonObject& root) {
         {STRING_VIEW("value"), [](JsonArray& out, size_t index) {
             const auto& magnitude = magnitude::get(index);
             out.add(magnitude::format(magnitude,
-                magnitude::process(magnitude, magnitude.last)));
+                magnitude::process(magnitude, magnitude::internal::last[index])));
         }},
         {STRING_VIEW("units"), [](JsonArray& out, size_t index) {
             out.add(static_cast<int>(magnitude::get(index).units));
@@ -3401,8 +3639,8 @@ void setup() {
             for (auto& magnitude : magnitude::internal::magnitudes) {
                 JsonArray& data = magnitudes.createNestedArray();
                 data.add(sensor::magnitude::topicWithIndex(magnitude));
-                data.add(magnitude.last);
-                data.add(magnitude.reported);
+                data.add(magnitude::last(magnitude));
+                data.add(magnitude::reported(magnitude));
             }
             return true;
         },
@@ -3419,7 +3657,9 @@ void setup() {
             return tryHandle(request, type,
                 [&](const Magnitude& magnitude) {
                     request.send(magnitude::format(magnitude,
-                        realTimeValues() ? magnitude.last : magnitude.reported));
+                        realTimeValues()
+                            ? magnitude::last(magnitude)
+                            : magnitude::reported(magnitude)));
                     return true;
                 });
         };
@@ -3519,8 +3759,8 @@ void setup() {
             ctx.output.printf_P(PSTR("%2zu * %s @ %s (read:%s reported:%s units:%s)\n"),
                 index++, magnitude::topicWithIndex(magnitude).c_str(),
                 magnitude::description(magnitude).c_str(),
-                magnitude::format(magnitude, magnitude.last).c_str(),
-                magnitude::format(magnitude, magnitude.reported).c_str(),
+                magnitude::format(magnitude, magnitude::last(magnitude)).c_str(),
+                magnitude::format(magnitude, magnitude::reported(magnitude)).c_str(),
                 magnitude::units(magnitude).c_str());
         }
 
@@ -3629,6 +3869,9 @@ void init() {
         }
     }
 
+    // Lookup table is rebuilt every time, since init() can be repeated until every sensor is ready
+    magnitude::index();
+
     // Energy tracking is implemented by looking at the specific magnitude & it's index at read time
     // TODO: shuffle some functions around so that debug can be in the init func instead and still be inline?
     for (auto& magnitude : magnitude::internal::magnitudes) {
@@ -3688,6 +3931,9 @@ void loop() {
                 continue;
             }
 
+            const auto& thresholds = magnitude::internal::thresholds[index];
+            auto& reported = magnitude::internal::reported[index];
+
             // -------------------------------------------------------------
             // RAW value, returned from the sensor 
             // -------------------------------------------------------------
@@ -3713,11 +3959,11 @@ void loop() {
 #endif
 
             // We also check that value is above a certain threshold
-            if ((!std::isnan(magnitude.zero_threshold)) && ((value.raw < magnitude.zero_threshold))) {
+            if ((!std::isnan(thresholds.zero)) && ((value.raw < thresholds.zero))) {
                 value.raw = 0.0;
             }
 
-            magnitude.last = value.raw;
+            magnitude::internal::last[index] = value.raw;
             magnitude.filter->update(value.raw);
 
             // -------------------------------------------------------------
@@ -3736,8 +3982,8 @@ void loop() {
 
             // In case magnitude was configured with ${name}MaxDelta, override report check
             // when the value change is greater than the delta
-            if (!std::isnan(magnitude.reported) && (magnitude.max_delta > build::DefaultMaxDelta)) {
-                report = std::abs(value.processed - magnitude.reported) >= magnitude.max_delta;
+            if (!std::isnan(reported) && (thresholds.max_delta > build::DefaultMaxDelta)) {
+                report = std::abs(value.processed - reported) >= thresholds.max_delta;
             }
 
             // Special case for energy, save readings to RAM and EEPROM
@@ -3752,7 +3998,7 @@ void loop() {
                 magnitude.filter->reset();
 
                 // Check ${name}MinDelta if there is a minimum change threshold to report
-                if (std::isnan(magnitude.reported) || (std::abs(value.filtered - magnitude.reported) >= magnitude.min_delta)) {
+                if (std::isnan(reported) || (std::abs(value.filtered - reported) >= thresholds.min_delta)) {
                     const auto report = magnitude::value(magnitude, value.filtered);
                     magnitude::report(report);
 
@@ -3763,7 +4009,7 @@ void loop() {
 #if DOMOTICZ_SUPPORT
                     domoticzSendMagnitude(index, report);
 #endif
-                    magnitude.reported = value.filtered;
+                    reported = value.filtered;
                 }
 
             }
@@ -3795,6 +4041,9 @@ void loop() {
         wsPost(web::onData);
 #endif
     }
+
+    // Reading takes some time, next one is still counted from the loop start
+    espurnaLoopDeadline(readInterval() - (timestamp - last_update));
 }
 
 void configure() {
@@ -3874,15 +4123,16 @@ void configure() {
         //   (default is set to 0.0 aka value has changed from the last recorded one)
         // - ${prefix}DeltaMax${index} will trigger report as soon as read value is greater than the specified delta
         //   (default is 0.0 as well, but this needs to be >0 to actually do something)
-        magnitude.min_delta = getSetting(
+        auto& thresholds = magnitude::internal::thresholds[magnitude.id];
+        thresholds.min_delta = getSetting(
             settings::keys::get(magnitude, settings::suffix::MinDelta),
             build::DefaultMinDelta);
-        magnitude.max_delta = getSetting(
+        thresholds.max_delta = getSetting(
             settings::keys::get(magnitude, settings::suffix::MaxDelta),
             build::DefaultMaxDelta);
 
         // Sometimes we want to ensure the value is above certain threshold before reporting
-        magnitude.zero_threshold = getSetting(
+        thresholds.zero = getSetting(
             settings::keys::get(magnitude, settings::suffix::ZeroThreshold),
             Value::Unknown);
 
@@ -3896,6 +4146,10 @@ void configure() {
 void setup() {
     migrateVersion(settings::migrate);
 
+#if SENSOR_ENERGY_JOURNAL_SECTORS
+    energy::setup_journal();
+#endif
+
     sensor::load();
     sensor::init();
 
@@ -3954,6 +4208,10 @@ size_t magnitudeCount() {
     return espurna::sensor::magnitude::count();
 }
 
+size_t magnitudeId(unsigned char type, unsigned char index) {
+    return espurna::sensor::magnitude::id(type, index);
+}
+
 unsigned char magnitudeIndex(unsigned char index) {
     using namespace espurna::sensor;
 
@@ -3997,7 +4255,9 @@ espurna::sensor::Value magnitudeValue(unsigned char index) {
     if (index < magnitude::count()) {
         const auto& magnitude = magnitude::get(index);
         out = magnitude::value(magnitude,
-            realTimeValues() ? magnitude.last : magnitude.reported);
+            realTimeValues()
+                ? magnitude::last(magnitude)
+                : magnitude::reported(magnitude));
     }
 
     return out;
@@ -257,6 +257,10 @@ String magnitudeUnits(espurna::sensor::Unit);
 unsigned char magnitudeType(unsigned char index);
 unsigned char magnitudeIndex(unsigned char index);
 
+// Reverse of the above, find magnitude index using it's type and type-specific index.
+// Will return `magnitudeCount()` when magnitude does not exist
+size_t magnitudeId(unsigned char type, unsigned char index);
+
 String magnitudeTopic(unsigned char index);
 String magnitudeUnits(unsigned char index);
 String magnitudeDescription(unsigned char index);
@@ -10,7 +10,125 @@
 
 #include "BaseEmonSensor.h"
 
-#include "../libs/fs_math.h"
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+
+namespace espurna {
+namespace sensor {
+namespace emon {
+
+// Integer square root, result is rounded down
+inline uint32_t isqrt(uint64_t value) {
+    uint64_t out { 0 };
+    uint64_t bit { static_cast<uint64_t>(1) << 62 };
+
+    while (bit > value) {
+        bit >>= 2;
+    }
+
+    while (bit) {
+        if (value >= out + bit) {
+            value -= out + bit;
+            out = (out >> 1) + bit;
+        } else {
+            out >>= 1;
+        }
+
+        bit >>= 2;
+    }
+
+    return static_cast<uint32_t>(out);
+}
+
+// RMS of the ADC samples, without using any floating point math.
+// DC offset (aka pivot) is tracked by a low-pass filter in fixed point,
+// and every offset-corrected sample is added to the sum and the sum of squares.
+// Since the state is preserved between calls, sampling can be split into multiple runs.
+class Accumulator {
+public:
+    static constexpr int Shift { 16 };
+    static constexpr int64_t FilterSpeed { EMON_FILTER_SPEED };
+
+    struct Result {
+        uint32_t samples;
+        uint32_t rms; // fixed point with 8 fractional bits
+        int32_t min;
+        int32_t max;
+    };
+
+    void pivot(uint32_t value) {
+        _offset = static_cast<int64_t>(value) << Shift;
+    }
+
+    uint32_t pivot() const {
+        return static_cast<uint32_t>(_offset >> Shift);
+    }
+
+    double pivot_fraction() const {
+        return static_cast<double>(_offset) / static_cast<double>(1 << Shift);
+    }
+
+    uint32_t samples() const {
+        return _samples;
+    }
+
+    void add(int32_t sample) {
+        _offset += ((static_cast<int64_t>(sample) << Shift) - _offset) / FilterSpeed;
+
+        const auto filtered = static_cast<int64_t>(sample) - (_offset >> Shift);
+        _sum += filtered;
+        _sum_squares += static_cast<uint64_t>(filtered * filtered);
+
+        _min = std::min(_min, sample);
+        _max = std::max(_max, sample);
+
+        ++_samples;
+    }
+
+    // Remaining DC component is removed from the mean of squares
+    // (var = E[x^2] - E[x]^2), both are calculated with 16 fractional bits
+    Result result() const {
+        Result out;
+        out.samples = _samples;
+        out.rms = 0;
+        out.min = _min;
+        out.max = _max;
+
+        if (_samples) {
+            const auto mean_squares = (_sum_squares << Shift) / _samples;
+            const auto mean = (_sum * (1 << (Shift / 2))) / static_cast<int64_t>(_samples);
+            const auto mean_squared = static_cast<uint64_t>(mean * mean);
+
+            if (mean_squares > mean_squared) {
+                out.rms = isqrt(mean_squares - mean_squared);
+            }
+        }
+
+        return out;
+    }
+
+    // Pivot is preserved for the next run
+    void reset() {
+        _sum = 0;
+        _sum_squares = 0;
+        _samples = 0;
+        _min = std::numeric_limits<int32_t>::max();
+        _max = std::numeric_limits<int32_t>::min();
+    }
+
+private:
+    int64_t _offset { 0 };
+    int64_t _sum { 0 };
+    uint64_t _sum_squares { 0 };
+    uint32_t _samples { 0 };
+    int32_t _min { std::numeric_limits<int32_t>::max() };
+    int32_t _max { std::numeric_limits<int32_t>::min() };
+};
+
+} // namespace emon
+} // namespace sensor
+} // namespace espurna
 
 class BaseAnalogEmonSensor : public BaseEmonSensor {
 public:
@@ -22,6 +140,11 @@ public:
     using TimeSource = espurna::time::CoreClock;
     static constexpr auto MaxTime = TimeSource::duration { EMON_MAX_TIME };
 
+    // Sampling time is measured in cpu cycles, since slices are expected to be shorter than 1ms
+    using SampleSource = espurna::time::CpuClock;
+    static constexpr auto SliceTime = std::chrono::duration_cast<SampleSource::duration>(
+        espurna::duration::Microseconds { EMON_SLICE_TIME });
+
     static constexpr double IRef { EMON_CURRENT_RATIO };
 
     // TODO: mask common magnitudes (...voltage), when there are multiple channels?
@@ -63,7 +186,6 @@ public:
     }
 
     void setSamplesMax(size_t samples) {
-        _samples = samples;
         _samples_max = samples;
         _dirty = true;
     }
@@ -72,6 +194,12 @@ public:
         _resolution = resolution;
         _adc_counts = 1 << _resolution;
         setPivot(_adc_counts >> 1);
+        _accumulator.pivot(_adc_counts >> 1);
+    }
+
+    // Effective rate of the last sampling window, only counting the time spent sampling
+    uint32_t sampleRate() const {
+        return _sample_rate;
     }
 
     // ---------------------------------------------------------------------
@@ -81,6 +209,9 @@ public:
     void begin() override {
         updateCurrent(0.0);
         setPivot(_adc_counts >> 1); // aka divide by 2
+        _accumulator.pivot(_adc_counts >> 1);
+        _accumulator.reset();
+        _sampling = SampleSource::duration::zero();
         calculateFactors();
 
         _ready = true;
@@ -98,6 +229,14 @@ public:
 #endif
     }
 
+    // When enabled, spread the sampling across multiple loop iterations.
+    // Window is full after reaching the sample limit, so the sampling stops until the next read
+    void tick() override {
+        if (_ready && (SliceTime.count() > 0)) {
+            sample(SliceTime);
+        }
+    }
+
     void pre() override {
         updateCurrent(sampleCurrent());
 
@@ -136,42 +275,47 @@ public:
         return 0.0;
     }
 
-    double sampleCurrent() {
-        int max = 0;
-        int min = _adc_counts;
-        double sum = 0;
+    // Take samples until either the time runs out or the window is full
+    void sample(SampleSource::duration budget) {
+        const auto start = SampleSource::now();
 
-        auto pivot = getPivot();
+        auto now = start;
+        while ((_accumulator.samples() < _samples_max) && (now - start < budget)) {
+            _accumulator.add(static_cast<int32_t>(this->analogRead()));
+            now = SampleSource::now();
+        }
 
-        const auto time_span = TimeSource::now();
-        for (size_t i = 0; i < _samples; i++) {
-            int sample;
-            double filtered;
+        _sampling += now - start;
+    }
 
-            sample = this->analogRead();
-            if (sample > max) max = sample;
-            if (sample < min) min = sample;
+    // Finish the current window, blocking until it is full or until MaxTime passes.
+    // (which would only happen when sampling was not done via tick() beforehand)
+    double sampleCurrent() {
+        if (_accumulator.samples() < _samples_max) {
+            sample(std::chrono::duration_cast<SampleSource::duration>(MaxTime));
+        }
 
-            // Digital low pass filter extracts the VDC offset
-            pivot = (pivot + (sample - pivot) / EMON_FILTER_SPEED);
-            filtered = sample - pivot;
+        const auto result = _accumulator.result();
 
-            // Root-mean-square method
-            sum += (filtered * filtered);
-        }
+        const auto sampling = std::chrono::duration_cast<espurna::duration::Microseconds>(_sampling);
+        _sample_rate = sampling.count()
+            ? static_cast<uint32_t>((static_cast<uint64_t>(result.samples) * 1000000) / sampling.count())
+            : 0;
 
-        const auto elapsed = TimeSource::now() - time_span;
+        _accumulator.reset();
+        _sampling = SampleSource::duration::zero();
 
         // Quick fix
-        if (pivot < min || max < pivot) {
-            pivot = (max + min) / 2.0;
+        auto pivot = _accumulator.pivot();
+        if (result.samples && ((static_cast<int32_t>(pivot) < result.min) || (result.max < static_cast<int32_t>(pivot)))) {
+            pivot = static_cast<uint32_t>(result.min + result.max) / 2;
+            _accumulator.pivot(pivot);
         }
 
-        setPivot(pivot);
+        setPivot(_accumulator.pivot_fraction());
 
-        // Calculate current
-        double rms = _samples > 0 ? fs_sqrt(sum / _samples) : 0;
-        double current = _current_factor * rms;
+        // Calculate current, rms is using 8 fractional bits
+        double current = (_current_factor * result.rms) / 256.0;
 
         current = (double) (int(current * _multiplier) - 1) / _multiplier;
         if (current < 0) {
@@ -179,22 +323,16 @@ public:
         }
 
 #if SENSOR_DEBUG
-        DEBUG_MSG_P(PSTR("[EMON] Total samples: %d\n"), _samples);
-        DEBUG_MSG_P(PSTR("[EMON] Total time (ms): %u\n"), elapsed.count());
-        DEBUG_MSG_P(PSTR("[EMON] Sample frequency (Hz): %d\n"), int(1000 * _samples / elapsed.count()));
-        DEBUG_MSG_P(PSTR("[EMON] Max value: %d\n"), max);
-        DEBUG_MSG_P(PSTR("[EMON] Min value: %d\n"), min);
+        DEBUG_MSG_P(PSTR("[EMON] Total samples: %u\n"), result.samples);
+        DEBUG_MSG_P(PSTR("[EMON] Total time (us): %u\n"), static_cast<uint32_t>(sampling.count()));
+        DEBUG_MSG_P(PSTR("[EMON] Sample frequency (Hz): %u\n"), _sample_rate);
+        DEBUG_MSG_P(PSTR("[EMON] Max value: %d\n"), result.max);
+        DEBUG_MSG_P(PSTR("[EMON] Min value: %d\n"), result.min);
         DEBUG_MSG_P(PSTR("[EMON] Midpoint value: %d\n"), int(getPivot()));
-        DEBUG_MSG_P(PSTR("[EMON] RMS value: %d\n"), int(rms));
+        DEBUG_MSG_P(PSTR("[EMON] RMS value: %u\n"), result.rms >> 8);
         DEBUG_MSG_P(PSTR("[EMON] Current (mA): %d\n"), int(1000 * current));
 #endif
 
-        if ((elapsed > MaxTime)
-            || ((elapsed < MaxTime) && (_samples < _samples_max)))
-        {
-            _samples = (_samples * MaxTime.count()) / elapsed.count();
-        }
-
         return current;
     }
 
@@ -220,8 +358,11 @@ private:
     double _current_factor { 1.0 };                 // Calculated, reads (RMS) to current
     unsigned int _multiplier { 1 };                 // Calculated, error
 
-    size_t _samples_max { EMON_MAX_SAMPLES };       // Number of samples, will be adjusted at runtime
-    size_t _samples { _samples_max };               // based on the maximum value
+    size_t _samples_max { EMON_MAX_SAMPLES };       // Number of samples in a single window
+
+    espurna::sensor::emon::Accumulator _accumulator;
+    SampleSource::duration _sampling { SampleSource::duration::zero() }; // Time spent sampling the current window
+    uint32_t _sample_rate { 0 };                    // Calculated, samples per second
 
     size_t _resolution { EMON_ANALOG_RESOLUTION };  // ADC resolution (in bits)
     size_t _adc_counts { static_cast<size_t>(1) << _resolution };       // Max count
@@ -11,6 +11,8 @@
 #include "BaseSensor.h"
 #include "BaseEmonSensor.h"
 
+#include "../libs/FrameParser.h"
+
 #include <SoftwareSerial.h>
 
 class CSE7766Sensor : public BaseEmonSensor {
@@ -21,10 +23,6 @@ class CSE7766Sensor : public BaseEmonSensor {
         // Public
         // ---------------------------------------------------------------------
 
-        using TimeSource = espurna::time::CoreClock;
-
-        static constexpr auto SyncInterval = espurna::duration::Milliseconds { CSE7766_SYNC_INTERVAL };
-
         static constexpr Magnitude Magnitudes[] {
             MAGNITUDE_CURRENT,
             MAGNITUDE_VOLTAGE,
@@ -119,17 +117,20 @@ class CSE7766Sensor : public BaseEmonSensor {
 
             if (3 == _pin_rx) {
                 Serial.begin(CSE7766_BAUDRATE);
+                _stream = &Serial;
             } else if (13 == _pin_rx) {
                 Serial.begin(CSE7766_BAUDRATE);
                 Serial.flush();
                 Serial.swap();
+                _stream = &Serial;
             } else {
                 _serial = std::make_unique<SoftwareSerial>(_pin_rx, -1, _inverted);
                 _serial->enableIntTx(false);
                 _serial->begin(CSE7766_BAUDRATE);
+                _stream = _serial.get();
             }
 
-            _last_index_reset = TimeSource::now();
+            _parser.reset();
 
             _ready = true;
             _dirty = false;
@@ -185,6 +186,11 @@ class CSE7766Sensor : public BaseEmonSensor {
         // Protected
         // ---------------------------------------------------------------------
 
+        // Packet is 24 bytes long. First byte is the state (0x55 when everything is ok,
+        // 0xAA when chip is not calibrated and 0xF? on errors), second byte is always 0x5A
+        static constexpr uint8_t HeaderBytes[] { 0x00, 0x5A };
+        static constexpr uint8_t HeaderMask[] { 0x00, 0xff };
+
         /**
          * "
          * Checksum is the sum of all data
@@ -192,35 +198,34 @@ class CSE7766Sensor : public BaseEmonSensor {
          * "
          * @return bool
          */
-        bool _checksum() const {
-            unsigned char checksum = 0;
-            for (unsigned char i = 2; i < 23; i++) {
-                checksum += _data[i];
-            }
-            return checksum == _data[23];
+        static bool _check(const uint8_t* data, size_t length) {
+            return ((0x55 == data[0]) || (0xAA == data[0]) || (data[0] >= 0xF0))
+                && espurna::frame::checksum::sum8<2, 23>(data, length);
         }
 
-        void _process() {
+        static constexpr espurna::frame::Spec FrameSpec {
+            .header = {
+                .bytes = HeaderBytes,
+                .mask = HeaderMask,
+                .size = std::size(HeaderBytes),
+            },
+            .length = 24,
+            .frame_length = nullptr,
+            .check = _check,
+        };
+
+        void _process(const uint8_t* data) {
 
             // Sample data:
             // 55 5A 02 E9 50 00 03 31 00 3E 9E 00 0D 30 4F 44 F8 00 12 65 F1 81 76 72 (w/ load)
             // F2 5A 02 E9 50 00 03 2B 00 3E 9E 02 D7 7C 4F 44 F8 CF A5 5D E1 B3 2A B4 (w/o load)
 
 #if SENSOR_DEBUG
-            DEBUG_MSG_P(PSTR("[SENSOR] CSE7766: _process: %s\n"), hexEncode(_data).c_str());
-#endif
-
-            // Checksum
-            if (!_checksum()) {
-                _error = SENSOR_ERROR_CRC;
-#if SENSOR_DEBUG
-                DEBUG_MSG_P(PSTR("[SENSOR] CSE7766: Checksum error\n"));
+            DEBUG_MSG_P(PSTR("[SENSOR] CSE7766: _process: %s\n"), hexEncode(data, data + FrameSpec.length).c_str());
 #endif
-                return;
-            }
 
             // Calibration
-            if (0xAA == _data[0]) {
+            if (0xAA == data[0]) {
                 _error = SENSOR_ERROR_CALIBRATION;
 #if SENSOR_DEBUG
                 DEBUG_MSG_P(PSTR("[SENSOR] CSE7766: Chip not calibrated\n"));
@@ -228,37 +233,37 @@ class CSE7766Sensor : public BaseEmonSensor {
                 return;
             }
 
-            if ((_data[0] & 0xFC) > 0xF0) {
+            if ((data[0] & 0xFC) > 0xF0) {
                 _error = SENSOR_ERROR_OTHER;
 #if SENSOR_DEBUG
-                if (0xF1 == (_data[0] & 0xF1)) DEBUG_MSG_P(PSTR("[SENSOR] CSE7766: Abnormal coefficient storage area\n"));
-                if (0xF2 == (_data[0] & 0xF2)) DEBUG_MSG_P(PSTR("[SENSOR] CSE7766: Power cycle exceeded range\n"));
-                if (0xF4 == (_data[0] & 0xF4)) DEBUG_MSG_P(PSTR("[SENSOR] CSE7766: Current cycle exceeded range\n"));
-                if (0xF8 == (_data[0] & 0xF8)) DEBUG_MSG_P(PSTR("[SENSOR] CSE7766: Voltage cycle exceeded range\n"));
+                if (0xF1 == (data[0] & 0xF1)) DEBUG_MSG_P(PSTR("[SENSOR] CSE7766: Abnormal coefficient storage area\n"));
+                if (0xF2 == (data[0] & 0xF2)) DEBUG_MSG_P(PSTR("[SENSOR] CSE7766: Power cycle exceeded range\n"));
+                if (0xF4 == (data[0] & 0xF4)) DEBUG_MSG_P(PSTR("[SENSOR] CSE7766: Current cycle exceeded range\n"));
+                if (0xF8 == (data[0] & 0xF8)) DEBUG_MSG_P(PSTR("[SENSOR] CSE7766: Voltage cycle exceeded range\n"));
 #endif
                 return;
             }
 
             // Calibration coefficients
-            unsigned long _coefV = (_data[2]  << 16 | _data[3]  << 8 | _data[4] );              // 190770
-            unsigned long _coefC = (_data[8]  << 16 | _data[9]  << 8 | _data[10]);              // 16030
-            unsigned long _coefP = (_data[14] << 16 | _data[15] << 8 | _data[16]);              // 5195000
+            unsigned long _coefV = (data[2]  << 16 | data[3]  << 8 | data[4] );              // 190770
+            unsigned long _coefC = (data[8]  << 16 | data[9]  << 8 | data[10]);              // 16030
+            unsigned long _coefP = (data[14] << 16 | data[15] << 8 | data[16]);              // 5195000
 
             // Adj: this looks like a sampling report
-            uint8_t adj = _data[20];                                                            // F1 11110001
+            uint8_t adj = data[20];                                                            // F1 11110001
 
             // Calculate voltage
             _voltage = 0;
             if ((adj & 0x40) == 0x40) {
-                unsigned long voltage_cycle = _data[5] << 16 | _data[6] << 8 | _data[7];        // 817
+                unsigned long voltage_cycle = data[5] << 16 | data[6] << 8 | data[7];        // 817
                 _voltage = _voltage_ratio * _coefV / voltage_cycle / CSE7766_V2R;                      // 190700 / 817 = 233.41
             }
 
             // Calculate power
             _active = 0;
             if ((adj & 0x10) == 0x10) {
-                if ((_data[0] & 0xF2) != 0xF2) {
-                    unsigned long power_cycle = _data[17] << 16 | _data[18] << 8 | _data[19];   // 4709
+                if ((data[0] & 0xF2) != 0xF2) {
+                    unsigned long power_cycle = data[17] << 16 | data[18] << 8 | data[19];   // 4709
                     _active = _power_active_ratio * _coefP / power_cycle / CSE7766_V1R / CSE7766_V2R;       // 5195000 / 4709 = 1103.20
                 }
             }
@@ -267,7 +272,7 @@ class CSE7766Sensor : public BaseEmonSensor {
             _current = 0;
             if ((adj & 0x20) == 0x20) {
                 if (_active > 0) {
-                    unsigned long current_cycle = _data[11] << 16 | _data[12] << 8 | _data[13]; // 3376
+                    unsigned long current_cycle = data[11] << 16 | data[12] << 8 | data[13]; // 3376
                     _current = _current_ratio * _coefC / current_cycle / CSE7766_V1R;                  // 16030 / 3376 = 4.75
                 }
             }
@@ -283,7 +288,7 @@ class CSE7766Sensor : public BaseEmonSensor {
             }
 
             // Calculate energy
-            uint32_t cf_pulses = _data[21] << 8 | _data[22];
+            uint32_t cf_pulses = data[21] << 8 | data[22];
 
             static uint32_t cf_pulses_last = 0;
             if (0 == cf_pulses_last) cf_pulses_last = cf_pulses;
@@ -305,44 +310,20 @@ class CSE7766Sensor : public BaseEmonSensor {
 
             _error = SENSOR_ERROR_OK;
 
-            while (_serial_available()) {
-
-                // A 24 bytes message takes ~55ms to go through at 4800 bps
-                // Reset counter if more than 1000ms have passed since last byte.
-                if (TimeSource::now() - _last_index_reset > SyncInterval) {
-                    _data_index = 0;
-                }
-
-                _last_index_reset = TimeSource::now();
-
-                uint8_t byte = _serial_read();
-
-                // first byte must be 0x55 or 0xF?
-                if (0 == _data_index) {
-                    if ((0x55 != byte) && (byte < 0xF0)) {
-                        continue;
-                    }
-
-                // second byte must be 0x5A
-                } else if (1 == _data_index) {
-                    if (0x5A != byte) {
-                        _data_index = 0;
-                        continue;
-                    }
-                }
-
-                _data[_data_index++] = byte;
-                if (_data_index > 23) {
-                    _serial_flush();
-                    break;
-                }
+            // A 24 bytes message takes ~55ms to go through at 4800 bps.
+            // Parser keeps the partial frame around until the next tick(),
+            // and resyncs by itself when something gets corrupted
+            const auto errors = _parser.stats().errors;
+            const auto frames = _parser.read(*_stream,
+                [&](const uint8_t* data, size_t) {
+                    _process(data);
+                });
 
-            }
-
-            // Process packet
-            if (24 == _data_index) {
-                _process();
-                _data_index = 0;
+            if (!frames && (errors != _parser.stats().errors)) {
+                _error = SENSOR_ERROR_CRC;
+#if SENSOR_DEBUG
+                DEBUG_MSG_P(PSTR("[SENSOR] CSE7766: Checksum error\n"));
+#endif
             }
 
         }
@@ -353,49 +334,27 @@ class CSE7766Sensor : public BaseEmonSensor {
             return (3 == _pin_rx) || (13 == _pin_rx);
         }
 
-        bool _serial_available() const {
-            if (_serial_is_hardware()) {
-                return Serial.available();
-            } else {
-                return _serial->available();
-            }
-        }
-
-        void _serial_flush() {
-            if (_serial_is_hardware()) {
-                return Serial.flush();
-            } else {
-                return _serial->flush();
-            }
-        }
-
-        uint8_t _serial_read() const {
-            if (_serial_is_hardware()) {
-                return Serial.read();
-            } else {
-                return _serial->read();
-            }
-        }
-
         // ---------------------------------------------------------------------
 
         unsigned char _pin_rx = CSE7766_RX_PIN;
         bool _inverted = CSE7766_PIN_INVERSE;
         std::unique_ptr<SoftwareSerial> _serial;
+        Stream* _stream { nullptr };
+
+        espurna::frame::Parser<64, 24> _parser { FrameSpec };
 
         double _active = 0;
         double _reactive = 0;
         double _voltage = 0;
         double _current = 0;
 
-        TimeSource::time_point _last_index_reset;
-        unsigned char _data[24] {0};
-        size_t _data_index = 0;
-
 };
 
 #if __cplusplus < 201703L
 constexpr BaseSensor::Magnitude CSE7766Sensor::Magnitudes[];
+constexpr uint8_t CSE7766Sensor::HeaderBytes[];
+constexpr uint8_t CSE7766Sensor::HeaderMask[];
+constexpr espurna::frame::Spec CSE7766Sensor::FrameSpec;
 #endif
 
 #endif // SENSOR_SUPPORT && CSE7766_SUPPORT
@@ -266,6 +266,11 @@ public:
         return String(buffer);
     }
 
+    // Port is shared between the channels and switching them blocks for ~10ms,
+    // so the whole window is still sampled at once when the value is read
+    void tick() override {
+    }
+
     unsigned int analogRead() override {
         return _port->read(_channel);
     }
@@ -9,12 +9,18 @@
 
 #include "BaseSensor.h"
 
+#include "../libs/EdgeRing.h"
+
 class EventSensor : public BaseSensor {
 
     public:
 
         static constexpr size_t SensorsMax = 8;
         using TimeSource = espurna::time::CpuClock;
+        using ReadTimeSource = espurna::time::CoreClock;
+
+        // Cycle counter wraps around, intervals between events are allowed to be longer than that
+        using Cycles = std::chrono::duration<uint64_t, TimeSource::period>;
 
         static constexpr unsigned char defaultPin(unsigned char index) {
             return (index == 0) ? EVENTS1_PIN :
@@ -137,9 +143,49 @@ class EventSensor : public BaseSensor {
             return MAGNITUDE_NONE;
         }
 
+#if EVENTS_EDGE_RING_SIZE
+        // Debounce and count the edges queued by the ISR. Time since the last event
+        // is also tracked here, since the ISR timestamps alone can't tell how many
+        // times the cycle counter wrapped around between them
+        void tick() override {
+            _edges.drain([&](uint32_t timestamp) {
+                const auto now = ReadTimeSource::now();
+                const auto elapsed = std::chrono::duration_cast<Cycles>(now - _last_event);
+                if (_debounce.accept(timestamp, elapsed.count())) {
+                    ++_counter;
+                    _interval = Cycles(_debounce.interval());
+                    _last_event = now;
+                }
+            });
+
+#if SENSOR_DEBUG
+            const auto overflows = _edges.overflows();
+            if (overflows != _overflows) {
+                DEBUG_MSG_P(PSTR("[SENSOR] EVENTS @ GPIO%hhu: %u edge(s) lost\n"),
+                    _pin.pin(), overflows - _overflows);
+                _overflows = overflows;
+            }
+#endif
+        }
+
+        // Time between the last two accepted events
+        Cycles interval() const {
+            return _interval;
+        }
+
+        // Number of edges that did not fit into the queue since boot
+        uint32_t overflows() const {
+            return _edges.overflows();
+        }
+#endif
+
         void pre() override {
             _last = _current;
+#if EVENTS_EDGE_RING_SIZE
             _current = _counter;
+#else
+            _current = *(reinterpret_cast<volatile unsigned long*>(&_counter));
+#endif
             _difference = _current - _last;
         }
 
@@ -165,6 +211,12 @@ class EventSensor : public BaseSensor {
             ++(instance->_counter);
         }
 
+#if EVENTS_EDGE_RING_SIZE
+        static void IRAM_ATTR handleEdgeInterrupt(EventSensor* instance) {
+            instance->_edges.push(TimeSource::now().time_since_epoch().count());
+        }
+#endif
+
     protected:
 
         // ---------------------------------------------------------------------
@@ -190,12 +242,18 @@ class EventSensor : public BaseSensor {
         }
 
         void _enableInterrupts() {
+#if EVENTS_EDGE_RING_SIZE
+            _debounce = espurna::edge::Debounce(_interrupt_debounce.count());
+            _edges.clear();
+            _pin.attach(this, handleEdgeInterrupt, _interrupt_mode);
+#else
             if (_interrupt_debounce.count()) {
                 _interrupt_last = TimeSource::now();
                 _pin.attach(this, handleDebouncedInterrupt, _interrupt_mode);
             } else {
                 _pin.attach(this, handleInterrupt, _interrupt_mode);
             }
+#endif
         }
 
         // ---------------------------------------------------------------------
@@ -211,6 +269,16 @@ class EventSensor : public BaseSensor {
         TimeSource::duration _interrupt_debounce;
         TimeSource::time_point _interrupt_last;
 
+#if EVENTS_EDGE_RING_SIZE
+        espurna::edge::Ring<EVENTS_EDGE_RING_SIZE> _edges;
+        espurna::edge::Debounce _debounce;
+        Cycles _interval{};
+        ReadTimeSource::time_point _last_event;
+#if SENSOR_DEBUG
+        uint32_t _overflows { 0 };
+#endif
+#endif
+
         InterruptablePin _pin{};
         uint8_t _pin_mode { INPUT };
         int _interrupt_mode { RISING };
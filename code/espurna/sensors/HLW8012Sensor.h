@@ -9,6 +9,8 @@
 
 #include "BaseEmonSensor.h"
 
+#include "../libs/EdgeRing.h"
+
 #include <HLW8012.h>
 
 // ref. HLW8012/src/HLW8012.h
@@ -315,8 +317,42 @@ class HLW8012Sensor : public BaseEmonSensor {
             _power_apparent = _hlw8012.getApparentPower();
 
             _power_factor = _hlw8012.getPowerFactor() * 100.0;
+
+#if HLW8012_EDGE_RING_SIZE && SENSOR_DEBUG
+            DEBUG_MSG_P(PSTR("[SENSOR] HLW8012: CF edges %u, last interval %u (cycles), lost %u\n"),
+                _cf_edges, _cf_interval, _cf_ring.overflows());
+#endif
+#if HLW8012_EDGE_RING_SIZE
+            _cf_edges = 0;
+#endif
+        }
+
+#if HLW8012_EDGE_RING_SIZE
+        // Pulse width is still measured by the library, ring only provides the
+        // timing of CF edges to the loop. Drain it often enough to avoid overflows
+        void tick() override {
+            _cf_ring.drain([&](uint32_t timestamp) {
+                if (_cf_started) {
+                    _cf_interval = timestamp - _cf_last;
+                }
+
+                _cf_last = timestamp;
+                _cf_started = true;
+                ++_cf_edges;
+            });
         }
 
+        // Time between the last two CF edges, in CPU cycles
+        uint32_t cfInterval() const {
+            return _cf_interval;
+        }
+
+        // Number of edges that did not fit into the queue since boot
+        uint32_t overflows() const {
+            return _cf_ring.overflows();
+        }
+#endif
+
         // Special handling for no-interrupts mode, make sure to switch between cf and cf1
         void post() override {
             if (!_hlw8012_use_interrupts()) {
@@ -326,6 +362,9 @@ class HLW8012Sensor : public BaseEmonSensor {
 
         // Handle interrupt calls
         static void IRAM_ATTR handleCf(HLW8012Sensor* instance) {
+#if HLW8012_EDGE_RING_SIZE
+            instance->_cf_ring.push(espurna::time::CpuClock::now().time_since_epoch().count());
+#endif
             instance->_hlw8012.cf_interrupt();
         }
 
@@ -381,6 +420,14 @@ class HLW8012Sensor : public BaseEmonSensor {
         InterruptablePin _cf1{};
 
         HLW8012 _hlw8012{};
+
+#if HLW8012_EDGE_RING_SIZE
+        espurna::edge::Ring<HLW8012_EDGE_RING_SIZE> _cf_ring;
+        uint32_t _cf_last { 0 };
+        uint32_t _cf_interval { 0 };
+        uint32_t _cf_edges { 0 };
+        bool _cf_started { false };
+#endif
 };
 
 #if __cplusplus < 201703L
@@ -12,6 +12,7 @@
 #include <SoftwareSerial.h>
 
 #include "BaseSensor.h"
+#include "../libs/FrameParser.h"
 
 class PM1006Sensor : public BaseSensor {
 
@@ -50,16 +51,21 @@ class PM1006Sensor : public BaseSensor {
 
             if (3 == _pin_rx) {
                 Serial.begin(PM1006_BAUDRATE);
+                _stream = &Serial;
             } else if (13 == _pin_rx) {
                 Serial.begin(PM1006_BAUDRATE);
                 Serial.flush();
                 Serial.swap();
+                _stream = &Serial;
             } else {
                 _serial = std::make_unique<SoftwareSerial>(_pin_rx, -1, false);
                 _serial->enableIntTx(false);
                 _serial->begin(PM1006_BAUDRATE);
+                _stream = _serial.get();
             }
 
+            _parser.reset();
+
             _ready = true;
             _dirty = false;
 
@@ -111,90 +117,62 @@ class PM1006Sensor : public BaseSensor {
             return (3 == _pin_rx) || (13 == _pin_rx);
         }
 
-        bool _serial_available() const {
-            if (_serial_is_hardware()) {
-                return Serial.available();
-            } else {
-                return _serial->available();
-            }
-        }
-
-        void _serial_flush() {
-            if (_serial_is_hardware()) {
-                return Serial.flush();
-            } else {
-                return _serial->flush();
-            }
-        }
-
-        uint8_t _serial_read() {
-            if (_serial_is_hardware()) {
-                return Serial.read();
-            } else {
-                return _serial->read();
-            }
-        }
-
-        // ---------------------------------------------------------------------
-
-        void _parse() {
-#if SENSOR_DEBUG
-            DEBUG_MSG_P(PSTR("[SENSOR] PM1006: %s\n"), hexEncode(_buffer).c_str());
-#endif
+        // 16 11 0B DF1 DF2 DF3 DF4 ... DF16 CS, where every byte adds up to zero
+        static constexpr uint8_t HeaderBytes[] { 0x16, 0x11, 0x0B };
 
-            // check second header byte
-            if ((_buffer[1] != 0x11) || (_buffer[2] != 0x0B)) {
-#if SENSOR_DEBUG
-                DEBUG_MSG_P(PSTR("[SENSOR] PM1006: Wrong header\n"));
-#endif
-                return;
-            }
+        static constexpr espurna::frame::Spec FrameSpec {
+            .header = {
+                .bytes = HeaderBytes,
+                .mask = nullptr,
+                .size = std::size(HeaderBytes),
+            },
+            .length = 20,
+            .frame_length = nullptr,
+            .check = espurna::frame::checksum::sum8_zero,
+        };
 
-            // check crc
-            uint8_t crc = 0;
-            for (unsigned char i=0; i<20; i++) crc += _buffer[i];
-            if (crc != 0) {
+        void _parse(const uint8_t* data) {
 #if SENSOR_DEBUG
-                DEBUG_MSG_P(PSTR("[SENSOR] PM1006: Wrong CRC\n"));
+            DEBUG_MSG_P(PSTR("[SENSOR] PM1006: %s\n"),
+                hexEncode(data, data + FrameSpec.length).c_str());
 #endif
-                return;
-            }
 
             // PM 2.5
-            _pm25 = 256 * _buffer[5] + _buffer[6];
+            _pm25 = 256 * data[5] + data[6];
 
         }
 
         void _read() {
+#if SENSOR_DEBUG
+            const auto errors = _parser.stats().errors;
+#endif
+            _parser.read(*_stream,
+                [&](const uint8_t* data, size_t) {
+                    _parse(data);
+                });
 
-            while(_serial_available()) {
-                
-                unsigned char ch = _serial_read();
-                if ((_position > 0) || (ch == 0x16)) {
-                    _buffer[_position] = ch;
-                    _position++;
-                    if (_position == 20) {
-                        _position = 0;
-                        _parse();
-                        memset(_buffer, 0, sizeof(_buffer));
-                    }
-                }
-                yield();
-        
+#if SENSOR_DEBUG
+            if (errors != _parser.stats().errors) {
+                DEBUG_MSG_P(PSTR("[SENSOR] PM1006: Wrong CRC\n"));
             }
-
+#endif
         }
 
         // ---------------------------------------------------------------------
 
-        unsigned char _buffer[20] = {0};
-        unsigned char _position = 0;
-        
         double _pm25 = 0;
 
         unsigned char _pin_rx = PM1006_RX_PIN;
         std::unique_ptr<SoftwareSerial> _serial;
+        Stream* _stream { nullptr };
+
+        espurna::frame::Parser<32, 20> _parser { FrameSpec };
 
 };
 
+#if __cplusplus < 201703L
+constexpr uint8_t PM1006Sensor::HeaderBytes[];
+constexpr espurna::frame::Spec PM1006Sensor::FrameSpec;
+#endif
+
 #endif // SENSOR_SUPPORT && PM1006_SUPPORT
@@ -10,6 +10,7 @@
 #pragma once
 
 #include "BaseSensor.h"
+#include "../libs/FrameParser.h"
 
 #include <SoftwareSerial.h>
 
@@ -28,11 +29,11 @@
 #define PMS_DATA_MAX        17
 
 // [MAGIC][LEN][DATA9|13|17][SUM]
-inline int PMS_PACKET_SIZE(int size) {
+constexpr int PMS_PACKET_SIZE(int size) {
     return (size + 3) * 2;
 }
 
-inline int PMS_PAYLOAD_SIZE(int size) {
+constexpr int PMS_PAYLOAD_SIZE(int size) {
     return (size + 1) * 2;
 }
 
@@ -76,71 +77,63 @@ class PMSX003 {
             _serial->write(command, sizeof(command));
         }
 
-        // Read sensor's data
+        // Read sensor's data. Command responses share the same framing, so
+        // only the packet of the expected size is used
         bool readData(uint16_t* data, size_t data_count) {
+            bool out { false };
 
-            do {
-
-                int avail = _serial->available();
-#if SENSOR_DEBUG
-                DEBUG_MSG_P(PSTR("[SENSOR] PMS: Packet available = %d\n"), avail);
-#endif
-                if (avail < PMS_PACKET_SIZE(data_count)) {
-                    break;
-                }
-
-                if (_serial->read() == 0x42 && _serial->read() == 0x4D) {
-
-                    uint16_t sum = 0x42 + 0x4D;
-                    uint16_t size = read16(sum);
-                    if (size != PMS_PAYLOAD_SIZE(data_count)) {
+            _parser.read(*_serial,
+                [&](const uint8_t* frame, size_t length) {
+                    const size_t expected = PMS_PACKET_SIZE(data_count);
+                    if (length != expected) {
 #if SENSOR_DEBUG
-                        DEBUG_MSG_P(PSTR("[SENSOR] PMS: Payload size: %hu != %zu.\n"),
-                                size, PMS_PAYLOAD_SIZE(data_count));
+                        DEBUG_MSG_P(PSTR("[SENSOR] PMS: Packet size: %zu != %zu.\n"),
+                                length, expected);
 #endif
-                        break;
+                        return;
                     }
 
                     for (size_t i = 0; i < data_count; i++) {
-                        data[i] = read16(sum);
+                        data[i] = (frame[4 + (i * 2)] << 8) | frame[5 + (i * 2)];
 #if SENSOR_DEBUG
                         DEBUG_MSG_P(PSTR("[SENSOR] PMS:   data[%zu] = %hu\n"), i, data[i]);
 #endif
                     }
 
-                    uint16_t checksum = read16();
-                    if (sum == checksum) {
-                        return true;
-                    } else {
+                    out = true;
+                });
+
 #if SENSOR_DEBUG
-                        DEBUG_MSG_P(PSTR("[SENSOR] PMS checksum: %04X != %04X\n"), sum, checksum);
+            const auto& stats = _parser.stats();
+            DEBUG_MSG_P(PSTR("[SENSOR] PMS: Frames = %u, errors = %u, dropped = %u\n"),
+                stats.frames, stats.errors, stats.dropped);
 #endif
-                    }
-                    break;
-                }
-
-            } while (true);
 
-            return false;
+            return out;
 
         }
 
     private:
 
-        // Read 16-bit
-        uint16_t read16() {
-            return ((uint16_t) _serial->read()) << 8 | _serial->read();
-        }
+        static constexpr uint8_t HeaderBytes[] { 0x42, 0x4D };
 
-        // Read 16-bit and calculate checksum
-        uint16_t read16(uint16_t &checksum) {
-            uint8_t high = _serial->read();
-            uint8_t low = _serial->read();
-            checksum += high;
-            checksum += low;
-            return ((uint16_t) high) << 8 | low;
+        static size_t _frameLength(const uint8_t* frame) {
+            return ((frame[2] << 8) | frame[3]) + 4;
         }
 
+        static constexpr espurna::frame::Spec FrameSpec {
+            .header = {
+                .bytes = HeaderBytes,
+                .mask = nullptr,
+                .size = std::size(HeaderBytes),
+            },
+            .length = 4,
+            .frame_length = _frameLength,
+            .check = espurna::frame::checksum::sum16_be,
+        };
+
+        espurna::frame::Parser<64, PMS_PACKET_SIZE(PMS_DATA_MAX)> _parser { FrameSpec };
+
 };
 
 class PMSX003Sensor : public BaseSensor, PMSX003 {
@@ -407,6 +400,8 @@ class PMSX003Sensor : public BaseSensor, PMSX003 {
 };
 
 #if __cplusplus < 201703L
+constexpr uint8_t PMSX003::HeaderBytes[];
+constexpr espurna::frame::Spec PMSX003::FrameSpec;
 constexpr PMSX003Sensor::Spec PMSX003Sensor::Specs[];
 #endif
 
@@ -10,11 +10,17 @@
 #include "BaseSensor.h"
 #include "BaseEmonSensor.h"
 
+#include "../libs/EdgeRing.h"
+
 class PulseMeterSensor : public BaseEmonSensor {
 
     public:
 
         using TimeSource = espurna::time::CpuClock;
+        using ReadTimeSource = espurna::time::CoreClock;
+
+        // Cycle counter wraps around, intervals between pulses are allowed to be longer than that
+        using Cycles = std::chrono::duration<uint64_t, TimeSource::period>;
 
         // ---------------------------------------------------------------------
         // Public
@@ -73,7 +79,7 @@ class PulseMeterSensor : public BaseEmonSensor {
 
         // Initialization method, must be idempotent
         void begin() override {
-            _previous_time = TimeSource::now();
+            _previous_time = ReadTimeSource::now();
             _enableInterrupts();
             _ready = true;
         }
@@ -91,25 +97,77 @@ class PulseMeterSensor : public BaseEmonSensor {
             return String(_pin);
         }
 
+#if PULSEMETER_EDGE_RING_SIZE
+        // Debounce and count the edges queued by the ISR. Time since the last pulse
+        // is also tracked here, since the ISR timestamps alone can't tell how many
+        // times the cycle counter wrapped around between them
+        void tick() override {
+            _edges.drain([&](uint32_t timestamp) {
+                const auto now = ReadTimeSource::now();
+                const auto elapsed = std::chrono::duration_cast<Cycles>(now - _last_pulse);
+                if (_debounce.accept(timestamp, elapsed.count())) {
+                    ++_pulses;
+                    _interval = Cycles(_debounce.interval());
+                    _last_pulse = now;
+                }
+            });
+
+#if SENSOR_DEBUG
+            const auto overflows = _edges.overflows();
+            if (overflows != _overflows) {
+                DEBUG_MSG_P(PSTR("[SENSOR] PulseMeter: %u edge(s) lost\n"), overflows - _overflows);
+                _overflows = overflows;
+            }
+#endif
+        }
+
+        // Number of edges that did not fit into the queue since boot
+        uint32_t overflows() const {
+            return _edges.overflows();
+        }
+#endif
+
         // Pre-read hook (usually to populate registers with up-to-date data)
         void pre() override {
-            const auto now = TimeSource::now();
+            const auto now = ReadTimeSource::now();
+            const auto elapsed = now - _previous_time;
             _previous_time = now;
 
+#if PULSEMETER_EDGE_RING_SIZE
+            const auto reading = _pulses;
+#else
             const auto reading = *(reinterpret_cast<volatile unsigned long*>(&_pulses));
+#endif
             unsigned long pulses = reading - _previous_pulses;
             _previous_pulses = reading;
 
             using namespace espurna::sensor;
-            const auto delta = WattSeconds(
-                static_cast<double>(KilowattHours::Ratio::num)
-                    * static_cast<double>(pulses) / _energy_ratio);
+            const auto pulse_energy = static_cast<double>(KilowattHours::Ratio::num) / _energy_ratio;
+            const auto delta = WattSeconds(pulse_energy * static_cast<double>(pulses));
             _energy[0] += delta;
 
-            const auto elapsed = std::chrono::duration_cast<espurna::duration::Seconds>(now - _previous_time);
-            if (elapsed.count()) {
-                _active = delta.value / elapsed.count();
+            using Seconds = std::chrono::duration<double>;
+
+#if PULSEMETER_EDGE_RING_SIZE
+            // Instantaneous power is based on the time between the last two pulses. Without
+            // any new pulses, it can't be more than a single pulse since the last one
+            if (pulses) {
+                const auto interval = std::chrono::duration_cast<Seconds>(_interval);
+                if (interval.count() > 0.0) {
+                    _active = pulse_energy / interval.count();
+                }
+            } else {
+                const auto since = std::chrono::duration_cast<Seconds>(now - _last_pulse);
+                if (since.count() > 0.0) {
+                    _active = std::min(_active, pulse_energy / since.count());
+                }
+            }
+#else
+            const auto seconds = std::chrono::duration_cast<Seconds>(elapsed);
+            if (seconds.count() > 0.0) {
+                _active = static_cast<double>(delta.value) / seconds.count();
             }
+#endif
         }
 
         double defaultRatio(unsigned char index) const override {
@@ -153,10 +211,14 @@ class PulseMeterSensor : public BaseEmonSensor {
         // Handle interrupt calls
         void IRAM_ATTR interrupt() {
             const auto now = TimeSource::now();
+#if PULSEMETER_EDGE_RING_SIZE
+            _edges.push(now.time_since_epoch().count());
+#else
             if (now - _interrupt_last > _interrupt_debounce) {
                 _interrupt_last = now;
                 ++_pulses;
             }
+#endif
         }
 
         static void IRAM_ATTR handleInterrupt(PulseMeterSensor* instance) {
@@ -170,6 +232,10 @@ class PulseMeterSensor : public BaseEmonSensor {
         // ---------------------------------------------------------------------
 
         void _enableInterrupts() {
+#if PULSEMETER_EDGE_RING_SIZE
+            _debounce = espurna::edge::Debounce(_interrupt_debounce.count());
+            _edges.clear();
+#endif
             _interrupt_last = TimeSource::now();
             _pin.attach(this, handleInterrupt, _interrupt_mode);
         }
@@ -188,7 +254,19 @@ class PulseMeterSensor : public BaseEmonSensor {
         TimeSource::time_point _interrupt_last;
         TimeSource::duration _interrupt_debounce;
 
-        TimeSource::time_point _previous_time;
+        ReadTimeSource::time_point _previous_time;
+
+#if PULSEMETER_EDGE_RING_SIZE
+        espurna::edge::Ring<PULSEMETER_EDGE_RING_SIZE> _edges;
+        espurna::edge::Debounce _debounce;
+
+        Cycles _interval{};
+        ReadTimeSource::time_point _last_pulse;
+
+#if SENSOR_DEBUG
+        uint32_t _overflows { 0 };
+#endif
+#endif
 
         InterruptablePin _pin;
         int _interrupt_mode = FALLING;
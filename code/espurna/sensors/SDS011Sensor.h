@@ -13,7 +13,7 @@
 #include <SoftwareSerial.h>
 
 #include "BaseSensor.h"
-
+#include "../libs/FrameParser.h"
 
 class SDS011Sensor : public BaseSensor {
 
@@ -64,6 +64,7 @@ class SDS011Sensor : public BaseSensor {
 
             _serial = std::make_unique<SoftwareSerial>(_pin_rx, _pin_tx);
             _serial->begin(9600);
+            _parser.reset();
 
             _ready = true;
             _dirty = false;
@@ -111,47 +112,38 @@ class SDS011Sensor : public BaseSensor {
         // Protected
         // ---------------------------------------------------------------------
 
+        // AA C0 PM25_LO PM25_HI PM10_LO PM10_HI ID_LO ID_HI CHECKSUM AB
+        static constexpr uint8_t HeaderBytes[] { 0xAA, 0xC0 };
+
+        static bool _check(const uint8_t* data, size_t length) {
+            return (0xAB == data[length - 1])
+                && espurna::frame::checksum::sum8<2, 8>(data, length);
+        }
+
+        static constexpr espurna::frame::Spec FrameSpec {
+            .header = {
+                .bytes = HeaderBytes,
+                .mask = nullptr,
+                .size = std::size(HeaderBytes),
+            },
+            .length = 10,
+            .frame_length = nullptr,
+            .check = _check,
+        };
+
         void _read() {
-            byte buffer;
-            int value;
-            int len = 0;
-            int pm10_serial = 0;
-            int pm25_serial = 0;
-            int checksum_is = 0;
-            int checksum_ok = 0;
-
-            while ((_serial->available() > 0) && (_serial->available() >= (10-len))) {
-                buffer = _serial->read();
-                value = int(buffer);
-                switch (len) {
-                    case (0): if (value != 170) { len = -1; }; break;
-                    case (1): if (value != 192) { len = -1; }; break;
-                    case (2): pm25_serial = value; checksum_is = value; break;
-                    case (3): pm25_serial += (value << 8); checksum_is += value; break;
-                    case (4): pm10_serial = value; checksum_is += value; break;
-                    case (5): pm10_serial += (value << 8); checksum_is += value; break;
-                    case (6): checksum_is += value; break;
-                    case (7): checksum_is += value; break;
-                    case (8): if (value == (checksum_is % 256)) { checksum_ok = 1; } else { len = -1; }; break;
-                    case (9): if (value != 171) { len = -1; }; break;
-                }
-
-                len++;
-
-                if (len == 10) {
-                    if(checksum_ok == 1) {
-                        _p10 = (float)pm10_serial/10.0;
-                        _p2dot5 = (float)pm25_serial/10.0;
-                        len = 0; checksum_ok = 0; pm10_serial = 0.0; pm25_serial = 0.0; checksum_is = 0;
-                        _error = SENSOR_ERROR_OK;
-                    } else {
-                        _error = SENSOR_ERROR_CRC;
-                    }
-                }
-
-                yield();
+            const auto errors = _parser.stats().errors;
+            const auto frames = _parser.read(*_serial,
+                [&](const uint8_t* data, size_t) {
+                    _p2dot5 = static_cast<double>((data[3] << 8) | data[2]) / 10.0;
+                    _p10 = static_cast<double>((data[5] << 8) | data[4]) / 10.0;
+                });
+
+            if (frames) {
+                _error = SENSOR_ERROR_OK;
+            } else if (errors != _parser.stats().errors) {
+                _error = SENSOR_ERROR_CRC;
             }
-
         }
 
         double _p2dot5 = 0;
@@ -160,6 +152,13 @@ class SDS011Sensor : public BaseSensor {
         unsigned char _pin_tx;
         std::unique_ptr<SoftwareSerial> _serial;
 
+        espurna::frame::Parser<32, 10> _parser { FrameSpec };
+
 };
 
+#if __cplusplus < 201703L
+constexpr uint8_t SDS011Sensor::HeaderBytes[];
+constexpr espurna::frame::Spec SDS011Sensor::FrameSpec;
+#endif
+
 #endif // SENSOR_SUPPORT && SDS011_SUPPORT
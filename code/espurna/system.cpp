@@ -8,8 +8,6 @@ Copyright (C) 2019 by Xose Pérez <xose dot perez at gmail dot com>
 
 #include "espurna.h"
 
-#include <Ticker.h>
-
 #include "rtcmem.h"
 #include "ws.h"
 #include "ntp.h"
@@ -150,6 +148,152 @@ void blockingDelay(CoreClock::duration timeout) {
 
 } // namespace time
 
+namespace timer {
+namespace {
+namespace build {
+
+static constexpr espurna::duration::Milliseconds Tolerance { TIMER_LATENESS_TOLERANCE };
+
+} // namespace build
+
+using TimeSource = espurna::time::CoreClock;
+
+uint32_t runtime() {
+    return ::micros();
+}
+
+namespace internal {
+
+Wheel wheel(build::Tolerance.count(), runtime);
+
+} // namespace internal
+
+uint32_t now() {
+    return TimeSource::now().time_since_epoch().count();
+}
+
+// Loop sleeps until the earliest expiry, instead of the usual delay
+void deadline(uint32_t now) {
+    const auto next = internal::wheel.next(now);
+    if (next != Wheel::Never) {
+        espurnaLoopDeadline(espurna::duration::Milliseconds(next));
+    }
+}
+
+void deadline(const Timer& timer, uint32_t now) {
+    const auto expiry = static_cast<int32_t>(timer.expiry() - now);
+    espurnaLoopDeadline(espurna::duration::Milliseconds(
+        (expiry > 0) ? expiry : 0));
+}
+
+void loop() {
+    if (!internal::wheel.armed()) {
+        return;
+    }
+
+    const auto ts = now();
+    internal::wheel.advance(ts);
+    deadline(ts);
+}
+
+#if TERMINAL_SUPPORT
+namespace terminal {
+
+uint32_t average(const Stats& stats) {
+    return stats.runs
+        ? static_cast<uint32_t>(stats.runtime_total / stats.runs)
+        : 0;
+}
+
+void dump(Print& out) {
+    const auto ts = now();
+
+    out.printf_P(PSTR("armed %u, tolerance %u (ms)\n"),
+        static_cast<uint32_t>(internal::wheel.armed()),
+        static_cast<uint32_t>(build::Tolerance.count()));
+    out.printf_P(PSTR("%16s %8s %8s %8s %8s %8s %8s %8s\n"),
+        PSTR("timer"), PSTR("next"), PSTR("period"),
+        PSTR("runs"), PSTR("overruns"), PSTR("late"),
+        PSTR("max"), PSTR("avg"));
+
+    internal::wheel.foreach([&](const Timer& timer) {
+        char buffer[16];
+
+        const char* name = timer.name();
+        if (!name) {
+            std::snprintf(buffer, sizeof(buffer), "%p", &timer);
+            name = buffer;
+        }
+
+        const auto& stats = timer.stats();
+        const auto next = timer.armed()
+            ? static_cast<int32_t>(timer.expiry() - ts)
+            : -1;
+
+        out.printf_P(PSTR("%16s %8d %8u %8u %8u %8u %8u %8u\n"),
+            name, next, timer.period(),
+            stats.runs, stats.overruns, stats.late_max,
+            stats.runtime_max, average(stats));
+    });
+
+    const auto& total = internal::wheel.total();
+    out.printf_P(PSTR("%16s %8s %8s %8u %8u %8u %8u %8u\n"),
+        PSTR("total"), PSTR("-"), PSTR("-"),
+        total.runs, total.overruns, total.late_max,
+        total.runtime_max, average(total));
+}
+
+void setup() {
+    terminalRegisterCommand(F("TIMERS"), [](::terminal::CommandContext&& ctx) {
+        dump(ctx.output);
+        terminalOK(ctx);
+    });
+}
+
+} // namespace terminal
+#endif
+
+void setup() {
+    espurnaRegisterLoop(loop);
+#if TERMINAL_SUPPORT
+    terminal::setup();
+#endif
+}
+
+} // namespace
+
+void SystemTimer::once(TimeSource::duration delay, Callback callback) {
+    const auto ts = now();
+    internal::wheel.once(_timer, ts, delay.count(), std::move(callback));
+    deadline(_timer, ts);
+}
+
+void SystemTimer::repeat(TimeSource::duration period, Callback callback) {
+    const auto ts = now();
+    internal::wheel.repeat(_timer, ts, period.count(), std::move(callback));
+    deadline(_timer, ts);
+}
+
+void SystemTimer::at(TimeSource::time_point expiry, Callback callback) {
+    const auto ts = now();
+    internal::wheel.at(_timer, ts, expiry.time_since_epoch().count(), std::move(callback));
+    deadline(_timer, ts);
+}
+
+void SystemTimer::stop() {
+    internal::wheel.cancel(_timer);
+}
+
+size_t armed() {
+    return internal::wheel.armed();
+}
+
+const Stats& total() {
+    return internal::wheel.total();
+}
+
+} // namespace timer
+
 namespace {
 
 namespace memory {
@@ -337,7 +481,7 @@ namespace internal {
 
 Data persistent_data { &Rtcmem->sys };
 
-Ticker timer;
+espurna::timer::SystemTimer timer { "stability" };
 bool flag { true };
 
 } // namespace internal
@@ -424,7 +568,7 @@ void init() {
     internal::persistent_data.counter(next);
     internal::flag = (count < build::ChecksMax);
 
-    internal::timer.once_scheduled(build::CheckTime.count(), []() {
+    internal::timer.once(build::CheckTime, []() {
         DEBUG_MSG_P(PSTR("[MAIN] Resetting stability counter\n"));
         internal::persistent_data.counter(build::ChecksMin);
     });
@@ -584,7 +728,7 @@ struct CallbackRunner {
 
 namespace internal {
 
-Ticker timer;
+espurna::timer::SystemTimer timer { "heartbeat" };
 std::vector<CallbackRunner> runners;
 bool scheduled { false };
 
@@ -644,7 +788,7 @@ void run() {
         next = BeatMin;
     }
 
-    internal::timer.once_ms(next.count(), schedule);
+    internal::timer.once(next, schedule);
 }
 
 void stop(Callback callback) {
@@ -672,7 +816,7 @@ void push(Callback callback, Mode mode, duration::Seconds interval) {
         offset - msec
     });
 
-    internal::timer.detach();
+    internal::timer.stop();
     schedule();
 }
 
@@ -726,7 +870,7 @@ void init() {
     pushOnce([](Mask) {
         if (!espurna::boot::stability::check()) {
             DEBUG_MSG_P(PSTR("[MAIN] System UNSTABLE\n"));
-        } else if (espurna::boot::internal::timer.active()) {
+        } else if (espurna::boot::internal::timer.armed()) {
             DEBUG_MSG_P(PSTR("[MAIN] Pending stability counter reset...\n"));
         }
         return true;
@@ -789,7 +933,7 @@ void init() {
 // Store reset reason both here and in for the next boot
 namespace internal {
 
-Ticker reset_timer;
+espurna::timer::SystemTimer reset_timer { "reset" };
 auto reset_reason = CustomResetReason::None;
 
 void reset(CustomResetReason reason) {
@@ -824,7 +968,7 @@ static constexpr espurna::duration::Milliseconds ShortDelayForReset { 500 };
 void deferredReset(duration::Milliseconds delay, CustomResetReason reason) {
     DEBUG_MSG_P(PSTR("[MAIN] Requested reset: %s\n"),
         espurna::boot::serialize(reason).c_str());
-    internal::reset_timer.once_ms(delay.count(), [reason]() {
+    internal::reset_timer.once(delay, [reason]() {
         internal::reset(reason);
     });
 }
@@ -867,6 +1011,7 @@ void setup() {
     web::init();
 #endif
 
+    timer::setup();
     espurnaRegisterLoop(loop);
     heartbeat::init();
 }
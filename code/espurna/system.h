@@ -9,6 +9,7 @@ Copyright (C) 2019 by Xose Pérez <xose dot perez at gmail dot com>
 #pragma once
 
 #include "settings.h"
+#include "libs/TimerWheel.h"
 
 #include <chrono>
 #include <cstdint>
@@ -199,6 +200,48 @@ void blockingDelay(CoreClock::duration timeout);
 
 } // namespace time
 
+namespace timer {
+
+// Software timer serviced by the main loop. Unlike the Ticker, callback always runs in the loop context,
+// so it is allowed to block, allocate or use the network. Not usable from the interrupt handlers.
+// Timer is cancelled when the object is destroyed, and arming it again replaces the previous callback.
+class SystemTimer {
+public:
+    using Callback = Timer::Callback;
+    using TimeSource = espurna::time::CoreClock;
+
+    SystemTimer() = default;
+
+    explicit SystemTimer(const char* name) :
+        _timer(name)
+    {}
+
+    void once(TimeSource::duration, Callback);
+    void repeat(TimeSource::duration, Callback);
+    void at(TimeSource::time_point, Callback);
+    void stop();
+
+    bool armed() const {
+        return _timer.armed();
+    }
+
+    explicit operator bool() const {
+        return armed();
+    }
+
+    const Timer& timer() const {
+        return _timer;
+    }
+
+private:
+    Timer _timer;
+};
+
+size_t armed();
+const Stats& total();
+
+} // namespace timer
+
 namespace heartbeat {
 
 using Mask = int32_t;
@@ -19,6 +19,9 @@ Updated to use WiFiServer and support reverse connections by Niek van der Maas <
 
 #if TELNET_SUPPORT
 
+#include <algorithm>
+#include <cstring>
+#include <limits>
 #include <list>
 #include <memory>
 #include <vector>
@@ -33,22 +36,116 @@ Updated to use WiFiServer and support reverse connections by Niek van der Maas <
 
 #include <ESPAsyncTCP.h>
 
+#if TELNET_SERVER_ASYNC_BUFFERED
+
+namespace espurna {
+namespace telnet {
+namespace buffer {
+namespace build {
+
+constexpr size_t ChunkSize { TELNET_BUFFER_CHUNK_SIZE };
+constexpr size_t ClientMax { TELNET_CLIENT_BUFFER_MAX };
+
+static_assert(ChunkSize <= std::numeric_limits<uint16_t>::max(), "");
+
+// Every client could reference at most this many chunks, plus the one that is currently written into.
+// So, one slow client is never able to exhaust the pool for everyone else
+constexpr size_t chunksMax() {
+    return ((((ClientMax + ChunkSize - 1) / ChunkSize) + 1) * TELNET_MAX_CLIENTS) + 1;
+}
+
+} // namespace build
+
+// Output is written into the shared chunks exactly once. Every client only keeps
+// references to the parts it needs to send, and the chunk is returned to the pool
+// when the last one of them was acknowledged by the remote side
+struct Chunk {
+    Chunk* next;
+    uint16_t size;
+    uint16_t refs;
+    char data[build::ChunkSize];
+};
+
+class ChunkRef {
+public:
+    ChunkRef() = default;
+    explicit ChunkRef(Chunk* chunk);
+
+    ChunkRef(const ChunkRef& other) :
+        ChunkRef(other._chunk)
+    {}
+
+    ChunkRef(ChunkRef&& other) noexcept :
+        _chunk(other._chunk)
+    {
+        other._chunk = nullptr;
+    }
+
+    ChunkRef& operator=(const ChunkRef& other) {
+        if (this != &other) {
+            ChunkRef(other).swap(*this);
+        }
+        return *this;
+    }
+
+    ChunkRef& operator=(ChunkRef&& other) noexcept {
+        ChunkRef(std::move(other)).swap(*this);
+        return *this;
+    }
+
+    ~ChunkRef();
+
+    void swap(ChunkRef& other) noexcept {
+        std::swap(_chunk, other._chunk);
+    }
+
+    explicit operator bool() const {
+        return _chunk != nullptr;
+    }
+
+    bool operator==(const ChunkRef& other) const {
+        return _chunk == other._chunk;
+    }
+
+    Chunk* get() const {
+        return _chunk;
+    }
+
+private:
+    Chunk* _chunk { nullptr };
+};
+
+// Part of the chunk, waiting to be sent or acknowledged
+struct Span {
+    ChunkRef chunk;
+    uint16_t offset;
+    uint16_t length;
+    uint16_t sent;
+
+    const char* data() const {
+        return chunk.get()->data + offset;
+    }
+};
+
+} // namespace buffer
+} // namespace telnet
+} // namespace espurna
+
 struct AsyncBufferedClient {
     public:
-        constexpr static size_t BuffersMax =
-#if (TCP_MSS == 1460)
-            2ul;
-#else
-            5ul;
-#endif
-
-        using buffer_t = std::vector<uint8_t>;
+        using Span = espurna::telnet::buffer::Span;
 
         explicit AsyncBufferedClient(AsyncClient* client);
 
         size_t write(char c);
         size_t write(const char* data, size_t size=0);
 
+        // Pending output is over the limit, new data is dropped until the queue is drained
+        bool accept(size_t size);
+
+        // Queue already stored data. Nothing is copied, client keeps the reference to the chunk
+        void enqueue(const Span& span);
+
         void flush();
         size_t available();
 
@@ -57,16 +154,25 @@ struct AsyncBufferedClient {
         bool connected();
 
     private:
-        void _addBuffer();
+        void _trySend();
+        void _onAck(size_t len);
+        void _notifyDropped();
 
-        static void _trySend(AsyncBufferedClient* client);
         static void _s_onAck(void* client_ptr, AsyncClient*, size_t, uint32_t);
         static void _s_onPoll(void* client_ptr, AsyncClient* client);
 
+        // Spans are kept until acknowledged, so the per-client limit also accounts for the data in flight
+        std::list<Span> _spans;
+        size_t _queued { 0 };
+
+        bool _dropping { false };
+        size_t _dropped { 0 };
+
         std::unique_ptr<AsyncClient> _client;
-        std::list<buffer_t> _buffers;
 };
 
+#endif // TELNET_SERVER_ASYNC_BUFFERED
+
 using TTelnetServer = AsyncServer;
 
 #if TELNET_SERVER_ASYNC_BUFFERED
@@ -200,69 +306,251 @@ void _telnetDisconnect(unsigned char clientId) {
 
 #if TELNET_SERVER_ASYNC_BUFFERED
 
+namespace espurna {
+namespace telnet {
+namespace buffer {
+namespace {
+
+// Released chunks are kept around for a bit, instead of going back to the heap right away
+constexpr size_t ChunksCached { 2 };
+
+struct Pool {
+    Chunk* cached { nullptr };
+    size_t allocated { 0 };
+    ChunkRef tail;
+};
+
+Pool pool;
+
+Chunk* allocate() {
+    if (pool.cached) {
+        auto* out = pool.cached;
+        pool.cached = out->next;
+        out->next = nullptr;
+        out->size = 0;
+        return out;
+    }
+
+    if (pool.allocated >= build::chunksMax()) {
+        return nullptr;
+    }
+
+    auto* out = new (std::nothrow) Chunk;
+    if (out) {
+        out->next = nullptr;
+        out->size = 0;
+        out->refs = 0;
+        ++pool.allocated;
+    }
+
+    return out;
+}
+
+void release(Chunk* chunk) {
+    size_t cached { 0 };
+    for (auto* it = pool.cached; it; it = it->next) {
+        ++cached;
+    }
+
+    if (cached < ChunksCached) {
+        chunk->next = pool.cached;
+        pool.cached = chunk;
+        return;
+    }
+
+    delete chunk;
+    --pool.allocated;
+}
+
+// Data is copied into the chunk exactly once, callback receives every stored part of it.
+// Returns the number of bytes stored, which is less than the size when the pool is exhausted
+template <typename T>
+size_t append(const char* data, size_t size, T&& callback) {
+    size_t out { 0 };
+
+    while (size) {
+        auto* chunk = pool.tail.get();
+        if (!chunk || (chunk->size == build::ChunkSize)) {
+            chunk = allocate();
+            if (!chunk) {
+                break;
+            }
+
+            pool.tail = ChunkRef(chunk);
+        }
+
+        const auto length = std::min(size, build::ChunkSize - chunk->size);
+        std::memcpy(chunk->data + chunk->size, data, length);
+
+        const Span span{pool.tail, chunk->size, static_cast<uint16_t>(length), 0};
+        chunk->size += length;
+        callback(span);
+
+        data += length;
+        size -= length;
+        out += length;
+    }
+
+    return out;
+}
+
+} // namespace
+
+ChunkRef::ChunkRef(Chunk* chunk) :
+    _chunk(chunk)
+{
+    if (_chunk) {
+        ++_chunk->refs;
+    }
+}
+
+ChunkRef::~ChunkRef() {
+    if (_chunk && !--_chunk->refs) {
+        release(_chunk);
+    }
+}
+
+} // namespace buffer
+} // namespace telnet
+} // namespace espurna
+
 AsyncBufferedClient::AsyncBufferedClient(AsyncClient* client) : _client(client) {
     _client->onAck(_s_onAck, this);
     _client->onPoll(_s_onPoll, this);
 }
 
-void AsyncBufferedClient::_trySend(AsyncBufferedClient* client) {
-    while (!client->_buffers.empty()) {
-        auto& chunk = client->_buffers.front();
-        if (client->_client->space() >= chunk.size()) {
-            client->_client->write((const char*)chunk.data(), chunk.size());
-            client->_buffers.pop_front();
+void AsyncBufferedClient::_trySend() {
+    bool added { false };
+
+    for (auto& span : _spans) {
+        if (span.sent == span.length) {
             continue;
         }
-        return;
+
+        const size_t space = _client->space();
+        if (!space) {
+            break;
+        }
+
+        // Data is copied, lwip could still reference it after close() when the chunks are already released
+        const size_t size = std::min(space, static_cast<size_t>(span.length - span.sent));
+        const size_t written = _client->add(span.data() + span.sent, size, ASYNC_WRITEFLAG_COPY);
+        if (!written) {
+            break;
+        }
+
+        span.sent += written;
+        added = true;
+
+        if (span.sent != span.length) {
+            break;
+        }
     }
-}
 
-void AsyncBufferedClient::_s_onAck(void* client_ptr, AsyncClient*, size_t, uint32_t) {
-    _trySend(reinterpret_cast<AsyncBufferedClient*>(client_ptr));
+    if (added) {
+        _client->send();
+    }
 }
 
-void AsyncBufferedClient::_s_onPoll(void* client_ptr, AsyncClient*) {
-    _trySend(reinterpret_cast<AsyncBufferedClient*>(client_ptr));
+void AsyncBufferedClient::_onAck(size_t len) {
+    while (len && !_spans.empty()) {
+        auto& span = _spans.front();
+
+        const auto acked = std::min(len, static_cast<size_t>(span.sent));
+        if (!acked) {
+            break;
+        }
+
+        span.offset += acked;
+        span.length -= acked;
+        span.sent -= acked;
+
+        _queued -= acked;
+        len -= acked;
+
+        if (!span.length) {
+            _spans.pop_front();
+        }
+    }
+
+    // Only resume when there's enough space for more than a couple of lines
+    if (_dropping && (_queued <= (espurna::telnet::buffer::build::ClientMax / 2))) {
+        _notifyDropped();
+    }
+
+    _trySend();
 }
 
-void AsyncBufferedClient::_addBuffer() {
-    // Note: c++17 emplace returns created object reference
-    _buffers.emplace_back();
-    _buffers.back().reserve(TCP_MSS);
+void AsyncBufferedClient::_notifyDropped() {
+    _dropping = false;
+
+    char buffer[64];
+    const int len = snprintf_P(buffer, sizeof(buffer),
+        PSTR("\n[TELNET] Output dropped: %u bytes\n"), _dropped);
+    _dropped = 0;
+
+    // Notification itself is never dropped, even if it goes over the limit
+    if ((len > 0) && (static_cast<size_t>(len) < sizeof(buffer))) {
+        espurna::telnet::buffer::append(buffer, len,
+            [&](const Span& span) {
+                enqueue(span);
+            });
+    }
 }
 
-size_t AsyncBufferedClient::write(const char* data, size_t size) {
+void AsyncBufferedClient::_s_onAck(void* client_ptr, AsyncClient*, size_t len, uint32_t) {
+    reinterpret_cast<AsyncBufferedClient*>(client_ptr)->_onAck(len);
+}
 
-    if (_buffers.size() > AsyncBufferedClient::BuffersMax) return 0;
+void AsyncBufferedClient::_s_onPoll(void* client_ptr, AsyncClient*) {
+    reinterpret_cast<AsyncBufferedClient*>(client_ptr)->_trySend();
+}
 
-    // TODO: just waiting for onPoll is insufficient, we need to push data asap
-    size_t written = 0;
-    if (_buffers.empty()) {
-        written = _client->add(data, size);
-        if (written == size) return size;
+// Slow client is not allowed to hold more than the limit. When it is reached,
+// everything is dropped until the queue is (mostly) drained
+bool AsyncBufferedClient::accept(size_t size) {
+    if (!_dropping && ((_queued + size) <= espurna::telnet::buffer::build::ClientMax)) {
+        return true;
     }
 
-    const size_t full_size = size;
-    char* data_ptr = const_cast<char*>(data + written);
-    size -= written;
+    _dropping = true;
+    _dropped += size;
 
-    while (size) {
-        if (_buffers.empty()) _addBuffer();
-        auto& current = _buffers.back();
-        const auto have = current.capacity() - current.size();
-        if (have >= size) {
-            current.insert(current.end(), data_ptr, data_ptr + size);
-            size = 0;
-        } else {
-            current.insert(current.end(), data_ptr, data_ptr + have);
-            _addBuffer();
-            data_ptr += have;
-            size -= have;
+    return false;
+}
+
+void AsyncBufferedClient::enqueue(const Span& span) {
+    _queued += span.length;
+
+    if (!_spans.empty()) {
+        auto& last = _spans.back();
+        if ((last.chunk == span.chunk) && ((last.offset + last.length) == span.offset)) {
+            last.length += span.length;
+            _trySend();
+            return;
         }
     }
 
-    return full_size;
+    _spans.push_back(span);
+    _trySend();
+}
+
+size_t AsyncBufferedClient::write(const char* data, size_t size) {
+    if (!accept(size)) {
+        return 0;
+    }
+
+    const auto out = espurna::telnet::buffer::append(data, size,
+        [&](const Span& span) {
+            enqueue(span);
+        });
 
+    if (out != size) {
+        _dropping = true;
+        _dropped += size - out;
+    }
+
+    return out;
 }
 
 size_t AsyncBufferedClient::write(char c) {
@@ -271,7 +559,7 @@ size_t AsyncBufferedClient::write(char c) {
 }
 
 void AsyncBufferedClient::flush() {
-    _client->send();
+    _trySend();
 }
 
 size_t AsyncBufferedClient::available() {
@@ -301,6 +589,42 @@ size_t _telnetWrite(unsigned char clientId, const char *data, size_t len) {
     return 0;
 }
 
+#if TELNET_SERVER == TELNET_SERVER_ASYNC && TELNET_SERVER_ASYNC_BUFFERED
+
+// Data is stored once, every client only references it
+size_t _telnetWrite(const char *data, size_t len) {
+    bool recipients[TELNET_MAX_CLIENTS] {};
+
+    unsigned char count = 0;
+    for (unsigned char i = 0; i < TELNET_MAX_CLIENTS; i++) {
+        // Do not send broadcast messages to unauthenticated clients
+        if (_telnetAuth && !_telnetClientsAuth[i]) {
+            continue;
+        }
+
+        auto& client = _telnetClients[i];
+        if (client && client->connected() && client->accept(len)) {
+            recipients[i] = true;
+            ++count;
+        }
+    }
+
+    if (count) {
+        espurna::telnet::buffer::append(data, len,
+            [&](const AsyncBufferedClient::Span& span) {
+                for (unsigned char i = 0; i < TELNET_MAX_CLIENTS; i++) {
+                    if (recipients[i]) {
+                        _telnetClients[i]->enqueue(span);
+                    }
+                }
+            });
+    }
+
+    return count;
+}
+
+#else
+
 size_t _telnetWrite(const char *data, size_t len) {
     unsigned char count = 0;
     for (unsigned char i = 0; i < TELNET_MAX_CLIENTS; i++) {
@@ -314,6 +638,8 @@ size_t _telnetWrite(const char *data, size_t len) {
     return count;
 }
 
+#endif
+
 size_t _telnetWrite(const char *data) {
     return _telnetWrite(data, strlen(data));
 }
@@ -514,8 +840,26 @@ bool telnetConnected() {
 
 #if DEBUG_TELNET_SUPPORT
 
+// Debug output is only broadcast to the authenticated clients
+bool telnetDebugConnected() {
+    for (unsigned char i = 0; i < TELNET_MAX_CLIENTS; i++) {
+        if (_telnetAuth && !_telnetClientsAuth[i]) {
+            continue;
+        }
+
+        auto& client = _telnetClients[i];
+        if (client && client->connected()) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Only fails when there are recipients, but none of them could accept the data right now.
+// Without any recipients, data is consumed so the caller does not wait for it to be sent
 bool telnetDebugSend(const char* prefix, const char* data) {
-    if (!telnetConnected()) return false;
+    if (!telnetDebugConnected()) return true;
     bool result = false;
     if (prefix && (prefix[0] != '\0')) {
         result = _telnetWrite(prefix) > 0;
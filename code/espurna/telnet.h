@@ -13,6 +13,7 @@ Copyright (C) 2017-2019 by Xose Pérez <xose dot perez at gmail dot com>
 uint16_t telnetPort();
 bool telnetConnected();
 unsigned char telnetWrite(unsigned char ch);
+bool telnetDebugConnected();
 bool telnetDebugSend(const char* prefix, const char* data);
 void telnetSetup();
 
@@ -409,13 +409,12 @@ void updateCounters() {
 //------------------------------------------------------------------------------
 double _getLocalValue(const char* description, unsigned char type) {
 #if SENSOR_SUPPORT
-    for (unsigned char index = 0; index < magnitudeCount(); ++index) {
-        if (magnitudeType(index) == type) {
-            const auto value = magnitudeValue(index);
-            DEBUG_MSG_P(PSTR("[THERMOSTAT] %s: %s\n"),
-                    description, value.repr.c_str());
-            return value.value;
-        }
+    const auto index = magnitudeId(type, 0);
+    if (index < magnitudeCount()) {
+        const auto value = magnitudeValue(index);
+        DEBUG_MSG_P(PSTR("[THERMOSTAT] %s: %s\n"),
+                description, value.repr.c_str());
+        return value.value;
     }
 #endif
     return espurna::sensor::Value::Unknown;
@@ -423,11 +422,9 @@ double _getLocalValue(const char* description, unsigned char type) {
 
 String _getLocalUnit(unsigned char type) {
 #if SENSOR_SUPPORT
-    for (unsigned char index = 0; index < magnitudeCount(); ++index) {
-        const auto info = magnitudeInfo(index);
-        if (info.type == type) {
-            return magnitudeUnits(info.units);
-        }
+    const auto index = magnitudeId(type, 0);
+    if (index < magnitudeCount()) {
+        return magnitudeUnits(magnitudeInfo(index).units);
     }
 #endif
     return F("none");
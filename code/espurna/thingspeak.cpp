@@ -20,14 +20,13 @@ Copyright (C) 2019 by Xose Pérez <xose dot perez at gmail dot com>
 #include <memory>
 
 #if THINGSPEAK_USE_ASYNC
-#include <ESPAsyncTCP.h>
+#include "http_client.h"
 #else
 #include <ESP8266HTTPClient.h>
 #endif
 
 #include "libs/URL.h"
 #include "libs/SecureClientHelpers.h"
-#include "libs/AsyncClientHelpers.h"
 
 namespace espurna {
 namespace thingspeak {
@@ -317,265 +316,63 @@ void send(const String& address, const String& data) {
 
 #if THINGSPEAK_USE_ASYNC
 namespace async {
+namespace internal {
 namespace {
 
-class Client {
-public:
-    static constexpr auto Timeout = espurna::duration::Seconds(15);
-
-    using Completion = void(*)(const String&);
-
-    using ClientState = AsyncClientState;
-    enum class ParserState {
-        Init,
-        Headers,
-        Body,
-        End,
-    };
-
-    bool send(const String& data, Completion completion) {
-        if (_client_state == ClientState::Disconnected) {
-            _data = data;
-            _completion = completion;
-
-            if (!_client) {
-                _client = std::make_unique<AsyncClient>();
-                _client->onDisconnect(Client::_onDisconnected, this);
-                _client->onConnect(Client::_onConnect, this);
-                _client->onTimeout(Client::_onTimeout, this);
-                _client->onPoll(Client::_onPoll, this);
-                _client->onData(Client::_onData, this);
-            }
-
-            _connection_start = TimeSource::now();
-            _client_state = ClientState::Connecting;
-
-            if (_client->connect(_address.host.c_str(), _address.port)) {
-                return true;
-            }
-
-            _client->close(true);
-        }
-
-        return false;
-    }
-
-    bool send(const String& address, const String& data, Completion completion) {
-        _address = address;
-        return send(data, completion);
-    }
-
-    void disconnect() {
-        if (_client_state == ClientState::Disconnected) {
-            _client = nullptr;
-        }
-    }
-
-    const URL& address() const {
-        return _address;
-    }
-
-    explicit operator bool() const {
-        return _client_state != ClientState::Disconnected;
-    }
-
-private:
-    void onDisconnected() {
-        DEBUG_MSG_P(PSTR("[THINGSPEAK] Disconnected\n"));
-        _parser_state = ParserState::Init;
-        _client_state = ClientState::Disconnected;
-        _data = "";
-    }
-
-    void onTimeout(uint32_t timestamp) {
-        DEBUG_MSG_P(PSTR("[THINGSPEAK] ERROR: Network timeout after %ums\n"), timestamp);
-        _client->close(true);
-    }
-
-    bool _sendPendingData() {
-        if (!_data.length()) {
-            return true;
-        }
-
-        size_t wrote = _client->write(_data.c_str(), _data.length());
-        if (wrote == _data.length()) {
-            _data = "";
-            return true;
-        }
-
-        return false;
-    }
-
-    void onPoll() {
-        if (_client_state != ClientState::Connected) {
-            return;
-        }
-
-        if (!_sendPendingData()) {
-            return;
-        }
-
-        const auto now = TimeSource::now();
-        if (now - _connection_start > Timeout) {
-            DEBUG_MSG_P(PSTR("[THINGSPEAK] ERROR: Timeout after %ums\n"),
-                (now - _connection_start).count());
-            _client->close(true);
-        }
-    }
-
-    void onConnect() {
-            _parser_state = ParserState::Init;
-            _client_state = ClientState::Connected;
-
-            DEBUG_MSG_P(PSTR("[THINGSPEAK] Connected to %s:%hu\n"),
-                _address.host.c_str(), _address.port);
-
-            DEBUG_MSG_P(PSTR("[THINGSPEAK] POST %s?%s\n"),
-                    _address.path.c_str(), _data.c_str());
-
-            static constexpr size_t HeadersSize { 256 };
-
-            String headers;
-            headers.reserve(HeadersSize);
-            auto append = [&](const String& key, const String& value) {
-                headers += key;
-                headers += F(": ");
-                headers += value;
-                headers += F("\r\n");
-            };
-
-            headers += F("POST ");
-            headers += _address.path;
-            headers += F(" HTTP/1.1");
-            headers += F("\r\n");
-
-            append(F("Host"), _address.host);
-            append(F("User-Agent"), getAppName());
-            append(F("Connection"), F("close"));
-            append(F("Content-Type"), F("application/x-www-form-urlencoded"));
-            append(F("Content-Length"), String(_data.length(), 10));
-
-            headers += F("\r\n");
-
-            _client->write(headers.c_str(), headers.length());
-            _sendPendingData();
-    }
-
-    void onData(const uint8_t* data, size_t len) {
-        if (_data.length()) {
-            _parser_state = ParserState::End;
-            _client->close(true);
-            return;
-        }
-
-        alignas(4) static constexpr char Status[] PROGMEM = "HTTP/1.1 200 OK";
-        alignas(4) static constexpr char Break[] PROGMEM = "\r\n\r\n";
-
-        auto begin = reinterpret_cast<const char*>(data);
-        auto end = begin + len;
-
-        const char* ptr { nullptr };
-
-        do {
-            switch (_parser_state) {
-
-            case ParserState::End:
-                break;
-
-            case ParserState::Init:
-            {
-                ptr = strnstr(begin, Status, len);
-                if (!ptr) {
-                    _client->close(true);
-                    return;
-                }
-                _parser_state = ParserState::Headers;
-                break;
-            }
-
-            case ParserState::Headers:
-            {
-                ptr = strnstr(ptr, Break, len);
-                if (!ptr) {
-                    return;
-                }
-
-                ptr = ptr + __builtin_strlen(Break);
-                _parser_state = ParserState::Body;
-            }
+// Response body is the entry ID, or 0 when update has failed
+static constexpr size_t ResponseSize { 32 };
 
-            case ParserState::Body:
-            {
-                if (!ptr) {
-                    ptr = begin;
-                }
+bool pending = false;
+String response;
 
-                if (end - ptr) {
-                    String body;
-                    body.concat(ptr, end - ptr);
-
-                    _completion(body);
-                    _client->close(true);
-
-                    _parser_state = ParserState::End;
-                }
-                return;
-            }
-
-            }
+} // namespace
+} // namespace internal
 
-        } while (_parser_state != ParserState::End);
-    }
+namespace {
 
-    static void _onDisconnected(void* ptr, AsyncClient*) {
-        reinterpret_cast<Client*>(ptr)->onDisconnected();
-    }
+bool ready() {
+    return !internal::pending;
+}
 
-    static void _onConnect(void* ptr, AsyncClient*) {
-        reinterpret_cast<Client*>(ptr)->onConnect();
-    }
+void onBody(const uint8_t* data, size_t size) {
+    size = std::min(size, internal::ResponseSize - internal::response.length());
+    internal::response.concat(reinterpret_cast<const char*>(data), size);
+}
 
-    static void _onTimeout(void* ptr, AsyncClient*, uint32_t timestamp) {
-        reinterpret_cast<Client*>(ptr)->onTimeout(timestamp);
-    }
+void onComplete(int status, espurna::http::Error) {
+    internal::pending = false;
 
-    static void _onPoll(void* ptr, AsyncClient*) {
-        reinterpret_cast<Client*>(ptr)->onPoll();
-    }
+    String body;
+    std::swap(body, internal::response);
 
-    static void _onData(void* ptr, AsyncClient*, const void* data, size_t len) {
-        reinterpret_cast<Client*>(ptr)->onData(reinterpret_cast<const uint8_t*>(data), len);
+    if (status != 200) {
+        DEBUG_MSG_P(PSTR("[THINGSPEAK] ERROR: HTTP %d\n"), status);
+        body = "";
     }
 
-    ParserState _parser_state = ParserState::Init;
-    ClientState _client_state = ClientState::Disconnected;
-
-    TimeSource::time_point _connection_start;
-
-    URL _address;
-    Completion _completion;
-    String _data;
-    std::unique_ptr<AsyncClient> _client;
-};
-
-} // namespace
-
-namespace internal {
-namespace {
-
-Client client;
-
-} // namespace
-} // namespace internal
-
-namespace {
+    maybe_retry(body);
+}
 
+// Connection to the server is kept open between the flushes
 void send(const String& address, const String& data) {
-    if (internal::client) {
-        return;
-    }
+    const URL url(address);
 
-    if (!internal::client.send(address, data, maybe_retry)) {
+    DEBUG_MSG_P(PSTR("[THINGSPEAK] POST %s?%s\n"),
+        url.path.c_str(), data.c_str());
+
+    espurna::http::Request request;
+    request.head = espurna::http::Head("POST", url.host, url.port, url.path)
+        .header("User-Agent", getAppName())
+        .header("Content-Type", "application/x-www-form-urlencoded")
+        .finish(data.length());
+    request.body_size = data.length();
+    request.body = espurna::http::body(String(data));
+    request.on_body = onBody;
+    request.on_complete = onComplete;
+
+    internal::response = "";
+    internal::pending = httpClientSend(url, std::move(request));
+    if (!internal::pending) {
         DEBUG_MSG_P(PSTR("[THINGSPEAK] Connection failed\n"));
     }
 }
@@ -586,7 +383,7 @@ void send(const String& address, const String& data) {
 
 bool ready() {
 #if THINGSPEAK_USE_ASYNC
-    return !static_cast<bool>(async::internal::client);
+    return async::ready();
 #else
     return true;
 #endif
@@ -20,7 +20,6 @@ Copyright (C) 2019-2021 by Maxim Prokhorov <prokhorov dot max at outlook dot com
 #include "libs/OnceFlag.h"
 
 #include <functional>
-#include <queue>
 #include <forward_list>
 #include <StreamString.h>
 
@@ -32,14 +31,6 @@ Copyright (C) 2019-2021 by Maxim Prokhorov <prokhorov dot max at outlook dot com
 
 namespace tuya {
 
-    bool operator<(const DataFrame& lhs, const DataFrame& rhs) {
-        if ((lhs.command() != Command::Heartbeat) && (rhs.command() == Command::Heartbeat)) {
-            return true;
-        }
-
-        return false;
-    }
-
     constexpr unsigned long SerialSpeed { 9600u };
 
     constexpr unsigned long DiscoveryTimeout { 1500u };
@@ -67,7 +58,7 @@ namespace tuya {
     };
 
     Transport tuyaSerial(TUYA_SERIAL);
-    std::priority_queue<DataFrame> outputFrames;
+    OutputQueue outputFrames;
 
     template <typename T>
     void send(unsigned char dp, T value) {
@@ -430,19 +421,10 @@ error:
 
     void processSerial(State& state) {
 
-        while (tuyaSerial.available()) {
-
-            tuyaSerial.read();
-
-            if (tuyaSerial.done()) {
-                processFrame(state, tuyaSerial);
-                tuyaSerial.reset();
-            }
-
-            if (tuyaSerial.full()) {
-                tuyaSerial.rewind();
-                tuyaSerial.reset();
-            }
+        // there could be more than one frame received since the last loop
+        while (tuyaSerial.read()) {
+            processFrame(state, tuyaSerial);
+            tuyaSerial.reset();
         }
 
     }
@@ -463,6 +445,7 @@ error:
             // send fast heartbeat until mcu responds with something
             case State::INIT:
                 tuyaSerial.rewind();
+                tuyaSerial.clear();
                 state = State::BOOT;
             case State::BOOT:
                 sendHeartbeat(Heartbeat::Boot);
@@ -510,7 +493,7 @@ error:
         }
 
         if (TUYA_SERIAL && !outputFrames.empty()) {
-            auto& frame = outputFrames.top();
+            auto& frame = outputFrames.front();
             dataframeDebugSend("=>", frame);
             tuyaSerial.write(frame.serialize());
             outputFrames.pop();
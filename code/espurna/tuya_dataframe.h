@@ -9,6 +9,7 @@ Copyright (C) 2019 by Maxim Prokhorov <prokhorov dot max at outlook dot com>
 #pragma once
 
 #include <cstdint>
+#include <deque>
 #include <vector>
 
 #include "tuya_types.h"
@@ -184,4 +185,63 @@ private:
     uint8_t _version { 0u };
 };
 
+// Heartbeat is always sent first, everything else is sent in the same order it was added.
+// Only the latest value of the DP is sent, since the previous one is already outdated by the time
+// it could be written to the serial (e.g. when brightness is changed multiple times in a row)
+class OutputQueue {
+public:
+    using Frames = std::deque<DataFrame>;
+
+    template <typename... Args>
+    void emplace(Args&&... args) {
+        push(DataFrame(std::forward<Args>(args)...));
+    }
+
+    void push(DataFrame&& frame) {
+        if (frame.command() == static_cast<uint8_t>(Command::Heartbeat)) {
+            if (_frames.empty() || (_frames.front().command() != frame.command())) {
+                _frames.push_front(std::move(frame));
+            }
+            return;
+        }
+
+        if ((frame.command() == static_cast<uint8_t>(Command::SetDP)) && frame.length()) {
+            for (auto& queued : _frames) {
+                if ((queued.command() == frame.command()) && queued.length() && (queued[0] == frame[0])) {
+                    queued = std::move(frame);
+                    ++_coalesced;
+                    return;
+                }
+            }
+        }
+
+        _frames.push_back(std::move(frame));
+    }
+
+    bool empty() const {
+        return _frames.empty();
+    }
+
+    size_t size() const {
+        return _frames.size();
+    }
+
+    const DataFrame& front() const {
+        return _frames.front();
+    }
+
+    void pop() {
+        _frames.pop_front();
+    }
+
+    // Number of frames that were replaced with a newer one
+    size_t coalesced() const {
+        return _coalesced;
+    }
+
+private:
+    Frames _frames;
+    size_t _coalesced { 0 };
+};
+
 } // namespace
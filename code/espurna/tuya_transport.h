@@ -11,6 +11,7 @@ Copyright (C) 2019 by Maxim Prokhorov <prokhorov dot max at outlook dot com>
 #include <Print.h>
 #include <StreamString.h>
 
+#include <algorithm>
 #include <iterator>
 #include <vector>
 
@@ -73,21 +74,24 @@ namespace tuya {
             stream.reserve((length * 2) + 1);
         }
 
+        // Frame is assembled beforehand, so the UART driver receives everything in a single call
         template <typename T, typename PrintType>
         void _write(const T& data) {
+            _buffer.clear();
+            _buffer.reserve(std::distance(data.cbegin(), data.cend()) + 3);
 
-            const uint8_t header[2] = {0x55, 0xaa};
-            uint8_t checksum = 0xff;
-
-            PrintType::write(_stream, header, 2);
+            _buffer.push_back(0x55);
+            _buffer.push_back(0xaa);
 
+            uint8_t checksum = 0xff;
             for (auto it = data.cbegin(); it != data.cend(); ++it) {
                 checksum += *it;
-                PrintType::write(_stream, *it);
+                _buffer.push_back(*it);
             }
 
-            PrintType::write(_stream, checksum);
+            _buffer.push_back(checksum);
 
+            PrintType::write(_stream, _buffer.data(), _buffer.size());
         }
 
         template <typename T>
@@ -100,10 +104,19 @@ namespace tuya {
             _write<T, PrintHex>(data);
         }
 
-
+    private:
+        std::vector<uint8_t> _buffer;
     };
 
+    // Everything available is read from the stream at once and stored in the ring buffer.
+    // Frame parser state is kept between the read() calls, so the frame may arrive in any number of parts.
+    // When header, length or checksum are invalid, parsing restarts from the next byte after the
+    // failed header. Complete frame is copied into a contiguous buffer and is available until reset()
+    //
+    // > 0x55 0xaa <version> <command> <length:2> <data...> <checksum>
+
     class Input : public virtual StreamWrapper {
+    public:
         // Buffer depth based on the SDK recommendations
         constexpr static size_t LIMIT = 256;
 
@@ -111,98 +124,216 @@ namespace tuya {
         // 256 * 1.04 = 266.24
         constexpr static size_t TIME_LIMIT = 267;
 
-    public:
+        // Can hold at least one complete frame and the start of the next one
+        constexpr static size_t RING_SIZE = 512;
+
         using const_iterator = std::vector<uint8_t>::const_iterator;
 
         Input(Stream& stream) :
             StreamWrapper(stream)
         {
-            _buffer.reserve(LIMIT);
+            _frame.reserve(LIMIT);
         }
 
-        bool full() { return (_index >= LIMIT); }
-        bool done() { return _done; }
-        size_t size() { return _index; }
+        bool done() const { return _done; }
+        size_t size() const { return _frame.size(); }
+
+        // Parser skips anything that could not be a frame, so the ring is never full for long
+        bool full() const { return (_head - _tail) >= RING_SIZE; }
+
+        // Number of bytes that were dropped while looking for the frame header
+        size_t errors() const { return _errors; }
 
         uint8_t operator[](size_t i) const {
-            if (i > LIMIT) return 0;
-            return _buffer[i];
+            if (i >= _frame.size()) return 0;
+            return _frame[i];
         }
 
         const_iterator cbegin() const {
-            return _buffer.cbegin();
+            return _frame.cbegin();
         }
 
         const_iterator cend() const {
-            return _buffer.cend();
+            return _frame.cend();
         }
 
-        void read() {
+        // Returns true when there's a complete frame available
+        bool read() {
+            if (_done) return true;
 
-            if (_done) return;
-            if (full()) return;
+            fill();
+            parse();
 
-            if (_last && (millis() - _last > TIME_LIMIT)) reset();
-            _last = millis();
+            return _done;
+        }
 
-            int byte = _stream.read();
-            if (byte < 0) return;
+        // Data can also be received from somewhere else
+        size_t feed(const uint8_t* data, size_t size) {
+            size = std::min(size, RING_SIZE - (_head - _tail));
+            for (size_t n = 0; n < size; ++n) {
+                _ring[(_head + n) & (RING_SIZE - 1)] = data[n];
+            }
+            _head += size;
 
-            //DEBUG_MSG("i=%u byte=%u chk=%u:%u\n",
-            //  _index, byte, _checksum, uint8_t(_checksum + byte));
+            return size;
+        }
 
-            // check that header value is 0x55aa
-            if (0 == _index) {
-                if (0x55 != byte) return;
-            } else if (1 == _index) {
-                if (0xaa != byte) return;
-            }
+        // Drop the current frame, the next read() continues with the rest of the buffered data
+        void reset() {
+            _frame.clear();
+            _done = false;
+        }
 
-            // set read boundary from received length
-            if (4 == _index) {
-                _read_until = byte << 8;
-            }
+        // Drop everything, including the partially received frame
+        void clear() {
+            reset();
+            restart();
+            _tail = _head;
+        }
 
-            if (5 == _index) {
-                _read_until += byte + _index + 1;
-                //DEBUG_MSG("read_until=%u\n", _read_until);
-            }
+    private:
+        enum class State {
+            Header,
+            Header2,
+            Version,
+            Command,
+            Length,
+            Length2,
+            Data,
+            Checksum
+        };
+
+        uint8_t at(size_t offset) const {
+            return _ring[(_tail + offset) & (RING_SIZE - 1)];
+        }
 
-            // verify that the checksum byte is the same that we got so far
-            if ((_index > 5) && (_index >= _read_until)) {
-                if (_checksum != byte) {
-                    //DEBUG_MSG("chk err, recv=%u calc=%u\n", byte, _checksum);
-                    reset();
-                    return;
-                }
+        void fill() {
+            const int available = _stream.available();
+            if (available <= 0) return;
 
-                //DEBUG_MSG("chk ok\n");
-                _done = true;
-                return;
+            // Partial frame is no longer valid when the MCU stops sending in the middle of it
+            if (_last && (millis() - _last > TIME_LIMIT) && (_offset || (_head != _tail))) {
+                clear();
             }
+            _last = millis();
 
-            _buffer[_index] = byte;
-            _checksum += byte;
+            uint8_t buffer[64];
 
-            ++_index;
+            size_t left = std::min(static_cast<size_t>(available), RING_SIZE - (_head - _tail));
+            while (left) {
+                const size_t size = _stream.readBytes(buffer, std::min(left, sizeof(buffer)));
+                if (!size) break;
 
+                feed(buffer, size);
+                left -= size;
+            }
         }
 
-        void reset() {
-            std::fill(_buffer.begin(), _buffer.end(), 0);
-            _read_until = LIMIT;
+        void restart() {
+            _state = State::Header;
+            _offset = 0;
             _checksum = 0;
-            _index = 0;
-            _done = false;
-            _last = 0;
+            _length = 0;
         }
 
-    private:
+        // Current frame candidate is invalid, try again starting with the next byte
+        void skip() {
+            ++_tail;
+            ++_errors;
+            restart();
+        }
+
+        void parse() {
+            while (!_done && (_tail + _offset) != _head) {
+                const uint8_t byte = at(_offset);
+
+                switch (_state) {
+                case State::Header:
+                    if (byte != 0x55) {
+                        ++_tail;
+                        ++_errors;
+                        continue;
+                    }
+                    _state = State::Header2;
+                    break;
+
+                case State::Header2:
+                    if (byte != 0xaa) {
+                        skip();
+                        continue;
+                    }
+                    _state = State::Version;
+                    break;
+
+                case State::Version:
+                    _state = State::Command;
+                    break;
+
+                case State::Command:
+                    _state = State::Length;
+                    break;
+
+                case State::Length:
+                    _length = byte << 8;
+                    _state = State::Length2;
+                    break;
+
+                case State::Length2:
+                    _length += byte;
+                    if ((_length + 6) > LIMIT) {
+                        skip();
+                        continue;
+                    }
+                    _state = _length ? State::Data : State::Checksum;
+                    break;
+
+                case State::Data:
+                    if ((_offset + 1) == (_length + 6)) {
+                        _state = State::Checksum;
+                    }
+                    break;
+
+                case State::Checksum:
+                    if (_checksum != byte) {
+                        skip();
+                        continue;
+                    }
+
+                    complete();
+                    continue;
+                }
+
+                // header bytes are included in the checksum, 0x55 + 0xaa == 0xff
+                _checksum += byte;
+                ++_offset;
+            }
+        }
+
+        void complete() {
+            _frame.resize(_offset);
+            for (size_t n = 0; n < _offset; ++n) {
+                _frame[n] = at(n);
+            }
+
+            _tail += _offset + 1;
+            _done = true;
+
+            restart();
+        }
+
+        std::vector<uint8_t> _frame;
         bool _done = false;
-        size_t _index = 0;
-        size_t _read_until = LIMIT;
+
+        uint8_t _ring[RING_SIZE];
+        size_t _head = 0;
+        size_t _tail = 0;
+
+        State _state = State::Header;
+        size_t _offset = 0;
+        size_t _length = 0;
         uint8_t _checksum = 0;
-        std::vector<uint8_t> _buffer;
+
+        size_t _errors = 0;
         unsigned long _last = 0;
     };
 
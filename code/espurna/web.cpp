@@ -20,6 +20,8 @@ Copyright (C) 2016-2019 by Xose Pérez <xose dot perez at gmail dot com>
 #include "utils.h"
 #include "web.h"
 
+#include "libs/HttpRange.h"
+
 #include <Schedule.h>
 #include <Print.h>
 #include <Hash.h>
@@ -57,6 +59,11 @@ namespace {
 
 } // namespace
 
+// Older images only contain the index.html
+#ifndef WEBUI_ASSETS
+#define WEBUI_ASSETS(X)
+#endif
+
 #endif // WEB_EMBEDDED
 
 #if WEB_SSL_ENABLED
@@ -213,7 +220,6 @@ size_t AsyncWebPrint::write(const uint8_t* data, size_t size) {
 
 namespace {
 
-alignas(4) static constexpr char LastModified[] PROGMEM = __DATE__ " " __TIME__ " GMT";
 static constexpr size_t WebConfigBufferMax { 4096 };
 
 // server instance can't (yet) be static, port is the ctor argument :/
@@ -462,49 +468,155 @@ void _onAPCaptiveRequest(AsyncWebServerRequest* request) {
 #endif
 
 #if WEB_EMBEDDED
-alignas(4) static constexpr char IfModifiedSince[] PROGMEM = "If-Modified-Since";
+namespace embedded {
+
+// Besides the index.html itself, generated header may also provide a list of assets referenced by it.
+// Asset path contains the content hash, so the browser is allowed to cache it indefinitely
+struct Asset {
+    const char* path;
+    const char* type;
+    const uint8_t* data;
+    size_t size;
+    bool immutable;
+};
 
-void _onHome(AsyncWebServerRequest *request) {
-    if (!_isAPModeRequest(request) && !_authenticateRequest(request)) {
-        _webRequestAuth(request);
-        return;
-    }
+#define WEBUI_ASSET_ENTRY(PATH, TYPE, DATA)\
+    Asset{PATH, TYPE, DATA, std::size(DATA), true},
 
-    if (request->hasHeader(FPSTR(IfModifiedSince))) {
-        const auto value = request->header(FPSTR(IfModifiedSince));
-        if (strncmp_P(value.c_str(), LastModified, value.length()) == 0) {
-            request->send(304);
-            return;
+constexpr Asset Assets[] {
+    Asset{"/index.html", "text/html", webui_image, std::size(webui_image), false},
+    WEBUI_ASSETS(WEBUI_ASSET_ENTRY)
+};
+
+#undef WEBUI_ASSET_ENTRY
+
+alignas(4) static constexpr char IfNoneMatch[] PROGMEM = "If-None-Match";
+alignas(4) static constexpr char IfRange[] PROGMEM = "If-Range";
+alignas(4) static constexpr char Range[] PROGMEM = "Range";
+
+// Content hash (FNV-1a) is only calculated once, when the asset is requested for the first time
+struct Etag {
+    char value[11];
+};
+
+Etag etags[std::size(Assets)] {};
+
+const char* etag(size_t index) {
+    auto& out = etags[index];
+    if (!out.value[0]) {
+        const auto& asset = Assets[index];
+
+        uint32_t hash { 2166136261ul };
+        uint8_t buffer[64];
+        for (size_t offset = 0; offset < asset.size; offset += sizeof(buffer)) {
+            const size_t length = std::min(sizeof(buffer), asset.size - offset);
+            memcpy_P(buffer, asset.data + offset, length);
+            for (size_t byte = 0; byte < length; ++byte) {
+                hash = (hash ^ buffer[byte]) * 16777619ul;
+            }
         }
+
+        snprintf_P(out.value, sizeof(out.value), PSTR("\"%08x\""), static_cast<unsigned int>(hash));
     }
 
+    return out.value;
+}
+
+AsyncWebServerResponse* response(AsyncWebServerRequest* request, const Asset& asset, size_t start, size_t length) {
 #if WEB_SSL_ENABLED
-    // Chunked response, we calculate the chunks based on free heap (in multiples of 32)
+    // Chunks are based on free heap (in multiples of 32)
     // This is necessary when a TLS connection is open since it sucks too much memory
     const size_t max = (systemFreeHeap() / 3) & 0xFFE0;
-    auto* response = request->beginChunkedResponse("text/html", [max](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
-        // Get the chunk based on the index and maxLen
-        size_t len = std::size(webui_image) - index;
-        len = std::min({len, maxLen, max});
+    const uint8_t* data = asset.data + start;
+    return request->beginResponse(asset.type, length, [data, length, max](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+        size_t len = std::min({length - index, maxLen, max});
         if (len > 0) {
-            memcpy_P(buffer, webui_image + index, len);
+            memcpy_P(buffer, data + index, len);
         }
 
         // Return the actual length of the chunk (0 for end of file)
         return len;
     });
 #else
-    auto* response = request->beginResponse_P(200, F("text/html"), webui_image, std::size(webui_image));
+    return request->beginResponse_P(200, asset.type, asset.data + start, length);
 #endif
+}
 
-    response->addHeader(F("Content-Encoding"), F("gzip"));
-    response->addHeader(F("Last-Modified"), FPSTR(LastModified));
-    response->addHeader(F("X-XSS-Protection"), F("1; mode=block"));
-    response->addHeader(F("X-Content-Type-Options"), F("nosniff"));
-    response->addHeader(F("X-Frame-Options"), F("deny"));
+// Not modified response must also carry the same validator and caching policy
+void cache(AsyncWebServerResponse* response, const Asset& asset, const char* tag) {
+    response->addHeader(F("ETag"), tag);
+    response->addHeader(F("Cache-Control"), asset.immutable
+        ? F("public, max-age=31536000, immutable")
+        : F("no-cache"));
+}
 
-    request->send(response);
+void send(AsyncWebServerRequest* request, size_t index) {
+    const auto& asset = Assets[index];
+    const char* tag = etag(index);
+
+    if (request->hasHeader(FPSTR(IfNoneMatch))) {
+        if (request->header(FPSTR(IfNoneMatch)).equals(tag)) {
+            auto* out = request->beginResponse(304);
+            cache(out, asset, tag);
+            request->send(out);
+            return;
+        }
+    }
+
+    // Only a single range is supported, which is enough for the browser to resume the transfer.
+    // Range does not apply when If-Range does not match the current content
+    auto range = espurna::web::range::Range{espurna::web::range::Range::Type::Full, 0, 0};
+    if (request->hasHeader(FPSTR(Range))) {
+        if (!request->hasHeader(FPSTR(IfRange)) || request->header(FPSTR(IfRange)).equals(tag)) {
+            const auto value = request->header(FPSTR(Range));
+            range = espurna::web::range::parse(value.c_str(), value.length(), asset.size);
+        }
+    }
+
+    if (range.type == espurna::web::range::Range::Type::Unsatisfiable) {
+        auto* response = request->beginResponse(416);
+        response->addHeader(F("Content-Range"), String(F("bytes */")) + String(asset.size, 10));
+        request->send(response);
+        return;
+    }
+
+    AsyncWebServerResponse* out;
+    if (range.type == espurna::web::range::Range::Type::Partial) {
+        out = response(request, asset, range.start, range.length());
+        out->setCode(206);
+
+        char buffer[48];
+        snprintf_P(buffer, sizeof(buffer), PSTR("bytes %u-%u/%u"),
+            range.start, range.end, asset.size);
+        out->addHeader(F("Content-Range"), buffer);
+    } else {
+        out = response(request, asset, 0, asset.size);
+    }
+
+    out->addHeader(F("Content-Encoding"), F("gzip"));
+    out->addHeader(F("Accept-Ranges"), F("bytes"));
+    cache(out, asset, tag);
+    out->addHeader(F("X-XSS-Protection"), F("1; mode=block"));
+    out->addHeader(F("X-Content-Type-Options"), F("nosniff"));
+    out->addHeader(F("X-Frame-Options"), F("deny"));
+
+    request->send(out);
 }
+
+void setup(AsyncWebServer& server) {
+    for (size_t index = 0; index < std::size(Assets); ++index) {
+        server.on(Assets[index].path, HTTP_GET, [index](AsyncWebServerRequest* request) {
+            if (!_isAPModeRequest(request) && !_authenticateRequest(request)) {
+                _webRequestAuth(request);
+                return;
+            }
+
+            send(request, index);
+        });
+    }
+}
+
+} // namespace embedded
 #endif
 
 #if WEB_SSL_ENABLED
@@ -662,7 +774,7 @@ void webSetup() {
 
     // Serve home (basic authentication protection is done manually b/c the handler is installed through callback functions)
     #if WEB_EMBEDDED
-        _server->on("/index.html", HTTP_GET, _onHome);
+        embedded::setup(*_server);
     #endif
 
     // Serve static files (not supported, yet)
@@ -12,6 +12,7 @@ Copyright (C) 2021 by Maxim Prokhorov <prokhorov dot max at outlook dot com>
 
 #include "wifi.h"
 
+#include "rtcmem.h"
 #include "telnet.h"
 #include "ws.h"
 
@@ -1104,7 +1105,7 @@ espurna::duration::Milliseconds interval() {
 
 namespace internal {
 
-Ticker timer;
+espurna::timer::SystemTimer timer { "wifi garp" };
 bool wait { false };
 
 } // namespace internal
@@ -1138,11 +1139,11 @@ bool wait() {
 }
 
 void stop() {
-    internal::timer.detach();
+    internal::timer.stop();
 }
 
 void start(espurna::duration::Milliseconds next) {
-    internal::timer.attach_ms(next.count(), []() {
+    internal::timer.repeat(next, []() {
         internal::wait = false;
     });
 }
@@ -1472,6 +1473,10 @@ struct Task {
         return _networks;
     }
 
+    const Network& current() const {
+        return *_current;
+    }
+
 private:
     String _hostname;
 
@@ -1500,7 +1505,7 @@ wifi::Networks preparedNetworks;
 bool connected { false };
 bool wait { false };
 
-Ticker timer;
+espurna::timer::SystemTimer timer { "wifi connect" };
 bool persist { false };
 
 using TaskPtr = std::unique_ptr<Task>;
@@ -1518,16 +1523,16 @@ bool persist() {
 
 void stop() {
     internal::task.reset();
-    internal::timer.detach();
+    internal::timer.stop();
 }
 
-bool start(String&& hostname) {
+bool start(String&& hostname, int retries) {
     if (!internal::task) {
         internal::task = std::make_unique<internal::Task>(
             std::move(hostname),
             std::move(internal::preparedNetworks),
-            build::ConnectionRetries);
-        internal::timer.detach();
+            retries);
+        internal::timer.stop();
         return true;
     }
 
@@ -1536,7 +1541,7 @@ bool start(String&& hostname) {
 }
 
 void schedule(espurna::duration::Milliseconds next, internal::ActionPtr ptr) {
-    internal::timer.once_ms(next.count(), ptr);
+    internal::timer.once(next, ptr);
     DEBUG_MSG_P(PSTR("[WIFI] Next connection attempt in %u (ms)\n"), next.count());
 }
 
@@ -1620,6 +1625,190 @@ bool prepared() {
     return internal::preparedNetworks.size();
 }
 
+// Last successful connection is stored in RTC memory. When it matches one of the configured networks,
+// the first attempt skips the scan and goes directly to the same BSSID and channel.
+// Hint is only used once, failed attempt erases it and the normal connection routine follows
+
+namespace cache {
+namespace build {
+
+constexpr bool enabled() {
+    return 1 == WIFI_FAST_RECONNECT;
+}
+
+constexpr bool lease() {
+    return 1 == WIFI_FAST_RECONNECT_LEASE;
+}
+
+} // namespace build
+
+namespace internal {
+
+bool hinted { false };
+bool leased { false };
+
+} // namespace internal
+
+// FNV-1a, only needs to detect the network configuration changes
+uint32_t hash(const Network& network) {
+    uint32_t out { 2166136261ul };
+
+    auto update = [&](const String& value) {
+        for (auto it = value.begin(); it != value.end(); ++it) {
+            out = (out ^ static_cast<uint8_t>(*it)) * 16777619ul;
+        }
+        out = (out ^ 0xff) * 16777619ul;
+    };
+
+    update(network.ssid());
+    update(network.passphrase());
+
+    return out ? out : 1;
+}
+
+bool available() {
+    return build::enabled()
+        && rtcmemStatus()
+        && (Rtcmem->wifi.hash != 0)
+        && (Rtcmem->wifi.channel > 0)
+        && (Rtcmem->wifi.channel <= 14);
+}
+
+void erase() {
+    Rtcmem->wifi.hash = 0;
+    Rtcmem->wifi.bssid[0] = 0;
+    Rtcmem->wifi.bssid[1] = 0;
+    Rtcmem->wifi.channel = 0;
+    Rtcmem->wifi.ip = 0;
+    Rtcmem->wifi.netmask = 0;
+    Rtcmem->wifi.gateway = 0;
+    Rtcmem->wifi.dns = 0;
+}
+
+Mac bssid() {
+    const uint32_t low = Rtcmem->wifi.bssid[0];
+    const uint32_t high = Rtcmem->wifi.bssid[1];
+
+    return Mac{{
+        static_cast<uint8_t>(low),
+        static_cast<uint8_t>(low >> 8),
+        static_cast<uint8_t>(low >> 16),
+        static_cast<uint8_t>(low >> 24),
+        static_cast<uint8_t>(high),
+        static_cast<uint8_t>(high >> 8)}};
+}
+
+void store(const Network& network, bool dhcp) {
+    if (!build::enabled() || !rtcmemStatus()) {
+        return;
+    }
+
+    station_config config{};
+    wifi_station_get_config(&config);
+
+    ip_info info{};
+    wifi_get_ip_info(STATION_IF, &info);
+
+    Rtcmem->wifi.hash = hash(network);
+    Rtcmem->wifi.bssid[0] = config.bssid[0]
+        | (config.bssid[1] << 8)
+        | (config.bssid[2] << 16)
+        | (static_cast<uint32_t>(config.bssid[3]) << 24);
+    Rtcmem->wifi.bssid[1] = config.bssid[4]
+        | (config.bssid[5] << 8);
+    Rtcmem->wifi.channel = wifi::sta::channel();
+
+    // Static settings are already known, only the DHCP lease is interesting
+    if (dhcp) {
+        Rtcmem->wifi.ip = info.ip.addr;
+        Rtcmem->wifi.netmask = info.netmask.addr;
+        Rtcmem->wifi.gateway = info.gw.addr;
+        Rtcmem->wifi.dns = IPAddress(dns_getserver(0)).v4();
+    } else {
+        Rtcmem->wifi.ip = 0;
+        Rtcmem->wifi.netmask = 0;
+        Rtcmem->wifi.gateway = 0;
+        Rtcmem->wifi.dns = 0;
+    }
+}
+
+// Replace prepared networks with a single hinted one. Networks with BSSID and channel
+// already set in settings are not changed
+bool prepare() {
+    internal::hinted = false;
+    internal::leased = false;
+    if (!available()) {
+        return false;
+    }
+
+    const uint32_t expected = Rtcmem->wifi.hash;
+    for (auto& network : connection::internal::preparedNetworks) {
+        if (network.channel() || (hash(network) != expected)) {
+            continue;
+        }
+
+        IpSettings lease;
+        if (build::lease() && network.dhcp() && Rtcmem->wifi.ip) {
+            lease = IpSettings{
+                IPAddress(Rtcmem->wifi.ip),
+                IPAddress(Rtcmem->wifi.netmask),
+                IPAddress(Rtcmem->wifi.gateway),
+                IPAddress(Rtcmem->wifi.dns)};
+        }
+
+        Network hint(
+            lease
+                ? Network(String(network.ssid()), String(network.passphrase()), std::move(lease))
+                : network,
+            bssid(),
+            Rtcmem->wifi.channel);
+
+        internal::leased = !hint.dhcp() && network.dhcp();
+        internal::hinted = true;
+
+        Networks networks;
+        networks.push_back(std::move(hint));
+        connection::internal::preparedNetworks = std::move(networks);
+
+        return true;
+    }
+
+    return false;
+}
+
+bool hinted() {
+    return internal::hinted;
+}
+
+// Successful connection replaces the stored one
+void success(const Network& network) {
+    store(network, network.dhcp() || internal::leased);
+    internal::hinted = false;
+    internal::leased = false;
+}
+
+// Hint did not work, make sure the next attempt does not use it
+void fail() {
+    if (internal::hinted) {
+        internal::hinted = false;
+        internal::leased = false;
+        erase();
+    }
+}
+
+} // namespace cache
+
+// Hinted network is only tried once
+int retries() {
+    return cache::hinted() ? 0 : build::ConnectionRetries;
+}
+
+void remember() {
+    if (internal::task) {
+        cache::success(internal::task->current());
+    }
+}
+
 } // namespace connection
 
 bool connected() {
@@ -1722,7 +1911,7 @@ namespace internal {
 
 int8_t threshold { build::threshold() };
 int8_t counter { build::Checks };
-Ticker timer;
+espurna::timer::SystemTimer timer { "wifi rssi" };
 
 void task() {
     if (!wifi::sta::connected()) {
@@ -1746,12 +1935,12 @@ void task() {
 
 void start() {
     counter = build::Checks;
-    timer.attach_ms(build::Interval.count(), task);
+    timer.repeat(build::Interval, task);
 }
 
 void stop() {
     counter = build::Checks;
-    timer.detach();
+    timer.stop();
 }
 
 } // namespace internal
@@ -2088,7 +2277,7 @@ namespace internal {
 
 auto timeout = build::Timeout;
 bool enabled { false };
-Ticker timer;
+espurna::timer::SystemTimer timer { "wifi fallback" };
 
 } // namespace internal
 
@@ -2105,13 +2294,13 @@ bool enabled() {
 }
 
 void remove() {
-    internal::timer.detach();
+    internal::timer.stop();
 }
 
 void check();
 
 void schedule() {
-    internal::timer.once_ms(internal::timeout.count(), check);
+    internal::timer.once(internal::timeout, check);
 }
 
 void check() {
@@ -2701,6 +2890,11 @@ void loop() {
         }
 
         wifi::sta::scan::periodic::stop();
+        if (wifi::sta::connection::cache::prepare()) {
+            state = State::Connect;
+            break;
+        }
+
         if (wifi::sta::scan::settings::enabled()) {
             if (wifi::sta::scanning()) {
                 break;
@@ -2767,7 +2961,7 @@ void loop() {
 
     case State::Connect: {
         if (!wifi::sta::connecting()) {
-            if (!wifi::sta::connection::start(getHostname())) {
+            if (!wifi::sta::connection::start(getHostname(), wifi::sta::connection::retries())) {
                 state = State::Timeout;
                 break;
             }
@@ -2802,6 +2996,10 @@ void loop() {
             state = State::Idle;
             wifi::sta::connection::schedule_next();
             publish(wifi::Event::StationTimeout);
+        } else if (wifi::sta::connection::cache::hinted()) {
+            wifi::sta::connection::cache::fail();
+            wifi::sta::connection::stop();
+            state = State::Init;
         } else {
             wifi::sta::connection::stop();
             state = State::Fallback;
@@ -2809,6 +3007,7 @@ void loop() {
         break;
 
     case State::Connected:
+        wifi::sta::connection::remember();
         wifi::sta::connection::stop();
         if (wifi::sta::scan::settings::enabled()) {
             wifi::sta::scan::periodic::start();
@@ -220,6 +220,7 @@ ws_callbacks_t _ws_callbacks;
 
 void wsPost(uint32_t client_id, ws_on_send_callback_f&& cb) {
     _ws_queue.emplace(client_id, std::move(cb));
+    espurnaLoopWake();
 }
 
 void wsPost(ws_on_send_callback_f&& cb) {
@@ -228,6 +229,7 @@ void wsPost(ws_on_send_callback_f&& cb) {
 
 void wsPost(uint32_t client_id, const ws_on_send_callback_f& cb) {
     _ws_queue.emplace(client_id, cb);
+    espurnaLoopWake();
 }
 
 void wsPost(const ws_on_send_callback_f& cb) {
@@ -239,6 +241,7 @@ namespace {
 template <typename T>
 void _wsPostCallbacks(uint32_t client_id, T&& cbs, WsPostponedCallbacks::Mode mode) {
     _ws_queue.emplace(client_id, std::forward<T>(cbs), mode);
+    espurnaLoopWake();
 }
 
 } // namespace
@@ -528,8 +531,8 @@ void _wsParse(AsyncWebSocketClient *client, uint8_t * payload, size_t length) {
         }
 
         if (strcmp(action, "reconnect") == 0) {
-            static Ticker timer;
-            timer.once_ms_scheduled(100, []() {
+            static espurna::timer::SystemTimer timer { "ws reconnect" };
+            timer.once(espurna::duration::Milliseconds(100), []() {
                 wifiDisconnect();
                 yield();
             });
@@ -750,6 +753,12 @@ void _wsLoop() {
     const bool connected = wsConnected();
     _wsDoUpdate(connected);
     _wsHandlePostponedCallbacks(connected);
+
+    // only one message is sent per loop, don't wait for too long until the next one
+    if (!_ws_queue.empty()) {
+        espurnaLoopDeadline(espurna::duration::Milliseconds::zero());
+    }
+
     #if DEBUG_WEB_SUPPORT
         _ws_debug.send(connected);
     #endif
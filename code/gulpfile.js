@@ -26,7 +26,10 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 // Dependencies
 // -----------------------------------------------------------------------------
 
+const crypto = require('crypto');
+const fs = require('fs');
 const path = require('path');
+const zlib = require('zlib');
 
 const gulp = require('gulp');
 const through = require('through2');
@@ -65,7 +68,21 @@ var toMinifiedHtml = function(options) {
     });
 }
 
-var toHeader = function(name, debug) {
+var toArray = function(name, contents) {
+    var output = '';
+    output += 'alignas(4) static constexpr uint8_t ' + name + '[] PROGMEM = {';
+    for (var i=0; i<contents.length; i++) {
+        if (i > 0) { output += ','; }
+        if (0 === (i % 20)) { output += '\n'; }
+        output += '0x' + ('00' + contents[i].toString(16)).slice(-2);
+    }
+    output += '\n};';
+
+    return output;
+}
+
+// Optional list of assets is appended to the header, see web.cpp
+var toHeader = function(name, debug, assets) {
 
     return through.obj(function (source, encoding, callback) {
 
@@ -74,14 +91,16 @@ var toHeader = function(name, debug) {
         var safename = name || filename.split('.').join('_');
 
         // Generate output
-        var output = '';
-        output += 'alignas(4) static constexpr uint8_t ' + safename + '[] PROGMEM = {';
-        for (var i=0; i<source.contents.length; i++) {
-            if (i > 0) { output += ','; }
-            if (0 === (i % 20)) { output += '\n'; }
-            output += '0x' + ('00' + source.contents[i].toString(16)).slice(-2);
+        var output = toArray(safename, source.contents);
+
+        if (assets && assets.length) {
+            var entries = '';
+            for (const asset of assets) {
+                output += '\n\n' + toArray(asset.name, asset.contents);
+                entries += '\\\n    X("' + asset.path + '", "' + asset.type + '", ' + asset.name + ')';
+            }
+            output += '\n\n#define WEBUI_ASSETS(X)' + entries + '\n';
         }
-        output += '\n};';
 
         // clone the contents
         var destination = source.clone();
@@ -90,6 +109,9 @@ var toHeader = function(name, debug) {
 
         if (debug) {
             console.info('Image ' + filename + ' \tsize: ' + source.contents.length + ' bytes');
+            for (const asset of (assets || [])) {
+                console.info('Asset ' + asset.path + ' \tsize: ' + asset.contents.length + ' bytes');
+            }
         }
 
         callback(null, destination);
@@ -98,6 +120,54 @@ var toHeader = function(name, debug) {
 
 };
 
+// Vendored libs marked with `data-asset` are not inlined, but served as separate files instead.
+// Since they rarely change, browser is able to cache them indefinitely using the content hash as the file name.
+// Gzipped files are also written to the data folder, next to the index.html.gz
+var assetTypes = {
+    '.css': 'text/css',
+    '.js': 'application/javascript'
+};
+
+var assetCollector = function(assets) {
+    const re = /<(link|script)([^>]*?)(href|src)="([^"]+)"([^>]*?)\sdata-asset([^>]*)>/g;
+
+    return through.obj(function (source, _, callback) {
+        if (source.isNull()) {
+            callback(null, source);
+            return;
+        }
+
+        var contents = source.contents.toString();
+        contents = contents.replace(re, function(_, tag, before, attr, href, middle, after) {
+            const extension = path.extname(href);
+
+            var data = fs.readFileSync(htmlFolder + href).toString();
+            if ('.css' === extension) {
+                data = data.split('pure-').join('p-');
+            }
+
+            const compressed = zlib.gzipSync(Buffer.from(data), {level: 9});
+            const hash = crypto.createHash('sha256').
+                update(compressed).digest('hex').slice(0, 8);
+
+            // filesystem copy of the index.html references the same files, served as-is by the serveStatic()
+            fs.writeFileSync(dataFolder + hash + extension + '.gz', compressed);
+
+            assets.push({
+                name: 'webui_asset_' + hash,
+                path: '/' + hash + extension,
+                type: assetTypes[extension],
+                contents: compressed
+            });
+
+            return '<' + tag + before + attr + '="/' + hash + extension + '"' + middle + after + '>';
+        });
+
+        source.contents = Buffer.from(contents);
+        callback(null, source);
+    });
+}
+
 // TODO: this is a roughly equivalent port of the gulp-remove-code,
 // which also uses regexp rules to filter in-between specially-formatted comment blocks
 
@@ -227,8 +297,11 @@ var buildWebUI = function(module) {
         modules[module] = true;
     }
 
+    var assets = [];
+
     return gulp.src(htmlFolder + '*.html').
         pipe(htmlRemover(modules)).
+        pipe(assetCollector(assets)).
         pipe(inline({handlers: [inlineHandler(modules)]})).
         pipe(toMinifiedHtml({
             collapseWhitespace: true,
@@ -240,7 +313,7 @@ var buildWebUI = function(module) {
         pipe(gzip({ gzipOptions: { level: 9 } })).
         pipe(rename('index.' + module + '.html.gz')).
         pipe(gulp.dest(dataFolder)).
-        pipe(toHeader('webui_image', true)).
+        pipe(toHeader('webui_image', true, assets)).
         pipe(gulp.dest(staticFolder));
 
 };
@@ -1485,6 +1485,23 @@ function rfm69AddMessage(message) {
     }
 }
 
+function loopProfileUpdate(value) {
+    let [body] = document.getElementById("loop-profile").tBodies;
+    while (body.rows.length) {
+        body.deleteRow(0);
+    }
+
+    for (let entry of [...value.callbacks, ["loop", ...value.loop]]) {
+        let row = body.insertRow();
+        for (let cell of entry) {
+            row.insertCell().appendChild(document.createTextNode(cell));
+        }
+    }
+
+    initGenericKeyValueElement("loopProfileStatus", value.enabled ? "Running" : "Stopped");
+    initGenericKeyValueElement("loopProfileBudget", value.budget);
+}
+
 function rfm69ClearCounters() {
     sendAction("rfm69Clear");
     return false;
@@ -2486,6 +2503,15 @@ function processData(data) {
 
         //endRemoveIf(!rfm69)
 
+        // ---------------------------------------------------------------------
+        // Loop profiler
+        // ---------------------------------------------------------------------
+
+        if ("loopProfile" === key) {
+            loopProfileUpdate(value);
+            return;
+        }
+
         // ---------------------------------------------------------------------
         // RPN Rules
         // ---------------------------------------------------------------------
@@ -3012,6 +3038,16 @@ function main() {
 
     elementSelectorOnClick(".password-reveal", toggleVisiblePassword);
 
+    elementSelectorOnClick(".button-loop-profile-start", () => {
+        sendAction("loopProfileStart");
+    });
+    elementSelectorOnClick(".button-loop-profile-stop", () => {
+        sendAction("loopProfileStop");
+    });
+    elementSelectorOnClick(".button-loop-profile-reset", () => {
+        sendAction("loopProfileReset");
+    });
+
     elementSelectorOnClick(".button-dbg-clear", (event) => {
         event.preventDefault();
         CmdOutput.clear();
@@ -0,0 +1,177 @@
+#!/usr/bin/env python3
+
+# Render deferred debug log messages (DEBUG_LOG_DEFERRED), using the format strings from the firmware .elf
+# Every other line is printed as-is
+#
+# $ pio device monitor | python scripts/log_decoder.py .pio/build/<env>/firmware.elf
+# $ python scripts/log_decoder.py .pio/build/<env>/firmware.elf serial.log
+
+import argparse
+import base64
+import binascii
+import re
+import struct
+import sys
+
+MARKER = "\x1e"
+HEADER = struct.Struct("<IBx")
+FLAG_TIMESTAMP = 1
+
+# ESP8266 is ILP32, both `long` and `size_t` are 4 bytes
+ARGUMENT_SIZES = {
+    "": 4,
+    "hh": 4,
+    "h": 4,
+    "l": 4,
+    "ll": 8,
+    "j": 8,
+    "z": 4,
+    "t": 4,
+}
+
+SPEC_RE = re.compile(
+    r"%(?P<flags>[-+ #0]*)(?P<width>\*|\d+)?(?:\.(?P<precision>\*|\d*))?"
+    r"(?P<length>hh|h|ll|l|j|z|t)?(?P<conversion>[diuxXocfFeEgGaAsp%])"
+)
+
+
+class Elf:
+    """Minimal ELF32 reader, only enough to read strings at the given address"""
+
+    def __init__(self, path):
+        with open(path, "rb") as f:
+            self.data = f.read()
+
+        if self.data[:4] != b"\x7fELF" or self.data[4] != 1:
+            raise ValueError(f"{path} is not an ELF32 file")
+
+        (shoff,) = struct.unpack_from("<I", self.data, 0x20)
+        shentsize, shnum = struct.unpack_from("<HH", self.data, 0x2E)
+
+        SHT_NOBITS = 8
+
+        self.sections = []
+        for index in range(shnum):
+            _, sh_type, _, addr, offset, size = struct.unpack_from(
+                "<IIIIII", self.data, shoff + index * shentsize
+            )
+            if addr and size and sh_type != SHT_NOBITS:
+                self.sections.append((addr, offset, size))
+
+    def string(self, address):
+        for addr, offset, size in self.sections:
+            if addr <= address < addr + size:
+                begin = offset + (address - addr)
+                end = self.data.index(b"\0", begin, offset + size)
+                return self.data[begin:end].decode("utf-8", errors="replace")
+
+        raise KeyError(f"no string at 0x{address:08x}")
+
+
+class Payload:
+    def __init__(self, data):
+        self.data = data
+        self.offset = 0
+
+    def unpack(self, fmt):
+        (value,) = struct.unpack_from(fmt, self.data, self.offset)
+        self.offset += struct.calcsize(fmt)
+        return value
+
+    def string(self):
+        end = self.data.index(b"\0", self.offset)
+        out = self.data[self.offset : end].decode("utf-8", errors="replace")
+        self.offset = end + 1
+        return out
+
+
+def integer(payload, size, signed):
+    fmt = {4: "<i", 8: "<q"}[size]
+    if not signed:
+        fmt = fmt.upper()
+    return payload.unpack(fmt)
+
+
+def render(fmt, payload):
+    def replace(match):
+        spec = match.group(0)
+        conversion = match.group("conversion")
+        if conversion == "%":
+            return "%"
+
+        stars = []
+        for star in ("width", "precision"):
+            if match.group(star) == "*":
+                stars.append(payload.unpack("<i"))
+
+        # python % formatting does not know about length modifiers
+        length = match.group("length") or ""
+        spec = spec.replace(length + conversion, conversion, 1)
+
+        if conversion in "di":
+            value = integer(payload, ARGUMENT_SIZES[length], True)
+        elif conversion in "uxXo":
+            value = integer(payload, ARGUMENT_SIZES[length], False)
+            spec = spec[:-1] + ("d" if conversion == "u" else conversion)
+        elif conversion == "c":
+            value = chr(integer(payload, ARGUMENT_SIZES[length], False) & 0xFF)
+        elif conversion in "fFeEgG":
+            value = payload.unpack("<d")
+        elif conversion in "aA":
+            value = payload.unpack("<d").hex()
+            spec = spec[:-1] + "s"
+        elif conversion == "s":
+            value = payload.string()
+        elif conversion == "p":
+            value = f"0x{payload.unpack('<I'):x}"
+            spec = spec[:-1] + "s"
+
+        return spec % (*stars, value)
+
+    return SPEC_RE.sub(replace, fmt)
+
+
+def decode(elf, encoded):
+    data = base64.b64decode(encoded)
+    timestamp, flags = HEADER.unpack_from(data)
+
+    payload = Payload(data[HEADER.size :])
+    fmt = elf.string(payload.unpack("<I"))
+
+    prefix = ""
+    if flags & FLAG_TIMESTAMP:
+        prefix = f"[{timestamp % 1000000:06d}] "
+
+    return prefix + render(fmt, payload)
+
+
+def decode_lines(elf, lines, output):
+    for line in lines:
+        marker = line.find(MARKER)
+        if marker < 0:
+            output.write(line)
+            continue
+
+        output.write(line[:marker])
+
+        encoded = line[marker + 1 :].strip()
+        try:
+            output.write(decode(elf, encoded))
+        except (binascii.Error, struct.error, KeyError, ValueError, TypeError) as e:
+            output.write(f"<undecoded {encoded} ({e})>\n")
+
+        output.flush()
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser()
+    parser.add_argument("firmware_elf")
+    parser.add_argument(
+        "log",
+        nargs="?",
+        type=argparse.FileType("r", errors="replace"),
+        default=sys.stdin,
+    )
+
+    args = parser.parse_args()
+    decode_lines(Elf(args.firmware_elf), args.log, sys.stdout)
@@ -0,0 +1,205 @@
+#include <Arduino.h>
+#include <unity.h>
+
+#pragma GCC diagnostic warning "-Wall"
+#pragma GCC diagnostic warning "-Wextra"
+#pragma GCC diagnostic warning "-Wstrict-aliasing"
+#pragma GCC diagnostic warning "-Wpointer-arith"
+#pragma GCC diagnostic warning "-Wstrict-overflow=5"
+
+#include <libs/DeferredFormat.h>
+
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+namespace espurna {
+namespace debug {
+namespace deferred {
+namespace test {
+namespace {
+
+struct Encoded {
+    uint8_t data[128];
+    Result result;
+};
+
+Encoded encode(const char* format, ...) {
+    Encoded out;
+
+    va_list args;
+    va_start(args, format);
+    out.result = deferred::encode(out.data, sizeof(out.data), format, args);
+    va_end(args);
+
+    return out;
+}
+
+std::string expected(const char* format, ...) {
+    char buffer[256];
+
+    va_list args;
+    va_start(args, format);
+    std::vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+
+    return buffer;
+}
+
+std::string render(const Encoded& encoded) {
+    char buffer[256];
+    const auto len = deferred::render(buffer, sizeof(buffer), encoded.data, encoded.result.size);
+    TEST_ASSERT_GREATER_OR_EQUAL(0, len);
+
+    return buffer;
+}
+
+#define TEST_DEFERRED(FORMAT, ...)\
+    {\
+        const auto encoded = encode(FORMAT, ##__VA_ARGS__);\
+        TEST_ASSERT_TRUE(encoded.result);\
+        TEST_ASSERT_EQUAL_STRING(expected(FORMAT, ##__VA_ARGS__).c_str(), render(encoded).c_str());\
+    }
+
+} // namespace
+
+void test_parse() {
+    auto spec = parse("%d");
+    TEST_ASSERT_EQUAL(2, spec.length);
+    TEST_ASSERT_EQUAL(0, spec.stars);
+    TEST_ASSERT(Argument::Int == spec.argument);
+
+    spec = parse("%-08.3lld tail");
+    TEST_ASSERT_EQUAL(9, spec.length);
+    TEST_ASSERT(Argument::LongLong == spec.argument);
+
+    spec = parse("%*.*f");
+    TEST_ASSERT_EQUAL(5, spec.length);
+    TEST_ASSERT_EQUAL(2, spec.stars);
+    TEST_ASSERT(Argument::Double == spec.argument);
+
+    spec = parse("%hhu");
+    TEST_ASSERT(Argument::Int == spec.argument);
+
+    spec = parse("%zu");
+    TEST_ASSERT(Argument::Size == spec.argument);
+
+    spec = parse("%lu");
+    TEST_ASSERT(Argument::Long == spec.argument);
+
+    spec = parse("%%");
+    TEST_ASSERT_EQUAL(2, spec.length);
+    TEST_ASSERT(Argument::None == spec.argument);
+
+    TEST_ASSERT(Argument::Invalid == parse("%n").argument);
+    TEST_ASSERT(Argument::Invalid == parse("%Lf").argument);
+    TEST_ASSERT(Argument::Invalid == parse("%ls").argument);
+    TEST_ASSERT(Argument::Invalid == parse("%").argument);
+    TEST_ASSERT(Argument::Invalid == parse("%000000000000000000d").argument);
+}
+
+void test_render() {
+    TEST_DEFERRED("plain text\n");
+    TEST_DEFERRED("[MAIN] Uptime: %s\n", "1d 2h 3m");
+    TEST_DEFERRED("[MAIN] Heap: initial %5lu available %5lu contiguous %5lu\n",
+        40000ul, 30000ul, 20000ul);
+    TEST_DEFERRED("%d%% %u %x %X %o %c", -5, 10u, 0xbeefu, 0xcafeu, 8u, 'z');
+    TEST_DEFERRED("%hhu %hd %zu %lld %llu", 255, -300, size_t(1234), -123456789012ll, 9876543210ull);
+    TEST_DEFERRED("%.3f %8.2e %g %-6s|", 3.14159, 12345.678, 0.5, "ab");
+    TEST_DEFERRED("%*d|%-*.*s|", 6, 42, 8, 3, "truncated");
+    TEST_DEFERRED("%p", reinterpret_cast<void*>(0x3ffe1234));
+    TEST_DEFERRED("%s and %s", "", "(empty)");
+}
+
+// Strings are copied, so they can go away after the message is stored
+void test_strings_copied() {
+    char temporary[16];
+    std::strcpy(temporary, "value");
+
+    const auto encoded = encode("%s=%d\n", temporary, 5);
+    std::strcpy(temporary, "XXXXX");
+
+    TEST_ASSERT_EQUAL_STRING("value=5\n", render(encoded).c_str());
+
+    const auto null = encode("%s", static_cast<const char*>(nullptr));
+    TEST_ASSERT_EQUAL_STRING("(null)", render(null).c_str());
+}
+
+void test_line() {
+    TEST_ASSERT_TRUE(encode("line\n").result.line);
+    TEST_ASSERT_TRUE(encode("%s", "line\r").result.line);
+    TEST_ASSERT_FALSE(encode("no line").result.line);
+    TEST_ASSERT_FALSE(encode("%s", "").result.line);
+    TEST_ASSERT_FALSE(encode("%d", 10).result.line);
+}
+
+void test_unsupported() {
+    TEST_ASSERT_FALSE(encode("%n", nullptr).result);
+    TEST_ASSERT_FALSE(encode("%Lf", 1.0l).result);
+
+    // does not fit into the payload
+    const std::string large(200, 'x');
+    TEST_ASSERT_FALSE(encode("%s", large.c_str()).result);
+}
+
+// Output is truncated exactly like vsnprintf, and the full length is returned
+void test_truncated() {
+    const auto encoded = encode("%s %d %s", "first", 12345, "second");
+    TEST_ASSERT_TRUE(encoded.result);
+
+    char buffer[10];
+    const auto len = deferred::render(buffer, sizeof(buffer), encoded.data, encoded.result.size);
+    TEST_ASSERT_EQUAL(18, len);
+    TEST_ASSERT_EQUAL_STRING("first 123", buffer);
+
+    TEST_ASSERT_EQUAL(18, deferred::render(nullptr, 0, encoded.data, encoded.result.size));
+}
+
+void test_malformed() {
+    const auto encoded = encode("%d %s", 1, "string");
+    TEST_ASSERT_TRUE(encoded.result);
+
+    char buffer[32];
+    TEST_ASSERT_EQUAL(-1, deferred::render(buffer, sizeof(buffer), encoded.data, 2));
+    TEST_ASSERT_EQUAL(-1, deferred::render(buffer, sizeof(buffer), encoded.data, encoded.result.size - 1));
+}
+
+void test_base64() {
+    const auto encode = [](const char* data) {
+        std::string out;
+        base64(reinterpret_cast<const uint8_t*>(data), std::strlen(data),
+            [&](const char* chunk, size_t length) {
+                out.append(chunk, length);
+            });
+
+        TEST_ASSERT_EQUAL(base64Length(std::strlen(data)), out.size());
+        return out;
+    };
+
+    TEST_ASSERT_EQUAL_STRING("", encode("").c_str());
+    TEST_ASSERT_EQUAL_STRING("Zg==", encode("f").c_str());
+    TEST_ASSERT_EQUAL_STRING("Zm8=", encode("fo").c_str());
+    TEST_ASSERT_EQUAL_STRING("Zm9v", encode("foo").c_str());
+    TEST_ASSERT_EQUAL_STRING("Zm9vYmFy", encode("foobar").c_str());
+}
+
+} // namespace test
+} // namespace deferred
+} // namespace debug
+} // namespace espurna
+
+int main(int, char**) {
+    using namespace espurna::debug::deferred::test;
+
+    UNITY_BEGIN();
+    RUN_TEST(test_parse);
+    RUN_TEST(test_render);
+    RUN_TEST(test_strings_copied);
+    RUN_TEST(test_line);
+    RUN_TEST(test_unsupported);
+    RUN_TEST(test_truncated);
+    RUN_TEST(test_malformed);
+    RUN_TEST(test_base64);
+    return UNITY_END();
+}
@@ -0,0 +1,173 @@
+#include <Arduino.h>
+#include <unity.h>
+
+#pragma GCC diagnostic warning "-Wall"
+#pragma GCC diagnostic warning "-Wextra"
+#pragma GCC diagnostic warning "-Wstrict-aliasing"
+#pragma GCC diagnostic warning "-Wpointer-arith"
+#pragma GCC diagnostic warning "-Wstrict-overflow=5"
+
+#include <libs/EdgeRing.h>
+
+#include <vector>
+
+using espurna::edge::Debounce;
+using espurna::edge::Ring;
+
+void test_push_pop() {
+    Ring<4> ring;
+    TEST_ASSERT_EQUAL(0, ring.size());
+
+    uint32_t out;
+    TEST_ASSERT_FALSE(ring.pop(out));
+
+    TEST_ASSERT(ring.push(10));
+    TEST_ASSERT(ring.push(20));
+    TEST_ASSERT_EQUAL(2, ring.size());
+
+    TEST_ASSERT(ring.pop(out));
+    TEST_ASSERT_EQUAL(10, out);
+    TEST_ASSERT(ring.pop(out));
+    TEST_ASSERT_EQUAL(20, out);
+    TEST_ASSERT_FALSE(ring.pop(out));
+}
+
+void test_overflow() {
+    Ring<4> ring;
+
+    for (uint32_t value = 0; value < 4; ++value) {
+        TEST_ASSERT(ring.push(value));
+    }
+
+    // every slot is used, the rest of the edges are counted and dropped
+    TEST_ASSERT_FALSE(ring.push(100));
+    TEST_ASSERT_FALSE(ring.push(200));
+    TEST_ASSERT_EQUAL(2, ring.overflows());
+    TEST_ASSERT_EQUAL(4, ring.size());
+
+    std::vector<uint32_t> values;
+    ring.drain([&](uint32_t value) {
+        values.push_back(value);
+    });
+
+    TEST_ASSERT_EQUAL(4, values.size());
+    TEST_ASSERT_EQUAL(0, values.front());
+    TEST_ASSERT_EQUAL(3, values.back());
+
+    TEST_ASSERT(ring.push(300));
+    TEST_ASSERT_EQUAL(2, ring.overflows());
+}
+
+void test_wraparound() {
+    Ring<8> ring;
+
+    uint32_t expected { 0 };
+    uint32_t next { 0 };
+    for (size_t round = 0; round < 1000; ++round) {
+        for (size_t index = 0; index < (round % 8) + 1; ++index) {
+            TEST_ASSERT(ring.push(next++));
+        }
+
+        ring.drain([&](uint32_t value) {
+            TEST_ASSERT_EQUAL(expected++, value);
+        });
+    }
+
+    TEST_ASSERT_EQUAL(next, expected);
+    TEST_ASSERT_EQUAL(0, ring.overflows());
+}
+
+void test_clear() {
+    Ring<4> ring;
+    ring.push(1);
+    ring.push(2);
+    ring.clear();
+    TEST_ASSERT_EQUAL(0, ring.size());
+
+    uint32_t out;
+    TEST_ASSERT_FALSE(ring.pop(out));
+}
+
+void test_debounce() {
+    Debounce debounce(100);
+
+    // contact bounces, only the first edge of every burst is accepted
+    const uint32_t edges[] {1000, 1010, 1050, 1099, 2000, 2001, 2100, 2101, 3500};
+    std::vector<uint32_t> accepted;
+    std::vector<uint32_t> intervals;
+
+    for (auto edge : edges) {
+        if (debounce.accept(edge)) {
+            accepted.push_back(edge);
+            intervals.push_back(debounce.interval());
+        }
+    }
+
+    const std::vector<uint32_t> expected {1000, 2000, 2101, 3500};
+    TEST_ASSERT_EQUAL(expected.size(), accepted.size());
+    TEST_ASSERT_EQUAL_UINT32_ARRAY(expected.data(), accepted.data(), expected.size());
+
+    const std::vector<uint32_t> expected_intervals {0, 1000, 101, 1399};
+    TEST_ASSERT_EQUAL_UINT32_ARRAY(expected_intervals.data(), intervals.data(), expected_intervals.size());
+}
+
+void test_debounce_overflow() {
+    // cycle counter overflows between the edges
+    Debounce debounce(100);
+    TEST_ASSERT(debounce.accept(0xffffff00));
+    TEST_ASSERT_FALSE(debounce.accept(0xffffff50));
+    TEST_ASSERT_FALSE(debounce.accept(0xffffff64));
+    TEST_ASSERT(debounce.accept(0x00000010));
+    TEST_ASSERT_EQUAL(0x110, debounce.interval());
+}
+
+void test_debounce_long_interval() {
+    // 160MHz, edges are ~134W apart at 1000imp/kWh (26.87s), just over the counter period
+    constexpr uint64_t Cycles { 160000000ull * 26866ull / 1000ull };
+    static_assert(Cycles > Debounce::Period, "");
+
+    // loop-side time is coarse and also late by a couple of ms
+    constexpr uint64_t Latency { 160000ull * 3ull };
+
+    Debounce debounce(100);
+    TEST_ASSERT(debounce.accept(0x1000, 0));
+
+    const auto timestamp = static_cast<uint32_t>(0x1000 + Cycles);
+    TEST_ASSERT(debounce.accept(timestamp, Cycles + Latency));
+    TEST_ASSERT(debounce.interval() == Cycles);
+
+    // several periods apart, loop-side time is early
+    const uint64_t longer { (Debounce::Period * 5) + 12345 };
+    TEST_ASSERT(debounce.accept(static_cast<uint32_t>(timestamp + longer), longer - Latency));
+    TEST_ASSERT(debounce.interval() == longer);
+
+    // without the loop-side time, only the remainder is known
+    Debounce wrapped(100);
+    TEST_ASSERT(wrapped.accept(0x1000));
+    TEST_ASSERT(wrapped.accept(timestamp));
+    TEST_ASSERT(wrapped.interval() == (Cycles - Debounce::Period));
+}
+
+void test_debounce_exact_period() {
+    // exactly one period apart is not a bounce, when the loop-side time says so
+    Debounce debounce(100);
+    TEST_ASSERT(debounce.accept(0x1000, 0));
+    TEST_ASSERT(debounce.accept(0x1010, Debounce::Period));
+    TEST_ASSERT(debounce.interval() == (Debounce::Period + 0x10));
+
+    // but is when edges were drained at the same time
+    TEST_ASSERT_FALSE(debounce.accept(0x1020, 0));
+}
+
+int main(int, char**) {
+    UNITY_BEGIN();
+    RUN_TEST(test_push_pop);
+    RUN_TEST(test_overflow);
+    RUN_TEST(test_wraparound);
+    RUN_TEST(test_clear);
+    RUN_TEST(test_debounce);
+    RUN_TEST(test_debounce_overflow);
+    RUN_TEST(test_debounce_long_interval);
+    RUN_TEST(test_debounce_exact_period);
+    return UNITY_END();
+}
@@ -0,0 +1,358 @@
+#include <Arduino.h>
+#include <unity.h>
+
+#pragma GCC diagnostic warning "-Wall"
+#pragma GCC diagnostic warning "-Wextra"
+#pragma GCC diagnostic warning "-Wstrict-aliasing"
+#pragma GCC diagnostic warning "-Wpointer-arith"
+#pragma GCC diagnostic warning "-Wstrict-overflow=5"
+
+#include <libs/FrameParser.h>
+
+#include <algorithm>
+#include <vector>
+
+namespace espurna {
+namespace frame {
+namespace test {
+
+// Replays the recorded bytes, no more than `chunk` at a time (like the hardware fifo would)
+struct RecordedStream {
+    RecordedStream(std::vector<uint8_t> data, size_t chunk) :
+        _data(std::move(data)),
+        _chunk(chunk)
+    {}
+
+    int available() {
+        const auto left = _data.size() - _offset;
+        return static_cast<int>(std::min(left, _chunk));
+    }
+
+    size_t readBytes(uint8_t* out, size_t size) {
+        size = std::min(size, _data.size() - _offset);
+        std::copy(_data.begin() + _offset, _data.begin() + _offset + size, out);
+        _offset += size;
+        ++reads;
+        return size;
+    }
+
+    std::vector<uint8_t> _data;
+    size_t _chunk;
+    size_t _offset { 0 };
+    size_t reads { 0 };
+};
+
+// CSE7766, first byte is the calibration status, second byte is always 0x5A
+bool cse7766_check(const uint8_t* frame, size_t length) {
+    return ((frame[0] == 0x55) || (frame[0] == 0xAA) || (frame[0] >= 0xF0))
+        && checksum::sum8<2, 23>(frame, length);
+}
+
+constexpr uint8_t Cse7766HeaderBytes[] { 0x00, 0x5A };
+constexpr uint8_t Cse7766HeaderMask[] { 0x00, 0xff };
+
+const Spec Cse7766 {
+    .header = {
+        .bytes = Cse7766HeaderBytes,
+        .mask = Cse7766HeaderMask,
+        .size = sizeof(Cse7766HeaderBytes),
+    },
+    .length = 24,
+    .frame_length = nullptr,
+    .check = cse7766_check,
+};
+
+const std::vector<uint8_t> Cse7766Frame {
+    0x55, 0x5A, 0x02, 0xE9, 0x50, 0x00, 0x03, 0x31,
+    0x00, 0x3E, 0x9E, 0x00, 0x0D, 0x30, 0x4F, 0x44,
+    0xF8, 0x00, 0x12, 0x65, 0xF1, 0x81, 0x76, 0x72};
+
+// SDS011, fixed header and tail, sum of data bytes
+bool sds011_check(const uint8_t* frame, size_t length) {
+    return (frame[length - 1] == 0xAB)
+        && checksum::sum8<2, 8>(frame, length);
+}
+
+constexpr uint8_t Sds011HeaderBytes[] { 0xAA, 0xC0 };
+
+const Spec Sds011 {
+    .header = {
+        .bytes = Sds011HeaderBytes,
+        .mask = nullptr,
+        .size = sizeof(Sds011HeaderBytes),
+    },
+    .length = 10,
+    .frame_length = nullptr,
+    .check = sds011_check,
+};
+
+const std::vector<uint8_t> Sds011Frame {
+    0xAA, 0xC0, 0xD4, 0x04, 0x3A, 0x0A, 0xA1, 0x60, 0x1D, 0xAB};
+
+// PM1006, every byte adds up to zero
+constexpr uint8_t Pm1006HeaderBytes[] { 0x16, 0x11, 0x0B };
+
+const Spec Pm1006 {
+    .header = {
+        .bytes = Pm1006HeaderBytes,
+        .mask = nullptr,
+        .size = sizeof(Pm1006HeaderBytes),
+    },
+    .length = 20,
+    .frame_length = nullptr,
+    .check = checksum::sum8_zero,
+};
+
+const std::vector<uint8_t> Pm1006Frame {
+    0x16, 0x11, 0x0B, 0x00, 0x00, 0x00, 0x1C, 0x00, 0x00, 0x01,
+    0x9B, 0x00, 0x00, 0x00, 0x18, 0x01, 0x00, 0x00, 0x00, 0xFD};
+
+// PMSX003, variable length with the big-endian payload size right after the header
+size_t pms_length(const uint8_t* frame) {
+    return ((frame[2] << 8) | frame[3]) + 4;
+}
+
+constexpr uint8_t PmsHeaderBytes[] { 0x42, 0x4D };
+
+const Spec Pms {
+    .header = {
+        .bytes = PmsHeaderBytes,
+        .mask = nullptr,
+        .size = sizeof(PmsHeaderBytes),
+    },
+    .length = 4,
+    .frame_length = pms_length,
+    .check = checksum::sum16_be,
+};
+
+std::vector<uint8_t> pms_frame(const std::vector<uint16_t>& values) {
+    std::vector<uint8_t> out {0x42, 0x4D};
+
+    const uint16_t length = (values.size() + 1) * 2;
+    out.push_back(length >> 8);
+    out.push_back(length & 0xff);
+
+    for (auto value : values) {
+        out.push_back(value >> 8);
+        out.push_back(value & 0xff);
+    }
+
+    uint16_t sum { 0 };
+    for (auto byte : out) {
+        sum += byte;
+    }
+
+    out.push_back(sum >> 8);
+    out.push_back(sum & 0xff);
+
+    return out;
+}
+
+std::vector<uint8_t> join(std::initializer_list<std::vector<uint8_t>> parts) {
+    std::vector<uint8_t> out;
+    for (const auto& part : parts) {
+        out.insert(out.end(), part.begin(), part.end());
+    }
+
+    return out;
+}
+
+std::vector<uint8_t> corrupt(std::vector<uint8_t> data, size_t index) {
+    data[index] ^= 0x10;
+    return data;
+}
+
+const std::vector<uint8_t> Noise {
+    0x00, 0xff, 0x5A, 0x55, 0x42, 0xAA, 0x16, 0x11, 0xC0, 0x4D, 0x0B};
+
+} // namespace test
+} // namespace frame
+} // namespace espurna
+
+using namespace espurna::frame;
+using namespace espurna::frame::test;
+
+void test_ring() {
+    Ring<8> ring;
+    TEST_ASSERT_EQUAL(0, ring.size());
+    TEST_ASSERT_EQUAL(8, ring.available());
+    TEST_ASSERT_EQUAL(8, ring.contiguous());
+
+    const uint8_t data[] {1, 2, 3, 4, 5, 6};
+    TEST_ASSERT_EQUAL(6, ring.push(data, sizeof(data)));
+    ring.drop(4);
+
+    // free space wraps around, so only the tail part is contiguous
+    TEST_ASSERT_EQUAL(6, ring.available());
+    TEST_ASSERT_EQUAL(2, ring.contiguous());
+
+    TEST_ASSERT_EQUAL(6, ring.push(data, sizeof(data)));
+    TEST_ASSERT_EQUAL(8, ring.size());
+    TEST_ASSERT_EQUAL(0, ring.push(data, sizeof(data)));
+
+    const uint8_t expected[] {5, 6, 1, 2, 3, 4, 5, 6};
+    uint8_t out[8];
+    ring.copy(out, sizeof(out));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, out, sizeof(out));
+}
+
+void test_checksum() {
+    TEST_ASSERT(Cse7766.check(Cse7766Frame.data(), Cse7766Frame.size()));
+    TEST_ASSERT(Sds011.check(Sds011Frame.data(), Sds011Frame.size()));
+    TEST_ASSERT(Pm1006.check(Pm1006Frame.data(), Pm1006Frame.size()));
+
+    const auto pms = pms_frame({1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13});
+    TEST_ASSERT_EQUAL(32, pms.size());
+    TEST_ASSERT(Pms.check(pms.data(), pms.size()));
+
+    for (size_t index = 2; index < Cse7766Frame.size(); ++index) {
+        const auto data = corrupt(Cse7766Frame, index);
+        TEST_ASSERT_FALSE(Cse7766.check(data.data(), data.size()));
+    }
+}
+
+void test_single_frame() {
+    Parser<64, 24> parser(Cse7766);
+    TEST_ASSERT_FALSE(parser.next());
+
+    TEST_ASSERT_EQUAL(Cse7766Frame.size(),
+        parser.push(Cse7766Frame.data(), Cse7766Frame.size()));
+    TEST_ASSERT(parser.next());
+    TEST_ASSERT_EQUAL(24, parser.length());
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(Cse7766Frame.data(), parser.data(), parser.length());
+    TEST_ASSERT_EQUAL(0, parser.buffered());
+
+    TEST_ASSERT_FALSE(parser.next());
+    TEST_ASSERT_EQUAL(1, parser.stats().frames);
+    TEST_ASSERT_EQUAL(0, parser.stats().errors);
+    TEST_ASSERT_EQUAL(0, parser.stats().dropped);
+}
+
+void test_partial_frame() {
+    Parser<64, 24> parser(Cse7766);
+
+    for (size_t index = 0; index < Cse7766Frame.size() - 1; ++index) {
+        parser.push(&Cse7766Frame[index], 1);
+        TEST_ASSERT_FALSE(parser.next());
+    }
+
+    parser.push(&Cse7766Frame.back(), 1);
+    TEST_ASSERT(parser.next());
+    TEST_ASSERT_EQUAL(0, parser.stats().dropped);
+}
+
+void test_noise() {
+    RecordedStream stream(join({
+        Noise, Sds011Frame, Noise, Noise, Sds011Frame, Sds011Frame, Noise}), 16);
+
+    Parser<32, 10> parser(Sds011);
+
+    size_t frames { 0 };
+    parser.read(stream, [&](const uint8_t* data, size_t length) {
+        TEST_ASSERT_EQUAL(Sds011Frame.size(), length);
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(Sds011Frame.data(), data, length);
+        ++frames;
+    });
+
+    TEST_ASSERT_EQUAL(3, frames);
+    TEST_ASSERT_EQUAL(3, parser.stats().frames);
+    TEST_ASSERT_EQUAL(0, stream.available());
+
+    // trailing noise is either dropped or stays buffered until more data arrives
+    TEST_ASSERT_EQUAL(Noise.size() * 4, parser.stats().dropped + parser.buffered());
+}
+
+void test_resync() {
+    // corrupted frames always start with a valid header, so the parser
+    // has to drop just a single byte and look at the rest of the data
+    RecordedStream stream(join({
+        corrupt(Cse7766Frame, 10),
+        Cse7766Frame,
+        corrupt(Cse7766Frame, 23),
+        {0x55, 0x5A, 0x02},
+        Cse7766Frame}), 128);
+
+    Parser<32, 24> parser(Cse7766);
+
+    size_t frames { 0 };
+    parser.read(stream, [&](const uint8_t* data, size_t length) {
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(Cse7766Frame.data(), data, length);
+        ++frames;
+    });
+
+    TEST_ASSERT_EQUAL(2, frames);
+    TEST_ASSERT_EQUAL(3, parser.stats().errors);
+    TEST_ASSERT_EQUAL(0, parser.buffered());
+}
+
+void test_sum_zero() {
+    RecordedStream stream(join({
+        Pm1006Frame, Noise, corrupt(Pm1006Frame, 6), Pm1006Frame}), 5);
+
+    Parser<32, 20> parser(Pm1006);
+
+    size_t frames { 0 };
+    parser.read(stream, [&](const uint8_t* data, size_t) {
+        TEST_ASSERT_EQUAL(0x1C, data[6]);
+        ++frames;
+    });
+
+    TEST_ASSERT_EQUAL(2, frames);
+    TEST_ASSERT_EQUAL(1, parser.stats().errors);
+}
+
+void test_variable_length() {
+    const auto short_frame = pms_frame({1, 2, 3, 4, 5, 6, 7, 8, 9});
+    const auto long_frame = pms_frame({1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17});
+
+    // bogus length should not stall the parser, waiting for the data that never comes
+    const std::vector<uint8_t> bogus {0x42, 0x4D, 0xff, 0xff};
+
+    RecordedStream stream(join({
+        Noise, short_frame, bogus, long_frame, Noise, short_frame}), 7);
+
+    Parser<64, 40> parser(Pms);
+
+    std::vector<size_t> lengths;
+    parser.read(stream, [&](const uint8_t* data, size_t length) {
+        TEST_ASSERT_EQUAL(0x42, data[0]);
+        lengths.push_back(length);
+    });
+
+    TEST_ASSERT_EQUAL(3, lengths.size());
+    TEST_ASSERT_EQUAL(short_frame.size(), lengths[0]);
+    TEST_ASSERT_EQUAL(long_frame.size(), lengths[1]);
+    TEST_ASSERT_EQUAL(short_frame.size(), lengths[2]);
+    TEST_ASSERT_EQUAL(1, parser.stats().errors);
+}
+
+void test_bulk_read() {
+    std::vector<uint8_t> data;
+    for (size_t index = 0; index < 100; ++index) {
+        data.insert(data.end(), Cse7766Frame.begin(), Cse7766Frame.end());
+    }
+
+    // ring buffer is a lot smaller than the available data. reads
+    // should still be done in chunks, not a single byte at a time
+    RecordedStream stream(std::move(data), 128);
+    Parser<64, 24> parser(Cse7766);
+
+    const auto frames = parser.read(stream, [](const uint8_t*, size_t) {});
+    TEST_ASSERT_EQUAL(100, frames);
+    TEST_ASSERT_EQUAL(0, parser.stats().dropped);
+    TEST_ASSERT_LESS_THAN(100, stream.reads);
+}
+
+int main(int, char**) {
+    UNITY_BEGIN();
+    RUN_TEST(test_ring);
+    RUN_TEST(test_checksum);
+    RUN_TEST(test_single_frame);
+    RUN_TEST(test_partial_frame);
+    RUN_TEST(test_noise);
+    RUN_TEST(test_resync);
+    RUN_TEST(test_sum_zero);
+    RUN_TEST(test_variable_length);
+    RUN_TEST(test_bulk_read);
+    return UNITY_END();
+}
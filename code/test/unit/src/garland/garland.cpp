@@ -0,0 +1,281 @@
+#include <Arduino.h>
+#include <unity.h>
+
+#pragma GCC diagnostic warning "-Wall"
+#pragma GCC diagnostic warning "-Wextra"
+#pragma GCC diagnostic warning "-Wstrict-aliasing"
+#pragma GCC diagnostic warning "-Wpointer-arith"
+#pragma GCC diagnostic warning "-Wstrict-overflow=5"
+
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+namespace {
+
+#include <garland/color.h>
+#include <garland/render.h>
+#include <garland/ws2812.h>
+
+// NEO_GRB from the Adafruit_NeoPixel.h
+constexpr uint16_t TypeGrb { (1 << 6) | (1 << 4) | (0 << 2) | 2 };
+
+// NEO_RGBW, has separate white channel
+constexpr uint16_t TypeRgbw { (3 << 6) | (0 << 4) | (1 << 2) | 2 };
+
+// Part of the Scene, which is not reachable from here
+const BrightnessLut::Gamma Gamma {{
+    0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3,
+    4, 4, 4, 4, 4, 4, 4, 5, 5, 5, 5, 5, 5, 6, 6, 6, 6, 6, 6, 7, 7, 7, 7, 7, 7, 8, 8, 8, 8, 8, 9, 9, 9, 9, 10,
+    10, 10, 10, 10, 11, 11, 11, 11, 12, 12, 12, 13, 13, 13, 13, 14, 14, 14, 15, 15, 15, 15, 16, 16, 16, 17, 17,
+    17, 18, 18, 19, 19, 19, 20, 20, 20, 21, 21, 22, 22, 22, 23, 23, 24, 24, 25, 25, 26, 26, 27, 27, 28, 28, 29,
+    29, 30, 30, 31, 31, 32, 32, 33, 34, 34, 35, 35, 36, 37, 37, 38, 39, 39, 40, 41, 42, 42, 43, 44, 45, 45, 46,
+    47, 48, 49, 49, 50, 51, 52, 53, 54, 55, 56, 57, 57, 58, 59, 60, 61, 63, 64, 65, 66, 67, 68, 69, 70, 71, 73,
+    74, 75, 76, 78, 79, 80, 82, 83, 84, 86, 87, 89, 90, 91, 93, 94, 96, 98, 99, 101, 102, 104, 106, 108, 109,
+    111, 113, 115, 117, 119, 121, 122, 124, 126, 129, 131, 133, 135, 137, 139, 142, 144, 146, 149, 151, 153, 156,
+    158, 161, 163, 166, 169, 171, 174, 177, 180, 183, 186, 189, 192, 195, 198, 201, 204, 208, 211, 214, 218, 221,
+    225, 228, 232, 236, 239, 243, 247, 251, 255}};
+
+std::vector<Color> pattern(size_t size, uint32_t seed) {
+    std::vector<Color> out;
+    out.reserve(size);
+
+    for (size_t index = 0; index < size; ++index) {
+        seed = (seed * 1103515245) + 12345;
+        out.emplace_back(seed >> 8);
+    }
+
+    return out;
+}
+
+// Per-pixel float interpolation and brightness, as it was done before
+void render_float(byte* out, const Color* leds, const Color* prev, size_t size, float transc, byte brightness) {
+    for (size_t index = 0; index < size; ++index) {
+        const Color color = (transc > 0)
+            ? leds[index].interpolate(prev[index], transc)
+            : leds[index];
+
+        byte* pixel = out + (index * 3);
+        pixel[1] = (int)(Gamma[color.r]) * brightness / 256;
+        pixel[0] = (int)(Gamma[color.g]) * brightness / 256;
+        pixel[2] = (int)(Gamma[color.b]) * brightness / 256;
+    }
+}
+
+template <typename T>
+double frames_per_second(size_t frames, T&& callback) {
+    using Clock = std::chrono::steady_clock;
+
+    const auto start = Clock::now();
+    for (size_t frame = 0; frame < frames; ++frame) {
+        callback(frame);
+    }
+
+    const auto elapsed = std::chrono::duration<double>(Clock::now() - start);
+    return static_cast<double>(frames) / elapsed.count();
+}
+
+void benchmark(size_t leds) {
+    const auto current = pattern(leds, 12345);
+    const auto previous = pattern(leds, 54321);
+
+    std::vector<byte> buffer(leds * 3);
+    constexpr size_t Frames { 2000 };
+
+    BrightnessLut lut;
+    lut.update(Gamma, 200);
+
+    // make sure rendered frames are actually used
+    volatile byte sink { 0 };
+
+    const auto fixed = frames_per_second(Frames, [&](size_t frame) {
+        render(buffer.data(), current.data(), previous.data(), leds,
+            frame % BlendWeightMax, lut, pixelOrder(TypeGrb));
+        sink = sink + buffer[frame % buffer.size()];
+    });
+
+    const auto floating = frames_per_second(Frames, [&](size_t frame) {
+        render_float(buffer.data(), current.data(), previous.data(), leds,
+            static_cast<float>(frame % BlendWeightMax) / BlendWeightMax, 200);
+        sink = sink + buffer[frame % buffer.size()];
+    });
+
+    // 800kHz, 24 bits per pixel and 300us latch time
+    const auto wire = 1000000.0 / ((leds * 30.0) + 300.0);
+
+    char message[192];
+    std::snprintf(message, sizeof(message),
+        "%zu leds: render %.0f fps (float %.0f fps), wire limit %.1f fps",
+        leds, fixed, floating, wire);
+    TEST_MESSAGE(message);
+
+    TEST_ASSERT_GREATER_THAN(wire, fixed);
+}
+
+// Line level changes, as seen by the strip
+struct Pulse {
+    bool level;
+    double duration; // ns
+};
+
+std::vector<Pulse> waveform(const std::vector<uint32_t>& samples) {
+    constexpr double Bit { 1000000000.0 / ws2812::BitClock };
+
+    std::vector<Pulse> out;
+    for (auto sample : samples) {
+        for (int bit = ws2812::SampleBits - 1; bit >= 0; --bit) {
+            const bool level = (sample >> bit) & 1;
+            if (out.empty() || (out.back().level != level)) {
+                out.push_back(Pulse{level, 0.0});
+            }
+
+            out.back().duration += Bit;
+        }
+    }
+
+    return out;
+}
+
+// Datasheet values, with +-150ns tolerance for every part of the bit
+constexpr double T0H { 400.0 };
+constexpr double T1H { 800.0 };
+constexpr double T0L { 850.0 };
+constexpr double T1L { 450.0 };
+constexpr double Tolerance { 150.0 };
+
+// Turn the waveform back into bytes, making sure every bit is within the timing constraints
+std::vector<uint8_t> decode(const std::vector<Pulse>& pulses, double& reset) {
+    std::vector<uint8_t> out;
+
+    uint8_t value { 0 };
+    size_t bits { 0 };
+
+    for (size_t index = 0; index + 1 < pulses.size(); index += 2) {
+        const auto& high = pulses[index];
+        const auto& low = pulses[index + 1];
+        TEST_ASSERT(high.level);
+        TEST_ASSERT_FALSE(low.level);
+
+        const bool one = high.duration > ((T0H + T1H) / 2.0);
+        TEST_ASSERT_DOUBLE_WITHIN(Tolerance, one ? T1H : T0H, high.duration);
+
+        // the last low period is the reset
+        if (index + 2 < pulses.size()) {
+            TEST_ASSERT_DOUBLE_WITHIN(Tolerance, one ? T1L : T0L, low.duration);
+        } else {
+            reset = low.duration - (one ? T1L : T0L);
+        }
+
+        value = (value << 1) | (one ? 1 : 0);
+        if (++bits == 8) {
+            out.push_back(value);
+            value = 0;
+            bits = 0;
+        }
+    }
+
+    TEST_ASSERT_EQUAL(0, bits);
+    return out;
+}
+
+} // namespace
+
+void test_ws2812() {
+    static_assert(ws2812::encode(0x00) == 0x88888888, "");
+    static_assert(ws2812::encode(0xff) == 0xeeeeeeee, "");
+    static_assert(ws2812::encode(0xa5) == 0xe8e88e8e, "");
+
+    // 10 samples per 100us
+    TEST_ASSERT_EQUAL(100000, ws2812::SampleRate);
+    TEST_ASSERT_EQUAL(30, ws2812::ResetSamples);
+
+    const std::vector<uint8_t> data {0x00, 0xff, 0x55, 0xaa, 0x01, 0x80, 0x12, 0xfe};
+
+    std::vector<uint32_t> samples(ws2812::samples(data.size()));
+    TEST_ASSERT_EQUAL(samples.size(), ws2812::encode(samples.data(), data.data(), data.size()));
+
+    double reset { 0.0 };
+    const auto decoded = decode(waveform(samples), reset);
+
+    TEST_ASSERT_EQUAL(data.size(), decoded.size());
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(data.data(), decoded.data(), data.size());
+    TEST_ASSERT_GREATER_OR_EQUAL(280000.0, reset);
+}
+
+void test_order() {
+    const auto grb = pixelOrder(TypeGrb);
+    TEST_ASSERT_EQUAL(1, grb.r);
+    TEST_ASSERT_EQUAL(0, grb.g);
+    TEST_ASSERT_EQUAL(2, grb.b);
+
+    TEST_ASSERT(pixelRgb(TypeGrb));
+    TEST_ASSERT_FALSE(pixelRgb(TypeRgbw));
+}
+
+void test_lut() {
+    BrightnessLut lut;
+
+    for (int brightness : {0, 1, 127, 200, 255}) {
+        lut.update(Gamma, brightness);
+        for (int value = 0; value < 256; ++value) {
+            TEST_ASSERT_EQUAL((int)(Gamma[value]) * brightness / 256, lut[value]);
+        }
+    }
+}
+
+void test_blend() {
+    for (int current = 0; current < 256; current += 5) {
+        for (int previous = 0; previous < 256; previous += 3) {
+            TEST_ASSERT_EQUAL(current, blend(current, previous, 0));
+            TEST_ASSERT_EQUAL(previous, blend(current, previous, BlendWeightMax));
+
+            // float version truncates, integer one rounds towards the lower value
+            const int expected = 0.5f * (previous - current) + current;
+            TEST_ASSERT_INT_WITHIN(1, expected, blend(current, previous, BlendWeightMax / 2));
+        }
+    }
+}
+
+void test_render() {
+    constexpr size_t Leds { 64 };
+    const auto current = pattern(Leds, 1);
+    const auto previous = pattern(Leds, 2);
+
+    BrightnessLut lut;
+    lut.update(Gamma, 255);
+
+    std::array<byte, Leds * 3> expected;
+    std::array<byte, Leds * 3> buffer;
+
+    render_float(expected.data(), current.data(), previous.data(), Leds, 0.0f, 255);
+    render(buffer.data(), current.data(), previous.data(), Leds, 0, lut, pixelOrder(TypeGrb));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected.data(), buffer.data(), buffer.size());
+
+    render_float(expected.data(), current.data(), previous.data(), Leds, 1.0f, 255);
+    render(buffer.data(), current.data(), previous.data(), Leds, BlendWeightMax, lut, pixelOrder(TypeGrb));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected.data(), buffer.data(), buffer.size());
+
+    // gamma table steps are small at the low end, so rounding differences are barely visible
+    render_float(expected.data(), current.data(), previous.data(), Leds, 0.25f, 255);
+    render(buffer.data(), current.data(), previous.data(), Leds, BlendWeightMax / 4, lut, pixelOrder(TypeGrb));
+    for (size_t index = 0; index < buffer.size(); ++index) {
+        TEST_ASSERT_INT_WITHIN(4, expected[index], buffer[index]);
+    }
+}
+
+void test_benchmark() {
+    benchmark(300);
+    benchmark(600);
+}
+
+int main(int, char**) {
+    UNITY_BEGIN();
+    RUN_TEST(test_order);
+    RUN_TEST(test_lut);
+    RUN_TEST(test_blend);
+    RUN_TEST(test_render);
+    RUN_TEST(test_ws2812);
+    RUN_TEST(test_benchmark);
+    return UNITY_END();
+}
@@ -0,0 +1,166 @@
+#include <Arduino.h>
+#include <unity.h>
+
+#pragma GCC diagnostic warning "-Wall"
+#pragma GCC diagnostic warning "-Wextra"
+#pragma GCC diagnostic warning "-Wstrict-aliasing"
+#pragma GCC diagnostic warning "-Wpointer-arith"
+#pragma GCC diagnostic warning "-Wstrict-overflow=5"
+
+#include <libs/HeartbeatBuilder.h>
+
+#include <string>
+#include <vector>
+
+namespace espurna {
+namespace heartbeat {
+namespace test {
+namespace {
+
+void test_fields() {
+    Builder<128, 8> builder;
+
+    TEST_ASSERT(builder.add("app", "ESPURNA"));
+    TEST_ASSERT(builder.add("uptime", static_cast<uint32_t>(4294967295ul)));
+    TEST_ASSERT(builder.add("rssi", static_cast<int32_t>(-67)));
+    TEST_ASSERT(builder.add("zero", static_cast<uint32_t>(0)));
+
+    TEST_ASSERT_EQUAL(4, builder.size());
+    TEST_ASSERT_EQUAL(0, builder.temporaries());
+    TEST_ASSERT_EQUAL(0, builder.dropped());
+
+    std::vector<std::string> out;
+    builder.foreach([&](const decltype(builder)::Field& field) {
+        out.push_back(std::string(field.topic) + "=" + field.value);
+    });
+
+    TEST_ASSERT_EQUAL(4, out.size());
+    TEST_ASSERT_EQUAL_STRING("app=ESPURNA", out[0].c_str());
+    TEST_ASSERT_EQUAL_STRING("uptime=4294967295", out[1].c_str());
+    TEST_ASSERT_EQUAL_STRING("rssi=-67", out[2].c_str());
+    TEST_ASSERT_EQUAL_STRING("zero=0", out[3].c_str());
+
+    TEST_ASSERT_EQUAL(8 + 11 + 4 + 2, builder.bytes());
+}
+
+void test_json() {
+    Builder<256, 8> builder;
+
+    builder.add("app", "ESPURNA");
+    builder.add("freeheap", static_cast<uint32_t>(24512));
+    builder.add("rssi", static_cast<int32_t>(-2147483647 - 1));
+    builder.add("desc", "say \"hi\"\\\n");
+
+    const char* json = builder.json();
+    TEST_ASSERT_NOT_NULL(json);
+    TEST_ASSERT_EQUAL_STRING(
+        "{\"app\":\"ESPURNA\",\"freeheap\":24512,\"rssi\":-2147483648,"
+        "\"desc\":\"say \\\"hi\\\"\\\\\\u000a\"}", json);
+
+    // values are still available after serializing
+    std::vector<std::string> values;
+    builder.foreach([&](const decltype(builder)::Field& field) {
+        values.push_back(field.value);
+    });
+    TEST_ASSERT_EQUAL_STRING("say \"hi\"\\\n", values[3].c_str());
+
+    // and the object is re-created in the same place
+    builder.add("loadavg", static_cast<uint32_t>(3));
+    json = builder.json();
+    TEST_ASSERT_NOT_NULL(json);
+    TEST_ASSERT_EQUAL_STRING(
+        "{\"app\":\"ESPURNA\",\"freeheap\":24512,\"rssi\":-2147483648,"
+        "\"desc\":\"say \\\"hi\\\"\\\\\\u000a\",\"loadavg\":3}", json);
+}
+
+void test_empty() {
+    Builder<8, 1> builder;
+    TEST_ASSERT_EQUAL_STRING("{}", builder.json());
+}
+
+void test_overflow() {
+    Builder<16, 2> builder;
+
+    TEST_ASSERT(builder.add("a", "1234567"));
+    TEST_ASSERT(!builder.add("b", "12345678"));
+    TEST_ASSERT(builder.add("c", "123456"));
+    TEST_ASSERT(!builder.add("d", ""));
+
+    TEST_ASSERT_EQUAL(2, builder.size());
+    TEST_ASSERT_EQUAL(2, builder.dropped());
+    TEST_ASSERT_EQUAL(15, builder.bytes());
+
+    // nothing left for the object
+    TEST_ASSERT_NULL(builder.json());
+
+    builder.clear();
+    TEST_ASSERT_EQUAL(0, builder.size());
+    TEST_ASSERT_EQUAL(0, builder.dropped());
+    TEST_ASSERT(builder.add("a", "1"));
+    TEST_ASSERT_EQUAL_STRING("{\"a\":\"1\"}", builder.json());
+}
+
+void test_raw() {
+    Builder<64, 4> builder;
+
+    TEST_ASSERT(builder.add("temperature", "21.5", 4, true));
+    TEST_ASSERT(builder.add("status", "1", 1, false));
+
+    TEST_ASSERT(builder.contains("status"));
+    TEST_ASSERT(!builder.contains("relay"));
+
+    TEST_ASSERT_EQUAL_STRING("{\"temperature\":21.5,\"status\":\"1\"}", builder.json());
+}
+
+void test_copy() {
+    Builder<32, 4> builder;
+
+    {
+        String topic("relay/0");
+        TEST_ASSERT(builder.add(topic, String("1"), true));
+        topic = "garbage";
+    }
+
+    TEST_ASSERT(builder.contains("relay/0"));
+    TEST_ASSERT_EQUAL(10, builder.bytes());
+    TEST_ASSERT_EQUAL_STRING("{\"relay/0\":1}", builder.json());
+
+    // neither topic nor value are kept when the value does not fit
+    TEST_ASSERT(!builder.add(String("topic"), String("0123456789abcdef"), false));
+    TEST_ASSERT_EQUAL(1, builder.size());
+    TEST_ASSERT_EQUAL(10, builder.bytes());
+    TEST_ASSERT_EQUAL(1, builder.dropped());
+}
+
+void test_temporaries() {
+    Builder<64, 4> builder;
+
+    const String persistent("persistent");
+    builder.add("first", persistent);
+    builder.add("second", String("temporary"));
+
+    TEST_ASSERT_EQUAL(1, builder.temporaries());
+    TEST_ASSERT_EQUAL(2, builder.size());
+
+    builder.clear();
+    TEST_ASSERT_EQUAL(0, builder.temporaries());
+}
+
+} // namespace
+} // namespace test
+} // namespace heartbeat
+} // namespace espurna
+
+int main(int, char**) {
+    using namespace espurna::heartbeat::test;
+
+    UNITY_BEGIN();
+    RUN_TEST(test_fields);
+    RUN_TEST(test_json);
+    RUN_TEST(test_empty);
+    RUN_TEST(test_overflow);
+    RUN_TEST(test_raw);
+    RUN_TEST(test_copy);
+    RUN_TEST(test_temporaries);
+    return UNITY_END();
+}
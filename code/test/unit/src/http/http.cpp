@@ -0,0 +1,516 @@
+#include <Arduino.h>
+#include <unity.h>
+
+#include "libs/HttpClient.h"
+
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+using namespace espurna::http;
+
+namespace {
+
+// Local server, receiving raw requests and sending the scripted responses back
+class MockServer {
+public:
+    struct Received {
+        std::string head;
+        std::string body;
+    };
+
+    // Like the TCP send buffer, only a limited amount of data is accepted until ack
+    size_t space() {
+        return _window - _pending;
+    }
+
+    size_t write(const char* data, size_t size) {
+        size = std::min(size, space());
+        _wire.append(data, size);
+        _pending += size;
+        return size;
+    }
+
+    void window(size_t size) {
+        _window = size;
+    }
+
+    void ack() {
+        _pending = 0;
+    }
+
+    // Complete requests received since the last call
+    std::vector<Received> receive() {
+        std::vector<Received> out;
+
+        for (;;) {
+            const auto end = _wire.find("\r\n\r\n");
+            if (end == std::string::npos) {
+                break;
+            }
+
+            const auto head = _wire.substr(0, end + 4);
+
+            size_t length { 0 };
+            const auto header = head.find("Content-Length: ");
+            if (header != std::string::npos) {
+                length = strtoul(head.c_str() + header + 16, nullptr, 10);
+            }
+
+            if (_wire.size() < head.size() + length) {
+                break;
+            }
+
+            out.push_back(Received{head, _wire.substr(head.size(), length)});
+            _wire.erase(0, head.size() + length);
+        }
+
+        return out;
+    }
+
+    void clear() {
+        _wire.clear();
+        _pending = 0;
+    }
+
+private:
+    std::string _wire;
+    size_t _window { 1460 };
+    size_t _pending { 0 };
+};
+
+struct Result {
+    int status { -1 };
+    Error error { Error::None };
+    std::string body;
+    size_t calls { 0 };
+};
+
+Request make_request(const char* path, std::string payload, Result& result, bool idempotent = false) {
+    Request out;
+    out.head = Head(idempotent ? "PUT" : "POST", String("localhost"), 8086, String(path)).finish(payload.size());
+    out.idempotent = idempotent;
+    out.body_size = payload.size();
+    out.body = body(String(payload.c_str()));
+    out.on_body = [&](const uint8_t* data, size_t size) {
+        result.body.append(reinterpret_cast<const char*>(data), size);
+    };
+    out.on_complete = [&](int status, Error error) {
+        result.status = status;
+        result.error = error;
+        ++result.calls;
+    };
+
+    return out;
+}
+
+void feed(Pipeline& pipeline, const std::string& data) {
+    pipeline.receive(reinterpret_cast<const uint8_t*>(data.data()), data.size());
+}
+
+template <typename T>
+size_t parse(Parser& parser, const std::string& data, T&& callback) {
+    return parser.parse(reinterpret_cast<const uint8_t*>(data.data()), data.size(), callback);
+}
+
+const char Ok[] = "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok";
+const char NoContent[] = "HTTP/1.1 204 No Content\r\n\r\n";
+
+} // namespace
+
+void test_head() {
+    const auto head = Head("POST", String("example.com"), 8080, String("/write?db=test"))
+        .header("Content-Type", "text/plain")
+        .finish(123);
+
+    TEST_ASSERT_EQUAL_STRING(
+        "POST /write?db=test HTTP/1.1\r\n"
+        "Host: example.com:8080\r\n"
+        "Content-Type: text/plain\r\n"
+        "Content-Length: 123\r\n\r\n",
+        head.c_str());
+
+    const auto other = Head("GET", String("example.com"), 80, String()).finish(0);
+    TEST_ASSERT_EQUAL_STRING(
+        "GET / HTTP/1.1\r\n"
+        "Host: example.com\r\n"
+        "Content-Length: 0\r\n\r\n",
+        other.c_str());
+}
+
+void test_parser_fragmented() {
+    const std::string response =
+        "HTTP/1.1 200 OK\r\n"
+        "content-length: 11\r\n"
+        "Content-Type: text/plain\r\n"
+        "\r\n"
+        "hello worldHTTP/1.1";
+
+    Parser parser;
+    std::string body;
+
+    size_t consumed { 0 };
+    for (size_t index = 0; index < response.size() && !parser.done(); ++index) {
+        consumed += parser.parse(
+            reinterpret_cast<const uint8_t*>(&response[index]), 1,
+            [&](const uint8_t* data, size_t size) {
+                body.append(reinterpret_cast<const char*>(data), size);
+            });
+    }
+
+    TEST_ASSERT(parser.done());
+    TEST_ASSERT(parser.keep_alive());
+    TEST_ASSERT_EQUAL(200, parser.status());
+    TEST_ASSERT_EQUAL_STRING("hello world", body.c_str());
+    TEST_ASSERT_EQUAL(response.size() - 8, consumed);
+}
+
+void test_parser_chunked() {
+    const std::string response =
+        "HTTP/1.1 200 OK\r\n"
+        "Transfer-Encoding: chunked\r\n"
+        "\r\n"
+        "5;name=value\r\n"
+        "hello\r\n"
+        "6\r\n"
+        " world\r\n"
+        "0\r\n"
+        "Trailer: ignored\r\n"
+        "\r\n";
+
+    Parser parser;
+    std::string body;
+
+    const auto consumed = parse(parser, response + "HTTP/1.1",
+        [&](const uint8_t* data, size_t size) {
+            body.append(reinterpret_cast<const char*>(data), size);
+        });
+
+    TEST_ASSERT(parser.done());
+    TEST_ASSERT_EQUAL(response.size(), consumed);
+    TEST_ASSERT_EQUAL_STRING("hello world", body.c_str());
+
+    parser.reset();
+    parse(parser,
+        "HTTP/1.1 200 OK\r\n"
+        "Transfer-Encoding: chunked\r\n"
+        "\r\n"
+        "2\r\n"
+        "hello\r\n",
+        [](const uint8_t*, size_t) {});
+    TEST_ASSERT(parser.error());
+}
+
+void test_parser_close() {
+    Parser parser;
+    std::string body;
+
+    const auto callback = [&](const uint8_t* data, size_t size) {
+        body.append(reinterpret_cast<const char*>(data), size);
+    };
+
+    parse(parser, "HTTP/1.0 200 OK\r\n\r\nfirst", callback);
+    parse(parser, " second", callback);
+    TEST_ASSERT(!parser.done());
+    TEST_ASSERT(!parser.keep_alive());
+
+    parser.finish();
+    TEST_ASSERT(parser.done());
+    TEST_ASSERT_EQUAL_STRING("first second", body.c_str());
+
+    parser.reset();
+    parse(parser, "HTTP/1.1 200 OK\r\nContent-Length: 10\r\n\r\nfirst", callback);
+    parser.finish();
+    TEST_ASSERT(parser.error());
+
+    parser.reset();
+    parse(parser, "HTTP/1.1 200 OK\r\nConnection: close\r\nContent-Length: 0\r\n\r\n", callback);
+    TEST_ASSERT(parser.done());
+    TEST_ASSERT(!parser.keep_alive());
+}
+
+void test_parser_interim() {
+    Parser parser;
+    parse(parser,
+        "HTTP/1.1 100 Continue\r\n\r\n"
+        "HTTP/1.1 204 No Content\r\n\r\n",
+        [](const uint8_t*, size_t) {});
+
+    TEST_ASSERT(parser.done());
+    TEST_ASSERT_EQUAL(204, parser.status());
+}
+
+void test_parser_bounded() {
+    std::string header("X-Long: ");
+    header.append(Parser::LineSize * 4, 'x');
+
+    Parser parser;
+    parse(parser,
+        "HTTP/1.1 200 OK\r\n" + header + "\r\nContent-Length: 0\r\n\r\n",
+        [](const uint8_t*, size_t) {});
+    TEST_ASSERT(parser.done());
+
+    std::string status("HTTP/1.1 201 ");
+    status.append(Parser::LineSize * 4, 'x');
+
+    parser.reset();
+    parse(parser, status + "\r\nContent-Length: 0\r\n\r\n", [](const uint8_t*, size_t) {});
+    TEST_ASSERT(parser.done());
+    TEST_ASSERT_EQUAL(201, parser.status());
+
+    parser.reset();
+    parse(parser, "SSH-2.0-OpenSSH\r\n", [](const uint8_t*, size_t) {});
+    TEST_ASSERT(parser.error());
+}
+
+void test_pipeline_keep_alive() {
+    MockServer server;
+    Pipeline pipeline(4);
+
+    Result results[3];
+    pipeline.push(make_request("/first", "a=1", results[0], true));
+    pipeline.push(make_request("/second", "b=2", results[1], true));
+    pipeline.push(make_request("/third", "c=3", results[2], true));
+
+    // Only one request is sent until the connection is known to be persistent
+    pipeline.send(server);
+    auto received = server.receive();
+    TEST_ASSERT_EQUAL(1, received.size());
+    TEST_ASSERT_EQUAL(0, received[0].head.find("PUT /first HTTP/1.1\r\n"));
+    TEST_ASSERT_EQUAL_STRING("a=1", received[0].body.c_str());
+
+    feed(pipeline, Ok);
+    TEST_ASSERT_EQUAL(1, results[0].calls);
+    TEST_ASSERT_EQUAL(200, results[0].status);
+    TEST_ASSERT_EQUAL_STRING("ok", results[0].body.c_str());
+    TEST_ASSERT(pipeline.confirmed());
+
+    // Everything else goes out at once
+    pipeline.send(server);
+    received = server.receive();
+    TEST_ASSERT_EQUAL(2, received.size());
+    TEST_ASSERT_EQUAL(2, pipeline.in_flight());
+
+    // Both responses in a single packet
+    feed(pipeline, std::string(NoContent) + Ok);
+    TEST_ASSERT_EQUAL(204, results[1].status);
+    TEST_ASSERT_EQUAL(200, results[2].status);
+    TEST_ASSERT_EQUAL_STRING("ok", results[2].body.c_str());
+    TEST_ASSERT(pipeline.idle());
+    TEST_ASSERT(!pipeline.broken());
+}
+
+void test_pipeline_depth() {
+    MockServer server;
+    Pipeline pipeline(2);
+
+    Result results[4];
+    for (auto& result : results) {
+        pipeline.push(make_request("/", "", result, true));
+    }
+
+    pipeline.send(server);
+    feed(pipeline, Ok);
+
+    pipeline.send(server);
+    TEST_ASSERT_EQUAL(2, pipeline.in_flight());
+    TEST_ASSERT_EQUAL(3, server.receive().size());
+
+    feed(pipeline, Ok);
+    pipeline.send(server);
+    TEST_ASSERT_EQUAL(2, pipeline.in_flight());
+
+    feed(pipeline, std::string(Ok) + Ok);
+    TEST_ASSERT(pipeline.idle());
+    for (auto& result : results) {
+        TEST_ASSERT_EQUAL(1, result.calls);
+        TEST_ASSERT_EQUAL(200, result.status);
+    }
+}
+
+void test_pipeline_streaming_body() {
+    MockServer server;
+    server.window(100);
+
+    Pipeline pipeline(1);
+
+    std::string payload;
+    for (size_t index = 0; index < 2000; ++index) {
+        payload += static_cast<char>('a' + (index % 26));
+    }
+
+    size_t largest { 0 };
+    size_t produced { 0 };
+
+    Result result;
+    auto request = make_request("/stream", payload, result);
+    request.body = [&](uint8_t* out, size_t size, size_t offset) -> size_t {
+        largest = std::max(largest, size);
+        produced += size;
+        std::memcpy(out, payload.data() + offset, size);
+        return size;
+    };
+    pipeline.push(std::move(request));
+
+    size_t rounds { 0 };
+    while (pipeline.send(server)) {
+        server.ack();
+        ++rounds;
+    }
+
+    const auto received = server.receive();
+    TEST_ASSERT_EQUAL(1, received.size());
+    TEST_ASSERT(payload == received[0].body);
+    TEST_ASSERT_EQUAL(payload.size(), produced);
+    TEST_ASSERT(largest <= 100);
+    TEST_ASSERT(rounds > (payload.size() / 100));
+
+    feed(pipeline, NoContent);
+    TEST_ASSERT_EQUAL(204, result.status);
+}
+
+void test_pipeline_connection_close() {
+    MockServer server;
+    Pipeline pipeline(4);
+
+    Result results[2];
+    pipeline.push(make_request("/first", "", results[0]));
+    pipeline.push(make_request("/second", "", results[1]));
+
+    pipeline.send(server);
+    feed(pipeline, "HTTP/1.1 200 OK\r\nConnection: close\r\nContent-Length: 0\r\n\r\n");
+    TEST_ASSERT_EQUAL(200, results[0].status);
+    TEST_ASSERT(pipeline.closing());
+
+    // Nothing else is sent through this connection
+    TEST_ASSERT_EQUAL(0, pipeline.send(server));
+    TEST_ASSERT_EQUAL(1, server.receive().size());
+
+    // Queued request is sent through the next one
+    pipeline.closed(Error::Closed);
+    server.clear();
+
+    pipeline.send(server);
+    const auto received = server.receive();
+    TEST_ASSERT_EQUAL(1, received.size());
+    TEST_ASSERT_EQUAL(0, received[0].head.find("POST /second HTTP/1.1\r\n"));
+
+    feed(pipeline, Ok);
+    TEST_ASSERT_EQUAL(200, results[1].status);
+    TEST_ASSERT_EQUAL(1, results[1].calls);
+}
+
+void test_pipeline_retry() {
+    MockServer server;
+    Pipeline pipeline(4);
+
+    Result result;
+    pipeline.push(make_request("/", "data", result, true));
+
+    // Stale keep-alive connection is closed by the server right after the request
+    pipeline.send(server);
+    pipeline.closed(Error::Closed);
+    TEST_ASSERT_EQUAL(0, result.calls);
+    TEST_ASSERT_EQUAL(1, pipeline.size());
+
+    server.clear();
+    pipeline.send(server);
+    TEST_ASSERT_EQUAL(1, server.receive().size());
+
+    pipeline.closed(Error::Closed);
+    TEST_ASSERT_EQUAL(1, result.calls);
+    TEST_ASSERT_EQUAL(0, result.status);
+    TEST_ASSERT(Error::Closed == result.error);
+    TEST_ASSERT(pipeline.idle());
+
+    // Partial response is never repeated
+    Result partial;
+    pipeline.push(make_request("/", "data", partial, true));
+    pipeline.send(server);
+    feed(pipeline, "HTTP/1.1 200 OK\r\nContent-Length: 10\r\n\r\nshort");
+    pipeline.closed(Error::Timeout);
+    TEST_ASSERT_EQUAL(1, partial.calls);
+    TEST_ASSERT(Error::Timeout == partial.error);
+    TEST_ASSERT(pipeline.idle());
+}
+
+void test_pipeline_non_idempotent() {
+    MockServer server;
+    Pipeline pipeline(4);
+
+    Result results[3];
+    pipeline.push(make_request("/first", "", results[0], true));
+    pipeline.push(make_request("/second", "a=1", results[1]));
+    pipeline.push(make_request("/third", "", results[2], true));
+
+    pipeline.send(server);
+    feed(pipeline, Ok);
+    TEST_ASSERT(pipeline.confirmed());
+
+    // POST is sent alone, even when the connection is persistent
+    pipeline.send(server);
+    auto received = server.receive();
+    TEST_ASSERT_EQUAL(2, received.size());
+    TEST_ASSERT_EQUAL(0, received[1].head.find("POST /second HTTP/1.1\r\n"));
+    TEST_ASSERT_EQUAL(1, pipeline.in_flight());
+
+    // and is never repeated, since the server might have already processed it
+    pipeline.closed(Error::Closed);
+    TEST_ASSERT_EQUAL(1, results[1].calls);
+    TEST_ASSERT(Error::Closed == results[1].error);
+    TEST_ASSERT_EQUAL(0, results[2].calls);
+    TEST_ASSERT_EQUAL(1, pipeline.size());
+
+    server.clear();
+    pipeline.send(server);
+    received = server.receive();
+    TEST_ASSERT_EQUAL(1, received.size());
+    TEST_ASSERT_EQUAL(0, received[0].head.find("PUT /third HTTP/1.1\r\n"));
+}
+
+void test_pipeline_abort() {
+    MockServer server;
+    Pipeline pipeline(4);
+
+    Result results[2];
+    pipeline.push(make_request("/", "", results[0]));
+    pipeline.push(make_request("/", "", results[1]));
+
+    pipeline.abort(Error::Connection);
+    for (auto& result : results) {
+        TEST_ASSERT_EQUAL(1, result.calls);
+        TEST_ASSERT(Error::Connection == result.error);
+    }
+    TEST_ASSERT(pipeline.idle());
+
+    // Unexpected data or invalid response break the connection
+    Result invalid;
+    pipeline.push(make_request("/", "", invalid));
+    pipeline.send(server);
+    feed(pipeline, "garbage\r\n");
+    TEST_ASSERT(pipeline.broken());
+    TEST_ASSERT(Error::Response == invalid.error);
+
+    pipeline.closed(Error::Closed);
+    TEST_ASSERT(!pipeline.broken());
+    feed(pipeline, Ok);
+    TEST_ASSERT(pipeline.broken());
+}
+
+int main(int, char**) {
+    UNITY_BEGIN();
+    RUN_TEST(test_head);
+    RUN_TEST(test_parser_fragmented);
+    RUN_TEST(test_parser_chunked);
+    RUN_TEST(test_parser_close);
+    RUN_TEST(test_parser_interim);
+    RUN_TEST(test_parser_bounded);
+    RUN_TEST(test_pipeline_keep_alive);
+    RUN_TEST(test_pipeline_depth);
+    RUN_TEST(test_pipeline_streaming_body);
+    RUN_TEST(test_pipeline_connection_close);
+    RUN_TEST(test_pipeline_retry);
+    RUN_TEST(test_pipeline_non_idempotent);
+    RUN_TEST(test_pipeline_abort);
+    return UNITY_END();
+}
@@ -0,0 +1,175 @@
+#include <Arduino.h>
+#include <unity.h>
+
+#pragma GCC diagnostic warning "-Wall"
+#pragma GCC diagnostic warning "-Wextra"
+#pragma GCC diagnostic warning "-Wstrict-aliasing"
+#pragma GCC diagnostic warning "-Wpointer-arith"
+#pragma GCC diagnostic warning "-Wstrict-overflow=5"
+
+#include <libs/IrCodes.h>
+
+#include <iterator>
+#include <string>
+
+namespace espurna {
+namespace ir {
+namespace codes {
+namespace test {
+namespace {
+
+std::vector<uint8_t> pack(const std::vector<uint16_t>& timings) {
+    std::vector<uint8_t> out;
+    packed::encode(timings.data(), timings.data() + timings.size(),
+        [&](uint8_t byte) {
+            out.push_back(byte);
+        });
+
+    return out;
+}
+
+std::string text(const std::vector<uint8_t>& data) {
+    std::string out;
+    packed::base64(data.data(), data.size(),
+        [&](const char* chunk, size_t length) {
+            out.append(chunk, length);
+        });
+
+    return out;
+}
+
+} // namespace
+
+void test_dictionary() {
+    Dictionary dictionary;
+    TEST_ASSERT_EQUAL(Dictionary::None, dictionary.find(0xff906f));
+
+    dictionary.reset(3);
+    TEST_ASSERT(dictionary.insert(0xff906f, 0));
+    TEST_ASSERT(dictionary.insert(0xffb847, 1));
+    TEST_ASSERT(dictionary.insert(0xe0e020df, 2));
+    TEST_ASSERT_FALSE(dictionary.insert(0xffb847, 5));
+    TEST_ASSERT_EQUAL(3, dictionary.size());
+
+    TEST_ASSERT_EQUAL(0, dictionary.find(0xff906f));
+    TEST_ASSERT_EQUAL(1, dictionary.find(0xffb847));
+    TEST_ASSERT_EQUAL(2, dictionary.find(0xe0e020df));
+    TEST_ASSERT_EQUAL(Dictionary::None, dictionary.find(0xfff807));
+    TEST_ASSERT_EQUAL(Dictionary::None, dictionary.find(0));
+}
+
+void test_dictionary_full() {
+    Dictionary dictionary;
+    dictionary.reset(64);
+
+    for (uint16_t index = 0; index < 64; ++index) {
+        TEST_ASSERT(dictionary.insert(0xff000000ull | (index << 8), index));
+    }
+
+    for (uint16_t index = 0; index < 64; ++index) {
+        TEST_ASSERT_EQUAL(index, dictionary.find(0xff000000ull | (index << 8)));
+    }
+
+    TEST_ASSERT_EQUAL(Dictionary::None, dictionary.find(0xff000001ull));
+}
+
+void test_packed_roundtrip() {
+    const std::vector<uint16_t> timings {
+        4500, 2250,
+        280, 280, 280, 280, 280, 280, 280, 845,
+        280, 845, 280, 845, 280, 280, 280,
+    };
+
+    const auto data = pack(timings);
+    TEST_ASSERT_LESS_THAN(timings.size() * 2, data.size());
+
+    std::vector<uint16_t> out;
+    TEST_ASSERT(packed::decode(data.data(), data.size(), 1024, out));
+    TEST_ASSERT(timings == out);
+}
+
+void test_packed_runs() {
+    // ON and OFF pair is only written once, followed by the number of repeats
+    std::vector<uint16_t> timings;
+    for (size_t index = 0; index < 32; ++index) {
+        timings.push_back(280);
+        timings.push_back(845);
+    }
+
+    const auto data = pack(timings);
+    const uint8_t expected[] {64, 0x98, 0x02, 0x9b, 0x0d, 30};
+    TEST_ASSERT_EQUAL(sizeof(expected), data.size());
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, data.data(), sizeof(expected));
+
+    std::vector<uint16_t> out;
+    TEST_ASSERT(packed::decode(data.data(), data.size(), 1024, out));
+    TEST_ASSERT(timings == out);
+}
+
+void test_packed_limits() {
+    const std::vector<uint16_t> timings {100, 200, 100, 200, 100, 200, 300};
+    const auto data = pack(timings);
+
+    std::vector<uint16_t> out;
+    TEST_ASSERT_FALSE(packed::decode(data.data(), data.size(), 6, out));
+
+    out.clear();
+    TEST_ASSERT_FALSE(packed::decode(data.data(), data.size() - 1, 1024, out));
+
+    auto extra = data;
+    extra.push_back(1);
+
+    out.clear();
+    TEST_ASSERT_FALSE(packed::decode(extra.data(), extra.size(), 1024, out));
+
+    // repeat count that goes past the total
+    const uint8_t overflow[] {4, 10, 41, 5};
+    out.clear();
+    TEST_ASSERT_FALSE(packed::decode(overflow, sizeof(overflow), 1024, out));
+
+    // value that does not fit
+    const std::vector<uint32_t> large {70000, 100};
+    std::vector<uint8_t> large_data;
+    packed::encode(large.data(), large.data() + large.size(),
+        [&](uint8_t byte) {
+            large_data.push_back(byte);
+        });
+
+    out.clear();
+    TEST_ASSERT_FALSE(packed::decode(large_data.data(), large_data.size(), 1024, out));
+}
+
+void test_base64() {
+    const std::string input("espurna");
+    const std::vector<uint8_t> data(input.begin(), input.end());
+    TEST_ASSERT_EQUAL_STRING("ZXNwdXJuYQ==", text(data).c_str());
+
+    const char encoded[] = "ZXNwdXJuYQ";
+
+    std::vector<uint8_t> out;
+    TEST_ASSERT(packed::unbase64(std::begin(encoded), std::end(encoded) - 1, out));
+    TEST_ASSERT(data == out);
+
+    const char invalid[] = "ZXN*dXJu";
+
+    out.clear();
+    TEST_ASSERT_FALSE(packed::unbase64(std::begin(invalid), std::end(invalid) - 1, out));
+}
+
+} // namespace test
+} // namespace codes
+} // namespace ir
+} // namespace espurna
+
+int main(int, char**) {
+    using namespace espurna::ir::codes::test;
+
+    UNITY_BEGIN();
+    RUN_TEST(test_dictionary);
+    RUN_TEST(test_dictionary_full);
+    RUN_TEST(test_packed_roundtrip);
+    RUN_TEST(test_packed_runs);
+    RUN_TEST(test_packed_limits);
+    RUN_TEST(test_base64);
+    return UNITY_END();
+}
@@ -0,0 +1,288 @@
+#include <Arduino.h>
+#include <unity.h>
+
+#pragma GCC diagnostic warning "-Wall"
+#pragma GCC diagnostic warning "-Wextra"
+#pragma GCC diagnostic warning "-Wstrict-aliasing"
+#pragma GCC diagnostic warning "-Wpointer-arith"
+#pragma GCC diagnostic warning "-Wstrict-overflow=5"
+
+#include <libs/Journal.h>
+
+#include <array>
+#include <cstdio>
+#include <cstring>
+
+namespace espurna {
+namespace journal {
+namespace test {
+
+// Behaves like a NOR flash, write can only clear bits that were set by the erase
+template <size_t Sectors, size_t SectorSize>
+struct FlashStorage {
+    using Sector = std::array<uint8_t, SectorSize>;
+    using Blob = std::array<Sector, Sectors>;
+
+    explicit FlashStorage(Blob& blob) :
+        _blob(blob)
+    {}
+
+    size_t sectors() const {
+        return Sectors;
+    }
+
+    size_t sector_size() const {
+        return SectorSize;
+    }
+
+    bool erase(size_t sector) {
+        TEST_ASSERT_LESS_THAN(Sectors, sector);
+        _blob[sector].fill(0xff);
+        ++erases[sector];
+        return true;
+    }
+
+    bool read(size_t sector, size_t offset, Record& out) {
+        TEST_ASSERT_LESS_THAN(Sectors, sector);
+        TEST_ASSERT_LESS_OR_EQUAL(SectorSize, (offset + 1) * sizeof(Record));
+        std::memcpy(&out, _blob[sector].data() + (offset * sizeof(Record)), sizeof(Record));
+        return true;
+    }
+
+    bool write(size_t sector, size_t offset, const Record& record) {
+        TEST_ASSERT_LESS_THAN(Sectors, sector);
+        TEST_ASSERT_LESS_OR_EQUAL(SectorSize, (offset + 1) * sizeof(Record));
+
+        const auto* input = reinterpret_cast<const uint8_t*>(&record);
+        auto* output = _blob[sector].data() + (offset * sizeof(Record));
+        for (size_t index = 0; index < sizeof(Record); ++index) {
+            output[index] &= input[index];
+        }
+
+        ++writes;
+        return true;
+    }
+
+    size_t total_erases() const {
+        size_t out { 0 };
+        for (auto& erase : erases) {
+            out += erase;
+        }
+
+        return out;
+    }
+
+    Blob& _blob;
+    std::array<size_t, Sectors> erases{};
+    size_t writes { 0 };
+};
+
+} // namespace test
+} // namespace journal
+} // namespace espurna
+
+using espurna::journal::Journal;
+using espurna::journal::Record;
+using espurna::journal::Value;
+
+using Storage = espurna::journal::test::FlashStorage<4, 4096>;
+
+namespace {
+
+Storage::Blob blob;
+
+Storage::Blob& erased() {
+    for (auto& sector : blob) {
+        sector.fill(0xff);
+    }
+
+    return blob;
+}
+
+Value value(uint32_t first, uint32_t second) {
+    return Value{
+        .data = {first, second},
+        .timestamp = 0,
+    };
+}
+
+} // namespace
+
+void test_empty() {
+    Journal<Storage> journal(Storage{erased()});
+    journal.begin();
+
+    TEST_ASSERT_EQUAL(0, journal.entries().size());
+    TEST_ASSERT_EQUAL(0, journal.sequence());
+
+    Value out;
+    TEST_ASSERT_FALSE(journal.get(0, out));
+}
+
+void test_garbage() {
+    for (auto& sector : blob) {
+        for (size_t index = 0; index < sector.size(); ++index) {
+            sector[index] = static_cast<uint8_t>(index * 31);
+        }
+    }
+
+    Journal<Storage> journal(Storage{blob});
+    journal.begin();
+    TEST_ASSERT_EQUAL(0, journal.entries().size());
+
+    TEST_ASSERT(journal.append(1, value(5, 10)));
+    TEST_ASSERT_EQUAL(1, journal.storage().total_erases());
+
+    Journal<Storage> restored(Storage{blob});
+    restored.begin();
+
+    Value out;
+    TEST_ASSERT(restored.get(1, out));
+    TEST_ASSERT_EQUAL(5, out.data[0]);
+    TEST_ASSERT_EQUAL(10, out.data[1]);
+}
+
+void test_restore() {
+    Journal<Storage> journal(Storage{erased()});
+    journal.begin();
+
+    for (uint32_t number = 0; number < 1000; ++number) {
+        TEST_ASSERT(journal.append(0, value(number, number * 2)));
+        TEST_ASSERT(journal.append(1, value(number * 3, number * 4)));
+    }
+
+    Journal<Storage> restored(Storage{blob});
+    restored.begin();
+
+    TEST_ASSERT_EQUAL(2, restored.entries().size());
+    TEST_ASSERT_EQUAL(journal.sequence(), restored.sequence());
+    TEST_ASSERT_EQUAL(journal.head(), restored.head());
+    TEST_ASSERT_EQUAL(journal.offset(), restored.offset());
+
+    Value out;
+    TEST_ASSERT(restored.get(0, out));
+    TEST_ASSERT_EQUAL(999, out.data[0]);
+    TEST_ASSERT_EQUAL(1998, out.data[1]);
+
+    TEST_ASSERT(restored.get(1, out));
+    TEST_ASSERT_EQUAL(2997, out.data[0]);
+    TEST_ASSERT_EQUAL(3996, out.data[1]);
+}
+
+void test_unchanged() {
+    Journal<Storage> journal(Storage{erased()});
+    journal.begin();
+
+    TEST_ASSERT(journal.append(0, value(1, 1)));
+    TEST_ASSERT(journal.append(0, value(1, 1)));
+    TEST_ASSERT(journal.append(0, value(1, 1)));
+    TEST_ASSERT_EQUAL(1, journal.storage().writes);
+}
+
+void test_torn_write() {
+    Journal<Storage> journal(Storage{erased()});
+    journal.begin();
+
+    TEST_ASSERT(journal.append(0, value(100, 0)));
+    TEST_ASSERT(journal.append(0, value(200, 0)));
+
+    // emulate power loss in the middle of the write. record is only partially written
+    const auto offset = journal.offset();
+    auto* ptr = blob[journal.head()].data() + (offset * sizeof(Record));
+    std::memset(ptr, 0, sizeof(Record) / 2);
+
+    Journal<Storage> restored(Storage{blob});
+    restored.begin();
+    TEST_ASSERT_EQUAL(offset + 1, restored.offset());
+
+    Value out;
+    TEST_ASSERT(restored.get(0, out));
+    TEST_ASSERT_EQUAL(200, out.data[0]);
+
+    TEST_ASSERT(restored.append(0, value(300, 0)));
+
+    Journal<Storage> again(Storage{blob});
+    again.begin();
+    TEST_ASSERT(again.get(0, out));
+    TEST_ASSERT_EQUAL(300, out.data[0]);
+}
+
+void test_interrupted_rotation() {
+    Journal<Storage> journal(Storage{erased()});
+    journal.begin();
+
+    const auto records = journal.records();
+
+    TEST_ASSERT(journal.append(0, value(1, 0)));
+    for (uint32_t number = 1; journal.offset() < records; ++number) {
+        TEST_ASSERT(journal.append(1, value(number, 0)));
+    }
+
+    const auto head = journal.head();
+    TEST_ASSERT(journal.append(1, value(12345, 0)));
+    TEST_ASSERT_NOT_EQUAL(head, journal.head());
+
+    // carry forward of the id #0 never happened, only the #1 was written
+    auto& sector = blob[journal.head()];
+    std::memmove(sector.data(), sector.data() + (2 * sizeof(Record)), sizeof(Record));
+    std::fill(sector.begin() + sizeof(Record), sector.end(), 0xff);
+
+    Journal<Storage> restored(Storage{blob});
+    restored.begin();
+    TEST_ASSERT_EQUAL(2, restored.entries().size());
+
+    Value out;
+    TEST_ASSERT(restored.get(0, out));
+    TEST_ASSERT_EQUAL(1, out.data[0]);
+
+    TEST_ASSERT(restored.get(1, out));
+    TEST_ASSERT_EQUAL(12345, out.data[0]);
+}
+
+// Energy is saved every 'snsSave' readings, which happen every 'snsRead' seconds.
+// Compare the number of erases with the settings storage, which erases a sector on every commit.
+void test_erases_per_day() {
+    constexpr size_t Counters = 4;
+    constexpr size_t SecondsPerDay = 60 * 60 * 24;
+    constexpr size_t SaveInterval = 6 * 10;
+
+    Journal<Storage> journal(Storage{erased()});
+    journal.begin();
+
+    uint32_t energy[Counters] {};
+    size_t saves { 0 };
+
+    for (size_t second = 0; second < SecondsPerDay; second += SaveInterval) {
+        for (size_t index = 0; index < Counters; ++index) {
+            energy[index] += 3600 * (index + 1);
+            TEST_ASSERT(journal.append(index, value(energy[index] / 3600000, energy[index] % 3600000)));
+            ++saves;
+        }
+    }
+
+    const auto& storage = journal.storage();
+
+    char message[128];
+    std::snprintf(message, sizeof(message),
+        "%zu saves per day, %zu erases total (%zu per sector), instead of %zu",
+        saves, storage.total_erases(), storage.total_erases() / storage.sectors(),
+        saves / Counters);
+    TEST_MESSAGE(message);
+
+    // first sector does not need to carry anything forward
+    const auto records = journal.records();
+    const auto expected = 1 + ((saves - records) + (records - Counters) - 1) / (records - Counters);
+    TEST_ASSERT_EQUAL(expected, storage.total_erases());
+}
+
+int main(int, char**) {
+    UNITY_BEGIN();
+    RUN_TEST(test_empty);
+    RUN_TEST(test_garbage);
+    RUN_TEST(test_restore);
+    RUN_TEST(test_unchanged);
+    RUN_TEST(test_torn_write);
+    RUN_TEST(test_interrupted_rotation);
+    RUN_TEST(test_erases_per_day);
+    return UNITY_END();
+}
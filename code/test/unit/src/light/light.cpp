@@ -0,0 +1,276 @@
+#include <Arduino.h>
+#include <unity.h>
+
+#pragma GCC diagnostic warning "-Wall"
+#pragma GCC diagnostic warning "-Wextra"
+#pragma GCC diagnostic warning "-Wstrict-aliasing"
+#pragma GCC diagnostic warning "-Wpointer-arith"
+#pragma GCC diagnostic warning "-Wstrict-overflow=5"
+
+#include "light_transition.h"
+
+#include <cstdio>
+#include <set>
+#include <vector>
+
+using namespace espurna::light::transition;
+
+namespace {
+
+constexpr long ValueMax { 255 };
+
+constexpr auto GammaTable = table::gamma(2.2);
+
+uint16_t read_gamma(size_t index) {
+    return GammaTable[index];
+}
+
+Fixed gamma(Fixed value, long max, uint32_t resolution) {
+    return espurna::light::transition::gamma(read_gamma, value, max, resolution);
+}
+
+using Samples = std::vector<Fixed>;
+
+// Same as the transition handler, every step the provider receives the current value
+Samples render(Easing easing, long from, long to, size_t steps) {
+    Samples out;
+
+    const Curve curve(easing, fixed(from), fixed(to), ValueMax);
+    for (size_t step = 1; step <= steps; ++step) {
+        out.push_back(curve.at(progress(step, steps)));
+    }
+
+    return out;
+}
+
+// Duty values the provider would actually use with the specific resolution
+std::set<uint32_t> duty(const Samples& samples, uint32_t resolution) {
+    std::set<uint32_t> out;
+    for (auto sample : samples) {
+        out.insert(static_cast<uint32_t>(
+            (static_cast<int64_t>(sample) * resolution) / fixed(ValueMax)));
+    }
+
+    return out;
+}
+
+bool monotonic(const Samples& samples, bool increasing) {
+    for (size_t index = 1; index < samples.size(); ++index) {
+        if (increasing && (samples[index] < samples[index - 1])) {
+            return false;
+        }
+
+        if (!increasing && (samples[index] > samples[index - 1])) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+Fixed largest_step(Fixed from, const Samples& samples) {
+    Fixed out { 0 };
+    Fixed previous { from };
+
+    for (auto sample : samples) {
+        const auto diff = std::abs(sample - previous);
+        if (diff > out) {
+            out = diff;
+        }
+
+        previous = sample;
+    }
+
+    return out;
+}
+
+constexpr Easing Easings[] {
+    Easing::Linear,
+    Easing::InOut,
+    Easing::Perceptual,
+};
+
+const char* name(Easing easing) {
+    switch (easing) {
+    case Easing::Linear:
+        return "linear";
+    case Easing::InOut:
+        return "inout";
+    case Easing::Perceptual:
+        return "perceptual";
+    }
+
+    return "";
+}
+
+} // namespace
+
+void test_fixed() {
+    TEST_ASSERT_EQUAL(0, fixed(0));
+    TEST_ASSERT_EQUAL(255 * 65536, fixed(255));
+    TEST_ASSERT_EQUAL(128, integral(fixed(128)));
+    TEST_ASSERT_EQUAL(129, integral(fixed(128) + (One / 2)));
+
+    TEST_ASSERT_EQUAL(0, progress(0, 50));
+    TEST_ASSERT_EQUAL(One / 2, progress(25, 50));
+    TEST_ASSERT_EQUAL(One, progress(50, 50));
+    TEST_ASSERT_EQUAL(One, progress(1, 0));
+
+    TEST_ASSERT_EQUAL(fixed(100), lerp(fixed(0), fixed(200), One / 2));
+    TEST_ASSERT_EQUAL(fixed(100), lerp(fixed(200), fixed(0), One / 2));
+}
+
+void test_endpoints() {
+    for (auto easing : Easings) {
+        TEST_MESSAGE(name(easing));
+
+        const Curve up(easing, fixed(10), fixed(200), ValueMax);
+        TEST_ASSERT_INT_WITHIN(One / 64, fixed(10), up.at(0));
+        TEST_ASSERT_EQUAL(fixed(200), up.at(One));
+
+        const Curve down(easing, fixed(255), fixed(0), ValueMax);
+        TEST_ASSERT_INT_WITHIN(One / 64, fixed(255), down.at(0));
+        TEST_ASSERT_EQUAL(fixed(0), down.at(One));
+    }
+}
+
+void test_monotonic() {
+    const long pairs[][2] {
+        {0, 255}, {255, 0}, {0, 1}, {1, 0}, {3, 7}, {100, 101}, {254, 255}, {200, 20},
+    };
+
+    for (auto easing : Easings) {
+        for (auto& pair : pairs) {
+            for (size_t steps : {1, 2, 7, 50, 500}) {
+                const auto samples = render(easing, pair[0], pair[1], steps);
+                TEST_ASSERT_EQUAL(steps, samples.size());
+                TEST_ASSERT(monotonic(samples, pair[1] > pair[0]));
+                TEST_ASSERT_EQUAL(fixed(pair[1]), samples.back());
+            }
+        }
+    }
+}
+
+void test_smooth() {
+    constexpr size_t Steps { 50 };
+    const Fixed rate { fixed(255) / static_cast<Fixed>(Steps) };
+
+    // every step of the linear transition is the same, rounding aside
+    const auto linear = render(Easing::Linear, 0, 255, Steps);
+    TEST_ASSERT_INT_WITHIN(One / 256, rate, largest_step(0, linear));
+
+    // smoothstep peaks at 1.5x of the linear rate in the middle
+    const auto inout = render(Easing::InOut, 0, 255, Steps);
+    TEST_ASSERT_LESS_OR_EQUAL(rate * 3 / 2 + One / 8, largest_step(0, inout));
+    TEST_ASSERT_LESS_THAN(rate, inout[1] - inout[0]);
+    TEST_ASSERT_LESS_THAN(rate, inout[Steps - 1] - inout[Steps - 2]);
+
+    // perceptual has the steepest slope at the end, Y = L^3 means 3x the rate at most
+    const auto perceptual = render(Easing::Perceptual, 0, 255, Steps);
+    TEST_ASSERT_LESS_OR_EQUAL(rate * 3, largest_step(0, perceptual));
+    TEST_ASSERT_LESS_THAN(linear[Steps / 2], perceptual[Steps / 2]);
+}
+
+void test_low_brightness() {
+    // Previously, float step was at least 1.0 of the [0:255] value, transition from 0 to 2
+    // would only have two steps and 10bit PWM would see duty jumping by 4 units at a time
+    constexpr size_t Steps { 50 };
+    const auto samples = render(Easing::Linear, 0, 2, Steps);
+
+    const auto ten = duty(samples, 1023);
+    const auto sixteen = duty(samples, 65535);
+
+    char message[128];
+    std::snprintf(message, sizeof(message),
+        "0 -> 2 in %zu steps, %zu duty values with 10bit and %zu with 16bit PWM",
+        Steps, ten.size(), sixteen.size());
+    TEST_MESSAGE(message);
+
+    TEST_ASSERT_EQUAL(9, ten.size());
+    TEST_ASSERT_EQUAL(Steps, sixteen.size());
+}
+
+void test_gamma() {
+    TEST_ASSERT_EQUAL(0, gamma(0, ValueMax, 1023));
+    TEST_ASSERT_EQUAL(fixed(ValueMax), gamma(fixed(ValueMax), ValueMax, 1023));
+
+    // compare with the 8bit table, which used to be the only option
+    TEST_ASSERT_INT_WITHIN(2 * One, fixed(55), gamma(fixed(128), ValueMax, 1023));
+    TEST_ASSERT_INT_WITHIN(2 * One, fixed(223), gamma(fixed(240), ValueMax, 1023));
+
+    // values are rounded to the nearest provider step
+    for (uint32_t resolution : {255u, 1023u, 4095u, 65535u}) {
+        Fixed previous { 0 };
+        std::set<Fixed> values;
+        for (long value = 0; value <= ValueMax; ++value) {
+            const auto out = gamma(fixed(value), ValueMax, resolution);
+            TEST_ASSERT_GREATER_OR_EQUAL(previous, out);
+
+            const int64_t max { fixed(ValueMax) };
+            const auto steps = ((out * static_cast<int64_t>(resolution)) + (max / 2)) / max;
+            TEST_ASSERT_EQUAL(out, ((steps * max) + (resolution / 2)) / resolution);
+
+            values.insert(out);
+            previous = out;
+        }
+
+        // 8bit table maps first 16 values to 0 and has only ~160 unique entries
+        if (resolution >= 4095) {
+            TEST_ASSERT_GREATER_THAN(240, values.size());
+        }
+    }
+
+    // 8bit table would have kept the output at 0 for the first 16 input values
+    TEST_ASSERT_GREATER_THAN(0, gamma(fixed(2), ValueMax, 65535));
+}
+
+void test_table() {
+    static_assert(GammaTable.front() == 0, "");
+    static_assert(GammaTable.back() == table::OutputMax, "");
+
+    // generated at compile time, but should still match the runtime math
+    for (size_t index = 0; index < table::Size; ++index) {
+        const auto input = static_cast<double>(index) / static_cast<double>(table::Size - 1);
+        const auto expected = std::lround(std::pow(input, 2.2) * table::OutputMax);
+        TEST_ASSERT_INT_WITHIN(1, expected, GammaTable[index]);
+    }
+
+    // interpolated values are between the two nearest entries
+    for (long value = 0; value < ValueMax; ++value) {
+        for (Fixed fraction = 0; fraction < One; fraction += One / 16) {
+            const auto input = fixed(value) + fraction;
+            const auto output = table::lookup(read_gamma, input, ValueMax);
+
+            const auto expected = std::pow(toFloat(input) / ValueMax, 2.2) * table::OutputMax;
+            TEST_ASSERT_FLOAT_WITHIN(table::OutputMax / 512.0f, expected, static_cast<float>(output));
+        }
+    }
+
+    TEST_ASSERT_EQUAL(table::OutputMax, table::lookup(read_gamma, fixed(ValueMax), ValueMax));
+}
+
+void test_cie() {
+    TEST_ASSERT_EQUAL(0, cie::luminance(0));
+    TEST_ASSERT_INT_WITHIN(2, One, cie::luminance(One));
+    TEST_ASSERT_INT_WITHIN(2, One, cie::lightness(One));
+
+    // L* of 50 is about 18% grey
+    TEST_ASSERT_INT_WITHIN(One / 200, (One * 1842) / 10000, cie::luminance(One / 2));
+
+    for (Fixed value = 0; value <= One; value += One / 256) {
+        TEST_ASSERT_INT_WITHIN(One / 500, value, cie::luminance(cie::lightness(value)));
+    }
+}
+
+int main(int, char**) {
+    UNITY_BEGIN();
+    RUN_TEST(test_fixed);
+    RUN_TEST(test_endpoints);
+    RUN_TEST(test_monotonic);
+    RUN_TEST(test_smooth);
+    RUN_TEST(test_low_brightness);
+    RUN_TEST(test_gamma);
+    RUN_TEST(test_table);
+    RUN_TEST(test_cie);
+    return UNITY_END();
+}
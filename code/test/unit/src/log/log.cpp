@@ -0,0 +1,257 @@
+#include <Arduino.h>
+#include <unity.h>
+
+#pragma GCC diagnostic warning "-Wall"
+#pragma GCC diagnostic warning "-Wextra"
+#pragma GCC diagnostic warning "-Wstrict-aliasing"
+#pragma GCC diagnostic warning "-Wpointer-arith"
+#pragma GCC diagnostic warning "-Wstrict-overflow=5"
+
+#include <libs/LogRing.h>
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace espurna {
+namespace debug {
+namespace test {
+namespace {
+
+bool append(LogRing& ring, const char* message, uint32_t timestamp = 0) {
+    return ring.append(timestamp, 0, message, std::strlen(message));
+}
+
+std::vector<std::string> read(LogRing& ring, LogRing::Cursor& cursor) {
+    std::vector<std::string> out;
+    ring.read(cursor, [&](const LogRing::Record& record) {
+        TEST_ASSERT_EQUAL('\0', record.data[record.length]);
+        out.emplace_back(record.data, record.length);
+        return true;
+    });
+
+    return out;
+}
+
+} // namespace
+
+void test_capacity() {
+    LogRing empty;
+    TEST_ASSERT_FALSE(empty);
+    TEST_ASSERT_FALSE(append(empty, "hello"));
+
+    LogRing small(16);
+    TEST_ASSERT_FALSE(small);
+
+    LogRing ring(1000);
+    TEST_ASSERT_TRUE(ring);
+    TEST_ASSERT_EQUAL(512, ring.capacity());
+    TEST_ASSERT_EQUAL(0, ring.size());
+}
+
+void test_append_read() {
+    LogRing ring(256);
+
+    auto cursor = ring.begin();
+    TEST_ASSERT_EQUAL(0, read(ring, cursor).size());
+
+    TEST_ASSERT_TRUE(ring.append(1234, 1, "first\n", 6));
+    TEST_ASSERT_TRUE(append(ring, "second\n"));
+
+    size_t index { 0 };
+    ring.read(cursor, [&](const LogRing::Record& record) {
+        switch (index++) {
+        case 0:
+            TEST_ASSERT_EQUAL(1234, record.timestamp);
+            TEST_ASSERT_EQUAL(1, record.flags);
+            TEST_ASSERT_EQUAL_STRING("first\n", record.data);
+            break;
+        case 1:
+            TEST_ASSERT_EQUAL(0, record.timestamp);
+            TEST_ASSERT_EQUAL(0, record.flags);
+            TEST_ASSERT_EQUAL_STRING("second\n", record.data);
+            break;
+        }
+        return true;
+    });
+
+    TEST_ASSERT_EQUAL(2, index);
+    TEST_ASSERT_EQUAL(0, cursor.dropped);
+    TEST_ASSERT_EQUAL(0, read(ring, cursor).size());
+
+    // new cursors only see the newer records
+    auto late = ring.end();
+    TEST_ASSERT_TRUE(append(ring, "third\n"));
+    TEST_ASSERT_EQUAL(1, read(ring, late).size());
+    TEST_ASSERT_EQUAL(1, read(ring, cursor).size());
+}
+
+void test_independent_cursors() {
+    LogRing ring(256);
+
+    auto fast = ring.begin();
+    auto slow = ring.begin();
+
+    append(ring, "one");
+    append(ring, "two");
+    TEST_ASSERT_EQUAL(2, read(ring, fast).size());
+
+    append(ring, "three");
+    TEST_ASSERT_EQUAL(1, read(ring, fast).size());
+
+    const auto out = read(ring, slow);
+    TEST_ASSERT_EQUAL(3, out.size());
+    TEST_ASSERT_EQUAL_STRING("one", out[0].c_str());
+    TEST_ASSERT_EQUAL_STRING("three", out[2].c_str());
+}
+
+// Reader that is unable to handle the record leaves it in place
+void test_partial_read() {
+    LogRing ring(256);
+    auto cursor = ring.begin();
+
+    append(ring, "one");
+    append(ring, "two");
+    append(ring, "three");
+
+    size_t budget { 2 };
+    TEST_ASSERT_EQUAL(2, ring.read(cursor, [&](const LogRing::Record&) {
+        if (!budget) {
+            return false;
+        }
+
+        --budget;
+        return true;
+    }));
+
+    const auto out = read(ring, cursor);
+    TEST_ASSERT_EQUAL(1, out.size());
+    TEST_ASSERT_EQUAL_STRING("three", out[0].c_str());
+}
+
+// Slow reader loses the oldest records, but is aware of how much was lost
+void test_eviction() {
+    LogRing ring(128);
+
+    auto cursor = ring.begin();
+    auto other = ring.begin();
+
+    char message[32];
+    for (int index = 0; index < 100; ++index) {
+        std::snprintf(message, sizeof(message), "message %d", index);
+        TEST_ASSERT_TRUE(append(ring, message));
+        TEST_ASSERT_LESS_OR_EQUAL(ring.capacity(), ring.size());
+
+        // keep up with everything
+        TEST_ASSERT_EQUAL(1, read(ring, other).size());
+    }
+
+    TEST_ASSERT_EQUAL(0, other.dropped);
+
+    const auto out = read(ring, cursor);
+    TEST_ASSERT_GREATER_THAN(0, out.size());
+    TEST_ASSERT_EQUAL(100, out.size() + cursor.dropped);
+    TEST_ASSERT_EQUAL(cursor.dropped, ring.evicted());
+    TEST_ASSERT_EQUAL_STRING("message 99", out.back().c_str());
+
+    std::snprintf(message, sizeof(message), "message %u", cursor.dropped);
+    TEST_ASSERT_EQUAL_STRING(message, out.front().c_str());
+}
+
+// Records are never split between the end and the start of the storage
+void test_wrap_around() {
+    LogRing ring(64);
+    auto cursor = ring.begin();
+
+    const char* messages[] {
+        "abcdefghijkl",
+        "mnopqrstuvw",
+        "xyz",
+        "0123456789",
+        "short",
+        "a",
+        "something longer",
+    };
+
+    for (size_t round = 0; round < 50; ++round) {
+        for (auto* message : messages) {
+            TEST_ASSERT_TRUE(append(ring, message));
+
+            const auto out = read(ring, cursor);
+            TEST_ASSERT_EQUAL(1, out.size());
+            TEST_ASSERT_EQUAL_STRING(message, out[0].c_str());
+        }
+    }
+
+    TEST_ASSERT_EQUAL(0, cursor.dropped);
+}
+
+void test_truncation() {
+    LogRing ring(64);
+    auto cursor = ring.begin();
+
+    const std::string message(200, 'x');
+    TEST_ASSERT_TRUE(ring.append(0, 0, message.data(), message.size()));
+
+    const auto out = read(ring, cursor);
+    TEST_ASSERT_EQUAL(1, out.size());
+    TEST_ASSERT_EQUAL(ring.maxLength(), out[0].size());
+}
+
+// Records appended while reading are not visited when reading is limited
+void test_read_until() {
+    LogRing ring(256);
+    auto cursor = ring.begin();
+
+    append(ring, "one");
+    append(ring, "two");
+
+    const auto until = ring.end().position;
+
+    size_t count { 0 };
+    ring.read(cursor, until, [&](const LogRing::Record&) {
+        append(ring, "more");
+        ++count;
+        return true;
+    });
+
+    TEST_ASSERT_EQUAL(2, count);
+    TEST_ASSERT_EQUAL(2, read(ring, cursor).size());
+}
+
+void test_skip() {
+    LogRing ring(128);
+    auto cursor = ring.begin();
+
+    for (int index = 0; index < 50; ++index) {
+        append(ring, "something");
+    }
+
+    ring.skip(cursor);
+    TEST_ASSERT_EQUAL(0, read(ring, cursor).size());
+    TEST_ASSERT_EQUAL(0, cursor.dropped);
+
+    append(ring, "else");
+    TEST_ASSERT_EQUAL(1, read(ring, cursor).size());
+}
+
+} // namespace test
+} // namespace debug
+} // namespace espurna
+
+int main(int, char**) {
+    using namespace espurna::debug::test;
+
+    UNITY_BEGIN();
+    RUN_TEST(test_capacity);
+    RUN_TEST(test_append_read);
+    RUN_TEST(test_independent_cursors);
+    RUN_TEST(test_partial_read);
+    RUN_TEST(test_eviction);
+    RUN_TEST(test_wrap_around);
+    RUN_TEST(test_truncation);
+    RUN_TEST(test_read_until);
+    RUN_TEST(test_skip);
+    return UNITY_END();
+}
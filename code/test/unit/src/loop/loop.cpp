@@ -0,0 +1,135 @@
+#include <Arduino.h>
+#include <unity.h>
+
+#pragma GCC diagnostic warning "-Wall"
+#pragma GCC diagnostic warning "-Wextra"
+#pragma GCC diagnostic warning "-Wstrict-aliasing"
+#pragma GCC diagnostic warning "-Wpointer-arith"
+#pragma GCC diagnostic warning "-Wstrict-overflow=5"
+
+#include <loop_profiler.h>
+
+#include <algorithm>
+#include <vector>
+
+namespace espurna {
+namespace loop {
+namespace profiler {
+namespace test {
+namespace {
+
+void test_buckets() {
+    TEST_ASSERT_EQUAL(0, Histogram::bucket(0));
+    TEST_ASSERT_EQUAL(0, Histogram::bucket(1));
+    TEST_ASSERT_EQUAL(0, Histogram::bucket((1 << (Histogram::Shift + 1)) - 1));
+    TEST_ASSERT_EQUAL(1, Histogram::bucket(1 << (Histogram::Shift + 1)));
+    TEST_ASSERT_EQUAL(Histogram::Buckets - 1, Histogram::bucket(0xffffffff));
+
+    for (size_t bucket = 0; bucket < Histogram::Buckets; ++bucket) {
+        TEST_ASSERT_EQUAL(bucket, Histogram::bucket(Histogram::lower(bucket)));
+        TEST_ASSERT_EQUAL(bucket, Histogram::bucket(Histogram::upper(bucket) - 1));
+        if (bucket + 1 < Histogram::Buckets) {
+            TEST_ASSERT_EQUAL(Histogram::upper(bucket), Histogram::lower(bucket + 1));
+        }
+    }
+}
+
+void test_stats() {
+    Stats stats;
+    TEST_ASSERT_EQUAL(0, stats.average());
+    TEST_ASSERT_EQUAL(0, stats.percentile(99));
+
+    constexpr uint32_t Budget { 10000 };
+    for (uint32_t value : {1000, 2000, 3000, 20000}) {
+        stats.add(value, Budget);
+    }
+
+    TEST_ASSERT_EQUAL(4, stats.count);
+    TEST_ASSERT_EQUAL(1000, stats.min);
+    TEST_ASSERT_EQUAL(20000, stats.max);
+    TEST_ASSERT_EQUAL(6500, stats.average());
+    TEST_ASSERT_EQUAL(1, stats.overruns);
+
+    // never outside of the real values
+    TEST_ASSERT_EQUAL(20000, stats.percentile(99));
+    TEST_ASSERT_EQUAL(1000, stats.percentile(1));
+
+    // budget of 0 means overruns are not counted
+    Stats other;
+    other.add(0xffffffff, 0);
+    TEST_ASSERT_EQUAL(0, other.overruns);
+}
+
+// Percentile is only an estimate, but it should never be further away than the bucket width
+void test_percentile() {
+    std::vector<uint32_t> values;
+
+    uint32_t seed { 12345 };
+    for (size_t index = 0; index < 10000; ++index) {
+        seed = (seed * 1103515245) + 12345;
+        values.push_back(((seed >> 8) % 50000) + 500);
+    }
+
+    // few very slow ones, which should not be visible in p99 but are in the max
+    for (size_t index = 0; index < 50; ++index) {
+        values.push_back(10000000);
+    }
+
+    Stats stats;
+    for (auto value : values) {
+        stats.add(value, 100000);
+    }
+
+    TEST_ASSERT_EQUAL(50, stats.overruns);
+    TEST_ASSERT_EQUAL(10000000, stats.max);
+
+    std::sort(values.begin(), values.end());
+    for (uint32_t percent : {50, 90, 99}) {
+        const auto rank = ((values.size() * percent) + 99) / 100 - 1;
+        const auto expected = values[rank];
+        const auto bucket = Histogram::bucket(expected);
+        const auto width = Histogram::upper(bucket) - Histogram::lower(bucket);
+        TEST_ASSERT_UINT32_WITHIN(width, expected, stats.percentile(percent));
+    }
+
+    TEST_ASSERT_LESS_THAN(10000000, stats.percentile(99));
+    TEST_ASSERT_EQUAL(10000000, stats.percentile(100));
+}
+
+void test_report() {
+    Stats stats;
+    const auto empty = report(stats, [](uint32_t value) {
+        return value / 80;
+    });
+    TEST_ASSERT_EQUAL(0, empty.count);
+    TEST_ASSERT_EQUAL(0, empty.min);
+    TEST_ASSERT_EQUAL(0, empty.max);
+
+    stats.add(800, 0);
+    stats.add(1600, 0);
+
+    const auto out = report(stats, [](uint32_t value) {
+        return value / 80;
+    });
+    TEST_ASSERT_EQUAL(2, out.count);
+    TEST_ASSERT_EQUAL(10, out.min);
+    TEST_ASSERT_EQUAL(15, out.average);
+    TEST_ASSERT_EQUAL(20, out.max);
+    TEST_ASSERT_EQUAL(0, out.overruns);
+}
+
+} // namespace
+} // namespace test
+} // namespace profiler
+} // namespace loop
+} // namespace espurna
+
+int main(int, char**) {
+    UNITY_BEGIN();
+    using namespace espurna::loop::profiler::test;
+    RUN_TEST(test_buckets);
+    RUN_TEST(test_stats);
+    RUN_TEST(test_percentile);
+    RUN_TEST(test_report);
+    return UNITY_END();
+}
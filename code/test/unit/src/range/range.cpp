@@ -0,0 +1,84 @@
+#include <Arduino.h>
+#include <unity.h>
+
+#pragma GCC diagnostic warning "-Wall"
+#pragma GCC diagnostic warning "-Wextra"
+#pragma GCC diagnostic warning "-Wstrict-aliasing"
+#pragma GCC diagnostic warning "-Wpointer-arith"
+#pragma GCC diagnostic warning "-Wstrict-overflow=5"
+
+#include <libs/HttpRange.h>
+
+namespace espurna {
+namespace web {
+namespace range {
+namespace test {
+namespace {
+
+constexpr size_t Total { 1000 };
+
+void assert_partial(const char* value, size_t start, size_t end) {
+    const auto range = parse(value, Total);
+    TEST_ASSERT(Range::Type::Partial == range.type);
+    TEST_ASSERT_EQUAL(start, range.start);
+    TEST_ASSERT_EQUAL(end, range.end);
+    TEST_ASSERT_EQUAL(end - start + 1, range.length());
+}
+
+void assert_type(const char* value, Range::Type type) {
+    TEST_ASSERT(type == parse(value, Total).type);
+}
+
+} // namespace
+
+void test_partial() {
+    assert_partial("bytes=0-499", 0, 499);
+    assert_partial("bytes=500-999", 500, 999);
+    assert_partial("bytes=999-999", 999, 999);
+    assert_partial("bytes=500-", 500, 999);
+    assert_partial("bytes=-100", 900, 999);
+}
+
+void test_clamped() {
+    assert_partial("bytes=900-5000", 900, 999);
+    assert_partial("bytes=-5000", 0, 999);
+    assert_partial("bytes=0-99999999999999999999", 0, 999);
+}
+
+void test_unsatisfiable() {
+    assert_type("bytes=1000-", Range::Type::Unsatisfiable);
+    assert_type("bytes=1000-2000", Range::Type::Unsatisfiable);
+    assert_type("bytes=-0", Range::Type::Unsatisfiable);
+
+    TEST_ASSERT(Range::Type::Unsatisfiable == parse("bytes=0-", 0).type);
+}
+
+// Anything else is ignored and full content is sent instead
+void test_ignored() {
+    assert_type("", Range::Type::Full);
+    assert_type("bytes=", Range::Type::Full);
+    assert_type("items=0-10", Range::Type::Full);
+    assert_type("bytes=0-10,20-30", Range::Type::Full);
+    assert_type("bytes=10-5", Range::Type::Full);
+    assert_type("bytes=abc", Range::Type::Full);
+    assert_type("bytes=10", Range::Type::Full);
+    assert_type("bytes=-", Range::Type::Full);
+    assert_type("bytes=10-x", Range::Type::Full);
+    assert_type("bytes= 10-20", Range::Type::Full);
+}
+
+} // namespace test
+} // namespace range
+} // namespace web
+} // namespace espurna
+
+int main(int, char**) {
+    using namespace espurna::web::range::test;
+
+    UNITY_BEGIN();
+    RUN_TEST(test_partial);
+    RUN_TEST(test_clamped);
+    RUN_TEST(test_unsatisfiable);
+    RUN_TEST(test_ignored);
+    return UNITY_END();
+}
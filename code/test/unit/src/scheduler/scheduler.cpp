@@ -0,0 +1,153 @@
+#include <Arduino.h>
+#include <unity.h>
+
+#pragma GCC diagnostic warning "-Wall"
+#pragma GCC diagnostic warning "-Wextra"
+#pragma GCC diagnostic warning "-Wstrict-aliasing"
+#pragma GCC diagnostic warning "-Wpointer-arith"
+#pragma GCC diagnostic warning "-Wstrict-overflow=5"
+
+#include <libs/SchedulerEvents.h>
+
+#include <cstdlib>
+#include <vector>
+
+namespace espurna {
+namespace scheduler {
+namespace events {
+namespace test {
+namespace {
+
+constexpr int Everyday { 0x7f };
+constexpr int Monday { 1 << 0 };
+constexpr int Sunday { 1 << 6 };
+
+constexpr time_t Hour { 60 * 60 };
+constexpr time_t Day { Hour * 24 };
+
+// 2024-01-01 00:00:00 UTC, Monday
+constexpr time_t NewYear { 1704067200 };
+
+// 2024-03-31 00:00:00 UTC, Sunday. CET -> CEST at 01:00 UTC
+constexpr time_t SpringForward { 1711843200 };
+
+// 2024-10-27 00:00:00 UTC, Sunday. CEST -> CET at 01:00 UTC
+constexpr time_t FallBack { 1729987200 };
+
+void set_timezone(const char* tz) {
+    setenv("TZ", tz, 1);
+    tzset();
+}
+
+} // namespace
+
+void test_utc() {
+    const Time time{Monday, 12, 0, 30, true};
+    TEST_ASSERT_EQUAL(NewYear + (12 * Hour) + 30, next(time, NewYear));
+    TEST_ASSERT_EQUAL(NewYear + (12 * Hour) + 30, next(time, NewYear + (12 * Hour) + 29));
+
+    // exact time is already in the past, wait for the next week
+    TEST_ASSERT_EQUAL(NewYear + (7 * Day) + (12 * Hour) + 30, next(time, NewYear + (12 * Hour) + 30));
+
+    const Time sunday{Sunday, 0, 0, 0, true};
+    TEST_ASSERT_EQUAL(NewYear + (6 * Day), next(sunday, NewYear));
+}
+
+void test_never() {
+    TEST_ASSERT_EQUAL(Never, next(Time{0, 12, 0, 0, true}, NewYear));
+    TEST_ASSERT_EQUAL(Never, next(Time{0, 12, 0, 0, false}, NewYear));
+}
+
+void test_local() {
+    set_timezone("CET-1CEST,M3.5.0,M10.5.0/3");
+
+    const Time time{Monday, 8, 15, 0, false};
+    TEST_ASSERT_EQUAL(NewYear + (7 * Hour) + (15 * 60), next(time, NewYear));
+
+    set_timezone("UTC0");
+    TEST_ASSERT_EQUAL(NewYear + (8 * Hour) + (15 * 60), next(time, NewYear));
+}
+
+// Same wall clock time, but the day is one hour shorter or longer
+void test_local_dst() {
+    set_timezone("CET-1CEST,M3.5.0,M10.5.0/3");
+
+    const Time time{Everyday, 8, 0, 0, false};
+    const auto before = next(time, SpringForward - Day);
+    TEST_ASSERT_EQUAL(SpringForward - Day + (7 * Hour), before);
+    TEST_ASSERT_EQUAL(SpringForward + (6 * Hour), next(time, before));
+
+    const auto after = next(time, FallBack - Day);
+    TEST_ASSERT_EQUAL(FallBack - Day + (6 * Hour), after);
+    TEST_ASSERT_EQUAL(FallBack + (7 * Hour), next(time, after));
+}
+
+// 02:30 does not exist when switching to CEST, still happens on the same day
+void test_local_dst_gap() {
+    set_timezone("CET-1CEST,M3.5.0,M10.5.0/3");
+
+    const Time time{Everyday, 2, 30, 0, false};
+    const auto gap = next(time, SpringForward - Hour);
+    TEST_ASSERT(gap > SpringForward);
+    TEST_ASSERT(gap < SpringForward + (3 * Hour));
+
+    TEST_ASSERT_EQUAL(SpringForward + Day + (30 * 60), next(time, gap));
+}
+
+// 02:30 happens twice when switching to CET, but only one of them is used
+void test_local_dst_overlap() {
+    set_timezone("CET-1CEST,M3.5.0,M10.5.0/3");
+
+    const Time time{Everyday, 2, 30, 0, false};
+    const auto overlap = next(time, FallBack - Hour);
+    TEST_ASSERT((overlap == FallBack + (30 * 60))
+        || (overlap == FallBack + Hour + (30 * 60)));
+
+    TEST_ASSERT_EQUAL(FallBack + Day + Hour + (30 * 60), next(time, overlap));
+}
+
+void test_queue() {
+    Queue queue;
+    queue.push(300, 0);
+    queue.push(100, 1);
+    queue.push(200, 2);
+    queue.push(100, 3);
+    TEST_ASSERT_EQUAL(4, queue.size());
+    TEST_ASSERT_EQUAL(100, queue.top().timestamp);
+
+    std::vector<size_t> ids;
+    auto callback = [&](const Queue::Event& event) {
+        ids.push_back(event.id);
+    };
+
+    TEST_ASSERT_EQUAL(0, queue.expire(99, callback));
+    TEST_ASSERT_EQUAL(2, queue.expire(100, callback));
+    TEST_ASSERT_EQUAL(1, ids[0]);
+    TEST_ASSERT_EQUAL(3, ids[1]);
+
+    queue.push(150, 4);
+    TEST_ASSERT_EQUAL(3, queue.expire(1000, callback));
+    TEST_ASSERT_EQUAL(4, ids[2]);
+    TEST_ASSERT_EQUAL(2, ids[3]);
+    TEST_ASSERT_EQUAL(0, ids[4]);
+    TEST_ASSERT(queue.empty());
+}
+
+} // namespace test
+} // namespace events
+} // namespace scheduler
+} // namespace espurna
+
+int main(int, char**) {
+    using namespace espurna::scheduler::events::test;
+
+    UNITY_BEGIN();
+    RUN_TEST(test_utc);
+    RUN_TEST(test_never);
+    RUN_TEST(test_local);
+    RUN_TEST(test_local_dst);
+    RUN_TEST(test_local_dst_gap);
+    RUN_TEST(test_local_dst_overlap);
+    RUN_TEST(test_queue);
+    return UNITY_END();
+}
@@ -0,0 +1,339 @@
+#include <Arduino.h>
+#include <unity.h>
+
+#pragma GCC diagnostic warning "-Wall"
+#pragma GCC diagnostic warning "-Wextra"
+#pragma GCC diagnostic warning "-Wstrict-aliasing"
+#pragma GCC diagnostic warning "-Wpointer-arith"
+#pragma GCC diagnostic warning "-Wstrict-overflow=5"
+
+#include <libs/TimerWheel.h>
+
+#include <memory>
+#include <vector>
+
+namespace espurna {
+namespace timer {
+namespace test {
+namespace {
+
+uint32_t micros_value { 0 };
+
+uint32_t fake_micros() {
+    return micros_value;
+}
+
+void test_once() {
+    Wheel wheel;
+    Timer timer;
+
+    int calls { 0 };
+    wheel.once(timer, 0, 100, [&]() {
+        ++calls;
+    });
+
+    TEST_ASSERT(timer.armed());
+    TEST_ASSERT_EQUAL(1, wheel.armed());
+    TEST_ASSERT_EQUAL(100, wheel.next(0));
+    TEST_ASSERT_EQUAL(40, wheel.next(60));
+
+    TEST_ASSERT_EQUAL(0, wheel.advance(50));
+    TEST_ASSERT_EQUAL(0, wheel.advance(99));
+    TEST_ASSERT_EQUAL(0, calls);
+
+    TEST_ASSERT_EQUAL(1, wheel.advance(100));
+    TEST_ASSERT_EQUAL(1, calls);
+    TEST_ASSERT(!timer.armed());
+    TEST_ASSERT_EQUAL(0, wheel.armed());
+    TEST_ASSERT_EQUAL(Wheel::Never, wheel.next(100));
+
+    TEST_ASSERT_EQUAL(0, wheel.advance(5000));
+    TEST_ASSERT_EQUAL(1, calls);
+    TEST_ASSERT_EQUAL(1, timer.stats().runs);
+}
+
+void test_repeat() {
+    Wheel wheel;
+    Timer timer;
+
+    int calls { 0 };
+    wheel.repeat(timer, 0, 50, [&]() {
+        ++calls;
+    });
+
+    for (uint32_t now = 0; now <= 500; now += 10) {
+        wheel.advance(now);
+    }
+
+    TEST_ASSERT_EQUAL(10, calls);
+    TEST_ASSERT(timer.armed());
+    TEST_ASSERT_EQUAL(550, timer.expiry());
+    TEST_ASSERT_EQUAL(0, timer.stats().overruns);
+
+    wheel.cancel(timer);
+    TEST_ASSERT(!timer.armed());
+    TEST_ASSERT_EQUAL(0, wheel.advance(1000));
+    TEST_ASSERT_EQUAL(10, calls);
+}
+
+void test_repeat_late() {
+    Wheel wheel;
+    Timer timer;
+
+    int calls { 0 };
+    wheel.repeat(timer, 0, 100, [&]() {
+        ++calls;
+    });
+
+    // missed periods are not repeated, next expiry is counted from the time callback ran
+    TEST_ASSERT_EQUAL(1, wheel.advance(450));
+    TEST_ASSERT_EQUAL(1, calls);
+    TEST_ASSERT_EQUAL(550, timer.expiry());
+    TEST_ASSERT_EQUAL(1, timer.stats().overruns);
+    TEST_ASSERT_EQUAL(350, timer.stats().late_max);
+
+    TEST_ASSERT_EQUAL(1, wheel.advance(550));
+    TEST_ASSERT_EQUAL(650, timer.expiry());
+    TEST_ASSERT_EQUAL(1, timer.stats().overruns);
+}
+
+void test_order() {
+    Wheel wheel;
+
+    Timer first;
+    Timer second;
+    Timer third;
+
+    std::vector<int> order;
+    wheel.once(third, 0, 300, [&]() {
+        order.push_back(3);
+    });
+    wheel.once(first, 0, 100, [&]() {
+        order.push_back(1);
+    });
+    wheel.once(second, 0, 200, [&]() {
+        order.push_back(2);
+    });
+
+    TEST_ASSERT_EQUAL(3, wheel.advance(1000));
+    TEST_ASSERT_EQUAL(3, order.size());
+    TEST_ASSERT_EQUAL(1, order[0]);
+    TEST_ASSERT_EQUAL(2, order[1]);
+    TEST_ASSERT_EQUAL(3, order[2]);
+}
+
+void test_far() {
+    Wheel wheel;
+    Timer near;
+    Timer far;
+
+    // same slot, different turn of the wheel
+    const uint32_t turn = Wheel::Slots * Wheel::Resolution;
+
+    int near_calls { 0 };
+    int far_calls { 0 };
+
+    wheel.once(near, 0, 100, [&]() {
+        ++near_calls;
+    });
+    wheel.once(far, 0, 100 + (turn * 3), [&]() {
+        ++far_calls;
+    });
+
+    TEST_ASSERT_EQUAL(1, wheel.advance(100));
+    TEST_ASSERT_EQUAL(1, near_calls);
+    TEST_ASSERT_EQUAL(0, far_calls);
+
+    TEST_ASSERT_EQUAL(0, wheel.advance(100 + turn));
+    TEST_ASSERT_EQUAL(0, wheel.advance(100 + (turn * 2)));
+    TEST_ASSERT_EQUAL(turn, wheel.next(100 + (turn * 2)));
+
+    TEST_ASSERT_EQUAL(1, wheel.advance(100 + (turn * 3)));
+    TEST_ASSERT_EQUAL(1, far_calls);
+}
+
+void test_wraparound() {
+    Wheel wheel;
+    Timer timer;
+
+    const uint32_t start = UINT32_MAX - 100;
+    wheel.advance(start);
+
+    int calls { 0 };
+    wheel.repeat(timer, start, 80, [&]() {
+        ++calls;
+    });
+
+    TEST_ASSERT_EQUAL(0, wheel.advance(start + 50));
+    TEST_ASSERT_EQUAL(1, wheel.advance(start + 80));
+    TEST_ASSERT_EQUAL(1, wheel.advance(start + 160));
+    TEST_ASSERT_EQUAL(2, calls);
+    TEST_ASSERT_EQUAL(0, timer.stats().overruns);
+}
+
+void test_at() {
+    Wheel wheel;
+    wheel.advance(1000);
+
+    Timer past;
+    Timer future;
+
+    int calls { 0 };
+    wheel.at(past, 1000, 500, [&]() {
+        ++calls;
+    });
+    wheel.at(future, 1000, 2000, [&]() {
+        ++calls;
+    });
+
+    TEST_ASSERT_EQUAL(0, wheel.next(1000));
+    TEST_ASSERT_EQUAL(1, wheel.advance(1001));
+    TEST_ASSERT_EQUAL(1, calls);
+    TEST_ASSERT_EQUAL(1, wheel.advance(2000));
+    TEST_ASSERT_EQUAL(2, calls);
+}
+
+void test_rearm_from_callback() {
+    Wheel wheel;
+    Timer timer;
+
+    std::vector<int> values;
+    wheel.once(timer, 0, 100, [&]() {
+        values.push_back(1);
+        wheel.once(timer, 100, 100, [&]() {
+            values.push_back(2);
+        });
+    });
+
+    TEST_ASSERT_EQUAL(1, wheel.advance(100));
+    TEST_ASSERT(timer.armed());
+    TEST_ASSERT_EQUAL(1, wheel.advance(200));
+    TEST_ASSERT(!timer.armed());
+
+    TEST_ASSERT_EQUAL(2, values.size());
+    TEST_ASSERT_EQUAL(1, values[0]);
+    TEST_ASSERT_EQUAL(2, values[1]);
+    TEST_ASSERT_EQUAL(2, timer.stats().runs);
+}
+
+void test_cancel_from_callback() {
+    Wheel wheel;
+
+    Timer first;
+    Timer second;
+    Timer periodic;
+
+    int calls { 0 };
+    wheel.once(first, 0, 100, [&]() {
+        ++calls;
+        wheel.cancel(second);
+    });
+    wheel.once(second, 0, 110, [&]() {
+        ++calls;
+    });
+
+    // both are expired at the same time, but the second one is cancelled before it runs
+    TEST_ASSERT_EQUAL(1, wheel.advance(200));
+    TEST_ASSERT_EQUAL(1, calls);
+    TEST_ASSERT_EQUAL(0, wheel.armed());
+
+    wheel.repeat(periodic, 200, 10, [&]() {
+        ++calls;
+        wheel.cancel(periodic);
+    });
+
+    TEST_ASSERT_EQUAL(1, wheel.advance(300));
+    TEST_ASSERT_EQUAL(2, calls);
+    TEST_ASSERT(!periodic.armed());
+    TEST_ASSERT_EQUAL(0, wheel.advance(400));
+}
+
+void test_destroy_from_callback() {
+    Wheel wheel;
+
+    auto timer = std::make_unique<Timer>("temporary");
+
+    int calls { 0 };
+    wheel.repeat(*timer, 0, 100, [&]() {
+        ++calls;
+        timer.reset();
+    });
+
+    TEST_ASSERT_EQUAL(1, wheel.advance(100));
+    TEST_ASSERT_EQUAL(1, calls);
+    TEST_ASSERT_EQUAL(0, wheel.armed());
+    TEST_ASSERT_EQUAL(1, wheel.total().runs);
+
+    size_t known { 0 };
+    wheel.foreach([&](const Timer&) {
+        ++known;
+    });
+    TEST_ASSERT_EQUAL(0, known);
+}
+
+void test_stats() {
+    micros_value = 0;
+
+    Wheel wheel(20, fake_micros);
+
+    Timer fast("fast");
+    Timer slow("slow");
+
+    wheel.repeat(fast, 0, 100, [&]() {
+        micros_value += 10;
+    });
+    wheel.once(slow, 0, 150, [&]() {
+        micros_value += 5000;
+    });
+
+    wheel.advance(100);
+    wheel.advance(180);
+    wheel.advance(200);
+
+    TEST_ASSERT_EQUAL(2, fast.stats().runs);
+    TEST_ASSERT_EQUAL(0, fast.stats().overruns);
+    TEST_ASSERT_EQUAL(10, fast.stats().runtime_max);
+    TEST_ASSERT_EQUAL(20, fast.stats().runtime_total);
+
+    TEST_ASSERT_EQUAL(1, slow.stats().runs);
+    TEST_ASSERT_EQUAL(1, slow.stats().overruns);
+    TEST_ASSERT_EQUAL(30, slow.stats().late_max);
+    TEST_ASSERT_EQUAL(5000, slow.stats().runtime_max);
+
+    TEST_ASSERT_EQUAL(3, wheel.total().runs);
+    TEST_ASSERT_EQUAL(1, wheel.total().overruns);
+    TEST_ASSERT_EQUAL(5020, wheel.total().runtime_total);
+
+    std::vector<const char*> names;
+    wheel.foreach([&](const Timer& timer) {
+        names.push_back(timer.name());
+    });
+
+    TEST_ASSERT_EQUAL(2, names.size());
+    TEST_ASSERT_EQUAL_STRING("slow", names[0]);
+    TEST_ASSERT_EQUAL_STRING("fast", names[1]);
+    TEST_ASSERT_EQUAL(1, wheel.armed());
+}
+
+} // namespace
+} // namespace test
+} // namespace timer
+} // namespace espurna
+
+int main(int, char**) {
+    using namespace espurna::timer::test;
+
+    UNITY_BEGIN();
+    RUN_TEST(test_once);
+    RUN_TEST(test_repeat);
+    RUN_TEST(test_repeat_late);
+    RUN_TEST(test_order);
+    RUN_TEST(test_far);
+    RUN_TEST(test_wraparound);
+    RUN_TEST(test_at);
+    RUN_TEST(test_rearm_from_callback);
+    RUN_TEST(test_cancel_from_callback);
+    RUN_TEST(test_destroy_from_callback);
+    RUN_TEST(test_stats);
+    return UNITY_END();
+}
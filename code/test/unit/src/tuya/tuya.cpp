@@ -6,6 +6,7 @@
 // Tests
 // -----------------------------------------------------------------------------
 
+#include <chrono>
 #include <type_traits>
 #include <queue>
 
@@ -298,6 +299,182 @@ void test_dataframe_echo() {
     }
 }
 
+// Frame could be received in any number of parts
+
+void test_transport_fragmented() {
+    const container data = {0x55, 0xaa, 0x00, 0x07, 0x00, 0x05, 0x01, 0x01, 0x00, 0x01, 0x01, 0x0f};
+
+    BufferedStream stream;
+    Transport transport(stream);
+
+    for (size_t n = 0; n < data.size(); ++n) {
+        TEST_ASSERT_FALSE(transport.read());
+        stream.write(data[n]);
+    }
+
+    TEST_ASSERT(transport.read());
+    TEST_ASSERT_EQUAL(data.size() - 1, transport.size());
+
+    DataFrameView frame(transport);
+    TEST_ASSERT(frame.command() == Command::ReportDP);
+    TEST_ASSERT_EQUAL(5, frame.length());
+
+    // current frame stays until reset, even when more data is available
+    stream.write(data.data(), data.size());
+    stream.write(data.data(), 5);
+    TEST_ASSERT(transport.read());
+    TEST_ASSERT_EQUAL(data.size() + 5, stream.available());
+
+    transport.reset();
+    TEST_ASSERT(transport.read());
+    transport.reset();
+    TEST_ASSERT_FALSE(transport.read());
+
+    stream.write(data.data() + 5, data.size() - 5);
+    TEST_ASSERT(transport.read());
+    TEST_ASSERT_EQUAL(0, transport.errors());
+}
+
+// Anything that is not a valid frame is skipped, parser starts again from the byte right after the header
+
+void test_transport_corrupted() {
+    const container valid = {0x55, 0xaa, 0x00, 0x00, 0x00, 0x01, 0x01, 0x01};
+
+    BufferedStream stream;
+    Transport transport(stream);
+
+    const container garbage = {0x01, 0x02, 0x55, 0x55, 0x03};
+    stream.write(garbage.data(), garbage.size());
+
+    // invalid checksum
+    container broken(valid);
+    broken.back() = 0x02;
+    stream.write(broken.data(), broken.size());
+
+    // length is too large
+    const container large = {0x55, 0xaa, 0x00, 0x07, 0xff, 0xff};
+    stream.write(large.data(), large.size());
+
+    // truncated frame, followed by a complete one
+    stream.write(valid.data(), 4);
+    stream.write(valid.data(), valid.size());
+
+    TEST_ASSERT(transport.read());
+    TEST_ASSERT(DataFrameView(transport).command() == Command::Heartbeat);
+    TEST_ASSERT_EQUAL(1, DataFrameView(transport).length());
+    TEST_ASSERT(transport.errors() > 0);
+
+    transport.reset();
+    TEST_ASSERT_FALSE(transport.read());
+    TEST_ASSERT_EQUAL(0, stream.available());
+}
+
+class CountingStream : public BufferedStream {
+    public:
+        size_t write(uint8_t c) {
+            ++_writes;
+            return BufferedStream::write(c);
+        }
+        size_t write(const unsigned char* data, unsigned long size) {
+            ++_writes;
+            return BufferedStream::write(data, size);
+        }
+        size_t writes() const {
+            return _writes;
+        }
+    private:
+        size_t _writes { 0 };
+};
+
+void test_transport_bulk_write() {
+    CountingStream stream;
+    Transport transport(stream);
+
+    DataFrame frame(Command::SetDP, DataProtocol<uint32_t>(0x02, 0x66).serialize());
+    transport.write(frame.serialize());
+
+    TEST_ASSERT_EQUAL(1, stream.writes());
+    TEST_ASSERT_EQUAL(frame.length() + 7, stream.available());
+}
+
+void test_output_queue() {
+    OutputQueue queue;
+
+    queue.emplace(Command::SetDP, DataProtocol<uint32_t>(0x02, 10).serialize());
+    queue.emplace(Command::SetDP, DataProtocol<bool>(0x01, true).serialize());
+    queue.emplace(Command::SetDP, DataProtocol<uint32_t>(0x02, 20).serialize());
+    queue.emplace(Command::QueryDP);
+    queue.emplace(Command::SetDP, DataProtocol<uint32_t>(0x02, 30).serialize());
+    queue.emplace(Command::Heartbeat);
+    queue.emplace(Command::Heartbeat);
+
+    TEST_ASSERT_EQUAL(4, queue.size());
+    TEST_ASSERT_EQUAL(2, queue.coalesced());
+
+    TEST_ASSERT(queue.front().command() == Command::Heartbeat);
+    queue.pop();
+
+    TEST_ASSERT(queue.front().command() == Command::SetDP);
+    {
+        DataProtocol<uint32_t> proto(queue.front().data());
+        TEST_ASSERT_EQUAL(0x02, proto.id());
+        TEST_ASSERT_EQUAL(30, proto.value());
+    }
+    queue.pop();
+
+    TEST_ASSERT(queue.front().command() == Command::SetDP);
+    {
+        DataProtocol<bool> proto(queue.front().data());
+        TEST_ASSERT_EQUAL(0x01, proto.id());
+    }
+    queue.pop();
+
+    TEST_ASSERT(queue.front().command() == Command::QueryDP);
+    queue.pop();
+
+    TEST_ASSERT(queue.empty());
+}
+
+void test_transport_throughput() {
+    constexpr size_t Frames { 10000 };
+
+    BufferedStream output;
+    Transport writer(output);
+
+    DataFrame frame(Command::ReportDP, DataProtocol<uint32_t>(0x02, 0x10).serialize());
+    writer.write(frame.serialize());
+
+    container data;
+    while (output.available()) {
+        data.push_back(output.read());
+    }
+
+    BufferedStream stream;
+    Transport transport(stream);
+
+    size_t parsed { 0 };
+
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t n = 0; n < Frames; ++n) {
+        stream.write(data.data(), data.size());
+        while (transport.read()) {
+            ++parsed;
+            transport.reset();
+        }
+    }
+    const auto end = std::chrono::steady_clock::now();
+
+    TEST_ASSERT_EQUAL(Frames, parsed);
+    TEST_ASSERT_EQUAL(0, transport.errors());
+
+    const auto elapsed = std::chrono::duration_cast<std::chrono::duration<double>>(end - start);
+    char message[128];
+    snprintf(message, sizeof(message), "Parsed %zu bytes in %.3f ms (%.1f MB/s)",
+        Frames * data.size(), elapsed.count() * 1000.0,
+        (Frames * data.size()) / elapsed.count() / (1024.0 * 1024.0));
+    TEST_MESSAGE(message);
+}
+
 int main(int, char**) {
 
     UNITY_BEGIN();
@@ -312,6 +489,11 @@ int main(int, char**) {
     RUN_TEST(test_dataframe_report);
     RUN_TEST(test_dataframe_echo);
     RUN_TEST(test_transport);
+    RUN_TEST(test_transport_fragmented);
+    RUN_TEST(test_transport_corrupted);
+    RUN_TEST(test_transport_bulk_write);
+    RUN_TEST(test_output_queue);
+    RUN_TEST(test_transport_throughput);
 
     return UNITY_END();
 